@@ -0,0 +1,145 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "../src/env_cache.h"
+#include "../src/env_store.h"
+#include "../src/path_list.h"
+
+namespace {
+
+// A dev prompt's PATH: `count` distinct directories, each listed twice as
+// happens when VsDevCmd.bat runs on top of an initialized prompt.
+std::wstring DevPromptPath(int64_t count) {
+  std::wstring list;
+  for (int64_t i = 0; i < count; ++i) {
+    list += L"C:\\Program Files\\Microsoft Visual Studio\\2022\\Community\\"
+            L"Common7\\Tools\\dir" +
+            std::to_wstring(i) + L';';
+  }
+  return list + list;
+}
+
+// The parent and what VsDevCmd.bat leaves behind: 40 variables, with PATH,
+// INCLUDE, LIB and LIBPATH grown at the front by `added` entries.
+std::pair<Environment, Environment> BeforeAndAfter(int64_t entries,
+                                                   int64_t added) {
+  Environment before;
+  for (int i = 0; i < 40; ++i) {
+    before[L"VAR" + std::to_wstring(i)] = L"value" + std::to_wstring(i);
+  }
+  auto after = before;
+  for (auto const* name : {L"PATH", L"INCLUDE", L"LIB", L"LIBPATH"}) {
+    auto old = DevPromptPath(entries / 2);
+    std::wstring grown;
+    for (int64_t i = 0; i < added; ++i) {
+      grown += L"C:\\VS\\" + std::wstring(name) + L"\\" + std::to_wstring(i) +
+               L";";
+    }
+    before[name] = old;
+    after[name] = grown + old;
+  }
+  after[L"VSCMD_VER"] = L"17.8.0";
+  return {before, after};
+}
+
+void BM_DedupePathList(benchmark::State& state) {
+  auto list = DevPromptPath(state.range(0));
+  for (auto _ : state) {
+    auto deduped = dedupe_path_list(list);
+    benchmark::DoNotOptimize(deduped.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0) * 2);
+}
+BENCHMARK(BM_DedupePathList)->Arg(16)->Arg(128)->Arg(1024);
+
+void BM_DiffPathList(benchmark::State& state) {
+  auto before = DevPromptPath(state.range(0));
+  auto after = L"C:\\VS\\bin;C:\\Kits\\bin;" + before + L"D:\\extra";
+  for (auto _ : state) {
+    PathListEdit edit;
+    benchmark::DoNotOptimize(diff_path_list(before, after, edit));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DiffPathList)->Arg(16)->Arg(128)->Arg(1024);
+
+void BM_DiffEnvironment(benchmark::State& state) {
+  auto [before, after] = BeforeAndAfter(state.range(0), 12);
+  for (auto _ : state) {
+    auto delta = diff_environment(before, after);
+    benchmark::DoNotOptimize(delta.lists_.size());
+  }
+}
+BENCHMARK(BM_DiffEnvironment)->Arg(32)->Arg(256);
+
+void BM_ApplyEnvironment(benchmark::State& state) {
+  auto [before, after] = BeforeAndAfter(state.range(0), 12);
+  auto delta = diff_environment(before, after);
+  for (auto _ : state) {
+    auto env = before;
+    apply_environment(env, delta);
+    benchmark::DoNotOptimize(env.size());
+  }
+}
+BENCHMARK(BM_ApplyEnvironment)->Arg(32)->Arg(256);
+
+// What starting one command used to cost: the std::map environment, then
+// its CreateProcess block.
+void BM_MapBlockPerCommand(benchmark::State& state) {
+  auto [before, after] = BeforeAndAfter(state.range(0), 12);
+  auto delta = diff_environment(before, after);
+  for (auto _ : state) {
+    auto env = before;
+    apply_environment(env, delta);
+    std::wstring block;
+    for (auto const& [name, value] : env) {
+      block += name;
+      block += L'=';
+      block += value;
+      block += L'\0';
+    }
+    block += L'\0';
+    benchmark::DoNotOptimize(block.data());
+  }
+}
+BENCHMARK(BM_MapBlockPerCommand)->Arg(32)->Arg(256);
+
+void BM_StoreBlockPerCommand(benchmark::State& state) {
+  auto [before, after] = BeforeAndAfter(state.range(0), 12);
+  auto delta = diff_environment(before, after);
+  for (auto _ : state) {
+    EnvStore store(before);
+    store.apply(delta);
+    auto block = store.block();
+    benchmark::DoNotOptimize(block.data().data());
+  }
+}
+BENCHMARK(BM_StoreBlockPerCommand)->Arg(32)->Arg(256);
+
+// --batch and --graph: one block for every command.
+void BM_SharedBlockPerCommand(benchmark::State& state) {
+  auto [before, after] = BeforeAndAfter(state.range(0), 12);
+  EnvStore store(before);
+  store.apply(diff_environment(before, after));
+  auto block = store.block();
+  for (auto _ : state) {
+    auto shared = block;
+    benchmark::DoNotOptimize(shared.data().data());
+  }
+}
+BENCHMARK(BM_SharedBlockPerCommand)->Arg(32)->Arg(256);
+
+void BM_EnvStoreGet(benchmark::State& state) {
+  auto [before, after] = BeforeAndAfter(32, 12);
+  EnvStore store(after);
+  for (auto _ : state) {
+    for (auto const* name : {L"path", L"Include", L"VAR7", L"missing"}) {
+      benchmark::DoNotOptimize(store.get(name));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * 4);
+}
+BENCHMARK(BM_EnvStoreGet);
+
+}  // namespace
@@ -0,0 +1,86 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../src/ascii.h"
+#include "../src/interner.h"
+
+namespace {
+
+// Ids shaped like Setup's package ids, mostly shared between instances.
+std::vector<std::wstring> SyntheticIds(int instance, int count) {
+  std::vector<std::wstring> ids;
+  ids.reserve(static_cast<size_t>(count));
+  for (int i = 0; i < count; ++i) {
+    // One in ten ids is specific to the instance.
+    ids.push_back(i % 10 == 0 ? L"Microsoft.VisualStudio.Component.Instance" +
+                                    std::to_wstring(instance) + L"." +
+                                    std::to_wstring(i)
+                              : L"Microsoft.VisualStudio.Component.Shared." +
+                                    std::to_wstring(i));
+  }
+  return ids;
+}
+
+std::vector<std::wstring> Required(int count) {
+  return {L"microsoft.visualstudio.component.shared." + std::to_wstring(1),
+          L"microsoft.visualstudio.component.shared." +
+              std::to_wstring(count / 2 + 1),
+          L"microsoft.visualstudio.component.shared." +
+              std::to_wstring(count - 1)};
+}
+
+void BM_RequireAllLinearScan(benchmark::State& state) {
+  auto count = static_cast<int>(state.range(0));
+  std::vector<std::vector<std::wstring>> instances;
+  for (int i = 0; i < 6; ++i) {
+    instances.push_back(SyntheticIds(i, count));
+  }
+  auto required = Required(count);
+  for (auto _ : state) {
+    int matched = 0;
+    for (auto const& ids : instances) {
+      matched += std::all_of(
+          required.begin(), required.end(), [&ids](std::wstring const& r) {
+            return std::any_of(ids.begin(), ids.end(),
+                               [&r](std::wstring const& id) {
+                                 return ascii_iequals(r, id);
+                               });
+          });
+    }
+    benchmark::DoNotOptimize(matched);
+  }
+}
+BENCHMARK(BM_RequireAllLinearScan)->Arg(1000)->Arg(5000);
+
+void BM_RequireAllIdSet(benchmark::State& state) {
+  auto count = static_cast<int>(state.range(0));
+  std::vector<IdSet> instances;
+  for (int i = 0; i < 6; ++i) {
+    instances.emplace_back(SyntheticIds(i, count));
+  }
+  IdSet required(Required(count));
+  for (auto _ : state) {
+    int matched = 0;
+    for (auto const& ids : instances) {
+      matched += ids.contains_all(required);
+    }
+    benchmark::DoNotOptimize(matched);
+  }
+}
+BENCHMARK(BM_RequireAllIdSet)->Arg(1000)->Arg(5000);
+
+void BM_InternInstanceIds(benchmark::State& state) {
+  auto count = static_cast<int>(state.range(0));
+  auto ids = SyntheticIds(0, count);
+  for (auto _ : state) {
+    IdSet set(ids);
+    benchmark::DoNotOptimize(set);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * count);
+}
+BENCHMARK(BM_InternInstanceIds)->Arg(1000)->Arg(5000);
+
+}  // namespace
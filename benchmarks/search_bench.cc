@@ -0,0 +1,261 @@
+#include <benchmark/benchmark.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../src/instance_source.h"
+#include "../src/package_index.h"
+#include "../src/query.h"
+#include "../src/sort_plan.h"
+#include "../src/unicode.h"
+#include "../src/version.h"
+#include "synthetic_instances.h"
+
+namespace {
+
+// Generating 10k packages per instance costs far more than the code being
+// measured, so each size is built once per run.
+std::vector<VisualStudio> const& Instances(int64_t instances,
+                                           int64_t packages) {
+  static std::map<std::pair<int64_t, int64_t>, std::vector<VisualStudio>>
+      cache;
+  auto& all = cache[{instances, packages}];
+  if (all.empty()) {
+    all = SyntheticInstances().generate(static_cast<int>(instances),
+                                        static_cast<int>(packages));
+  }
+  return all;
+}
+
+void InstanceArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"instances", "packages"});
+  for (int64_t instances : {1, 10, 100, 1000}) {
+    b->Args({instances, 100});
+  }
+}
+
+void PackageArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"instances", "packages"});
+  for (int64_t packages : {100, 1000, 10000}) {
+    b->Args({10, packages});
+  }
+}
+
+template <typename Predicate>
+void RunFilter(benchmark::State& state, Predicate predicate) {
+  auto const& all = Instances(state.range(0), state.range(1));
+  for (auto _ : state) {
+    int matched = 0;
+    for (auto const& vs : all) {
+      matched += predicate(vs);
+    }
+    benchmark::DoNotOptimize(matched);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(all.size()));
+}
+
+void BM_IsProductMatch(benchmark::State& state) {
+  std::wstring pattern = L"Professional";
+  RunFilter(state, [&pattern](VisualStudio const& vs) {
+    return vs.is_product_match(pattern);
+  });
+}
+BENCHMARK(BM_IsProductMatch)->Apply(InstanceArgs);
+
+void BM_IsWorkloadMatch(benchmark::State& state) {
+  std::wstring pattern = L"Microsoft.VisualStudio.Workload.NativeDesktop";
+  RunFilter(state, [&pattern](VisualStudio const& vs) {
+    return vs.is_workload_match(pattern);
+  });
+}
+BENCHMARK(BM_IsWorkloadMatch)->Apply(InstanceArgs);
+
+void BM_IsWorkloadMatchResolved(benchmark::State& state) {
+  auto workload =
+      resolve_workload(L"Microsoft.VisualStudio.Workload.NativeDesktop");
+  RunFilter(state, [workload](VisualStudio const& vs) {
+    return vs.is_workload_match(workload);
+  });
+}
+BENCHMARK(BM_IsWorkloadMatchResolved)->Apply(InstanceArgs);
+
+void BM_IsVersionMatch(benchmark::State& state) {
+  auto range = parse_version_range(to_version_range(std::string("16")));
+  RunFilter(state, [&range](VisualStudio const& vs) {
+    return vs.is_version_match(range->min_, range->max_);
+  });
+}
+BENCHMARK(BM_IsVersionMatch)->Apply(InstanceArgs);
+
+void BM_RequirementMatch(benchmark::State& state) {
+  auto requirement = parse_package_requirement(
+      L"Microsoft.VisualStudio.Component.Shared.1,"
+      L"Microsoft.VisualStudio.Component.Shared.55",
+      L"Microsoft.VisualStudio.Workload.NativeDesktop,"
+      L"Microsoft.VisualStudio.Workload.VCTools");
+  RunFilter(state, [&requirement](VisualStudio const& vs) {
+    return requirement.is_satisfied_by(vs.packages_);
+  });
+}
+BENCHMARK(BM_RequirementMatch)->Apply(PackageArgs);
+
+void BM_SortPlan(benchmark::State& state, char const* spec) {
+  auto const& all = Instances(state.range(0), state.range(1));
+  auto plan = SortPlan::parse(spec).value();
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto copy = all;
+    state.ResumeTiming();
+    plan.apply(copy);
+    benchmark::DoNotOptimize(copy.data());
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(all.size()));
+}
+BENCHMARK_CAPTURE(BM_SortPlan, version, "version:desc")->Apply(InstanceArgs);
+BENCHMARK_CAPTURE(BM_SortPlan, all_terms,
+                  "product:Enterprise-Professional-Community,version:desc,"
+                  "date:asc")
+    ->Apply(InstanceArgs);
+
+// The batch tooling's workload: many query variants over one enumeration.
+std::vector<QuerySpec> QueryVariants() {
+  std::vector<QuerySpec> specs;
+  for (auto const* version : {"[16,17)", "[17,18)", "[16,)"}) {
+    for (auto const* product : {"*", "Community", "Enterprise", "BuildTools"}) {
+      specs.push_back({.version_ = version,
+                       .product_ = product,
+                       .sort_ = "version:desc,date:asc"});
+    }
+  }
+  return specs;
+}
+
+// Converting and parsing every clause for every evaluation, as
+// GetMatchedVisualStudios did.
+void BM_QueryVariantsReparsed(benchmark::State& state) {
+  auto const& all = Instances(state.range(0), state.range(1));
+  auto specs = QueryVariants();
+  for (auto _ : state) {
+    for (auto const& spec : specs) {
+      auto range = parse_version_range(spec.version_);
+      InstanceFilter filter{.version_min_ = range->min_,
+                            .version_max_ = range->max_,
+                            .product_ = utf8_decode(spec.product_),
+                            .workload_ = utf8_decode(spec.workload_),
+                            .requires_ = parse_package_requirement(
+                                utf8_decode(spec.requires_all_),
+                                utf8_decode(spec.requires_any_))};
+      VectorInstanceSource source(all);
+      auto matched = collect_matching_instances(source, filter);
+      SortPlan::parse(spec.sort_)->apply(matched);
+      benchmark::DoNotOptimize(matched.data());
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(specs.size()));
+}
+BENCHMARK(BM_QueryVariantsReparsed)->Apply(InstanceArgs);
+
+void BM_QueryVariantsCompiled(benchmark::State& state) {
+  auto const& all = Instances(state.range(0), state.range(1));
+  std::vector<Query> queries;
+  for (auto const& spec : QueryVariants()) {
+    queries.push_back(Query::compile(spec).value());
+  }
+  for (auto _ : state) {
+    for (auto const& query : queries) {
+      auto selected = query.select(all);
+      benchmark::DoNotOptimize(selected.data());
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(queries.size()));
+}
+BENCHMARK(BM_QueryVariantsCompiled)->Apply(InstanceArgs);
+
+void BM_QueryMatchAll(benchmark::State& state) {
+  auto query = Query::compile({.workload_ = "*"}).value();
+  RunFilter(state, [&query](VisualStudio const& vs) {
+    return query.matches(vs);
+  });
+}
+BENCHMARK(BM_QueryMatchAll)->Apply(InstanceArgs);
+
+// --check, --first/--last and --list over one enumeration.
+void BM_QuerySelectIntent(benchmark::State& state, OutputIntent intent) {
+  auto const& all = Instances(state.range(0), state.range(1));
+  auto query = Query::compile({.version_ = "[16,)",
+                               .sort_ = "version:desc,date:asc"})
+                   .value();
+  for (auto _ : state) {
+    auto selected = query.select(all, intent);
+    benchmark::DoNotOptimize(selected.data());
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(all.size()));
+}
+BENCHMARK_CAPTURE(BM_QuerySelectIntent, all, OutputIntent::kAll)
+    ->Apply(InstanceArgs);
+BENCHMARK_CAPTURE(BM_QuerySelectIntent, exists, OutputIntent::kExists)
+    ->Apply(InstanceArgs);
+BENCHMARK_CAPTURE(BM_QuerySelectIntent, first, OutputIntent::kFirst)
+    ->Apply(InstanceArgs);
+
+// The same through the staged source, where an outranked instance never
+// has its packages copied.
+void BM_CollectIntent(benchmark::State& state, OutputIntent intent) {
+  auto const& all = Instances(state.range(0), state.range(1));
+  auto plan = SortPlan::parse("version:desc").value();
+  for (auto _ : state) {
+    // Copying the instances into the source, and freeing them, would
+    // dominate.
+    state.PauseTiming();
+    auto source = std::make_unique<VectorInstanceSource>(all);
+    state.ResumeTiming();
+    auto matched = collect_matching_instances(*source, {}, intent, plan);
+    if (intent == OutputIntent::kAll) {
+      plan.apply(matched);
+    }
+    benchmark::DoNotOptimize(matched.data());
+    state.PauseTiming();
+    source.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(all.size()));
+}
+BENCHMARK_CAPTURE(BM_CollectIntent, all, OutputIntent::kAll)
+    ->Apply(InstanceArgs);
+BENCHMARK_CAPTURE(BM_CollectIntent, exists, OutputIntent::kExists)
+    ->Apply(InstanceArgs);
+BENCHMARK_CAPTURE(BM_CollectIntent, first, OutputIntent::kFirst)
+    ->Apply(InstanceArgs);
+
+void BM_ToVersionRange(benchmark::State& state, char const* version) {
+  std::string input = version;
+  for (auto _ : state) {
+    auto range = to_version_range(input);
+    benchmark::DoNotOptimize(range);
+  }
+}
+BENCHMARK_CAPTURE(BM_ToVersionRange, major, "17");
+BENCHMARK_CAPTURE(BM_ToVersionRange, full, "17.8.34330.188");
+BENCHMARK_CAPTURE(BM_ToVersionRange, range, "[16.0,17.0)");
+
+void BM_ParseVersionRange(benchmark::State& state, char const* range) {
+  std::string input = range;
+  for (auto _ : state) {
+    auto parsed = parse_version_range(input);
+    benchmark::DoNotOptimize(parsed);
+  }
+}
+BENCHMARK_CAPTURE(BM_ParseVersionRange, expanded,
+                  "[17,17.65535.65535.65535)");
+BENCHMARK_CAPTURE(BM_ParseVersionRange, open, "[16.11.5,)");
+
+}  // namespace
@@ -0,0 +1,72 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "../src/instance_snapshot.h"
+#include "../src/query.h"
+#include "synthetic_instances.h"
+
+namespace {
+
+// One snapshot file per size, written once per run.
+std::filesystem::path const& SnapshotFile(int64_t instances,
+                                          int64_t packages) {
+  static std::map<std::pair<int64_t, int64_t>, std::filesystem::path> files;
+  auto& path = files[{instances, packages}];
+  if (path.empty()) {
+    path = std::filesystem::temp_directory_path() /
+           ("vsrun-bench-" + std::to_string(instances) + "-" +
+            std::to_string(packages) + ".snapshot");
+    write_instance_snapshot(
+        path,
+        SyntheticInstances().generate(static_cast<int>(instances),
+                                      static_cast<int>(packages)),
+        0, InstanceBackend::kCom);
+  }
+  return path;
+}
+
+void SnapshotArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"instances", "packages"});
+  for (int64_t instances : {10, 100, 1000}) {
+    b->Args({instances, 1000});
+  }
+}
+
+Query BenchQuery() {
+  return Query::compile({.version_ = "[17,)",
+                         .product_ = "Enterprise",
+                         .sort_ = "version:desc"})
+      .value();
+}
+
+// Decoding every record and then filtering, as lookups did before the
+// snapshot was read through SnapshotInstanceSource.
+void BM_SnapshotLoadAndSelect(benchmark::State& state) {
+  auto const& path = SnapshotFile(state.range(0), state.range(1));
+  auto query = BenchQuery();
+  for (auto _ : state) {
+    auto snap = InstanceSnapshot::open(path);
+    auto all = snap->load();
+    auto selected = query.evaluate(all, OutputIntent::kFirst);
+    benchmark::DoNotOptimize(selected.data());
+  }
+}
+BENCHMARK(BM_SnapshotLoadAndSelect)->Apply(SnapshotArgs);
+
+void BM_SnapshotCollect(benchmark::State& state) {
+  auto const& path = SnapshotFile(state.range(0), state.range(1));
+  auto query = BenchQuery();
+  for (auto _ : state) {
+    SnapshotInstanceSource source(*InstanceSnapshot::open(path));
+    auto selected = query.collect(source, OutputIntent::kFirst);
+    benchmark::DoNotOptimize(selected.data());
+  }
+}
+BENCHMARK(BM_SnapshotCollect)->Apply(SnapshotArgs);
+
+}  // namespace
@@ -0,0 +1,74 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <thread>
+
+#include "../src/startup.h"
+
+namespace {
+
+// Stages with injected latency: an instance lookup over COM and a
+// VsDevCmd.bat run take `range(0)` microseconds, copying the parent
+// environment a tenth of that.
+StartupStages LatencyStages(benchmark::State const& state, bool predict) {
+  auto latency = std::chrono::microseconds(state.range(0));
+  StartupStages stages{
+      .lookup_ =
+          [latency]() {
+            std::this_thread::sleep_for(latency);
+            VisualStudio vs{};
+            vs.install_path_ = L"C:\\VS";
+            return std::vector<VisualStudio>{vs};
+          },
+      .prepare_ =
+          [latency]() {
+            std::this_thread::sleep_for(latency / 10);
+            return Environment{{L"Path", L"C:\\Windows"}};
+          },
+      .develop_ = [latency](VisualStudio const&, Environment const&,
+                            std::atomic<bool> const&) {
+        std::this_thread::sleep_for(latency);
+        return std::optional(EnvDelta{});
+      }};
+  if (predict) {
+    stages.predict_ = []() {
+      VisualStudio vs{};
+      vs.install_path_ = L"C:\\VS";
+      return std::optional(vs);
+    };
+  }
+  return stages;
+}
+
+// The stages one after another, as wmain ran them.
+void BM_StartupSequential(benchmark::State& state) {
+  auto stages = LatencyStages(state, false);
+  for (auto _ : state) {
+    auto instances = stages.lookup_();
+    auto parent = stages.prepare_();
+    std::atomic<bool> cancelled{false};
+    auto dev_env = stages.develop_(instances.front(), parent, cancelled);
+    benchmark::DoNotOptimize(dev_env);
+  }
+}
+BENCHMARK(BM_StartupSequential)->Arg(0)->Arg(2000)->UseRealTime();
+
+void BM_StartupPipelined(benchmark::State& state) {
+  auto stages = LatencyStages(state, false);
+  for (auto _ : state) {
+    auto result = run_startup(stages);
+    benchmark::DoNotOptimize(result.dev_env_);
+  }
+}
+BENCHMARK(BM_StartupPipelined)->Arg(0)->Arg(2000)->UseRealTime();
+
+void BM_StartupSpeculative(benchmark::State& state) {
+  auto stages = LatencyStages(state, true);
+  for (auto _ : state) {
+    auto result = run_startup(stages);
+    benchmark::DoNotOptimize(result.dev_env_);
+  }
+}
+BENCHMARK(BM_StartupSpeculative)->Arg(0)->Arg(2000)->UseRealTime();
+
+}  // namespace
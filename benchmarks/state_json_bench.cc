@@ -0,0 +1,40 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <filesystem>
+
+#include "../src/state_json.h"
+#include "../tests/state_json_fixture.h"
+
+namespace {
+
+void BM_ParseStateJson(benchmark::State& state) {
+  StateJsonFixture fixture;
+  fixture.packages = static_cast<int>(state.range(0));
+  auto text = fixture.render();
+  for (auto _ : state) {
+    auto vs = parse_state_json(text);
+    benchmark::DoNotOptimize(vs);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(text.size()));
+}
+BENCHMARK(BM_ParseStateJson)->Arg(100)->Arg(1000)->Arg(5000);
+
+void BM_EnumerateStateJsonInstances(benchmark::State& state) {
+  auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+  auto root = std::filesystem::temp_directory_path() /
+              ("vsrun-state-json-bench-" + std::to_string(stamp));
+  StateJsonFixture fixture;
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    fixture.write(root, "instance" + std::to_string(i));
+  }
+  for (auto _ : state) {
+    auto all = enumerate_state_json_instances(root);
+    benchmark::DoNotOptimize(all);
+  }
+  std::filesystem::remove_all(root);
+}
+BENCHMARK(BM_EnumerateStateJsonInstances)->Arg(1)->Arg(4);
+
+}  // namespace
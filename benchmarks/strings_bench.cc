@@ -0,0 +1,223 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../src/split.h"
+#include "../src/unicode.h"
+#if defined(_WIN32)
+#include "../src/visualstudio.h"
+#endif
+
+namespace {
+
+// A PATH-like list of `count` entries.
+std::string PathList(int64_t count) {
+  std::string list;
+  for (int64_t i = 0; i < count; ++i) {
+    list += "C:\\Program Files\\Microsoft Visual Studio\\2022\\Community\\"
+            "VC\\Tools\\MSVC\\14.38.33130\\bin\\dir" +
+            std::to_string(i) + ';';
+  }
+  return list;
+}
+
+// Mostly ASCII, like paths and ids, with some CJK from localized titles.
+std::wstring MixedText(int64_t chars) {
+  std::wstring text;
+  for (int64_t i = 0; text.size() < static_cast<size_t>(chars); ++i) {
+    text += i % 8 == 0 ? L"Visual Studio \u793e\u533a\u7248 2022;"
+                       : L"C:\\Program Files\\Microsoft Visual Studio;";
+  }
+  text.resize(static_cast<size_t>(chars));
+  return text;
+}
+
+// Paths and ids only, as most environment variables are.
+std::wstring AsciiText(int64_t chars) {
+  std::wstring text;
+  while (text.size() < static_cast<size_t>(chars)) {
+    text += L"C:\\Program Files\\Microsoft Visual Studio\\2022\\VC;";
+  }
+  text.resize(static_cast<size_t>(chars));
+  return text;
+}
+
+// split_to_if before SplitRange, for comparison.
+template <typename F>
+void LegacySplitToIf(std::vector<std::string>& to, std::string const& str,
+                     F f, int max_count, bool is_compress_token) {
+  auto begin = str.begin();
+  auto delimiter = begin;
+  int count = 0;
+  while ((max_count < 0 || count++ < max_count) &&
+         (delimiter = std::find_if(begin, str.end(), f)) != str.end()) {
+    to.insert(to.end(), {begin, delimiter});
+    begin = is_compress_token ? std::find_if_not(delimiter, str.end(), f)
+                              : std::next(delimiter);
+  }
+  to.emplace_back(begin, str.end());
+}
+
+void BM_SplitLegacy(benchmark::State& state) {
+  auto list = PathList(state.range(0));
+  for (auto _ : state) {
+    std::vector<std::string> parts;
+    LegacySplitToIf(
+        parts, list, [](char c) { return c == ';'; }, -1, false);
+    benchmark::DoNotOptimize(parts.data());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(list.size()));
+}
+BENCHMARK(BM_SplitLegacy)->Arg(4)->Arg(64)->Arg(1024);
+
+void BM_Split(benchmark::State& state) {
+  auto list = PathList(state.range(0));
+  for (auto _ : state) {
+    auto parts = split(list, ';', -1);
+    benchmark::DoNotOptimize(parts.data());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(list.size()));
+}
+BENCHMARK(BM_Split)->Arg(4)->Arg(64)->Arg(1024);
+
+void BM_SplitToIfCompressed(benchmark::State& state) {
+  auto list = PathList(state.range(0));
+  for (auto _ : state) {
+    std::vector<std::string> parts;
+    split_to_if(
+        parts, list, [](char c) { return c == ';' || c == ' '; }, -1, true);
+    benchmark::DoNotOptimize(parts.data());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(list.size()));
+}
+BENCHMARK(BM_SplitToIfCompressed)->Arg(4)->Arg(64)->Arg(1024);
+
+// Walking the tokens without keeping them, as the callers do.
+void BM_SplitView(benchmark::State& state) {
+  auto list = PathList(state.range(0));
+  for (auto _ : state) {
+    size_t tokens = 0;
+    for (auto token : split_view(std::string_view(list), ';')) {
+      benchmark::DoNotOptimize(token.data());
+      ++tokens;
+    }
+    benchmark::DoNotOptimize(tokens);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(list.size()));
+}
+BENCHMARK(BM_SplitView)->Arg(4)->Arg(64)->Arg(1024);
+
+void BM_SplitViewIfCompressed(benchmark::State& state) {
+  auto list = PathList(state.range(0));
+  for (auto _ : state) {
+    size_t tokens = 0;
+    for (auto token : split_view_if(
+             list, [](char c) { return c == ';' || c == ' '; }, -1, true)) {
+      benchmark::DoNotOptimize(token.data());
+      ++tokens;
+    }
+    benchmark::DoNotOptimize(tokens);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(list.size()));
+}
+BENCHMARK(BM_SplitViewIfCompressed)->Arg(4)->Arg(64)->Arg(1024);
+
+void BM_SplitKeyValue(benchmark::State& state) {
+  std::string assignment = "INCLUDE=C:\\include;D:\\include";
+  for (auto _ : state) {
+    auto parts = split(assignment, '=', 1);
+    benchmark::DoNotOptimize(parts.data());
+  }
+}
+BENCHMARK(BM_SplitKeyValue);
+
+void BM_Utf8Encode(benchmark::State& state) {
+  auto text = MixedText(state.range(0));
+  for (auto _ : state) {
+    auto encoded = utf8_encode(text);
+    benchmark::DoNotOptimize(encoded);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          state.range(0));
+}
+BENCHMARK(BM_Utf8Encode)->Arg(64)->Arg(4096)->Arg(65536);
+
+void BM_Utf8Decode(benchmark::State& state) {
+  auto text = utf8_encode(MixedText(state.range(0)));
+  for (auto _ : state) {
+    auto decoded = utf8_decode(text);
+    benchmark::DoNotOptimize(decoded);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          state.range(0));
+}
+BENCHMARK(BM_Utf8Decode)->Arg(64)->Arg(4096)->Arg(65536);
+
+void BM_Utf8EncodeAscii(benchmark::State& state) {
+  auto text = AsciiText(state.range(0));
+  for (auto _ : state) {
+    auto encoded = utf8_encode(text);
+    benchmark::DoNotOptimize(encoded);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          state.range(0));
+}
+BENCHMARK(BM_Utf8EncodeAscii)->Arg(64)->Arg(4096)->Arg(65536);
+
+void BM_Utf8DecodeAscii(benchmark::State& state) {
+  auto text = utf8_encode(AsciiText(state.range(0)));
+  for (auto _ : state) {
+    auto decoded = utf8_decode(text);
+    benchmark::DoNotOptimize(decoded);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          state.range(0));
+}
+BENCHMARK(BM_Utf8DecodeAscii)->Arg(64)->Arg(4096)->Arg(65536);
+
+void BM_ToUtf16(benchmark::State& state) {
+  auto text = MixedText(state.range(0));
+  for (auto _ : state) {
+    auto utf16 = to_utf16(text);
+    benchmark::DoNotOptimize(utf16);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          state.range(0));
+}
+BENCHMARK(BM_ToUtf16)->Arg(64)->Arg(4096)->Arg(65536);
+
+#if defined(_WIN32)
+// The Win32 conversions the tools use for arguments and the environment.
+void BM_ToWstring(benchmark::State& state) {
+  auto text = utf8_encode(MixedText(state.range(0)));
+  for (auto _ : state) {
+    auto decoded = to_wstring(text);
+    benchmark::DoNotOptimize(decoded);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          state.range(0));
+}
+BENCHMARK(BM_ToWstring)->Arg(64)->Arg(4096)->Arg(65536);
+
+void BM_ToString(benchmark::State& state) {
+  auto text = MixedText(state.range(0));
+  for (auto _ : state) {
+    auto encoded = to_string(text);
+    benchmark::DoNotOptimize(encoded);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          state.range(0));
+}
+BENCHMARK(BM_ToString)->Arg(64)->Arg(4096)->Arg(65536);
+#endif
+
+}  // namespace
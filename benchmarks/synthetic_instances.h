@@ -0,0 +1,111 @@
+#ifndef BENCHMARKS_SYNTHETIC_INSTANCES_H_
+#define BENCHMARKS_SYNTHETIC_INSTANCES_H_
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../src/instance.h"
+
+// Deterministic VisualStudio records for benchmarks. The same seed gives the
+// same instances on every platform and standard library, so results from
+// two builds measure the same input.
+class SyntheticInstances {
+ public:
+  static constexpr std::array<std::wstring_view, 4> kProducts = {
+      L"Community", L"Professional", L"Enterprise", L"BuildTools"};
+  static constexpr std::array<std::wstring_view, 8> kWorkloads = {
+      L"Microsoft.VisualStudio.Workload.NativeDesktop",
+      L"Microsoft.VisualStudio.Workload.ManagedDesktop",
+      L"Microsoft.VisualStudio.Workload.NetWeb",
+      L"Microsoft.VisualStudio.Workload.Azure",
+      L"Microsoft.VisualStudio.Workload.NativeGame",
+      L"Microsoft.VisualStudio.Workload.Universal",
+      L"Microsoft.VisualStudio.Workload.Python",
+      L"Microsoft.VisualStudio.Workload.VCTools"};
+
+  explicit SyntheticInstances(uint64_t seed = 0x5eed) : state_(seed) {}
+
+  // `packages` counts every package of an instance, workloads included.
+  std::vector<VisualStudio> generate(int instances, int packages) {
+    std::vector<VisualStudio> all;
+    all.reserve(static_cast<size_t>(instances));
+    for (int i = 0; i < instances; ++i) {
+      all.push_back(instance(packages));
+    }
+    return all;
+  }
+
+  // Package ids shaped like Setup's: most are shared between instances, one
+  // in ten is specific to the instance.
+  std::vector<std::wstring> package_ids(int count) {
+    std::vector<std::wstring> ids;
+    ids.reserve(static_cast<size_t>(count));
+    auto salt = std::to_wstring(next() % 100000);
+    for (int i = 0; i < count; ++i) {
+      ids.push_back(i % 10 == 0
+                        ? L"Microsoft.VisualStudio.Component.Instance" + salt +
+                              L"." + std::to_wstring(i)
+                        : L"Microsoft.VisualStudio.Component.Shared." +
+                              std::to_wstring(i));
+    }
+    return ids;
+  }
+
+  // SplitMix64.
+  uint64_t next() {
+    uint64_t z = (state_ += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+
+ private:
+  VisualStudio instance(int packages) {
+    auto major = 15 + next() % 3;
+    auto minor = next() % 12;
+    auto build = 25000 + next() % 10000;
+    auto revision = next() % 500;
+    auto product = kProducts[next() % kProducts.size()];
+
+    VisualStudio vs{};
+    vs.version_ = (major << 48) | (minor << 32) | (build << 16) | revision;
+    vs.install_version_ = std::to_wstring(major) + L"." +
+                          std::to_wstring(minor) + L"." +
+                          std::to_wstring(build) + L"." +
+                          std::to_wstring(revision);
+    // Somewhere in 2017-2024.
+    vs.install_datetime_ =
+        to_filetime(131277024000000000 + next() % 2524608000000000);
+    vs.install_path_ = L"C:\\Program Files\\Microsoft Visual Studio\\" +
+                       std::to_wstring(major) + L"\\" + std::wstring(product);
+    vs.display_name_ = L"Visual Studio " + std::wstring(product);
+    vs.product_id_ =
+        L"Microsoft.VisualStudio.Product." + std::wstring(product);
+    vs.product_ = find_product(vs.product_id_);
+    vs.is_complete_ = next() % 20 != 0;
+    vs.is_prerelease_ = next() % 10 == 0;
+
+    std::vector<std::wstring> workloads;
+    auto mask = next();
+    for (size_t w = 0; w < kWorkloads.size(); ++w) {
+      if (mask & (uint64_t{1} << w)) {
+        workloads.emplace_back(kWorkloads[w]);
+      }
+    }
+    auto ids = package_ids(
+        packages > static_cast<int>(workloads.size())
+            ? packages - static_cast<int>(workloads.size())
+            : 0);
+    ids.insert(ids.end(), workloads.begin(), workloads.end());
+    vs.workloads_ = IdSet(workloads);
+    vs.packages_ = PackageIndex(std::move(ids));
+    return vs;
+  }
+
+  uint64_t state_;
+};
+
+#endif  // BENCHMARKS_SYNTHETIC_INSTANCES_H_
@@ -0,0 +1,53 @@
+#include <benchmark/benchmark.h>
+
+#include <memory>
+
+#include "../src/trace.h"
+
+namespace {
+
+constexpr int kSpans = 1000;
+
+// What every instrumented phase pays when --trace is not given.
+void BM_TraceSpanDisabled(benchmark::State& state) {
+  auto& tracer = Tracer::global();
+  for (auto _ : state) {
+    for (int i = 0; i < kSpans; ++i) {
+      TraceSpan span("phase", tracer);
+      benchmark::ClobberMemory();
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * kSpans);
+}
+BENCHMARK(BM_TraceSpanDisabled);
+
+void BM_TraceSpanEnabled(benchmark::State& state) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    // A fresh tracer each round keeps the buffer from growing without bound.
+    auto tracer = std::make_unique<Tracer>();
+    tracer->enable();
+    state.ResumeTiming();
+    for (int i = 0; i < kSpans; ++i) {
+      TraceSpan span("phase", *tracer);
+      benchmark::ClobberMemory();
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * kSpans);
+}
+BENCHMARK(BM_TraceSpanEnabled);
+
+void BM_TraceToJson(benchmark::State& state) {
+  Tracer tracer;
+  for (int i = 0; i < kSpans; ++i) {
+    tracer.record("GetPackages", i * 1000, i * 1000 + 750);
+  }
+  for (auto _ : state) {
+    auto json = tracer.to_json();
+    benchmark::DoNotOptimize(json.data());
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * kSpans);
+}
+BENCHMARK(BM_TraceToJson);
+
+}  // namespace
@@ -0,0 +1,41 @@
+#ifndef ASCII_H_
+#define ASCII_H_
+
+#include <algorithm>
+#include <string_view>
+
+// Case folding for identifiers (product and package IDs, variable names).
+// They are ASCII, so this avoids locale lookups and codepage conversions.
+template <typename CharT>
+constexpr CharT ascii_tolower(CharT c) {
+  if (CharT('A') <= c && c <= CharT('Z')) {
+    return static_cast<CharT>(c - CharT('A') + CharT('a'));
+  }
+  return c;
+}
+
+template <typename CharT>
+constexpr CharT ascii_toupper(CharT c) {
+  if (CharT('a') <= c && c <= CharT('z')) {
+    return static_cast<CharT>(c - CharT('a') + CharT('A'));
+  }
+  return c;
+}
+
+template <typename CharT>
+constexpr bool ascii_iequals_impl(std::basic_string_view<CharT> a,
+                                  std::basic_string_view<CharT> b) {
+  return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                    [](CharT x, CharT y) {
+                      return ascii_tolower(x) == ascii_tolower(y);
+                    });
+}
+
+constexpr bool ascii_iequals(std::string_view a, std::string_view b) {
+  return ascii_iequals_impl(a, b);
+}
+constexpr bool ascii_iequals(std::wstring_view a, std::wstring_view b) {
+  return ascii_iequals_impl(a, b);
+}
+
+#endif  // ASCII_H_
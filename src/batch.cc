@@ -0,0 +1,91 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "worker_pool.h"
+
+std::vector<std::string> parse_batch(std::string_view text) {
+  std::vector<std::string> commands;
+  bool nul_separated = text.find('\0') != std::string_view::npos;
+  char separator = nul_separated ? '\0' : '\n';
+  while (!text.empty()) {
+    auto end = text.find(separator);
+    auto command = text.substr(0, end);
+    text = end == std::string_view::npos ? std::string_view{}
+                                         : text.substr(end + 1);
+    if (nul_separated) {
+      if (!command.empty()) {
+        commands.emplace_back(command);
+      }
+      continue;
+    }
+    if (!command.empty() && command.back() == '\r') {
+      command.remove_suffix(1);
+    }
+    auto first = command.find_first_not_of(" \t");
+    if (first == std::string_view::npos || command[first] == '#') {
+      continue;
+    }
+    commands.emplace_back(command);
+  }
+  return commands;
+}
+
+std::vector<BatchResult> run_batch(std::vector<std::string> const& commands,
+                                   size_t jobs, BatchRunner const& run,
+                                   BatchReporter const& report) {
+  std::vector<BatchResult> results(commands.size());
+  if (commands.empty()) {
+    return results;
+  }
+  if (jobs == 0) {
+    jobs = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  std::mutex mutex;
+  std::vector<char> finished(commands.size(), 0);
+  size_t next_report = 0;
+  {
+    WorkerPool pool(std::min(jobs, commands.size()));
+    for (size_t i = 0; i < commands.size(); ++i) {
+      results[i].command_ = commands[i];
+      pool.post([&, i]() {
+        auto& result = results[i];
+        auto append = [&result](OutputChannel channel, std::string_view data) {
+          if (result.output_.empty() ||
+              result.output_.back().channel_ != channel) {
+            result.output_.push_back({channel, {}});
+          }
+          result.output_.back().data_ += data;
+        };
+        try {
+          result.exit_code_ = run(result.command_, append);
+        } catch (std::exception const& e) {
+          result.exit_code_ = std::nullopt;
+          append(OutputChannel::kStderr, e.what());
+        }
+
+        std::lock_guard lock(mutex);
+        finished[i] = 1;
+        for (; next_report < results.size() && finished[next_report];
+             ++next_report) {
+          report(next_report, results[next_report]);
+          results[next_report].output_ = {};
+        }
+      });
+    }
+  }
+  return results;
+}
+
+int batch_exit_code(std::vector<BatchResult> const& results) {
+  for (auto const& result : results) {
+    if (!result.succeeded()) {
+      return result.exit_code_.value_or(1);
+    }
+  }
+  return 0;
+}
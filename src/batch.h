@@ -0,0 +1,55 @@
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "process_runner.h"
+
+// Splits a `vsrun --batch` script into commands. The script is
+// NUL-separated when it contains a NUL, as `find -print0` writes it;
+// otherwise it has one command per line, where blank lines and lines
+// starting with '#' are skipped.
+std::vector<std::string> parse_batch(std::string_view text);
+
+struct BatchChunk {
+  OutputChannel channel_;
+  std::string data_;
+};
+
+struct BatchResult {
+  std::string command_;
+  // std::nullopt when the command could not be started.
+  std::optional<int> exit_code_;
+  // What the command wrote, in order, with adjacent writes to the same
+  // channel merged. Emptied once the result has been reported.
+  std::vector<BatchChunk> output_;
+
+  bool succeeded() const { return exit_code_ == 0; }
+};
+
+// Runs one command, streaming its output to `sink`.
+using BatchRunner = std::function<std::optional<int>(
+    std::string const& command, OutputSink const& sink)>;
+// Receives each finished command with its output. Called from one thread at
+// a time, in input order.
+using BatchReporter =
+    std::function<void(size_t index, BatchResult const& result)>;
+
+// Runs `commands` on at most `jobs` threads (one per core when 0). A
+// command's output is held back until it and every command before it have
+// finished, so the groups passed to `report` never interleave and come out
+// in input order. Returns the results in input order.
+std::vector<BatchResult> run_batch(std::vector<std::string> const& commands,
+                                   size_t jobs, BatchRunner const& run,
+                                   BatchReporter const& report);
+
+// 0 when every command succeeded; otherwise the exit code of the first
+// command that failed, or 1 if it could not be started.
+int batch_exit_code(std::vector<BatchResult> const& results);
+
+#endif  // BATCH_H_
@@ -0,0 +1,358 @@
+#include "command_graph.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "json_reader.h"
+
+namespace {
+
+bool fail(std::string* error, std::string message) {
+  if (error) {
+    *error = std::move(message);
+  }
+  return false;
+}
+
+bool read_string_value(JsonReader& reader, std::string& out) {
+  std::string_view raw;
+  if (reader.peek() != JsonReader::Type::kString || !reader.read_string(raw)) {
+    return false;
+  }
+  out = json_unescape(raw);
+  return true;
+}
+
+bool read_node(JsonReader& reader, GraphNode& node, std::string* error) {
+  if (!reader.begin_object()) {
+    return fail(error, "every node must be an object");
+  }
+  std::string_view key;
+  while (reader.next_member(key)) {
+    bool ok = true;
+    if (key == "name") {
+      ok = read_string_value(reader, node.name_);
+    } else if (key == "command") {
+      ok = read_string_value(reader, node.command_);
+    } else if (key == "arch") {
+      ok = read_string_value(reader, node.arch_);
+    } else if (key == "deps") {
+      ok = reader.begin_array();
+      while (ok && reader.next_element()) {
+        ok = read_string_value(reader, node.deps_.emplace_back());
+      }
+    } else {
+      ok = reader.skip();
+    }
+    if (!ok) {
+      return fail(error, "\"" + std::string(key) + "\" of node " +
+                             (node.name_.empty() ? "?" : node.name_) +
+                             " has the wrong type");
+    }
+  }
+  return !reader.failed();
+}
+
+}  // namespace
+
+std::optional<CommandGraph> CommandGraph::parse(std::string_view json,
+                                                std::string* error) {
+  JsonReader reader(json);
+  std::vector<GraphNode> nodes;
+  if (!reader.begin_array()) {
+    fail(error, "the graph must be a JSON array of nodes");
+    return std::nullopt;
+  }
+  while (reader.next_element()) {
+    if (!read_node(reader, nodes.emplace_back(), error)) {
+      if (reader.failed()) {
+        fail(error,
+             "malformed JSON at offset " + std::to_string(reader.position()));
+      }
+      return std::nullopt;
+    }
+  }
+  if (reader.failed() || reader.peek() != JsonReader::Type::kEnd) {
+    fail(error,
+         "malformed JSON at offset " + std::to_string(reader.position()));
+    return std::nullopt;
+  }
+  return build(std::move(nodes), error);
+}
+
+std::optional<CommandGraph> CommandGraph::build(std::vector<GraphNode> nodes,
+                                                std::string* error) {
+  std::map<std::string_view, size_t> index;
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (nodes[i].name_.empty() || nodes[i].command_.empty()) {
+      fail(error, "node " + std::to_string(i + 1) +
+                      " needs a \"name\" and a \"command\"");
+      return std::nullopt;
+    }
+    if (!index.emplace(nodes[i].name_, i).second) {
+      fail(error, "duplicate node " + nodes[i].name_);
+      return std::nullopt;
+    }
+  }
+
+  CommandGraph graph;
+  graph.dependents_.resize(nodes.size());
+  graph.dependency_count_.resize(nodes.size());
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    auto deps = nodes[i].deps_;
+    std::sort(deps.begin(), deps.end());
+    deps.erase(std::unique(deps.begin(), deps.end()), deps.end());
+    for (auto const& dep : deps) {
+      auto it = index.find(dep);
+      if (it == index.end()) {
+        fail(error, nodes[i].name_ + " depends on unknown node " + dep);
+        return std::nullopt;
+      }
+      graph.dependents_[it->second].push_back(i);
+      ++graph.dependency_count_[i];
+    }
+  }
+
+  // Kahn's algorithm: whatever is never released sits on a cycle.
+  auto remaining = graph.dependency_count_;
+  std::vector<size_t> ready;
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (remaining[i] == 0) {
+      ready.push_back(i);
+    }
+  }
+  size_t released = 0;
+  while (!ready.empty()) {
+    auto node = ready.back();
+    ready.pop_back();
+    ++released;
+    for (auto dependent : graph.dependents_[node]) {
+      if (--remaining[dependent] == 0) {
+        ready.push_back(dependent);
+      }
+    }
+  }
+  if (released != nodes.size()) {
+    auto it = std::find_if(remaining.begin(), remaining.end(),
+                           [](size_t count) { return count != 0; });
+    fail(error, "dependency cycle through " +
+                    nodes[it - remaining.begin()].name_);
+    return std::nullopt;
+  }
+  graph.nodes_ = std::move(nodes);
+  return graph;
+}
+
+namespace {
+
+class GraphScheduler {
+ public:
+  GraphScheduler(CommandGraph const& graph, size_t threads,
+                 FailurePolicy policy, NodeRunner const& run,
+                 NodeReporter const& report)
+      : graph_(graph),
+        policy_(policy),
+        run_(run),
+        report_(report),
+        results_(graph.size()),
+        remaining_(std::make_unique<std::atomic<size_t>[]>(graph.size())),
+        blocked_(std::make_unique<std::atomic<bool>[]>(graph.size())),
+        unfinished_(graph.size()),
+        queues_(threads) {
+    size_t next_queue = 0;
+    for (size_t i = 0; i < graph.size(); ++i) {
+      remaining_[i] = graph.dependency_count(i);
+      if (graph.dependency_count(i) == 0) {
+        queues_[next_queue++ % threads].ready_.push_back(i);
+        ++pending_;
+      }
+    }
+  }
+
+  std::vector<NodeResult> run() {
+    std::vector<std::thread> threads;
+    for (size_t self = 0; self < queues_.size(); ++self) {
+      threads.emplace_back([this, self]() { work(self); });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    return std::move(results_);
+  }
+
+ private:
+  struct Queue {
+    std::mutex mutex_;
+    std::deque<size_t> ready_;
+  };
+
+  void work(size_t self) {
+    while (auto node = next(self)) {
+      execute(self, *node);
+    }
+  }
+
+  // The newest node of our own deque, else the oldest one of another's;
+  // std::nullopt once every node has finished.
+  std::optional<size_t> next(size_t self) {
+    while (true) {
+      for (size_t n = 0; n < queues_.size(); ++n) {
+        auto& queue = queues_[(self + n) % queues_.size()];
+        std::lock_guard lock(queue.mutex_);
+        if (!queue.ready_.empty()) {
+          size_t node;
+          if (n == 0) {
+            node = queue.ready_.back();
+            queue.ready_.pop_back();
+          } else {
+            node = queue.ready_.front();
+            queue.ready_.pop_front();
+          }
+          --pending_;
+          return node;
+        }
+      }
+      std::unique_lock lock(idle_mutex_);
+      idle_.wait(lock, [this]() { return pending_ > 0 || unfinished_ == 0; });
+      if (unfinished_ == 0) {
+        return std::nullopt;
+      }
+    }
+  }
+
+  void execute(size_t self, size_t node) {
+    auto& result = results_[node];
+    if (blocked_[node] || stopping_) {
+      finish(self, node, NodeStatus::kSkipped);
+      return;
+    }
+    auto append = [&result](OutputChannel channel, std::string_view data) {
+      if (result.output_.empty() || result.output_.back().channel_ != channel) {
+        result.output_.push_back({channel, {}});
+      }
+      result.output_.back().data_ += data;
+    };
+    try {
+      result.exit_code_ = run_(graph_.nodes()[node], append);
+    } catch (std::exception const& e) {
+      result.exit_code_ = std::nullopt;
+      append(OutputChannel::kStderr, e.what());
+    }
+    finish(self, node,
+           result.exit_code_ == 0 ? NodeStatus::kSucceeded
+                                  : NodeStatus::kFailed);
+  }
+
+  // Records the outcome and releases the dependents. Those of a node that
+  // did not succeed are finished as skipped right here, without running.
+  void finish(size_t self, size_t node, NodeStatus status) {
+    std::vector<size_t> finishing = {node};
+    results_[node].status_ = status;
+    while (!finishing.empty()) {
+      auto current = finishing.back();
+      finishing.pop_back();
+      auto& result = results_[current];
+      if (result.status_ == NodeStatus::kFailed &&
+          policy_ == FailurePolicy::kFailFast) {
+        stopping_ = true;
+      }
+      {
+        std::lock_guard lock(report_mutex_);
+        report_(current, graph_.nodes()[current], result);
+      }
+      result.output_ = {};
+
+      for (auto dependent : graph_.dependents(current)) {
+        if (result.status_ != NodeStatus::kSucceeded) {
+          blocked_[dependent] = true;
+        }
+        if (--remaining_[dependent] != 0) {
+          continue;
+        }
+        if (blocked_[dependent] || stopping_) {
+          results_[dependent].status_ = NodeStatus::kSkipped;
+          finishing.push_back(dependent);
+        } else {
+          push(self, dependent);
+        }
+      }
+      if (--unfinished_ == 0) {
+        wake_all();
+      }
+    }
+  }
+
+  void push(size_t self, size_t node) {
+    {
+      std::lock_guard lock(queues_[self].mutex_);
+      queues_[self].ready_.push_back(node);
+      ++pending_;
+    }
+    {
+      std::lock_guard lock(idle_mutex_);
+    }
+    idle_.notify_one();
+  }
+
+  void wake_all() {
+    {
+      std::lock_guard lock(idle_mutex_);
+    }
+    idle_.notify_all();
+  }
+
+  CommandGraph const& graph_;
+  FailurePolicy policy_;
+  NodeRunner const& run_;
+  NodeReporter const& report_;
+  std::vector<NodeResult> results_;
+  std::unique_ptr<std::atomic<size_t>[]> remaining_;
+  // Set once a dependency did not succeed.
+  std::unique_ptr<std::atomic<bool>[]> blocked_;
+  std::atomic<size_t> unfinished_;
+  // Nodes sitting in the deques.
+  std::atomic<size_t> pending_{0};
+  std::atomic<bool> stopping_{false};
+  std::vector<Queue> queues_;
+  std::mutex idle_mutex_;
+  std::condition_variable idle_;
+  std::mutex report_mutex_;
+};
+
+}  // namespace
+
+std::vector<NodeResult> run_graph(CommandGraph const& graph, size_t jobs,
+                                  FailurePolicy policy, NodeRunner const& run,
+                                  NodeReporter const& report) {
+  if (graph.size() == 0) {
+    return {};
+  }
+  if (jobs == 0) {
+    jobs = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  GraphScheduler scheduler(graph, std::min(jobs, graph.size()), policy, run,
+                           report);
+  return scheduler.run();
+}
+
+int graph_exit_code(std::vector<NodeResult> const& results) {
+  for (auto const& result : results) {
+    if (result.status_ == NodeStatus::kFailed) {
+      return result.exit_code_.value_or(1);
+    }
+  }
+  for (auto const& result : results) {
+    if (result.status_ != NodeStatus::kSucceeded) {
+      return 1;
+    }
+  }
+  return 0;
+}
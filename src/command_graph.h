@@ -0,0 +1,92 @@
+#ifndef COMMAND_GRAPH_H_
+#define COMMAND_GRAPH_H_
+
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "batch.h"
+#include "process_runner.h"
+
+struct GraphNode {
+  std::string name_;
+  std::string command_;
+  // Empty for the default `--arch`.
+  std::string arch_;
+  // Names of the nodes that must succeed before this one starts.
+  std::vector<std::string> deps_;
+};
+
+// A validated `vsrun --graph` file: a JSON array of nodes,
+//
+//   [{"name": "configure-x64", "arch": "x64", "command": "cmake ..."},
+//    {"name": "build-x64", "deps": ["configure-x64"], "command": "..."}]
+//
+// Names are unique, every dependency names a node, and there are no cycles.
+class CommandGraph {
+ public:
+  CommandGraph() = default;
+
+  // Returns std::nullopt and describes the problem in `error` when `json` is
+  // malformed or does not describe a DAG.
+  static std::optional<CommandGraph> parse(std::string_view json,
+                                           std::string* error = nullptr);
+  static std::optional<CommandGraph> build(std::vector<GraphNode> nodes,
+                                           std::string* error = nullptr);
+
+  std::vector<GraphNode> const& nodes() const { return nodes_; }
+  size_t size() const { return nodes_.size(); }
+  // Indices of the nodes that depend on node `index`.
+  std::vector<size_t> const& dependents(size_t index) const {
+    return dependents_[index];
+  }
+  size_t dependency_count(size_t index) const {
+    return dependency_count_[index];
+  }
+
+ private:
+  std::vector<GraphNode> nodes_;
+  std::vector<std::vector<size_t>> dependents_;
+  std::vector<size_t> dependency_count_;
+};
+
+enum class FailurePolicy {
+  // Starts nothing new after the first failure.
+  kFailFast,
+  // Skips only what depends on a failed node.
+  kKeepGoing,
+};
+
+enum class NodeStatus { kSucceeded, kFailed, kSkipped };
+
+struct NodeResult {
+  NodeStatus status_ = NodeStatus::kSkipped;
+  // std::nullopt when the command could not be started or was skipped.
+  std::optional<int> exit_code_;
+  // Emptied once the result has been reported.
+  std::vector<BatchChunk> output_;
+};
+
+using NodeRunner = std::function<std::optional<int>(GraphNode const& node,
+                                                    OutputSink const& sink)>;
+// Receives every node once, as it finishes or is skipped, with its output
+// as one group. Called from one thread at a time.
+using NodeReporter = std::function<void(size_t index, GraphNode const& node,
+                                        NodeResult const& result)>;
+
+// Runs `graph` on `jobs` threads (one per core when 0). Each thread keeps
+// the nodes it made ready in its own deque and runs the newest first, so a
+// chain tends to stay on one thread; idle threads steal the oldest node
+// from the others. Returns the results in node order.
+std::vector<NodeResult> run_graph(CommandGraph const& graph, size_t jobs,
+                                  FailurePolicy policy, NodeRunner const& run,
+                                  NodeReporter const& report);
+
+// 0 when every node succeeded; otherwise the exit code of the first failed
+// node in file order, or 1 if it could not be started or nodes were skipped.
+int graph_exit_code(std::vector<NodeResult> const& results);
+
+#endif  // COMMAND_GRAPH_H_
@@ -0,0 +1,169 @@
+#include "command_line.h"
+
+#include <algorithm>
+#include <array>
+#include <system_error>
+
+#include "ascii.h"
+#include "split.h"
+#include "unicode.h"
+
+namespace {
+
+std::wstring_view lookup(Environment const& env, std::wstring_view name) {
+  for (auto const& [key, value] : env) {
+    if (ascii_iequals(key, name)) {
+      return value;
+    }
+  }
+  return {};
+}
+
+std::vector<std::wstring> split_list(std::wstring_view list) {
+  std::vector<std::wstring> items;
+  for (auto item : split_view(list, L';')) {
+    if (item.size() >= 2 && item.front() == L'"' && item.back() == L'"') {
+      item = item.substr(1, item.size() - 2);
+    }
+    if (!item.empty()) {
+      items.emplace_back(item);
+    }
+  }
+  return items;
+}
+
+bool is_file(std::filesystem::path const& p) {
+  std::error_code ec;
+  return std::filesystem::is_regular_file(p, ec);
+}
+
+}  // namespace
+
+bool is_cmd_builtin(std::string_view name) {
+  static constexpr std::array<std::string_view, 45> kBuiltins{
+      "assoc", "break",  "call",     "cd",    "chdir",  "cls",    "color",
+      "copy",  "date",   "del",      "dir",   "dpath",  "echo",   "endlocal",
+      "erase", "exit",   "for",      "ftype", "goto",   "if",     "keys",
+      "md",    "mkdir",  "mklink",   "move",  "path",   "pause",  "popd",
+      "prompt", "pushd", "rd",       "rem",   "ren",    "rename", "rmdir",
+      "set",   "setlocal", "shift",  "start", "time",   "title",  "type",
+      "ver",   "verify", "vol"};
+  // `echo.` and `cd..` are valid spellings too.
+  auto end = name.find_first_of("./\\:");
+  auto word = name.substr(0, end == 0 ? name.size() : end);
+  return std::any_of(kBuiltins.begin(), kBuiltins.end(),
+                     [word](std::string_view builtin) {
+                       return ascii_iequals(word, builtin);
+                     });
+}
+
+bool needs_shell(std::vector<std::string> const& cmd) {
+  if (cmd.empty()) {
+    return true;
+  }
+  if (cmd.size() == 1 &&
+      cmd.front().find_first_of(" \t") != std::string::npos) {
+    return true;
+  }
+  if (is_cmd_builtin(cmd.front())) {
+    return true;
+  }
+  return std::any_of(cmd.begin(), cmd.end(), [](std::string const& arg) {
+    return arg.find_first_of("&<>()@^|%") != std::string::npos;
+  });
+}
+
+std::string quote_argument(std::string_view arg) {
+  if (!arg.empty() && arg.find_first_of(" \t\n\v\"") == std::string::npos) {
+    return std::string(arg);
+  }
+  std::string quoted{'"'};
+  size_t backslashes = 0;
+  for (char c : arg) {
+    if (c == '\\') {
+      ++backslashes;
+      continue;
+    }
+    if (c == '"') {
+      // Backslashes before a quote are escapes, and so is the quote itself.
+      quoted.append(backslashes * 2 + 1, '\\');
+    } else {
+      quoted.append(backslashes, '\\');
+    }
+    backslashes = 0;
+    quoted.push_back(c);
+  }
+  // The closing quote must not be escaped by trailing backslashes.
+  quoted.append(backslashes * 2, '\\');
+  quoted.push_back('"');
+  return quoted;
+}
+
+std::string join_command_line(std::vector<std::string> const& args) {
+  std::string line;
+  for (auto const& arg : args) {
+    if (!line.empty()) {
+      line.push_back(' ');
+    }
+    line += quote_argument(arg);
+  }
+  return line;
+}
+
+std::optional<std::filesystem::path> find_executable(
+    std::string const& name, Environment const& env,
+    std::filesystem::path const& cwd) {
+  if (name.empty()) {
+    return std::nullopt;
+  }
+  auto wname = utf8_decode(name);
+
+  auto pathext = split_list(lookup(env, L"PATHEXT"));
+  if (pathext.empty()) {
+    pathext = {L".com", L".exe", L".bat", L".cmd"};
+  }
+  for (auto& ext : pathext) {
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   ascii_tolower<wchar_t>);
+  }
+
+  auto probe = [&](std::filesystem::path const& base)
+      -> std::optional<std::filesystem::path> {
+    auto ext = base.extension().wstring();
+    auto has_ext = std::any_of(pathext.begin(), pathext.end(),
+                               [&ext](std::wstring const& e) {
+                                 return ascii_iequals(ext, e);
+                               });
+    if (has_ext && is_file(base)) {
+      return base;
+    }
+    for (auto const& e : pathext) {
+      auto candidate = base;
+      candidate += e;
+      if (is_file(candidate)) {
+        return candidate;
+      }
+    }
+    return std::nullopt;
+  };
+
+  std::filesystem::path program(wname);
+  if (wname.find_first_of(L"\\/:") != std::wstring::npos) {
+    return probe(program.is_absolute() ? program
+                                       : (cwd / program).lexically_normal());
+  }
+  if (auto found = probe(cwd / program); found) {
+    return found;
+  }
+  for (auto const& dir : split_list(lookup(env, L"PATH"))) {
+    if (auto found = probe(std::filesystem::path(dir) / program); found) {
+      return found;
+    }
+  }
+  return std::nullopt;
+}
+
+bool is_native_executable(std::filesystem::path const& program) {
+  auto ext = program.extension().wstring();
+  return ascii_iequals(ext, L".exe") || ascii_iequals(ext, L".com");
+}
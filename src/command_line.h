@@ -0,0 +1,37 @@
+#ifndef COMMAND_LINE_H_
+#define COMMAND_LINE_H_
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "env_cache.h"
+
+// True for commands that only cmd.exe can run: internal commands such as
+// `dir` or `set`.
+bool is_cmd_builtin(std::string_view name);
+
+// True when `cmd` has to go through `cmd.exe /c`: it contains one of the
+// metacharacters &<>()@^| (or %, which cmd expands), names a builtin, or is
+// a single command line string such as "cmake -B build".
+bool needs_shell(std::vector<std::string> const& cmd);
+
+// Quotes `arg` so that CommandLineToArgvW and the MSVC CRT parse it back
+// unchanged.
+std::string quote_argument(std::string_view arg);
+std::string join_command_line(std::vector<std::string> const& args);
+
+// Resolves `name` the way cmd.exe would: relative to `cwd`, then each entry
+// of the PATH found in `env`, trying the PATHEXT extensions when `name` has
+// none of them. Variable names are matched case-insensitively.
+std::optional<std::filesystem::path> find_executable(
+    std::string const& name, Environment const& env,
+    std::filesystem::path const& cwd);
+
+// True for images CreateProcess starts by itself (.exe and .com); batch files
+// still need cmd.exe.
+bool is_native_executable(std::filesystem::path const& program);
+
+#endif  // COMMAND_LINE_H_
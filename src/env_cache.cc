@@ -0,0 +1,388 @@
+#include "env_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+#include "ascii.h"
+#include "trace.h"
+#include "unicode.h"
+
+namespace {
+
+// 2: list variables are stored as '<' prepend and '>' append edits.
+constexpr std::string_view kEntryMagic = "vsrun-env-cache 2\n";
+constexpr std::string_view kHeaderEnd = "--\n";
+
+bool has_newline(std::wstring_view s) {
+  return s.find_first_of(L"\r\n") != std::wstring_view::npos;
+}
+
+uint64_t fnv1a(uint64_t hash, std::string_view data) {
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  // Field separator, so that ("ab", "c") and ("a", "bc") differ.
+  hash ^= 0xFF;
+  hash *= 0x100000001b3ULL;
+  return hash;
+}
+
+std::string serialize_key(EnvCacheKey const& key) {
+  std::string out{kEntryMagic};
+  out += "path " + utf8_encode(key.install_path_) + '\n';
+  out += "version " + utf8_encode(key.install_version_) + '\n';
+  out += "datetime " + std::to_string(key.install_datetime_) + '\n';
+  out += "arch " + key.arch_ + '\n';
+  out += "host_arch " + key.host_arch_ + '\n';
+  for (auto const& [name, value] : key.inputs_) {
+    out += "input " + utf8_encode(name) + '=' + utf8_encode(value) + '\n';
+  }
+  out += kHeaderEnd;
+  return out;
+}
+
+std::optional<std::string> read_file(std::filesystem::path const& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return std::nullopt;
+  }
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+
+std::filesystem::path env_path(char const* name) {
+#if defined(_WIN32)
+  std::wstring wname(name, name + std::char_traits<char>::length(name));
+  if (auto const* value = _wgetenv(wname.c_str()); value && *value) {
+    return value;
+  }
+#else
+  if (auto const* value = std::getenv(name); value && *value) {
+    return value;
+  }
+#endif
+  return {};
+}
+
+}  // namespace
+
+std::vector<std::wstring> const& vsdevcmd_input_names() {
+  static const std::vector<std::wstring> names{
+      L"CommandPromptType",
+      L"DevEnvDir",
+      L"EXTERNAL_INCLUDE",
+      L"ExtensionSdkDir",
+      L"Framework40Version",
+      L"FrameworkDir",
+      L"FrameworkVersion",
+      L"INCLUDE",
+      L"LIB",
+      L"LIBPATH",
+      L"PATH",
+      L"Platform",
+      L"PreferredToolArchitecture",
+      L"ProgramFiles",
+      L"ProgramFiles(x86)",
+      L"UCRTVersion",
+      L"UniversalCRTSdkDir",
+      L"VCIDEInstallDir",
+      L"VCINSTALLDIR",
+      L"VCToolsInstallDir",
+      L"VCToolsVersion",
+      L"VSCMD_ARG_HOST_ARCH",
+      L"VSCMD_ARG_TGT_ARCH",
+      L"VSCMD_ARG_app_plat",
+      L"VSCMD_DEBUG",
+      L"VSCMD_SKIP_SENDTELEMETRY",
+      L"VSCMD_START_DIR",
+      L"VSCMD_VER",
+      L"VSINSTALLDIR",
+      L"WindowsLibPath",
+      L"WindowsSdkBinPath",
+      L"WindowsSdkDir",
+      L"WindowsSDKLibVersion",
+      L"WindowsSdkVerBinPath",
+      L"WindowsSDKVersion",
+      L"__DOTNET_ADD_32BIT",
+      L"__DOTNET_ADD_64BIT",
+      L"__DOTNET_PREFERRED_BITNESS",
+      L"__VSCMD_PREINIT_PATH",
+  };
+  return names;
+}
+
+Environment select_vsdevcmd_inputs(Environment const& parent) {
+  auto const& names = vsdevcmd_input_names();
+  Environment inputs;
+  for (auto const& [name, value] : parent) {
+    auto input = std::find_if(names.begin(), names.end(),
+                              [&name](std::wstring const& known) {
+                                return ascii_iequals(name, known);
+                              });
+    if (input != names.end()) {
+      inputs.emplace(*input, value);
+    }
+  }
+  return inputs;
+}
+
+Environment parse_set_output(std::wstring_view output) {
+  Environment env;
+  while (!output.empty()) {
+    auto eol = output.find(L'\n');
+    auto line = output.substr(0, eol);
+    output = eol == std::wstring_view::npos ? std::wstring_view{}
+                                            : output.substr(eol + 1);
+    if (!line.empty() && line.back() == L'\r') {
+      line.remove_suffix(1);
+    }
+    auto eq = line.find(L'=');
+    // Lines without '=' are noise; names starting with '=' are cmd's
+    // per-drive current directories.
+    if (eq == std::wstring_view::npos || eq == 0) {
+      continue;
+    }
+    env.insert_or_assign(std::wstring(line.substr(0, eq)),
+                         std::wstring(line.substr(eq + 1)));
+  }
+  return env;
+}
+
+EnvDelta diff_environment(Environment const& before,
+                          Environment const& after) {
+  EnvDelta delta;
+  for (auto const& [name, value] : after) {
+    auto it = before.find(name);
+    if (it != before.end() && it->second == value) {
+      continue;
+    }
+    if (!is_path_list(name)) {
+      delta.set_.emplace(name, value);
+      continue;
+    }
+    PathListEdit edit;
+    if (it != before.end() && !split_path_list(it->second).empty() &&
+        diff_path_list(it->second, value, edit)) {
+      if (!edit.empty()) {
+        delta.lists_.emplace(name, std::move(edit));
+      }
+    } else {
+      delta.set_.emplace(name, dedupe_path_list(value));
+    }
+  }
+  for (auto const& [name, value] : before) {
+    if (!after.contains(name)) {
+      delta.unset_.push_back(name);
+    }
+  }
+  return delta;
+}
+
+void apply_environment(Environment& env, EnvDelta const& delta) {
+  for (auto const& name : delta.unset_) {
+    env.erase(name);
+  }
+  for (auto const& [name, value] : delta.set_) {
+    env.insert_or_assign(name, value);
+  }
+  for (auto const& [name, edit] : delta.lists_) {
+    auto& value = env[name];
+    value = merge_path_list(value, edit);
+  }
+}
+
+EnvDelta resolve_path_lists(EnvDelta delta, Environment const& parent) {
+  for (auto const& [name, edit] : delta.lists_) {
+    auto it = parent.find(name);
+    std::wstring_view current;
+    if (it != parent.end()) {
+      current = it->second;
+    }
+    delta.set_.insert_or_assign(name, merge_path_list(current, edit));
+  }
+  delta.lists_.clear();
+  return delta;
+}
+
+void dedupe_path_lists(Environment& env) {
+  for (auto& [name, value] : env) {
+    if (is_path_list(name)) {
+      value = dedupe_path_list(value);
+    }
+  }
+}
+
+std::string serialize_env_cache_entry(EnvCacheKey const& key,
+                                      EnvDelta const& delta) {
+  auto out = serialize_key(key);
+  for (auto const& [name, value] : delta.set_) {
+    out += '+' + utf8_encode(name) + '=' + utf8_encode(value) + '\n';
+  }
+  for (auto const& name : delta.unset_) {
+    out += '-' + utf8_encode(name) + '\n';
+  }
+  for (auto const& [name, edit] : delta.lists_) {
+    for (auto const& [mark, entries] :
+         {std::pair{'<', &edit.prepend_}, std::pair{'>', &edit.append_}}) {
+      if (entries->empty()) {
+        continue;
+      }
+      out += mark + utf8_encode(name) + '=';
+      for (size_t i = 0; i < entries->size(); ++i) {
+        out += (i == 0 ? "" : ";") + utf8_encode((*entries)[i]);
+      }
+      out += '\n';
+    }
+  }
+  return out;
+}
+
+std::optional<EnvDelta> parse_env_cache_entry(std::string_view data,
+                                              EnvCacheKey const& key) {
+  auto header = serialize_key(key);
+  if (!data.starts_with(header)) {
+    return std::nullopt;
+  }
+  data.remove_prefix(header.size());
+
+  EnvDelta delta;
+  while (!data.empty()) {
+    auto eol = data.find('\n');
+    if (eol == std::string_view::npos) {
+      return std::nullopt;  // truncated write
+    }
+    auto line = data.substr(0, eol);
+    data.remove_prefix(eol + 1);
+    if (line.starts_with('+')) {
+      auto eq = line.find('=');
+      if (eq == std::string_view::npos || eq == 1) {
+        return std::nullopt;
+      }
+      delta.set_.insert_or_assign(utf8_decode(line.substr(1, eq - 1)),
+                                  utf8_decode(line.substr(eq + 1)));
+    } else if (line.starts_with('-') && line.size() > 1) {
+      delta.unset_.push_back(utf8_decode(line.substr(1)));
+    } else if (line.starts_with('<') || line.starts_with('>')) {
+      auto eq = line.find('=');
+      if (eq == std::string_view::npos || eq == 1) {
+        return std::nullopt;
+      }
+      auto& edit = delta.lists_[utf8_decode(line.substr(1, eq - 1))];
+      auto& entries = line.front() == '<' ? edit.prepend_ : edit.append_;
+      auto value = utf8_decode(line.substr(eq + 1));
+      for (auto entry : split_path_list(value)) {
+        entries.emplace_back(entry);
+      }
+    } else {
+      return std::nullopt;
+    }
+  }
+  return delta;
+}
+
+std::filesystem::path EnvCache::entry_path(EnvCacheKey const& key) const {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hash = fnv1a(hash, utf8_encode(key.install_path_));
+  hash = fnv1a(hash, key.arch_);
+  hash = fnv1a(hash, key.host_arch_);
+  for (auto const& [name, value] : key.inputs_) {
+    hash = fnv1a(hash, utf8_encode(name));
+    hash = fnv1a(hash, utf8_encode(value));
+  }
+  char name[32];
+  std::snprintf(name, sizeof(name), "env-%016llx.txt",
+                static_cast<unsigned long long>(hash));
+  return dir_ / name;
+}
+
+std::optional<EnvDelta> EnvCache::load(EnvCacheKey const& key) const {
+  auto data = read_file(entry_path(key));
+  if (!data) {
+    return std::nullopt;
+  }
+  return parse_env_cache_entry(*data, key);
+}
+
+bool EnvCache::store(EnvCacheKey const& key, EnvDelta const& delta) const {
+  if (has_newline(key.install_path_) || has_newline(key.install_version_) ||
+      std::any_of(key.inputs_.begin(), key.inputs_.end(),
+                  [](auto const& kv) { return has_newline(kv.second); }) ||
+      std::any_of(delta.set_.begin(), delta.set_.end(),
+                  [](auto const& kv) { return has_newline(kv.second); }) ||
+      std::any_of(delta.lists_.begin(), delta.lists_.end(),
+                  [](auto const& kv) {
+                    auto const& [prepend, append] = kv.second;
+                    return std::any_of(prepend.begin(), prepend.end(),
+                                       has_newline) ||
+                           std::any_of(append.begin(), append.end(),
+                                       has_newline);
+                  })) {
+    return false;
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(dir_, ec);
+  auto path = entry_path(key);
+  auto tmp = path;
+  tmp += ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      return false;
+    }
+    out << serialize_env_cache_entry(key, delta);
+    if (!out.flush()) {
+      return false;
+    }
+  }
+  // Concurrent vsrun processes may race here; the last complete entry wins.
+  std::filesystem::rename(tmp, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp, ec);
+    return false;
+  }
+  return true;
+}
+
+std::optional<EnvDelta> EnvCache::get_or_capture(
+    EnvCacheKey const& key, Environment const& parent,
+    std::function<std::optional<Environment>()> const& capture) const {
+  {
+    TraceSpan span("read env cache");
+    if (auto delta = load(key); delta) {
+      return delta;
+    }
+  }
+  auto captured = capture();
+  if (!captured) {
+    return std::nullopt;
+  }
+  auto delta = diff_environment(parent, *captured);
+  store(key, delta);
+  return delta;
+}
+
+std::filesystem::path default_cache_dir() {
+  if (auto dir = env_path("VSRUN_CACHE_DIR"); !dir.empty()) {
+    return dir;
+  }
+#if defined(_WIN32)
+  if (auto dir = env_path("LOCALAPPDATA"); !dir.empty()) {
+    return dir / "vsrun";
+  }
+#else
+  if (auto dir = env_path("XDG_CACHE_HOME"); !dir.empty()) {
+    return dir / "vsrun";
+  }
+  if (auto dir = env_path("HOME"); !dir.empty()) {
+    return dir / ".cache" / "vsrun";
+  }
+#endif
+  std::error_code ec;
+  return std::filesystem::temp_directory_path(ec) / "vsrun";
+}
@@ -0,0 +1,88 @@
+#ifndef ENV_CACHE_H_
+#define ENV_CACHE_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "path_list.h"
+
+using Environment = std::map<std::wstring, std::wstring>;
+
+// Everything the output of VsDevCmd.bat depends on. The identity part
+// (path, arches, inputs) names the cache entry; version and install date are
+// stored inside it, so a repaired or updated instance invalidates the entry.
+struct EnvCacheKey {
+  std::wstring install_path_;
+  std::wstring install_version_;
+  uint64_t install_datetime_;
+  std::string arch_;
+  std::string host_arch_;
+  Environment inputs_;
+};
+
+// Variables changed by VsDevCmd.bat. List variables (see is_path_list)
+// whose old entries survive are kept as edits rather than whole values, so
+// applying the delta merges into the list instead of repeating entries.
+struct EnvDelta {
+  Environment set_;
+  std::vector<std::wstring> unset_;
+  std::map<std::wstring, PathListEdit> lists_;
+};
+
+// Parent variables VsDevCmd.bat and the vcvars scripts it calls consult.
+std::vector<std::wstring> const& vsdevcmd_input_names();
+// The inputs among `parent`, matched regardless of case as Windows does and
+// renamed to the spelling of vsdevcmd_input_names(), so that a parent with
+// "Path" keys the same entry as one with "PATH".
+Environment select_vsdevcmd_inputs(Environment const& parent);
+
+// Parses the `NAME=VALUE` lines printed by cmd's `set` builtin.
+Environment parse_set_output(std::wstring_view output);
+
+// The smallest delta turning `before` into `after`, with list variables
+// compared as ordered sets: duplicates and respellings of an entry are not
+// changes, and the lists the delta sets carry no duplicates.
+EnvDelta diff_environment(Environment const& before, Environment const& after);
+void apply_environment(Environment& env, EnvDelta const& delta);
+// `delta` with its list edits turned into the whole values they give on top
+// of `parent`.
+EnvDelta resolve_path_lists(EnvDelta delta, Environment const& parent);
+// Removes the duplicate entries of every list variable of `env`.
+void dedupe_path_lists(Environment& env);
+
+std::string serialize_env_cache_entry(EnvCacheKey const& key,
+                                      EnvDelta const& delta);
+// Returns std::nullopt when `data` is malformed or was written for another
+// key (e.g. the instance has since been updated).
+std::optional<EnvDelta> parse_env_cache_entry(std::string_view data,
+                                              EnvCacheKey const& key);
+
+class EnvCache {
+ public:
+  explicit EnvCache(std::filesystem::path dir) : dir_(std::move(dir)) {}
+
+  std::filesystem::path entry_path(EnvCacheKey const& key) const;
+  std::optional<EnvDelta> load(EnvCacheKey const& key) const;
+  bool store(EnvCacheKey const& key, EnvDelta const& delta) const;
+
+  // Returns the cached delta for `key`, or runs `capture` (which yields the
+  // environment after VsDevCmd.bat ran on top of `parent`) and caches it.
+  std::optional<EnvDelta> get_or_capture(
+      EnvCacheKey const& key, Environment const& parent,
+      std::function<std::optional<Environment>()> const& capture) const;
+
+ private:
+  std::filesystem::path dir_;
+};
+
+// %VSRUN_CACHE_DIR%, else %LOCALAPPDATA%\vsrun (Windows) or
+// $XDG_CACHE_HOME/vsrun, $HOME/.cache/vsrun.
+std::filesystem::path default_cache_dir();
+
+#endif  // ENV_CACHE_H_
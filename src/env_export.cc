@@ -0,0 +1,270 @@
+#include "env_export.h"
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include "ascii.h"
+#include "json_reader.h"
+#include "unicode.h"
+
+namespace {
+
+constexpr std::pair<std::string_view, EnvFormat> kFormats[] = {
+    {"cmd", EnvFormat::kCmd},
+    {"powershell", EnvFormat::kPowerShell},
+    {"ps1", EnvFormat::kPowerShell},
+    {"sh", EnvFormat::kSh},
+    {"json", EnvFormat::kJson},
+    {"cmake", EnvFormat::kCMake},
+    {"cmake-preset", EnvFormat::kCMakePreset},
+    {"ninja", EnvFormat::kNinja},
+};
+
+template <typename Escape>
+std::string escape(std::wstring_view value, Escape escape_char) {
+  std::string out;
+  for (char c : utf8_encode(value)) {
+    escape_char(out, c);
+  }
+  return out;
+}
+
+std::string cmd_value(std::wstring_view value) {
+  // Inside a batch file `%` has to be doubled; the quotes of `set "A=B"`
+  // keep the other metacharacters literal.
+  return escape(value, [](std::string& out, char c) {
+    out += c;
+    if (c == '%') {
+      out += '%';
+    }
+  });
+}
+
+std::string single_quoted(std::wstring_view value, std::string_view quote) {
+  return "'" + escape(value, [quote](std::string& out, char c) {
+           if (c == '\'') {
+             out += quote;
+           } else {
+             out += c;
+           }
+         }) + "'";
+}
+
+std::string cmake_quoted(std::wstring_view value) {
+  return "\"" + escape(value, [](std::string& out, char c) {
+           if (c == '\\' || c == '"' || c == '$') {
+             out += '\\';
+           }
+           out += c;
+         }) + "\"";
+}
+
+bool is_sh_name(std::wstring_view name) {
+  auto is_alpha = [](wchar_t c) {
+    return (c >= L'a' && c <= L'z') || (c >= L'A' && c <= L'Z') || c == L'_';
+  };
+  return !name.empty() && is_alpha(name.front()) &&
+         std::all_of(name.begin(), name.end(), [&is_alpha](wchar_t c) {
+           return is_alpha(c) || (c >= L'0' && c <= L'9');
+         });
+}
+
+std::wstring const* find_variable(Environment const& env,
+                                  std::wstring_view name) {
+  for (auto const& [key, value] : env) {
+    if (ascii_iequals(key, name)) {
+      return &value;
+    }
+  }
+  return nullptr;
+}
+
+// The PATH entries VsDevCmd.bat added, as MSYS paths, followed by $PATH.
+std::string msys_path_value(std::wstring_view path, Environment const& parent) {
+  std::set<std::wstring> inherited;
+  if (auto const* before = find_variable(parent, L"PATH")) {
+    for (auto entry : split_path_list(*before)) {
+      inherited.insert(path_entry_key(entry));
+    }
+  }
+  std::wstring added;
+  for (auto entry : split_path_list(path)) {
+    if (inherited.count(path_entry_key(entry)) == 0) {
+      added += to_msys_path(entry) + L":";
+    }
+  }
+  return "\"" + escape(added, [](std::string& out, char c) {
+           if (c == '"' || c == '\\' || c == '$' || c == '`') {
+             out += '\\';
+           }
+           out += c;
+         }) + "$PATH\"";
+}
+
+std::string format_cmd(EnvDelta const& delta) {
+  std::string out = "@echo off\r\n";
+  for (auto const& name : delta.unset_) {
+    out += "set \"" + cmd_value(name) + "=\"\r\n";
+  }
+  for (auto const& [name, value] : delta.set_) {
+    out += "set \"" + cmd_value(name) + "=" + cmd_value(value) + "\"\r\n";
+  }
+  return out;
+}
+
+std::string format_powershell(EnvDelta const& delta) {
+  std::string out;
+  for (auto const& name : delta.unset_) {
+    out += "Remove-Item -LiteralPath " + single_quoted(L"Env:" + name, "''") +
+           " -ErrorAction SilentlyContinue\n";
+  }
+  for (auto const& [name, value] : delta.set_) {
+    out += "Set-Item -LiteralPath " + single_quoted(L"Env:" + name, "''") +
+           " -Value " + single_quoted(value, "''") + "\n";
+  }
+  return out;
+}
+
+std::string format_sh(EnvDelta const& delta, Environment const& parent,
+                      bool msys_paths) {
+  std::string out;
+  auto skip = [&out](std::wstring const& name) {
+    out += "# " + utf8_encode(name) + " is not a valid sh variable name\n";
+  };
+  for (auto const& name : delta.unset_) {
+    if (!is_sh_name(name)) {
+      skip(name);
+      continue;
+    }
+    out += "unset " + utf8_encode(name) + "\n";
+  }
+  for (auto const& [name, value] : delta.set_) {
+    if (!is_sh_name(name)) {
+      skip(name);
+      continue;
+    }
+    out += "export " + utf8_encode(name) + "=";
+    if (msys_paths && ascii_iequals(name, L"PATH")) {
+      out += msys_path_value(value, parent);
+    } else {
+      out += single_quoted(value, "'\\''");
+    }
+    out += "\n";
+  }
+  return out;
+}
+
+std::string format_json(EnvDelta const& delta) {
+  std::string out = "{\n  \"set\": {";
+  char const* separator = "\n";
+  for (auto const& [name, value] : delta.set_) {
+    out += separator;
+    out += "    " + json_quote(utf8_encode(name)) + ": " +
+           json_quote(utf8_encode(value));
+    separator = ",\n";
+  }
+  out += delta.set_.empty() ? "},\n" : "\n  },\n";
+  out += "  \"unset\": [";
+  separator = "";
+  for (auto const& name : delta.unset_) {
+    out += separator + json_quote(utf8_encode(name));
+    separator = ", ";
+  }
+  out += "]\n}\n";
+  return out;
+}
+
+std::string format_cmake(EnvDelta const& delta) {
+  std::string out;
+  for (auto const& name : delta.unset_) {
+    out += "unset(ENV{" + utf8_encode(name) + "})\n";
+  }
+  for (auto const& [name, value] : delta.set_) {
+    out += "set(ENV{" + utf8_encode(name) + "} " + cmake_quoted(value) + ")\n";
+  }
+  return out;
+}
+
+// A null value unsets the variable for the preset.
+std::string format_cmake_preset(EnvDelta const& delta) {
+  std::string out = "\"environment\": {";
+  char const* separator = "\n";
+  for (auto const& name : delta.unset_) {
+    out += separator;
+    out += "  " + json_quote(utf8_encode(name)) + ": null";
+    separator = ",\n";
+  }
+  for (auto const& [name, value] : delta.set_) {
+    out += separator;
+    out += "  " + json_quote(utf8_encode(name)) + ": " +
+           json_quote(utf8_encode(value));
+    separator = ",\n";
+  }
+  out += (delta.set_.empty() && delta.unset_.empty()) ? "}\n" : "\n}\n";
+  return out;
+}
+
+std::string format_ninja(EnvDelta const& delta, Environment const& parent) {
+  auto env = parent;
+  apply_environment(env, delta);
+  std::string out;
+  for (auto const& [name, value] : env) {
+    out += utf8_encode(name) + "=" + utf8_encode(value);
+    out += '\0';
+  }
+  out += '\0';
+  return out;
+}
+
+}  // namespace
+
+std::optional<EnvFormat> parse_env_format(std::string_view name) {
+  for (auto const& [format_name, format] : kFormats) {
+    if (ascii_iequals(name, format_name)) {
+      return format;
+    }
+  }
+  return std::nullopt;
+}
+
+std::string format_environment(EnvFormat format, EnvDelta const& edits,
+                               Environment const& parent, bool msys_paths) {
+  // Every format sets whole values.
+  auto delta = resolve_path_lists(edits, parent);
+  switch (format) {
+    case EnvFormat::kCmd:
+      return format_cmd(delta);
+    case EnvFormat::kPowerShell:
+      return format_powershell(delta);
+    case EnvFormat::kSh:
+      return format_sh(delta, parent, msys_paths);
+    case EnvFormat::kJson:
+      return format_json(delta);
+    case EnvFormat::kCMake:
+      return format_cmake(delta);
+    case EnvFormat::kCMakePreset:
+      return format_cmake_preset(delta);
+    case EnvFormat::kNinja:
+      return format_ninja(delta, parent);
+  }
+  return {};
+}
+
+std::wstring to_msys_path(std::wstring_view path) {
+  std::wstring out;
+  if (path.size() >= 2 && path[1] == L':' &&
+      ((path[0] >= L'a' && path[0] <= L'z') ||
+       (path[0] >= L'A' && path[0] <= L'Z'))) {
+    out = L"/";
+    out += ascii_tolower(path[0]);
+    path.remove_prefix(2);
+  }
+  for (auto c : path) {
+    out += c == L'\\' ? L'/' : c;
+  }
+  if (out.size() > 1 && out.back() == L'/') {
+    out.pop_back();
+  }
+  return out;
+}
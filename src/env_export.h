@@ -0,0 +1,44 @@
+#ifndef ENV_EXPORT_H_
+#define ENV_EXPORT_H_
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "env_cache.h"
+
+// The ways `vsrun --print-env=<format>` can write a dev environment.
+enum class EnvFormat {
+  // `set "NAME=VALUE"` lines for `call env.bat`.
+  kCmd,
+  // Set-Item lines for `. env.ps1`.
+  kPowerShell,
+  // `export NAME='VALUE'` lines for `. env.sh`.
+  kSh,
+  // {"set": {...}, "unset": [...]}.
+  kJson,
+  // set(ENV{...}) lines for a CMake toolchain file.
+  kCMake,
+  // The "environment" member of a CMakePresets.json configure preset.
+  kCMakePreset,
+  // The complete environment block `ninja -t msvc -e <file>` reads.
+  kNinja,
+};
+
+// Accepts cmd, powershell (or ps1), sh, json, cmake, cmake-preset and ninja.
+std::optional<EnvFormat> parse_env_format(std::string_view name);
+
+// Writes what `delta` changes on top of `parent` in `format`, as UTF-8.
+// With `msys_paths`, the sh format turns the PATH entries VsDevCmd.bat
+// added into MSYS paths (C:\VS\bin becomes /c/VS/bin) and puts them in
+// front of the shell's own $PATH, since an MSYS shell keeps a PATH of its
+// own; every other variable keeps its Windows form for the tools that read
+// it.
+std::string format_environment(EnvFormat format, EnvDelta const& delta,
+                               Environment const& parent,
+                               bool msys_paths = false);
+
+// C:\dir becomes /c/dir, \\server\share becomes //server/share.
+std::wstring to_msys_path(std::wstring_view path);
+
+#endif  // ENV_EXPORT_H_
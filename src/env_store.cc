@@ -0,0 +1,235 @@
+#include "env_store.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "ascii.h"
+#include "path_list.h"
+
+namespace {
+
+constexpr size_t kMinSlots = 64;
+
+uint32_t fold_hash(std::wstring_view name) {
+  uint32_t hash = 0x811c9dc5u;
+  for (auto c : name) {
+    hash ^= static_cast<uint32_t>(ascii_tolower(c));
+    hash *= 0x01000193u;
+  }
+  return hash;
+}
+
+// The order of CreateProcess blocks: by name, ignoring case, where Windows
+// compares upper-cased names (so '_' sorts after the letters).
+bool block_order(std::wstring_view a, std::wstring_view b) {
+  return std::lexicographical_compare(
+      a.begin(), a.end(), b.begin(), b.end(), [](wchar_t x, wchar_t y) {
+        return ascii_toupper(x) < ascii_toupper(y);
+      });
+}
+
+}  // namespace
+
+EnvBlock::EnvBlock()
+    // An empty block still needs both terminators.
+    : block_(std::make_shared<std::wstring const>(2, L'\0')), size_(0) {}
+
+EnvStore::EnvStore(Environment const& env) {
+  for (auto const& [name, value] : env) {
+    set(name, value);
+  }
+}
+
+size_t EnvStore::find_slot(std::wstring_view name, uint32_t hash) const {
+  auto mask = slots_.size() - 1;
+  for (auto slot = hash & mask;; slot = (slot + 1) & mask) {
+    auto index = slots_[slot];
+    if (index == 0) {
+      return slot;
+    }
+    auto const& entry = entries_[index - 1];
+    if (entry.hash_ == hash && ascii_iequals(this->name(entry), name)) {
+      return slot;
+    }
+  }
+}
+
+std::optional<std::wstring_view> EnvStore::get(std::wstring_view name) const {
+  if (slots_.empty()) {
+    return std::nullopt;
+  }
+  auto index = slots_[find_slot(name, fold_hash(name))];
+  if (index == 0) {
+    return std::nullopt;
+  }
+  return value(entries_[index - 1]);
+}
+
+void EnvStore::set(std::wstring_view name, std::wstring_view value) {
+  auto hash = fold_hash(name);
+  if (slots_.empty()) {
+    grow();
+  }
+  auto slot = find_slot(name, hash);
+  if (auto index = slots_[slot]; index != 0) {
+    auto& entry = entries_[index - 1];
+    if (value.size() <= entry.value_size_) {
+      // Shrinking in place; `value` may overlap the old one.
+      auto* text = arena_.data() + entry.offset_ + entry.name_size_ + 1;
+      std::wstring::traits_type::move(text, value.data(), value.size());
+      text[value.size()] = L'\0';
+      stale_ += entry.value_size_ - value.size();
+      entry.value_size_ = static_cast<uint32_t>(value.size());
+    } else {
+      stale_ += entry.text_size();
+      append_text(entry, this->name(entry), value);
+    }
+  } else {
+    if ((entries_.size() + 1) * 2 > slots_.size()) {
+      grow();
+      slot = find_slot(name, hash);
+    }
+    Entry entry{0, 0, 0, hash};
+    append_text(entry, name, value);
+    entries_.push_back(entry);
+    slots_[slot] = static_cast<uint32_t>(entries_.size());
+  }
+  if (stale_ > arena_.size() / 2) {
+    compact();
+  }
+}
+
+bool EnvStore::erase(std::wstring_view name) {
+  if (slots_.empty()) {
+    return false;
+  }
+  auto slot = find_slot(name, fold_hash(name));
+  auto index = slots_[slot];
+  if (index == 0) {
+    return false;
+  }
+  stale_ += entries_[index - 1].text_size();
+
+  // Backward-shift deletion: pull later entries of the probe run into the
+  // hole unless that would put them before their home slot.
+  auto mask = slots_.size() - 1;
+  auto hole = slot;
+  for (auto next = (hole + 1) & mask; slots_[next] != 0;
+       next = (next + 1) & mask) {
+    auto home = entries_[slots_[next] - 1].hash_ & mask;
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      slots_[hole] = slots_[next];
+      hole = next;
+    }
+  }
+  slots_[hole] = 0;
+
+  // Keeps entries_ dense by moving the last entry into the gap.
+  auto last = static_cast<uint32_t>(entries_.size());
+  if (index != last) {
+    auto moved = entries_.back().hash_ & mask;
+    while (slots_[moved] != last) {
+      moved = (moved + 1) & mask;
+    }
+    slots_[moved] = index;
+    entries_[index - 1] = entries_.back();
+  }
+  entries_.pop_back();
+  if (stale_ > arena_.size() / 2) {
+    compact();
+  }
+  return true;
+}
+
+void EnvStore::apply(EnvDelta const& delta) {
+  for (auto const& name : delta.unset_) {
+    erase(name);
+  }
+  for (auto const& [name, value] : delta.set_) {
+    set(name, value);
+  }
+  for (auto const& [name, edit] : delta.lists_) {
+    set(name, merge_path_list(get(name).value_or(std::wstring_view{}), edit));
+  }
+}
+
+EnvBlock EnvStore::block() const {
+  if (entries_.empty()) {
+    return EnvBlock();
+  }
+  std::vector<uint32_t> order(entries_.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+    return block_order(name(entries_[a]), name(entries_[b]));
+  });
+  size_t size = 1;
+  for (auto const& entry : entries_) {
+    size += entry.text_size();
+  }
+  auto block = std::make_shared<std::wstring>();
+  block->reserve(size);
+  for (auto index : order) {
+    auto const& entry = entries_[index];
+    block->append(arena_, entry.offset_, entry.text_size());
+  }
+  *block += L'\0';
+  return EnvBlock(std::move(block), entries_.size());
+}
+
+Environment EnvStore::to_environment() const {
+  Environment env;
+  for (auto const& entry : entries_) {
+    env.emplace(name(entry), value(entry));
+  }
+  return env;
+}
+
+void EnvStore::append_text(Entry& entry, std::wstring_view name,
+                           std::wstring_view value) {
+  // `name` and `value` may point into arena_, so it must not reallocate
+  // under them.
+  auto size = name.size() + value.size() + 2;
+  auto offset = arena_.size();
+  if (arena_.capacity() - arena_.size() < size) {
+    std::wstring grown;
+    grown.reserve(std::max(arena_.capacity() * 2, arena_.size() + size));
+    grown += arena_;
+    grown += name;
+    grown += L'=';
+    grown += value;
+    grown += L'\0';
+    arena_.swap(grown);
+  } else {
+    arena_ += name;
+    arena_ += L'=';
+    arena_ += value;
+    arena_ += L'\0';
+  }
+  entry.offset_ = static_cast<uint32_t>(offset);
+  entry.name_size_ = static_cast<uint32_t>(name.size());
+  entry.value_size_ = static_cast<uint32_t>(value.size());
+}
+
+void EnvStore::grow() {
+  slots_.assign(std::max(slots_.size() * 2, kMinSlots), 0);
+  auto mask = slots_.size() - 1;
+  for (uint32_t i = 0; i < entries_.size(); ++i) {
+    auto slot = entries_[i].hash_ & mask;
+    while (slots_[slot] != 0) {
+      slot = (slot + 1) & mask;
+    }
+    slots_[slot] = i + 1;
+  }
+}
+
+void EnvStore::compact() {
+  std::wstring arena;
+  arena.reserve(arena_.size() - stale_);
+  for (auto& entry : entries_) {
+    auto offset = arena.size();
+    arena.append(arena_, entry.offset_, entry.text_size());
+    entry.offset_ = static_cast<uint32_t>(offset);
+  }
+  arena_.swap(arena);
+  stale_ = 0;
+}
@@ -0,0 +1,103 @@
+#ifndef ENV_STORE_H_
+#define ENV_STORE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "env_cache.h"
+
+// A finished environment block in the form CreateProcessW takes with
+// CREATE_UNICODE_ENVIRONMENT: "NAME=VALUE\0" per variable, sorted by name
+// the way Windows sorts them, and one more '\0'. Copies share the block, so
+// one can be handed to every command of a batch.
+class EnvBlock {
+ public:
+  // The empty environment.
+  EnvBlock();
+
+  // The whole block, terminators included.
+  std::wstring_view data() const { return *block_; }
+  // The number of variables.
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  friend class EnvStore;
+  EnvBlock(std::shared_ptr<std::wstring const> block, size_t size)
+      : block_(std::move(block)), size_(size) {}
+
+  std::shared_ptr<std::wstring const> block_;
+  size_t size_;
+};
+
+// An environment as Windows treats it: names compare ASCII
+// case-insensitively, so `Path` and `PATH` are one variable, which keeps the
+// spelling it was first set with.
+//
+// The variables live in one string in block form ("NAME=VALUE\0"), indexed
+// by an open-addressing table of case-folded name hashes. Lookups and
+// updates do not allocate per variable, and block() only has to sort and
+// copy.
+class EnvStore {
+ public:
+  EnvStore() = default;
+  // Where names in `env` differ only in case, the value of the last one is
+  // kept under the spelling of the first.
+  explicit EnvStore(Environment const& env);
+
+  size_t size() const { return entries_.size(); }
+  bool empty() const { return entries_.empty(); }
+
+  // The view stays valid until the store is next changed.
+  std::optional<std::wstring_view> get(std::wstring_view name) const;
+  void set(std::wstring_view name, std::wstring_view value);
+  // Returns false when there was no such variable.
+  bool erase(std::wstring_view name);
+
+  // apply_environment, with names compared as Windows does.
+  void apply(EnvDelta const& delta);
+
+  EnvBlock block() const;
+  Environment to_environment() const;
+
+ private:
+  struct Entry {
+    uint32_t offset_;
+    uint32_t name_size_;
+    uint32_t value_size_;
+    uint32_t hash_;
+
+    uint32_t text_size() const { return name_size_ + value_size_ + 2; }
+  };
+
+  std::wstring_view name(Entry const& entry) const {
+    return std::wstring_view(arena_).substr(entry.offset_, entry.name_size_);
+  }
+  std::wstring_view value(Entry const& entry) const {
+    return std::wstring_view(arena_).substr(
+        entry.offset_ + entry.name_size_ + 1, entry.value_size_);
+  }
+
+  // The slot that holds `name`, or the empty slot where it would go.
+  size_t find_slot(std::wstring_view name, uint32_t hash) const;
+  void append_text(Entry& entry, std::wstring_view name,
+                   std::wstring_view value);
+  void grow();
+  void compact();
+
+  // "NAME=VALUE\0" texts, some of them stale after set() and erase().
+  std::wstring arena_;
+  size_t stale_ = 0;
+  // Dense, in no particular order.
+  std::vector<Entry> entries_;
+  // Index + 1 into entries_, 0 for an empty slot. A power of two in size,
+  // at most half full, probed linearly.
+  std::vector<uint32_t> slots_;
+};
+
+#endif  // ENV_STORE_H_
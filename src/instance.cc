@@ -0,0 +1,41 @@
+#include "instance.h"
+
+#include "ascii.h"
+
+bool VisualStudio::is_product_match(std::wstring const& product_pattern) const {
+  if (product_pattern == L"*") {
+    return true;
+  }
+  auto product = find_product(product_pattern);
+  if (product != Product::kUnknown && product_ != Product::kUnknown) {
+    return product == product_;
+  }
+  // The pattern may leave out the prefix.
+  std::wstring_view id = product_id_;
+  if (!ascii_iequals(std::wstring_view(product_pattern)
+                         .substr(0, kProductPrefix.size()),
+                     kProductPrefix)) {
+    if (!ascii_iequals(id.substr(0, kProductPrefix.size()), kProductPrefix)) {
+      return false;
+    }
+    id.remove_prefix(kProductPrefix.size());
+  }
+  return ascii_iequals(product_pattern, id);
+}
+bool VisualStudio::is_workload_match(
+    std::wstring const& workload_pattern) const {
+  return is_workload_match(resolve_workload(workload_pattern));
+}
+bool VisualStudio::is_workload_match(
+    std::optional<InternedId> workload) const {
+  return workload ? workloads_.contains(*workload) : !workloads_.empty();
+}
+std::optional<InternedId> resolve_workload(std::wstring_view pattern) {
+  if (pattern == L"*") {
+    return std::nullopt;
+  }
+  return Interner::global().intern(pattern);
+}
+bool VisualStudio::is_version_match(uint64_t min, uint64_t max) const {
+  return version_ >= min && version_ <= max;
+}
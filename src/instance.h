@@ -0,0 +1,63 @@
+#ifndef INSTANCE_H_
+#define INSTANCE_H_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+// Same layout as the Win32 FILETIME: 100ns ticks since 1601-01-01 UTC.
+struct FILETIME {
+  uint32_t dwLowDateTime;
+  uint32_t dwHighDateTime;
+};
+#endif
+
+#include "interner.h"
+#include "package_index.h"
+#include "product.h"
+
+struct VisualStudio {
+  uint64_t version_;
+  FILETIME install_datetime_;
+  std::wstring install_version_;
+  std::wstring install_path_;
+  std::wstring display_name_;
+  std::wstring product_id_;
+  // find_product(product_id_), resolved once where product_id_ is read.
+  // Left kUnknown, matching and sorting fall back to product_id_.
+  Product product_ = Product::kUnknown;
+  bool is_complete_;
+  bool is_prerelease_;
+  IdSet workloads_;
+  // Every installed package, workloads included.
+  PackageIndex packages_;
+  bool is_complete() const { return is_complete_; }
+  bool is_prerelease() const { return is_prerelease_; }
+  bool is_product_match(std::wstring const& product_pattern) const;
+  bool is_workload_match(std::wstring const& workload_pattern) const;
+  // Same as above for a pattern resolved once with resolve_workload().
+  bool is_workload_match(std::optional<InternedId> workload) const;
+  bool is_version_match(uint64_t min, uint64_t max) const;
+};
+
+// "*" resolves to std::nullopt, which matches any instance with workloads.
+// Workloads no instance has are interned too, and match none.
+std::optional<InternedId> resolve_workload(std::wstring_view pattern);
+
+inline uint64_t to_uint64(FILETIME const& ft) {
+  return (uint64_t{ft.dwHighDateTime} << 32) | ft.dwLowDateTime;
+}
+inline FILETIME to_filetime(uint64_t ticks) {
+  FILETIME ft;
+  ft.dwLowDateTime = static_cast<uint32_t>(ticks);
+  ft.dwHighDateTime = static_cast<uint32_t>(ticks >> 32);
+  return ft;
+}
+
+#endif  // INSTANCE_H_
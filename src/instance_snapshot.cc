@@ -0,0 +1,534 @@
+#include "instance_snapshot.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "env_cache.h"
+#include "trace.h"
+#include "unicode.h"
+
+static_assert(std::endian::native == std::endian::little,
+              "the snapshot is mapped in place and stored little-endian");
+static_assert(sizeof(snapshot::Header) == 40);
+static_assert(sizeof(snapshot::Record) == 72);
+static_assert(sizeof(snapshot::String) == 8);
+
+struct InstanceSnapshot::Mapping {
+  void const* data = nullptr;
+  size_t size = 0;
+#if defined(_WIN32)
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE map = nullptr;
+
+  ~Mapping() {
+    if (data) {
+      ::UnmapViewOfFile(data);
+    }
+    if (map) {
+      ::CloseHandle(map);
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+      ::CloseHandle(file);
+    }
+  }
+
+  bool open(std::filesystem::path const& path) {
+    file = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER file_size;
+    if (file == INVALID_HANDLE_VALUE || !::GetFileSizeEx(file, &file_size) ||
+        file_size.QuadPart == 0) {
+      return false;
+    }
+    map = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!map) {
+      return false;
+    }
+    data = ::MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+    size = static_cast<size_t>(file_size.QuadPart);
+    return data != nullptr;
+  }
+#else
+  ~Mapping() {
+    if (data) {
+      ::munmap(const_cast<void*>(data), size);
+    }
+  }
+
+  bool open(std::filesystem::path const& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      return false;
+    }
+    void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                     MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      return false;
+    }
+    data = p;
+    size = static_cast<size_t>(st.st_size);
+    return true;
+  }
+#endif
+};
+
+namespace {
+
+class StringPool {
+ public:
+  snapshot::String add(std::wstring_view str) {
+    auto utf16 = to_utf16(str);
+    auto size = static_cast<uint32_t>(utf16.size());
+    if (auto it = offsets_.find(utf16); it != offsets_.end()) {
+      return {it->second, size};
+    }
+    auto offset = static_cast<uint32_t>(units_.size());
+    units_ += utf16;
+    offsets_.emplace(std::move(utf16), offset);
+    return {offset, size};
+  }
+  std::u16string const& units() const { return units_; }
+
+ private:
+  std::u16string units_;
+  std::map<std::u16string, uint32_t> offsets_;
+};
+
+template <typename T>
+void append_pod(std::string& out, T const& value) {
+  out.append(reinterpret_cast<char const*>(&value), sizeof(value));
+}
+
+bool in_pool(snapshot::String s, uint32_t units) {
+  return s.offset <= units && s.size <= units - s.offset;
+}
+
+}  // namespace
+
+std::string serialize_instance_snapshot(
+    std::vector<VisualStudio> const& instances, uint64_t fingerprint,
+    InstanceBackend backend) {
+  StringPool pool;
+  std::vector<snapshot::Record> records;
+  std::vector<snapshot::String> ids;
+  records.reserve(instances.size());
+  for (auto const& vs : instances) {
+    snapshot::Record r{};
+    r.version = vs.version_;
+    r.install_datetime = to_uint64(vs.install_datetime_);
+    r.install_version = pool.add(vs.install_version_);
+    r.install_path = pool.add(vs.install_path_);
+    r.display_name = pool.add(vs.display_name_);
+    r.product_id = pool.add(vs.product_id_);
+    r.workloads_first = static_cast<uint32_t>(ids.size());
+    r.workloads_count = static_cast<uint32_t>(vs.workloads_.size());
+    for (auto const& workload : vs.workloads_.names()) {
+      ids.push_back(pool.add(workload));
+    }
+    r.packages_first = static_cast<uint32_t>(ids.size());
+    r.packages_count = static_cast<uint32_t>(vs.packages_.size());
+    for (auto const& package : vs.packages_.names()) {
+      ids.push_back(pool.add(package));
+    }
+    r.flags = (vs.is_complete_ ? snapshot::kComplete : 0) |
+              (vs.is_prerelease_ ? snapshot::kPrerelease : 0);
+    records.push_back(r);
+  }
+
+  snapshot::Header header{};
+  std::memcpy(header.magic, snapshot::kMagic, sizeof(header.magic));
+  header.format_version = snapshot::kFormatVersion;
+  header.record_count = static_cast<uint32_t>(records.size());
+  header.fingerprint = fingerprint;
+  header.id_count = static_cast<uint32_t>(ids.size());
+  header.string_units = static_cast<uint32_t>(pool.units().size());
+  header.backend = static_cast<uint32_t>(backend);
+
+  std::string out;
+  out.reserve(sizeof(header) + records.size() * sizeof(snapshot::Record) +
+              ids.size() * sizeof(snapshot::String) +
+              pool.units().size() * sizeof(char16_t));
+  append_pod(out, header);
+  for (auto const& r : records) {
+    append_pod(out, r);
+  }
+  for (auto const& id : ids) {
+    append_pod(out, id);
+  }
+  out.append(reinterpret_cast<char const*>(pool.units().data()),
+             pool.units().size() * sizeof(char16_t));
+  return out;
+}
+
+bool write_instance_snapshot(std::filesystem::path const& path,
+                             std::vector<VisualStudio> const& instances,
+                             uint64_t fingerprint, InstanceBackend backend) {
+  std::error_code ec;
+  std::filesystem::create_directories(path.parent_path(), ec);
+  auto tmp = path;
+  tmp += ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      return false;
+    }
+    out << serialize_instance_snapshot(instances, fingerprint, backend);
+    if (!out.flush()) {
+      return false;
+    }
+  }
+  std::filesystem::rename(tmp, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp, ec);
+    return false;
+  }
+  return true;
+}
+
+std::optional<InstanceSnapshot> InstanceSnapshot::open(
+    std::filesystem::path const& path) {
+  auto mapping = std::make_shared<Mapping>();
+  if (!mapping->open(path) || mapping->size < sizeof(snapshot::Header)) {
+    return std::nullopt;
+  }
+  auto const* base = static_cast<char const*>(mapping->data);
+  auto const* header = reinterpret_cast<snapshot::Header const*>(base);
+  if (std::memcmp(header->magic, snapshot::kMagic, sizeof(header->magic)) !=
+          0 ||
+      header->format_version != snapshot::kFormatVersion) {
+    return std::nullopt;
+  }
+
+  uint64_t records_size =
+      uint64_t{header->record_count} * sizeof(snapshot::Record);
+  uint64_t ids_size = uint64_t{header->id_count} * sizeof(snapshot::String);
+  uint64_t strings_size = uint64_t{header->string_units} * sizeof(char16_t);
+  if (sizeof(snapshot::Header) + records_size + ids_size + strings_size !=
+      mapping->size) {
+    return std::nullopt;
+  }
+
+  InstanceSnapshot snap;
+  snap.header_ = header;
+  snap.records_ = reinterpret_cast<snapshot::Record const*>(
+      base + sizeof(snapshot::Header));
+  snap.ids_ = reinterpret_cast<snapshot::String const*>(
+      base + sizeof(snapshot::Header) + records_size);
+  snap.strings_ = reinterpret_cast<char16_t const*>(
+      base + sizeof(snapshot::Header) + records_size + ids_size);
+
+  // Validate once here so that accessors can stay unchecked.
+  auto units = header->string_units;
+  auto in_ids = [&header](uint32_t first, uint32_t count) {
+    return first <= header->id_count && count <= header->id_count - first;
+  };
+  for (uint32_t i = 0; i < header->id_count; ++i) {
+    if (!in_pool(snap.ids_[i], units)) {
+      return std::nullopt;
+    }
+  }
+  for (uint32_t i = 0; i < header->record_count; ++i) {
+    auto const& r = snap.records_[i];
+    if (!in_pool(r.install_version, units) || !in_pool(r.install_path, units) ||
+        !in_pool(r.display_name, units) || !in_pool(r.product_id, units) ||
+        !in_ids(r.workloads_first, r.workloads_count) ||
+        !in_ids(r.packages_first, r.packages_count)) {
+      return std::nullopt;
+    }
+  }
+  snap.mapping_ = std::move(mapping);
+  return snap;
+}
+
+VisualStudio InstanceSnapshot::load(size_t i) const {
+  auto const& r = records_[i];
+  VisualStudio vs{
+      .version_ = r.version,
+      .install_datetime_ = to_filetime(r.install_datetime),
+      .install_version_ = from_utf16(string(r.install_version)),
+      .install_path_ = from_utf16(string(r.install_path)),
+      .display_name_ = from_utf16(string(r.display_name)),
+      .product_id_ = from_utf16(string(r.product_id)),
+      .is_complete_ = (r.flags & snapshot::kComplete) != 0,
+      .is_prerelease_ = (r.flags & snapshot::kPrerelease) != 0,
+      .workloads_ = {},
+      .packages_ = {}};
+  vs.product_ = find_product(vs.product_id_);
+  for (uint32_t w = 0; w < r.workloads_count; ++w) {
+    vs.workloads_.insert(
+        Interner::global().intern(from_utf16(workload(r, w))));
+  }
+  std::vector<InternedId> packages;
+  packages.reserve(r.packages_count);
+  for (uint32_t p = 0; p < r.packages_count; ++p) {
+    packages.push_back(Interner::global().intern(from_utf16(package(r, p))));
+  }
+  vs.packages_ = PackageIndex::from_ids(std::move(packages));
+  return vs;
+}
+
+namespace {
+
+class SnapshotInstance : public SourceInstance {
+ public:
+  SnapshotInstance(InstanceSnapshot const& snapshot,
+                   SnapshotInstanceSource& source, size_t i)
+      : snapshot_(snapshot), source_(source), record_(snapshot.record(i)) {}
+
+  bool is_complete() override {
+    return (record_.flags & snapshot::kComplete) != 0;
+  }
+  std::optional<std::pair<std::wstring, uint64_t>> version() override {
+    return std::pair{from_utf16(snapshot_.string(record_.install_version)),
+                     record_.version};
+  }
+  std::optional<std::wstring> product_id() override {
+    return from_utf16(snapshot_.string(record_.product_id));
+  }
+  std::optional<InstancePackages> packages(bool index_all) override {
+    InstancePackages packages;
+    for (uint32_t w = 0; w < record_.workloads_count; ++w) {
+      packages.workloads_.insert(
+          source_.intern(snapshot_.id(record_.workloads_first + w)));
+    }
+    if (index_all) {
+      std::vector<InternedId> ids;
+      ids.reserve(record_.packages_count);
+      for (uint32_t p = 0; p < record_.packages_count; ++p) {
+        ids.push_back(
+            source_.intern(snapshot_.id(record_.packages_first + p)));
+      }
+      packages.index_ = PackageIndex::from_ids(std::move(ids));
+    }
+    return packages;
+  }
+  bool details(VisualStudio& vs) override {
+    vs.install_path_ = from_utf16(snapshot_.string(record_.install_path));
+    vs.display_name_ = from_utf16(snapshot_.string(record_.display_name));
+    vs.install_datetime_ = to_filetime(record_.install_datetime);
+    vs.is_prerelease_ = (record_.flags & snapshot::kPrerelease) != 0;
+    return true;
+  }
+
+ private:
+  InstanceSnapshot const& snapshot_;
+  SnapshotInstanceSource& source_;
+  snapshot::Record const& record_;
+};
+
+}  // namespace
+
+std::unique_ptr<SourceInstance> SnapshotInstanceSource::next() {
+  if (next_ >= snapshot_.size()) {
+    return nullptr;
+  }
+  return std::make_unique<SnapshotInstance>(snapshot_, *this, next_++);
+}
+
+InternedId SnapshotInstanceSource::intern(snapshot::String id) {
+  std::lock_guard lock(interned_mutex_);
+  auto [it, inserted] = interned_.try_emplace(id.offset);
+  if (inserted) {
+    it->second = Interner::global().intern(from_utf16(snapshot_.string(id)));
+  }
+  return it->second;
+}
+
+std::vector<VisualStudio> InstanceSnapshot::load() const {
+  std::vector<VisualStudio> all;
+  all.reserve(size());
+  for (size_t i = 0; i < size(); ++i) {
+    all.push_back(load(i));
+  }
+  return all;
+}
+
+std::optional<uint64_t> instances_fingerprint(
+    std::filesystem::path const& instances_dir) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  auto mix = [&hash](void const* data, size_t size) {
+    auto const* bytes = static_cast<unsigned char const*>(data);
+    for (size_t i = 0; i < size; ++i) {
+      hash ^= bytes[i];
+      hash *= 0x100000001b3ULL;
+    }
+  };
+
+  std::error_code ec;
+  auto dir_time = std::filesystem::last_write_time(instances_dir, ec);
+  if (ec) {
+    return std::nullopt;
+  }
+  auto ticks = dir_time.time_since_epoch().count();
+  mix(&ticks, sizeof(ticks));
+
+  std::vector<std::filesystem::path> states;
+  for (auto it = std::filesystem::directory_iterator(instances_dir, ec);
+       !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+    states.push_back(it->path() / "state.json");
+  }
+  if (ec) {
+    return std::nullopt;
+  }
+  std::sort(states.begin(), states.end());
+  for (auto const& state : states) {
+    auto name = state.parent_path().filename().u8string();
+    mix(name.data(), name.size());
+    auto time = std::filesystem::last_write_time(state, ec);
+    ticks = ec ? 0 : time.time_since_epoch().count();
+    mix(&ticks, sizeof(ticks));
+    auto size = std::filesystem::file_size(state, ec);
+    size = ec ? 0 : size;
+    mix(&size, sizeof(size));
+  }
+  return hash;
+}
+
+std::filesystem::path default_instances_dir() {
+#if defined(_WIN32)
+  if (auto const* program_data = _wgetenv(L"ProgramData");
+      program_data && *program_data) {
+    return std::filesystem::path(program_data) / "Microsoft" / "VisualStudio" /
+           "Packages" / "_Instances";
+  }
+  return L"C:\\ProgramData\\Microsoft\\VisualStudio\\Packages\\_Instances";
+#else
+  return {};
+#endif
+}
+
+std::filesystem::path default_snapshot_path() {
+  return default_cache_dir() / "instances.snapshot";
+}
+
+namespace {
+
+// At most one refresh runs at a time; lookups that find the snapshot stale
+// meanwhile leave it to that one.
+class SnapshotRefresh {
+ public:
+  ~SnapshotRefresh() { wait(); }
+
+  void start(std::function<void()> refresh) {
+    std::lock_guard lock(mutex_);
+    if (running_) {
+      return;
+    }
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    running_ = true;
+    thread_ = std::thread([this, refresh = std::move(refresh)]() {
+      refresh();
+      running_ = false;
+    });
+  }
+
+  void wait() {
+    std::lock_guard lock(mutex_);
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::atomic<bool> running_{false};
+  std::thread thread_;
+};
+
+SnapshotRefresh& snapshot_refresh() {
+  static SnapshotRefresh refresh;
+  return refresh;
+}
+
+void refresh_in_background(
+    std::filesystem::path const& snapshot_path, uint64_t fingerprint,
+    InstanceBackend backend,
+    std::function<std::vector<VisualStudio>(InstanceBackend&)> enumerate) {
+  snapshot_refresh().start([snapshot_path, fingerprint, backend,
+                            enumerate = std::move(enumerate)]() {
+    TraceSpan span("refresh instance snapshot");
+    try {
+      auto produced = backend;
+      auto all = enumerate(produced);
+      write_instance_snapshot(snapshot_path, all, fingerprint, produced);
+    } catch (std::exception const&) {
+      // The snapshot stays stale and the next lookup tries again.
+    }
+  });
+}
+
+}  // namespace
+
+void wait_for_snapshot_refresh() { snapshot_refresh().wait(); }
+
+std::vector<VisualStudio> load_or_enumerate_instances(
+    std::filesystem::path const& snapshot_path,
+    std::filesystem::path const& instances_dir, InstanceBackend backend,
+    InstanceLookup const& lookup) {
+  std::optional<uint64_t> fingerprint;
+  {
+    TraceSpan span("fingerprint instances");
+    fingerprint = instances_fingerprint(instances_dir);
+  }
+  if (fingerprint) {
+    std::optional<InstanceSnapshot> snap;
+    {
+      TraceSpan span("open instance snapshot");
+      snap = InstanceSnapshot::open(snapshot_path);
+    }
+    if (snap && snap->fingerprint() == *fingerprint &&
+        snap->backend() == backend) {
+      TraceSpan span("match instance snapshot");
+      SnapshotInstanceSource source(std::move(*snap));
+      return lookup.match_(source);
+    }
+  }
+  if (lookup.search_) {
+    std::vector<VisualStudio> found;
+    {
+      TraceSpan span("search instances");
+      found = lookup.search_();
+    }
+    if (fingerprint) {
+      refresh_in_background(snapshot_path, *fingerprint, backend,
+                            lookup.enumerate_);
+    }
+    return found;
+  }
+  auto produced = backend;
+  auto all = lookup.enumerate_(produced);
+  if (fingerprint) {
+    TraceSpan span("write instance snapshot");
+    write_instance_snapshot(snapshot_path, all, *fingerprint, produced);
+  }
+  VectorInstanceSource source(std::move(all));
+  return lookup.match_(source);
+}
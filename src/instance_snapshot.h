@@ -0,0 +1,185 @@
+#ifndef INSTANCE_SNAPSHOT_H_
+#define INSTANCE_SNAPSHOT_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "instance.h"
+#include "instance_source.h"
+
+// A versioned binary copy of the enumerated instances, read in place through
+// a memory mapping. All integers are little-endian; strings are UTF-16 and
+// live in one pool that records point into by offset.
+//
+//   SnapshotHeader
+//   SnapshotRecord[record_count]
+//   SnapshotString[id_count]   workload and package IDs, referenced by records
+//   char16_t[string_units]     string pool
+//
+// Package IDs are stored folded and sorted.
+namespace snapshot {
+
+constexpr char kMagic[8] = {'V', 'S', 'R', 'U', 'N', 'S', 'N', 'P'};
+constexpr uint32_t kFormatVersion = 3;
+
+struct String {
+  uint32_t offset;  // in char16_t units from the start of the pool
+  uint32_t size;
+};
+
+struct Header {
+  char magic[8];
+  uint32_t format_version;
+  uint32_t record_count;
+  uint64_t fingerprint;
+  uint32_t id_count;
+  uint32_t string_units;
+  // The InstanceBackend that produced the records. The backends disagree on
+  // some fields, e.g. state.json has no isComplete, so a snapshot only
+  // serves the backend that wrote it.
+  uint32_t backend;
+  uint32_t reserved;
+};
+
+struct Record {
+  uint64_t version;
+  uint64_t install_datetime;
+  String install_version;
+  String install_path;
+  String display_name;
+  String product_id;
+  uint32_t workloads_first;
+  uint32_t workloads_count;
+  uint32_t packages_first;
+  uint32_t packages_count;
+  uint32_t flags;
+  uint32_t reserved;
+};
+
+constexpr uint32_t kComplete = 1u << 0;
+constexpr uint32_t kPrerelease = 1u << 1;
+
+}  // namespace snapshot
+
+std::string serialize_instance_snapshot(
+    std::vector<VisualStudio> const& instances, uint64_t fingerprint,
+    InstanceBackend backend);
+bool write_instance_snapshot(std::filesystem::path const& path,
+                             std::vector<VisualStudio> const& instances,
+                             uint64_t fingerprint, InstanceBackend backend);
+
+class InstanceSnapshot {
+ public:
+  // Maps `path` and checks that every offset stays inside the file. Returns
+  // std::nullopt for missing, truncated or foreign files.
+  static std::optional<InstanceSnapshot> open(
+      std::filesystem::path const& path);
+
+  uint64_t fingerprint() const { return header_->fingerprint; }
+  InstanceBackend backend() const {
+    return static_cast<InstanceBackend>(header_->backend);
+  }
+  size_t size() const { return header_->record_count; }
+
+  snapshot::Record const& record(size_t i) const { return records_[i]; }
+  std::u16string_view string(snapshot::String s) const {
+    return {strings_ + s.offset, s.size};
+  }
+  snapshot::String id(size_t i) const { return ids_[i]; }
+  std::u16string_view workload(snapshot::Record const& r, size_t i) const {
+    return string(ids_[r.workloads_first + i]);
+  }
+  std::u16string_view package(snapshot::Record const& r, size_t i) const {
+    return string(ids_[r.packages_first + i]);
+  }
+
+  // Decodes every field of record `i`, or of every record. Lookups go
+  // through SnapshotInstanceSource instead, which decodes only what the
+  // matcher asks for.
+  VisualStudio load(size_t i) const;
+  std::vector<VisualStudio> load() const;
+
+ private:
+  struct Mapping;
+
+  std::shared_ptr<Mapping const> mapping_;
+  snapshot::Header const* header_ = nullptr;
+  snapshot::Record const* records_ = nullptr;
+  snapshot::String const* ids_ = nullptr;
+  char16_t const* strings_ = nullptr;
+};
+
+// Serves the records of a snapshot in place. Each SourceInstance getter
+// decodes only the fields it returns, so records rejected by version or
+// product never have their strings decoded, and package ids are only decoded
+// for the candidates left when package requirements are checked. Workload and
+// package ids are interned once per distinct string of the pool.
+class SnapshotInstanceSource : public InstanceSource {
+ public:
+  explicit SnapshotInstanceSource(InstanceSnapshot snapshot)
+      : snapshot_(std::move(snapshot)) {}
+
+  std::unique_ptr<SourceInstance> next() override;
+
+  // The interned id for the pool string `id`.
+  InternedId intern(snapshot::String id);
+
+ private:
+  InstanceSnapshot snapshot_;
+  size_t next_ = 0;
+  // Pooled collectors fetch packages on several threads.
+  std::mutex interned_mutex_;
+  std::unordered_map<uint32_t, InternedId> interned_;
+};
+
+// Cheap staleness check for a snapshot: combines the mtime of Setup's
+// `_Instances` directory with the name, mtime and size of every
+// `<id>/state.json` in it. std::nullopt when the directory is unreadable.
+std::optional<uint64_t> instances_fingerprint(
+    std::filesystem::path const& instances_dir);
+
+// %ProgramData%\Microsoft\VisualStudio\Packages\_Instances
+std::filesystem::path default_instances_dir();
+std::filesystem::path default_snapshot_path();
+
+struct InstanceLookup {
+  // Matches instances that are in memory: the snapshot's, read in place, or
+  // those enumerate_ returned.
+  std::function<std::vector<VisualStudio>(InstanceSource& source)> match_ =
+      {};
+  // Fetches every instance from the backend, for a new snapshot. Sets
+  // `backend` when another one stood in, e.g. state.json for an unregistered
+  // COM server, so that the snapshot is tagged with what produced it.
+  std::function<std::vector<VisualStudio>(InstanceBackend& backend)>
+      enumerate_ = {};
+  // Matches against the backend directly, e.g. for a caller that only needs
+  // one instance and can stop early. When set, it answers for a stale
+  // snapshot, and enumerate_ refreshes the snapshot on a background thread
+  // afterwards; enumerate_ must then own everything it uses.
+  std::function<std::vector<VisualStudio>()> search_ = {};
+};
+
+// Runs `lookup.match_` over the snapshot at `snapshot_path` while it is fresh
+// for `instances_dir` and was enumerated for `backend`. Otherwise returns
+// `lookup.search_()` and rewrites the snapshot in the background, or calls
+// `lookup.enumerate_`, rewrites the snapshot and matches the result.
+std::vector<VisualStudio> load_or_enumerate_instances(
+    std::filesystem::path const& snapshot_path,
+    std::filesystem::path const& instances_dir, InstanceBackend backend,
+    InstanceLookup const& lookup);
+
+// Waits for a background refresh started by load_or_enumerate_instances.
+// Also runs at exit, so that a short-lived process leaves the new snapshot
+// behind.
+void wait_for_snapshot_refresh();
+
+#endif  // INSTANCE_SNAPSHOT_H_
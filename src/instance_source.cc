@@ -0,0 +1,385 @@
+#include "instance_source.h"
+
+#include <future>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace {
+
+class MemoryInstance : public SourceInstance {
+ public:
+  explicit MemoryInstance(VisualStudio const& vs) : vs_(vs) {}
+
+  bool is_complete() override { return vs_.is_complete_; }
+  std::optional<std::pair<std::wstring, uint64_t>> version() override {
+    return std::pair{vs_.install_version_, vs_.version_};
+  }
+  std::optional<std::wstring> product_id() override { return vs_.product_id_; }
+  std::optional<InstancePackages> packages(bool index_all) override {
+    return InstancePackages{
+        .workloads_ = vs_.workloads_,
+        .index_ = index_all ? vs_.packages_ : PackageIndex()};
+  }
+  bool details(VisualStudio& vs) override {
+    vs.install_path_ = vs_.install_path_;
+    vs.display_name_ = vs_.display_name_;
+    vs.install_datetime_ = vs_.install_datetime_;
+    vs.is_prerelease_ = vs_.is_prerelease_;
+    return true;
+  }
+
+ private:
+  VisualStudio const& vs_;
+};
+
+VisualStudio empty_instance() {
+  return {.version_ = 0,
+          .install_datetime_ = to_filetime(0),
+          .install_version_ = {},
+          .install_path_ = {},
+          .display_name_ = {},
+          .product_id_ = {},
+          .is_complete_ = false,
+          .is_prerelease_ = false,
+          .workloads_ = {},
+          .packages_ = {}};
+}
+
+// The instance an OutputIntent selects among the matches so far. The pooled
+// tasks share it, so that each stops as soon as it cannot be selected.
+class Leader {
+ public:
+  Leader(OutputIntent intent, SortPlan const& plan)
+      : intent_(intent), plan_(plan) {
+    if (intent != OutputIntent::kExists && !plan.empty()) {
+      key_stage_ =
+          plan.needs_details() ? MatchStage::kDetails : MatchStage::kProduct;
+    }
+  }
+
+  // The last stage whose fields the sort key depends on, or std::nullopt
+  // when it depends on none.
+  std::optional<MatchStage> key_stage() const { return key_stage_; }
+
+  // Whether `vs`, the instance at `index`, could still be selected if it
+  // matches. Needs the fields up to key_stage().
+  bool can_win(VisualStudio const& vs, size_t index) const {
+    std::lock_guard lock(mutex_);
+    return beats(vs, index);
+  }
+
+  void offer(VisualStudio const& vs, size_t index) {
+    std::lock_guard lock(mutex_);
+    if (beats(vs, index)) {
+      best_ = std::pair{plan_.key(vs), index};
+    }
+  }
+
+  // Whether no instance after those seen so far could be selected.
+  bool exhausted() const {
+    std::lock_guard lock(mutex_);
+    return best_ && !key_stage_ && intent_ != OutputIntent::kLast;
+  }
+
+ private:
+  bool beats(VisualStudio const& vs, size_t index) const {
+    if (!best_) {
+      return true;
+    }
+    if (intent_ == OutputIntent::kExists) {
+      return false;
+    }
+    // Ties go to the earlier instance first and to the later one last.
+    std::pair candidate{plan_.key(vs), index};
+    return intent_ == OutputIntent::kLast ? *best_ < candidate
+                                          : candidate < *best_;
+  }
+
+  OutputIntent intent_;
+  SortPlan const& plan_;
+  std::optional<MatchStage> key_stage_;
+  mutable std::mutex mutex_;
+  std::optional<std::pair<SortPlan::Key, size_t>> best_;
+};
+
+// Runs the staged match on `instance`, the one at `index`. Returns the stage
+// that rejected it, or std::nullopt when `vs` holds a complete match. With a
+// `leader`, instances that can no longer be selected are dropped as soon as
+// their sort key is known.
+std::optional<MatchStage> match_instance(SourceInstance& instance,
+                                         InstanceFilter const& filter,
+                                         std::optional<InternedId> workload,
+                                         Leader* leader, size_t index,
+                                         VisualStudio& vs) {
+  auto outranked = [&](std::optional<MatchStage> key_stage) {
+    return leader && leader->key_stage() == key_stage &&
+           !leader->can_win(vs, index);
+  };
+  if (outranked(std::nullopt)) {
+    return MatchStage::kOutranked;
+  }
+
+  vs.is_complete_ = instance.is_complete();
+  if (!vs.is_complete_ && filter.complete_only_) {
+    return MatchStage::kComplete;
+  }
+
+  auto version = instance.version();
+  if (!version) {
+    return MatchStage::kVersion;
+  }
+  std::tie(vs.install_version_, vs.version_) = std::move(*version);
+  if (!vs.is_version_match(filter.version_min_, filter.version_max_)) {
+    return MatchStage::kVersion;
+  }
+
+  auto product_id = instance.product_id();
+  if (!product_id) {
+    return MatchStage::kProduct;
+  }
+  vs.product_id_ = std::move(*product_id);
+  vs.product_ = find_product(vs.product_id_);
+  if (!vs.is_product_match(filter.product_)) {
+    return MatchStage::kProduct;
+  }
+  if (outranked(MatchStage::kProduct)) {
+    return MatchStage::kOutranked;
+  }
+
+  // A date key needs the details, which cost less than the package list.
+  bool details_first = leader && leader->key_stage() == MatchStage::kDetails;
+  if (details_first) {
+    if (!instance.details(vs)) {
+      return MatchStage::kDetails;
+    }
+    if (outranked(MatchStage::kDetails)) {
+      return MatchStage::kOutranked;
+    }
+  }
+
+  auto packages = instance.packages(!filter.requires_.empty());
+  if (!packages) {
+    return MatchStage::kPackages;
+  }
+  vs.workloads_ = std::move(packages->workloads_);
+  vs.packages_ = std::move(packages->index_);
+  if (!vs.is_workload_match(workload) ||
+      !filter.requires_.is_satisfied_by(vs.packages_)) {
+    return MatchStage::kPackages;
+  }
+
+  if (!details_first && !instance.details(vs)) {
+    return MatchStage::kDetails;
+  }
+  if (leader) {
+    leader->offer(vs, index);
+  }
+  return std::nullopt;
+}
+
+std::optional<VisualStudio> fetch_instance(SourceInstance& instance) {
+  auto vs = empty_instance();
+  auto version = instance.version();
+  auto product_id = version ? instance.product_id() : std::nullopt;
+  auto packages = product_id ? instance.packages(true) : std::nullopt;
+  if (!packages || !instance.details(vs)) {
+    return std::nullopt;
+  }
+  vs.is_complete_ = instance.is_complete();
+  std::tie(vs.install_version_, vs.version_) = std::move(*version);
+  vs.product_id_ = std::move(*product_id);
+  vs.product_ = find_product(vs.product_id_);
+  vs.workloads_ = std::move(packages->workloads_);
+  vs.packages_ = std::move(packages->index_);
+  return vs;
+}
+
+// Applies `f` to every instance of `source` and its index on the pool,
+// fetching the instances in batches until `stop` returns true, and returns
+// the results in enumeration order.
+template <typename F, typename Stop>
+auto ordered_map(InstanceSource& source, WorkerPool& pool, F f, Stop stop) {
+  using R = std::invoke_result_t<F, SourceInstance&, size_t>;
+  std::vector<std::future<R>> futures;
+  // Tasks refer to the caller's state, so they must all have finished before
+  // this returns or throws.
+  auto wait_all = [&futures]() {
+    for (auto& future : futures) {
+      future.wait();
+    }
+  };
+  try {
+    while (!stop()) {
+      auto batch = source.next_batch(kInstanceBatchSize);
+      if (batch.empty()) {
+        break;
+      }
+      for (auto& instance : batch) {
+        futures.push_back(pool.submit(
+            [f, index = futures.size(),
+             instance = std::shared_ptr<SourceInstance>(std::move(instance))]()
+                -> R { return f(*instance, index); }));
+      }
+    }
+  } catch (...) {
+    wait_all();
+    throw;
+  }
+  wait_all();
+  std::vector<R> results;
+  results.reserve(futures.size());
+  for (auto& future : futures) {
+    results.push_back(future.get());
+  }
+  return results;
+}
+
+std::vector<VisualStudio> collect_matching(InstanceSource& source,
+                                           InstanceFilter const& filter,
+                                           Leader* leader,
+                                           MatchObserver const& observer) {
+  auto workload = resolve_workload(filter.workload_);
+  std::vector<VisualStudio> matched;
+  for (size_t index = 0; !leader || !leader->exhausted(); ++index) {
+    auto instance = source.next();
+    if (!instance) {
+      break;
+    }
+    auto vs = empty_instance();
+    auto rejected =
+        match_instance(*instance, filter, workload, leader, index, vs);
+    if (observer) {
+      observer(vs, rejected);
+    }
+    if (!rejected) {
+      matched.push_back(std::move(vs));
+    }
+  }
+  return matched;
+}
+
+std::vector<VisualStudio> collect_matching(InstanceSource& source,
+                                           InstanceFilter const& filter,
+                                           Leader* leader, WorkerPool& pool,
+                                           MatchObserver const& observer) {
+  auto workload = resolve_workload(filter.workload_);
+  auto results = ordered_map(
+      source, pool,
+      [&filter, workload, leader](SourceInstance& instance, size_t index) {
+        auto vs = empty_instance();
+        auto rejected =
+            match_instance(instance, filter, workload, leader, index, vs);
+        return std::pair{std::move(vs), rejected};
+      },
+      [leader]() { return leader && leader->exhausted(); });
+  std::vector<VisualStudio> matched;
+  for (auto& [vs, rejected] : results) {
+    if (observer) {
+      observer(vs, rejected);
+    }
+    if (!rejected) {
+      matched.push_back(std::move(vs));
+    }
+  }
+  return matched;
+}
+
+// The instance `intent` selects out of `matched`, which is in enumeration
+// order. The leader has already dropped most of the others.
+std::vector<VisualStudio> select_one(std::vector<VisualStudio> matched,
+                                     OutputIntent intent,
+                                     SortPlan const& sort_plan) {
+  if (matched.size() < 2) {
+    return matched;
+  }
+  size_t i = intent == OutputIntent::kExists
+                 ? 0
+                 : *sort_plan.pick(matched, intent == OutputIntent::kLast);
+  std::vector<VisualStudio> selected;
+  selected.push_back(std::move(matched[i]));
+  return selected;
+}
+
+}  // namespace
+
+std::vector<std::unique_ptr<SourceInstance>> InstanceSource::next_batch(
+    size_t max) {
+  std::vector<std::unique_ptr<SourceInstance>> batch;
+  while (batch.size() < max) {
+    auto instance = next();
+    if (!instance) {
+      break;
+    }
+    batch.push_back(std::move(instance));
+  }
+  return batch;
+}
+
+std::unique_ptr<SourceInstance> VectorInstanceSource::next() {
+  if (next_ >= instances_.size()) {
+    return nullptr;
+  }
+  return std::make_unique<MemoryInstance>(instances_[next_++]);
+}
+
+std::vector<VisualStudio> collect_matching_instances(
+    InstanceSource& source, InstanceFilter const& filter,
+    MatchObserver const& observer) {
+  return collect_matching(source, filter, nullptr, observer);
+}
+
+std::vector<VisualStudio> collect_matching_instances(
+    InstanceSource& source, InstanceFilter const& filter, WorkerPool& pool,
+    MatchObserver const& observer) {
+  return collect_matching(source, filter, nullptr, pool, observer);
+}
+
+std::vector<VisualStudio> collect_matching_instances(
+    InstanceSource& source, InstanceFilter const& filter, OutputIntent intent,
+    SortPlan const& sort_plan, MatchObserver const& observer) {
+  if (intent == OutputIntent::kAll) {
+    return collect_matching(source, filter, nullptr, observer);
+  }
+  Leader leader(intent, sort_plan);
+  return select_one(collect_matching(source, filter, &leader, observer),
+                    intent, sort_plan);
+}
+
+std::vector<VisualStudio> collect_matching_instances(
+    InstanceSource& source, InstanceFilter const& filter, OutputIntent intent,
+    SortPlan const& sort_plan, WorkerPool& pool,
+    MatchObserver const& observer) {
+  if (intent == OutputIntent::kAll) {
+    return collect_matching(source, filter, nullptr, pool, observer);
+  }
+  Leader leader(intent, sort_plan);
+  return select_one(collect_matching(source, filter, &leader, pool, observer),
+                    intent, sort_plan);
+}
+
+std::vector<VisualStudio> collect_all_instances(InstanceSource& source) {
+  std::vector<VisualStudio> all;
+  while (auto instance = source.next()) {
+    if (auto vs = fetch_instance(*instance); vs) {
+      all.push_back(std::move(*vs));
+    }
+  }
+  return all;
+}
+
+std::vector<VisualStudio> collect_all_instances(InstanceSource& source,
+                                                WorkerPool& pool) {
+  auto results = ordered_map(
+      source, pool,
+      [](SourceInstance& instance, size_t) { return fetch_instance(instance); },
+      []() { return false; });
+  std::vector<VisualStudio> all;
+  for (auto& vs : results) {
+    if (vs) {
+      all.push_back(std::move(*vs));
+    }
+  }
+  return all;
+}
@@ -0,0 +1,130 @@
+#ifndef INSTANCE_SOURCE_H_
+#define INSTANCE_SOURCE_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "instance.h"
+#include "package_index.h"
+#include "sort_plan.h"
+#include "worker_pool.h"
+
+struct InstancePackages {
+  IdSet workloads_;
+  PackageIndex index_;
+};
+
+// One installed instance whose properties are fetched on demand. Each getter
+// may be a round trip to the Setup server, so callers ask for the cheap ones
+// first and stop as soon as the instance is rejected.
+class SourceInstance {
+ public:
+  virtual ~SourceInstance() = default;
+
+  virtual bool is_complete() = 0;
+  // The installation version and its packed form.
+  virtual std::optional<std::pair<std::wstring, uint64_t>> version() = 0;
+  virtual std::optional<std::wstring> product_id() = 0;
+  // The installed packages of type "Workload" and, with `index_all`, the
+  // index of every installed package. Reading the full list costs a call per
+  // package, so it is skipped when nothing will look it up.
+  virtual std::optional<InstancePackages> packages(bool index_all) = 0;
+  // Install path, display name, install date and the prerelease flag.
+  virtual bool details(VisualStudio& vs) = 0;
+};
+
+class InstanceSource {
+ public:
+  virtual ~InstanceSource() = default;
+  // Returns nullptr once every instance has been visited.
+  virtual std::unique_ptr<SourceInstance> next() = 0;
+  // Returns up to `max` instances, and none once every instance has been
+  // visited. Sources that can fetch several per round trip override this.
+  virtual std::vector<std::unique_ptr<SourceInstance>> next_batch(size_t max);
+};
+
+// Where instances are enumerated from. kCom falls back to kStateJson when the
+// Setup configuration server is not registered.
+enum class InstanceBackend { kCom, kStateJson };
+
+// Instances requested per next_batch() call by the pooled collectors.
+constexpr size_t kInstanceBatchSize = 8;
+
+// Serves instances that are already in memory, e.g. from the snapshot.
+class VectorInstanceSource : public InstanceSource {
+ public:
+  explicit VectorInstanceSource(std::vector<VisualStudio> instances)
+      : instances_(std::move(instances)) {}
+
+  std::unique_ptr<SourceInstance> next() override;
+
+ private:
+  std::vector<VisualStudio> instances_;
+  size_t next_ = 0;
+};
+
+struct InstanceFilter {
+  uint64_t version_min_ = 0;
+  uint64_t version_max_ = UINT64_MAX;
+  std::wstring product_ = L"*";
+  std::wstring workload_ = L"*";
+  PackageRequirement requires_ = {};
+  bool complete_only_ = true;
+};
+
+// Stages of the match, cheapest first. Rejected instances are reported with
+// the stage that rejected them and only the fields fetched so far.
+// kOutranked marks instances dropped because they could no longer be the one
+// an OutputIntent selects.
+enum class MatchStage {
+  kComplete,
+  kVersion,
+  kProduct,
+  kPackages,
+  kDetails,
+  kOutranked,
+};
+
+using MatchObserver =
+    std::function<void(VisualStudio const& vs, std::optional<MatchStage>)>;
+
+// Returns the instances of `source` that pass `filter`. Completeness and the
+// version are checked before the product, and the package list is only
+// fetched for instances that are still candidates after that. Matches carry
+// a package index only when `filter` has package requirements.
+std::vector<VisualStudio> collect_matching_instances(
+    InstanceSource& source, InstanceFilter const& filter,
+    MatchObserver const& observer = {});
+
+// Same as above for a caller that only needs what `intent` asks of the
+// matches sorted by `sort_plan`, which is at most one instance unless it is
+// OutputIntent::kAll. kExists stops enumerating at the first match. kFirst
+// and kLast fetch packages only for instances that could still be selected;
+// unless the plan sorts by date, that is decided from the version and
+// product, otherwise details are fetched before packages to decide it.
+std::vector<VisualStudio> collect_matching_instances(
+    InstanceSource& source, InstanceFilter const& filter, OutputIntent intent,
+    SortPlan const& sort_plan, MatchObserver const& observer = {});
+
+// Fetches every property of every instance, incomplete ones included.
+std::vector<VisualStudio> collect_all_instances(InstanceSource& source);
+
+// Same as above, with the per-instance fetches spread over `pool`. Results,
+// and calls to `observer`, stay in enumeration order; `observer` runs on the
+// calling thread.
+std::vector<VisualStudio> collect_matching_instances(
+    InstanceSource& source, InstanceFilter const& filter, WorkerPool& pool,
+    MatchObserver const& observer = {});
+std::vector<VisualStudio> collect_matching_instances(
+    InstanceSource& source, InstanceFilter const& filter, OutputIntent intent,
+    SortPlan const& sort_plan, WorkerPool& pool,
+    MatchObserver const& observer = {});
+std::vector<VisualStudio> collect_all_instances(InstanceSource& source,
+                                                WorkerPool& pool);
+
+#endif  // INSTANCE_SOURCE_H_
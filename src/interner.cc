@@ -0,0 +1,128 @@
+#include "interner.h"
+
+#include <algorithm>
+#include <bit>
+#include <mutex>
+
+Interner& Interner::global() {
+  static Interner interner;
+  return interner;
+}
+
+InternedId Interner::intern(std::wstring_view name) {
+  {
+    std::shared_lock lock(mutex_);
+    if (auto it = ids_.find(name); it != ids_.end()) {
+      return it->second;
+    }
+  }
+  std::unique_lock lock(mutex_);
+  if (auto it = ids_.find(name); it != ids_.end()) {
+    return it->second;
+  }
+  auto id = static_cast<InternedId>(names_.size());
+  names_.emplace_back(name);
+  ids_.emplace(names_.back(), id);
+  return id;
+}
+
+std::optional<InternedId> Interner::find(std::wstring_view name) const {
+  std::shared_lock lock(mutex_);
+  if (auto it = ids_.find(name); it != ids_.end()) {
+    return it->second;
+  }
+  return std::nullopt;
+}
+
+std::wstring_view Interner::name(InternedId id) const {
+  std::shared_lock lock(mutex_);
+  return names_.at(id);
+}
+
+size_t Interner::size() const {
+  std::shared_lock lock(mutex_);
+  return names_.size();
+}
+
+IdSet::IdSet(std::initializer_list<std::wstring_view> names) {
+  for (auto name : names) {
+    insert(Interner::global().intern(name));
+  }
+}
+
+IdSet::IdSet(std::vector<std::wstring> const& names) {
+  for (auto const& name : names) {
+    insert(Interner::global().intern(name));
+  }
+}
+
+void IdSet::insert(InternedId id) {
+  auto word = id / 64;
+  if (word >= words_.size()) {
+    words_.resize(word + 1);
+  }
+  words_[word] |= uint64_t{1} << (id % 64);
+}
+
+bool IdSet::contains_all(IdSet const& other) const {
+  for (size_t i = 0; i < other.words_.size(); ++i) {
+    auto mine = i < words_.size() ? words_[i] : 0;
+    if ((other.words_[i] & ~mine) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IdSet::intersects(IdSet const& other) const {
+  auto n = std::min(words_.size(), other.words_.size());
+  for (size_t i = 0; i < n; ++i) {
+    if ((words_[i] & other.words_[i]) != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IdSet::empty() const {
+  return std::all_of(words_.begin(), words_.end(),
+                     [](uint64_t word) { return word == 0; });
+}
+
+size_t IdSet::size() const {
+  size_t count = 0;
+  for (auto word : words_) {
+    count += static_cast<size_t>(std::popcount(word));
+  }
+  return count;
+}
+
+std::vector<InternedId> IdSet::ids() const {
+  std::vector<InternedId> ids;
+  for (size_t i = 0; i < words_.size(); ++i) {
+    for (auto word = words_[i]; word != 0; word &= word - 1) {
+      ids.push_back(static_cast<InternedId>(i * 64 + std::countr_zero(word)));
+    }
+  }
+  return ids;
+}
+
+std::vector<std::wstring> IdSet::names() const {
+  std::vector<std::wstring> names;
+  for (auto id : ids()) {
+    names.emplace_back(Interner::global().name(id));
+  }
+  return names;
+}
+
+bool IdSet::operator==(IdSet const& other) const {
+  auto n = std::max(words_.size(), other.words_.size());
+  for (size_t i = 0; i < n; ++i) {
+    auto a = i < words_.size() ? words_[i] : 0;
+    auto b = i < other.words_.size() ? other.words_[i] : 0;
+    if (a != b) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,86 @@
+#ifndef INTERNER_H_
+#define INTERNER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "ascii.h"
+
+using InternedId = uint32_t;
+
+// Maps workload and component ids to dense integers. Ids compare ASCII
+// case-insensitively, like Setup's own, and each distinct id is stored once
+// no matter how many instances carry it. Safe to use from several threads.
+class Interner {
+ public:
+  // The process-wide interner that IdSet names resolve against.
+  static Interner& global();
+
+  InternedId intern(std::wstring_view name);
+  std::optional<InternedId> find(std::wstring_view name) const;
+  // The spelling `id` was first interned with. The view stays valid for the
+  // interner's lifetime.
+  std::wstring_view name(InternedId id) const;
+  size_t size() const;
+
+ private:
+  struct Hash {
+    size_t operator()(std::wstring_view s) const {
+      uint64_t hash = 0xcbf29ce484222325ULL;
+      for (auto c : s) {
+        hash ^= static_cast<uint64_t>(ascii_tolower(c));
+        hash *= 0x100000001b3ULL;
+      }
+      return static_cast<size_t>(hash);
+    }
+  };
+  struct Equal {
+    bool operator()(std::wstring_view a, std::wstring_view b) const {
+      return ascii_iequals(a, b);
+    }
+  };
+
+  mutable std::shared_mutex mutex_;
+  // A deque so that the views in ids_ survive growth.
+  std::deque<std::wstring> names_;
+  std::unordered_map<std::wstring_view, InternedId, Hash, Equal> ids_;
+};
+
+// A set of interned ids stored as a bitset, so that membership is a bit test
+// and "has all of" / "has any of" are word-wise ANDs.
+class IdSet {
+ public:
+  IdSet() = default;
+  // Interns `names` into Interner::global().
+  IdSet(std::initializer_list<std::wstring_view> names);
+  explicit IdSet(std::vector<std::wstring> const& names);
+
+  void insert(InternedId id);
+  bool contains(InternedId id) const {
+    auto word = id / 64;
+    return word < words_.size() && (words_[word] >> (id % 64)) & 1;
+  }
+  bool contains_all(IdSet const& other) const;
+  bool intersects(IdSet const& other) const;
+
+  bool empty() const;
+  size_t size() const;
+  // Ascending ids, and their names in the same order.
+  std::vector<InternedId> ids() const;
+  std::vector<std::wstring> names() const;
+
+  bool operator==(IdSet const& other) const;
+
+ private:
+  std::vector<uint64_t> words_;
+};
+
+#endif  // INTERNER_H_
@@ -0,0 +1,380 @@
+#include "json_reader.h"
+
+#include <bitset>
+#include <cstdint>
+#include <cstdio>
+
+namespace {
+
+constexpr int kMaxDepth = 256;
+
+int hex_value(char c) {
+  if ('0' <= c && c <= '9') {
+    return c - '0';
+  }
+  if ('a' <= c && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if ('A' <= c && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+bool read_hex4(std::string_view s, size_t pos, uint32_t& value) {
+  if (pos + 4 > s.size()) {
+    return false;
+  }
+  value = 0;
+  for (size_t i = pos; i < pos + 4; ++i) {
+    int h = hex_value(s[i]);
+    if (h < 0) {
+      return false;
+    }
+    value = value * 16 + static_cast<uint32_t>(h);
+  }
+  return true;
+}
+
+void append_utf8(std::string& out, uint32_t cp) {
+  if (cp < 0x80) {
+    out.push_back(static_cast<char>(cp));
+  } else if (cp < 0x800) {
+    out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  } else if (cp < 0x10000) {
+    out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  } else {
+    out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  }
+}
+
+}  // namespace
+
+void JsonReader::skip_ws() {
+  while (pos_ < text_.size() &&
+         (text_[pos_] == ' ' || text_[pos_] == '\n' || text_[pos_] == '\r' ||
+          text_[pos_] == '\t')) {
+    ++pos_;
+  }
+}
+
+bool JsonReader::fail() {
+  failed_ = true;
+  pos_ = text_.size();
+  return false;
+}
+
+bool JsonReader::expect(char c) {
+  skip_ws();
+  if (pos_ < text_.size() && text_[pos_] == c) {
+    ++pos_;
+    return true;
+  }
+  return fail();
+}
+
+JsonReader::Type JsonReader::peek() {
+  skip_ws();
+  if (failed_ || pos_ >= text_.size()) {
+    return Type::kEnd;
+  }
+  switch (text_[pos_]) {
+    case '{':
+      return Type::kObject;
+    case '[':
+      return Type::kArray;
+    case '"':
+      return Type::kString;
+    case 't':
+    case 'f':
+      return Type::kBool;
+    case 'n':
+      return Type::kNull;
+    default:
+      return Type::kNumber;
+  }
+}
+
+bool JsonReader::begin_object() {
+  if (failed_ || !expect('{')) {
+    return false;
+  }
+  need_comma_ = false;
+  return true;
+}
+
+bool JsonReader::next_member(std::string_view& raw_key) {
+  skip_ws();
+  if (failed_ || pos_ >= text_.size()) {
+    return fail();
+  }
+  if (text_[pos_] == '}') {
+    ++pos_;
+    need_comma_ = true;
+    return false;
+  }
+  if (need_comma_ && !expect(',')) {
+    return false;
+  }
+  skip_ws();
+  if (!scan_string(raw_key) || !expect(':')) {
+    return false;
+  }
+  need_comma_ = false;
+  return true;
+}
+
+bool JsonReader::begin_array() {
+  if (failed_ || !expect('[')) {
+    return false;
+  }
+  need_comma_ = false;
+  return true;
+}
+
+bool JsonReader::next_element() {
+  skip_ws();
+  if (failed_ || pos_ >= text_.size()) {
+    return fail();
+  }
+  if (text_[pos_] == ']') {
+    ++pos_;
+    need_comma_ = true;
+    return false;
+  }
+  if (need_comma_ && !expect(',')) {
+    return false;
+  }
+  need_comma_ = false;
+  return true;
+}
+
+bool JsonReader::scan_string(std::string_view& raw) {
+  if (pos_ >= text_.size() || text_[pos_] != '"') {
+    return fail();
+  }
+  size_t begin = ++pos_;
+  while (true) {
+    auto stop = text_.find_first_of("\"\\", pos_);
+    if (stop == std::string_view::npos) {
+      return fail();
+    }
+    pos_ = stop + 1;
+    if (text_[stop] == '"') {
+      raw = text_.substr(begin, stop - begin);
+      need_comma_ = true;
+      return true;
+    }
+    // Skip the escaped character; json_unescape() validates it.
+    if (pos_ >= text_.size()) {
+      return fail();
+    }
+    ++pos_;
+  }
+}
+
+bool JsonReader::read_string(std::string_view& raw) {
+  skip_ws();
+  return !failed_ && scan_string(raw);
+}
+
+bool JsonReader::read_bool(bool& value) {
+  skip_ws();
+  auto rest = text_.substr(pos_);
+  if (rest.starts_with("true")) {
+    value = true;
+    pos_ += 4;
+  } else if (rest.starts_with("false")) {
+    value = false;
+    pos_ += 5;
+  } else {
+    return fail();
+  }
+  need_comma_ = true;
+  return true;
+}
+
+bool JsonReader::skip() {
+  // Containers are skipped with an explicit depth counter instead of
+  // recursion, so hostile input cannot exhaust the stack.
+  int depth = 0;
+  std::bitset<kMaxDepth + 1> in_object;
+  do {
+    switch (peek()) {
+      case Type::kObject:
+        if (++depth > kMaxDepth || !begin_object()) {
+          return fail();
+        }
+        in_object[depth] = true;
+        break;
+      case Type::kArray:
+        if (++depth > kMaxDepth || !begin_array()) {
+          return fail();
+        }
+        in_object[depth] = false;
+        break;
+      case Type::kString: {
+        std::string_view ignored;
+        if (!scan_string(ignored)) {
+          return false;
+        }
+        break;
+      }
+      case Type::kBool: {
+        bool ignored;
+        if (!read_bool(ignored)) {
+          return false;
+        }
+        break;
+      }
+      case Type::kNull:
+        if (!text_.substr(pos_).starts_with("null")) {
+          return fail();
+        }
+        pos_ += 4;
+        need_comma_ = true;
+        break;
+      case Type::kNumber: {
+        size_t begin = pos_;
+        while (pos_ < text_.size() &&
+               std::string_view("+-0123456789.eE").find(text_[pos_]) !=
+                   std::string_view::npos) {
+          ++pos_;
+        }
+        if (pos_ == begin) {
+          return fail();
+        }
+        need_comma_ = true;
+        break;
+      }
+      case Type::kEnd:
+        return fail();
+    }
+
+    // Close every container that has no further members/elements, and step
+    // over the separator (and member name) of the next one.
+    while (depth > 0) {
+      skip_ws();
+      if (pos_ >= text_.size()) {
+        return fail();
+      }
+      char c = text_[pos_];
+      if (c == (in_object[depth] ? '}' : ']')) {
+        ++pos_;
+        need_comma_ = true;
+        --depth;
+        continue;
+      }
+      if (need_comma_ && !expect(',')) {
+        return false;
+      }
+      if (in_object[depth]) {
+        std::string_view name;
+        skip_ws();
+        if (!scan_string(name) || !expect(':')) {
+          return false;
+        }
+      }
+      need_comma_ = false;
+      break;
+    }
+  } while (depth > 0);
+  return !failed_;
+}
+
+std::string json_unescape(std::string_view raw) {
+  std::string out;
+  out.reserve(raw.size());
+  for (size_t i = 0; i < raw.size(); ++i) {
+    char c = raw[i];
+    if (c != '\\' || i + 1 >= raw.size()) {
+      out.push_back(c);
+      continue;
+    }
+    char e = raw[++i];
+    switch (e) {
+      case 'b':
+        out.push_back('\b');
+        break;
+      case 'f':
+        out.push_back('\f');
+        break;
+      case 'n':
+        out.push_back('\n');
+        break;
+      case 'r':
+        out.push_back('\r');
+        break;
+      case 't':
+        out.push_back('\t');
+        break;
+      case 'u': {
+        uint32_t cp;
+        if (!read_hex4(raw, i + 1, cp)) {
+          out.push_back('?');
+          break;
+        }
+        i += 4;
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+          uint32_t low;
+          if (i + 2 < raw.size() && raw[i + 1] == '\\' && raw[i + 2] == 'u' &&
+              read_hex4(raw, i + 3, low) && low >= 0xDC00 && low <= 0xDFFF) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            i += 6;
+          } else {
+            cp = 0xFFFD;
+          }
+        } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+          cp = 0xFFFD;
+        }
+        append_utf8(out, cp);
+        break;
+      }
+      default:  // '"', '\\', '/'
+        out.push_back(e);
+        break;
+    }
+  }
+  return out;
+}
+
+std::string json_quote(std::string_view str) {
+  std::string out;
+  out.reserve(str.size() + 2);
+  out.push_back('"');
+  for (char c : str) {
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\r':
+        out += "\\r";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char buf[8];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+          out += buf;
+        } else {
+          out.push_back(c);
+        }
+    }
+  }
+  out.push_back('"');
+  return out;
+}
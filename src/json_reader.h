@@ -0,0 +1,65 @@
+#ifndef JSON_READER_H_
+#define JSON_READER_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// A pull-style JSON scanner over a buffer that stays alive for the reader's
+// lifetime. Nothing is allocated while scanning: strings come back as raw
+// views between the quotes, and only the values a caller keeps need
+// json_unescape(). Unwanted values are skipped without being decoded.
+//
+//   JsonReader reader(text);
+//   std::string_view key;
+//   if (reader.begin_object()) {
+//     while (reader.next_member(key)) {
+//       if (key == "id") reader.read_string(id); else reader.skip();
+//     }
+//   }
+//   if (reader.failed()) ...
+class JsonReader {
+ public:
+  enum class Type { kObject, kArray, kString, kNumber, kBool, kNull, kEnd };
+
+  explicit JsonReader(std::string_view text) : text_(text) {}
+
+  // Type of the next value, without consuming it.
+  Type peek();
+
+  bool begin_object();
+  // Reads the next member name of the current object and its ':'; returns
+  // false (consuming the '}') after the last member.
+  bool next_member(std::string_view& raw_key);
+
+  bool begin_array();
+  // Returns false (consuming the ']') after the last element.
+  bool next_element();
+
+  bool read_string(std::string_view& raw);
+  bool read_bool(bool& value);
+  bool skip();
+
+  bool failed() const { return failed_; }
+  size_t position() const { return pos_; }
+
+ private:
+  void skip_ws();
+  bool expect(char c);
+  bool scan_string(std::string_view& raw);
+  bool fail();
+
+  std::string_view text_;
+  size_t pos_ = 0;
+  // Whether a ',' is needed before the next member/element of the innermost
+  // container. Nesting is handled by the callers' own recursion.
+  bool need_comma_ = false;
+  bool failed_ = false;
+};
+
+// Decodes the escapes in a raw JSON string into UTF-8.
+std::string json_unescape(std::string_view raw);
+// Encodes `str` (UTF-8) as a quoted JSON string.
+std::string json_quote(std::string_view str);
+
+#endif  // JSON_READER_H_
@@ -0,0 +1,323 @@
+#include "local_socket.h"
+
+#include <cstdlib>
+#include <system_error>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+#include "unicode.h"
+#else
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#endif
+
+namespace {
+
+#if defined(_WIN32)
+constexpr DWORD kPipeBufferSize = 64 * 1024;
+
+HANDLE create_pipe_instance(std::wstring const& name, bool first) {
+  // FILE_FLAG_FIRST_PIPE_INSTANCE makes a second server fail instead of
+  // silently sharing the name.
+  return ::CreateNamedPipeW(
+      name.c_str(),
+      PIPE_ACCESS_DUPLEX | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+      PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT |
+          PIPE_REJECT_REMOTE_CLIENTS,
+      PIPE_UNLIMITED_INSTANCES, kPipeBufferSize, kPipeBufferSize, 0, nullptr);
+}
+#else
+bool make_address(std::string const& endpoint, sockaddr_un& address) {
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (endpoint.size() >= sizeof(address.sun_path)) {
+    return false;
+  }
+  std::memcpy(address.sun_path, endpoint.c_str(), endpoint.size() + 1);
+  return true;
+}
+
+int connect_socket(std::string const& endpoint) {
+  sockaddr_un address;
+  if (!make_address(endpoint, address)) {
+    return -1;
+  }
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) !=
+      0) {
+    ::close(fd);
+    return -1;
+  }
+#if defined(SO_NOSIGPIPE)
+  int on = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+  return fd;
+}
+#endif
+
+}  // namespace
+
+LocalStream::LocalStream(LocalStream&& other) noexcept
+    : handle_(std::exchange(other.handle_, kInvalid)) {}
+
+LocalStream& LocalStream::operator=(LocalStream&& other) noexcept {
+  if (this != &other) {
+    close();
+    handle_ = std::exchange(other.handle_, kInvalid);
+  }
+  return *this;
+}
+
+LocalStream::~LocalStream() { close(); }
+
+bool LocalStream::is_open() const { return handle_ != kInvalid; }
+
+void LocalStream::close() {
+  if (!is_open()) {
+    return;
+  }
+#if defined(_WIN32)
+  ::FlushFileBuffers(handle_);
+  ::CloseHandle(handle_);
+#else
+  ::close(handle_);
+#endif
+  handle_ = kInvalid;
+}
+
+size_t LocalStream::read_some(char* data, size_t size) {
+  if (!is_open() || size == 0) {
+    return 0;
+  }
+#if defined(_WIN32)
+  DWORD read = 0;
+  if (!::ReadFile(handle_, data, static_cast<DWORD>(size), &read, nullptr)) {
+    return 0;
+  }
+  return read;
+#else
+  while (true) {
+    auto n = ::read(handle_, data, size);
+    if (n >= 0) {
+      return static_cast<size_t>(n);
+    }
+    if (errno != EINTR) {
+      return 0;
+    }
+  }
+#endif
+}
+
+bool LocalStream::read_exact(char* data, size_t size) {
+  while (size > 0) {
+    auto n = read_some(data, size);
+    if (n == 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool LocalStream::write_all(std::string_view data) {
+  if (!is_open()) {
+    return false;
+  }
+  while (!data.empty()) {
+#if defined(_WIN32)
+    DWORD written = 0;
+    if (!::WriteFile(handle_, data.data(), static_cast<DWORD>(data.size()),
+                     &written, nullptr)) {
+      return false;
+    }
+    data.remove_prefix(written);
+#else
+#if defined(MSG_NOSIGNAL)
+    auto n = ::send(handle_, data.data(), data.size(), MSG_NOSIGNAL);
+#else
+    auto n = ::send(handle_, data.data(), data.size(), 0);
+#endif
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data.remove_prefix(static_cast<size_t>(n));
+#endif
+  }
+  return true;
+}
+
+bool LocalStream::write_frame(FrameType type, std::string_view payload) {
+  return write_all(encode_frame(type, payload));
+}
+
+std::optional<Frame> LocalStream::read_frame() {
+  char header[kFrameHeaderSize];
+  if (!read_exact(header, sizeof(header))) {
+    return std::nullopt;
+  }
+  auto decoded = decode_frame_header(std::string_view(header, sizeof(header)));
+  if (!decoded) {
+    return std::nullopt;
+  }
+  Frame frame{decoded->first, std::string(decoded->second, '\0')};
+  if (!read_exact(frame.payload_.data(), frame.payload_.size())) {
+    return std::nullopt;
+  }
+  return frame;
+}
+
+#if defined(_WIN32)
+
+LocalListener::LocalListener(std::string endpoint)
+    : endpoint_(std::move(endpoint)),
+      pending_(create_pipe_instance(utf8_decode(endpoint_), true)) {
+  if (pending_ == INVALID_HANDLE_VALUE) {
+    throw std::system_error(static_cast<int>(::GetLastError()),
+                            std::system_category(),
+                            "cannot create pipe " + endpoint_);
+  }
+}
+
+LocalListener::~LocalListener() {
+  if (pending_ != INVALID_HANDLE_VALUE) {
+    ::CloseHandle(pending_);
+  }
+}
+
+LocalStream LocalListener::accept() {
+  auto pipe = std::exchange(pending_, INVALID_HANDLE_VALUE);
+  if (pipe == INVALID_HANDLE_VALUE) {
+    pipe = create_pipe_instance(utf8_decode(endpoint_), false);
+    if (pipe == INVALID_HANDLE_VALUE) {
+      return LocalStream();
+    }
+  }
+  if (!::ConnectNamedPipe(pipe, nullptr) &&
+      ::GetLastError() != ERROR_PIPE_CONNECTED) {
+    ::CloseHandle(pipe);
+    return LocalStream();
+  }
+  // Have the next instance ready before this client is served.
+  pending_ = create_pipe_instance(utf8_decode(endpoint_), false);
+  return LocalStream(pipe);
+}
+
+LocalStream connect_local(std::string const& endpoint) {
+  auto name = utf8_decode(endpoint);
+  // All instances can be busy between a client connecting and the server
+  // creating the next one.
+  for (int attempt = 0; attempt < 10; ++attempt) {
+    auto pipe = ::CreateFileW(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0,
+                              nullptr, OPEN_EXISTING, 0, nullptr);
+    if (pipe != INVALID_HANDLE_VALUE) {
+      return LocalStream(pipe);
+    }
+    if (::GetLastError() != ERROR_PIPE_BUSY ||
+        !::WaitNamedPipeW(name.c_str(), 1000)) {
+      break;
+    }
+  }
+  return LocalStream();
+}
+
+std::string default_serve_endpoint() {
+  if (auto const* value = _wgetenv(L"VSRUN_ENDPOINT"); value && *value) {
+    return utf8_encode(value);
+  }
+  std::wstring user = L"default";
+  if (auto const* value = _wgetenv(L"USERNAME"); value && *value) {
+    user = value;
+  }
+  return utf8_encode(L"\\\\.\\pipe\\vsrun-" + user);
+}
+
+#else
+
+LocalListener::LocalListener(std::string endpoint)
+    : endpoint_(std::move(endpoint)) {
+  sockaddr_un address;
+  if (!make_address(endpoint_, address)) {
+    throw std::system_error(ENAMETOOLONG, std::generic_category(),
+                            "socket path too long: " + endpoint_);
+  }
+  // A socket file nobody answers on is left over from a server that died.
+  if (int fd = connect_socket(endpoint_); fd >= 0) {
+    ::close(fd);
+    throw std::system_error(EADDRINUSE, std::generic_category(),
+                            "a server already listens on " + endpoint_);
+  }
+  ::unlink(endpoint_.c_str());
+
+  fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd_ < 0) {
+    throw std::system_error(errno, std::generic_category(), "socket");
+  }
+  // Only the owner may connect.
+  auto old_mask = ::umask(0077);
+  int bound = ::bind(fd_, reinterpret_cast<sockaddr*>(&address),
+                     sizeof(address));
+  ::umask(old_mask);
+  if (bound != 0 || ::listen(fd_, SOMAXCONN) != 0) {
+    int error = errno;
+    ::close(fd_);
+    throw std::system_error(error, std::generic_category(),
+                            "cannot listen on " + endpoint_);
+  }
+}
+
+LocalListener::~LocalListener() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    ::unlink(endpoint_.c_str());
+  }
+}
+
+LocalStream LocalListener::accept() {
+  while (true) {
+    int fd = ::accept(fd_, nullptr, nullptr);
+    if (fd >= 0) {
+#if defined(SO_NOSIGPIPE)
+      int on = 1;
+      ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+      return LocalStream(fd);
+    }
+    if (errno != EINTR && errno != ECONNABORTED) {
+      return LocalStream();
+    }
+  }
+}
+
+LocalStream connect_local(std::string const& endpoint) {
+  return LocalStream(connect_socket(endpoint));
+}
+
+std::string default_serve_endpoint() {
+  if (auto const* value = std::getenv("VSRUN_ENDPOINT"); value && *value) {
+    return value;
+  }
+  if (auto const* value = std::getenv("XDG_RUNTIME_DIR"); value && *value) {
+    return std::string(value) + "/vsrun.sock";
+  }
+  return "/tmp/vsrun-" + std::to_string(::getuid()) + ".sock";
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef LOCAL_SOCKET_H_
+#define LOCAL_SOCKET_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "serve_protocol.h"
+
+// A connected local byte stream: a named pipe instance on Windows, a Unix
+// domain socket elsewhere. Reads and writes block; failures, including the
+// peer going away, are reported by return value and never throw.
+class LocalStream {
+ public:
+#if defined(_WIN32)
+  using Handle = void*;
+#else
+  using Handle = int;
+#endif
+
+  LocalStream() = default;
+  explicit LocalStream(Handle handle) : handle_(handle) {}
+  LocalStream(LocalStream&& other) noexcept;
+  LocalStream& operator=(LocalStream&& other) noexcept;
+  LocalStream(LocalStream const&) = delete;
+  LocalStream& operator=(LocalStream const&) = delete;
+  ~LocalStream();
+
+  bool is_open() const;
+  void close();
+
+  // Returns the number of bytes read, 0 at end of stream or on error.
+  size_t read_some(char* data, size_t size);
+  bool read_exact(char* data, size_t size);
+  bool write_all(std::string_view data);
+
+  bool write_frame(FrameType type, std::string_view payload);
+  // Returns std::nullopt at end of stream or on a malformed frame.
+  std::optional<Frame> read_frame();
+
+ private:
+  Handle handle_ = kInvalid;
+#if defined(_WIN32)
+  static inline Handle const kInvalid = reinterpret_cast<Handle>(-1);
+#else
+  static constexpr Handle kInvalid = -1;
+#endif
+};
+
+// Listens on `endpoint` and hands out one LocalStream per client.
+class LocalListener {
+ public:
+  // Throws std::system_error when the endpoint cannot be created, e.g. when
+  // another server already listens on it.
+  explicit LocalListener(std::string endpoint);
+  LocalListener(LocalListener const&) = delete;
+  LocalListener& operator=(LocalListener const&) = delete;
+  ~LocalListener();
+
+  // Blocks until a client connects. Returns a closed stream on failure.
+  LocalStream accept();
+  std::string const& endpoint() const { return endpoint_; }
+
+ private:
+  std::string endpoint_;
+#if defined(_WIN32)
+  // The pipe instance the next client connects to.
+  void* pending_;
+#else
+  int fd_ = -1;
+#endif
+};
+
+// Returns a closed stream when nothing listens on `endpoint`.
+LocalStream connect_local(std::string const& endpoint);
+
+// %VSRUN_ENDPOINT%, else a per-user pipe (\\.\pipe\vsrun-<user>) on Windows
+// or socket ($XDG_RUNTIME_DIR/vsrun.sock, /tmp/vsrun-<uid>.sock) elsewhere.
+std::string default_serve_endpoint();
+
+#endif  // LOCAL_SOCKET_H_
@@ -0,0 +1,50 @@
+#include "multi_arch.h"
+
+#include <algorithm>
+
+#include "split.h"
+#include "unicode.h"
+
+std::optional<std::vector<std::string>> parse_arch_list(std::string_view list,
+                                                        std::string* error) {
+  std::vector<std::string> archs;
+  for (auto arch : split_view(list, ',')) {
+    if (arch != "x86" && arch != "x64" && arch != "arm64") {
+      if (error) {
+        *error = "unknown arch \"" + std::string(arch) +
+                 "\", expected x86, x64 or arm64";
+      }
+      return std::nullopt;
+    }
+    if (std::find(archs.begin(), archs.end(), arch) == archs.end()) {
+      archs.emplace_back(arch);
+    }
+  }
+  if (archs.empty()) {
+    if (error) {
+      *error = "no arch given";
+    }
+    return std::nullopt;
+  }
+  return archs;
+}
+
+std::vector<BatchResult> run_per_arch(std::vector<std::string> const& archs,
+                                      ArchCapture const& capture,
+                                      ArchRunner const& run,
+                                      BatchReporter const& report) {
+  return run_batch(
+      archs, archs.size(),
+      [&capture, &run](std::string const& arch,
+                       OutputSink const& sink) -> std::optional<int> {
+        auto env = capture(arch);
+        if (!env) {
+          sink(OutputChannel::kStderr,
+               "cannot set up the dev environment for " + arch + "\n");
+          return std::nullopt;
+        }
+        (*env)[kArchVariable] = utf8_decode(arch);
+        return run(arch, *env, sink);
+      },
+      report);
+}
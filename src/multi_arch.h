@@ -0,0 +1,41 @@
+#ifndef MULTI_ARCH_H_
+#define MULTI_ARCH_H_
+
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "batch.h"
+#include "env_cache.h"
+#include "process_runner.h"
+
+// Set in the environment of every command `vsrun --arch a,b` runs, to the
+// arch that command is for.
+inline constexpr wchar_t kArchVariable[] = L"VSRUN_ARCH";
+
+// Splits a comma-separated `--arch` value such as "x64,arm64" into the
+// distinct archs, in the order given. Returns std::nullopt and names the
+// offending entry in `error` when one is not x86, x64 or arm64.
+std::optional<std::vector<std::string>> parse_arch_list(
+    std::string_view list, std::string* error = nullptr);
+
+// Captures the dev environment for one target arch.
+using ArchCapture =
+    std::function<std::optional<Environment>(std::string const& arch)>;
+// Runs the command for one arch in `env`.
+using ArchRunner = std::function<std::optional<int>(
+    std::string const& arch, Environment const& env, OutputSink const& sink)>;
+
+// Captures the environment of every arch at once and runs each arch's
+// command as soon as its environment is ready, with kArchVariable set.
+// The output of every arch is passed to `report` as one group, in `archs`
+// order; an arch whose capture fails counts as a command that could not
+// start. The results carry the arch as their command.
+std::vector<BatchResult> run_per_arch(std::vector<std::string> const& archs,
+                                      ArchCapture const& capture,
+                                      ArchRunner const& run,
+                                      BatchReporter const& report);
+
+#endif  // MULTI_ARCH_H_
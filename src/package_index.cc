@@ -0,0 +1,98 @@
+#include "package_index.h"
+
+#include <algorithm>
+
+#include "ascii.h"
+
+namespace {
+
+void sort_unique(std::vector<InternedId>& ids) {
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+std::vector<InternedId> parse_id_list(std::wstring_view list) {
+  std::vector<InternedId> ids;
+  while (!list.empty()) {
+    auto comma = list.find(L',');
+    auto id = list.substr(0, comma);
+    list = comma == std::wstring_view::npos ? std::wstring_view()
+                                            : list.substr(comma + 1);
+    auto first = id.find_first_not_of(L" \t");
+    if (first == std::wstring_view::npos) {
+      continue;
+    }
+    id = id.substr(first, id.find_last_not_of(L" \t") - first + 1);
+    ids.push_back(Interner::global().intern(id));
+  }
+  sort_unique(ids);
+  return ids;
+}
+
+}  // namespace
+
+std::wstring fold_package_id(std::wstring_view id) {
+  std::wstring folded(id);
+  for (auto& c : folded) {
+    c = ascii_tolower(c);
+  }
+  return folded;
+}
+
+PackageIndex::PackageIndex(std::vector<std::wstring> const& ids) {
+  auto& interner = Interner::global();
+  ids_.reserve(ids.size());
+  for (auto const& id : ids) {
+    ids_.push_back(interner.intern(id));
+  }
+  sort_unique(ids_);
+}
+
+PackageIndex PackageIndex::from_ids(std::vector<InternedId> ids) {
+  PackageIndex index;
+  index.ids_ = std::move(ids);
+  sort_unique(index.ids_);
+  return index;
+}
+
+bool PackageIndex::contains(InternedId id) const {
+  return std::binary_search(ids_.begin(), ids_.end(), id);
+}
+
+bool PackageIndex::contains(std::wstring_view id) const {
+  auto interned = Interner::global().find(id);
+  return interned && contains(*interned);
+}
+
+std::vector<std::wstring> PackageIndex::names() const {
+  auto const& interner = Interner::global();
+  std::vector<std::wstring> names;
+  names.reserve(ids_.size());
+  for (auto id : ids_) {
+    names.push_back(fold_package_id(interner.name(id)));
+  }
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+bool PackageRequirement::is_satisfied_by(PackageIndex const& index) const {
+  // Both sides are sorted, so each search of all_ can start where the
+  // previous one ended.
+  auto const& ids = index.ids();
+  auto from = ids.begin();
+  for (auto id : all_) {
+    from = std::lower_bound(from, ids.end(), id);
+    if (from == ids.end() || *from != id) {
+      return false;
+    }
+  }
+  return any_.empty() ||
+         std::any_of(any_.begin(), any_.end(), [&index](auto id) {
+           return index.contains(id);
+         });
+}
+
+PackageRequirement parse_package_requirement(std::wstring_view all,
+                                             std::wstring_view any) {
+  return {.all_ = parse_id_list(all), .any_ = parse_id_list(any)};
+}
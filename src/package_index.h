@@ -0,0 +1,58 @@
+#ifndef PACKAGE_INDEX_H_
+#define PACKAGE_INDEX_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "interner.h"
+
+// Setup package ids (workloads, components, ...) are ASCII and compare
+// case-insensitively; the snapshot stores them lowercased.
+std::wstring fold_package_id(std::wstring_view id);
+
+// The ids of every package installed in an instance, interned into
+// Interner::global() and sorted once when the instance is read, so that each
+// lookup is a binary search over integers and every distinct id is stored
+// once however many instances carry it.
+class PackageIndex {
+ public:
+  PackageIndex() = default;
+  // Interns and sorts `ids`, dropping duplicates.
+  explicit PackageIndex(std::vector<std::wstring> const& ids);
+  // Sorts ids that are already interned, dropping duplicates.
+  static PackageIndex from_ids(std::vector<InternedId> ids);
+
+  bool contains(InternedId id) const;
+  // Case-insensitive; ids never interned are not contained.
+  bool contains(std::wstring_view id) const;
+
+  // Ascending ids.
+  std::vector<InternedId> const& ids() const { return ids_; }
+  // Folded names, sorted.
+  std::vector<std::wstring> names() const;
+  size_t size() const { return ids_.size(); }
+  bool empty() const { return ids_.empty(); }
+
+  bool operator==(PackageIndex const& other) const = default;
+
+ private:
+  std::vector<InternedId> ids_;
+};
+
+// --requires / --requires-any: an instance qualifies when it has every id in
+// `all_` and, if `any_` is not empty, at least one id in `any_`.
+struct PackageRequirement {
+  std::vector<InternedId> all_;  // sorted
+  std::vector<InternedId> any_;  // sorted
+
+  bool empty() const { return all_.empty() && any_.empty(); }
+  bool is_satisfied_by(PackageIndex const& index) const;
+};
+
+// Parses comma-separated id lists; blanks around ids are ignored.
+PackageRequirement parse_package_requirement(std::wstring_view all,
+                                             std::wstring_view any = {});
+
+#endif  // PACKAGE_INDEX_H_
@@ -0,0 +1,130 @@
+#include "path_list.h"
+
+#include <unordered_set>
+
+#include "ascii.h"
+#include "split.h"
+
+namespace {
+
+constexpr std::wstring_view kPathLists[] = {L"PATH", L"INCLUDE", L"LIB",
+                                            L"LIBPATH", L"EXTERNAL_INCLUDE"};
+
+// Appends the entries of `entries` not seen yet to `out`.
+template <typename Entries>
+void append_new(std::wstring& out, std::unordered_set<std::wstring>& seen,
+                Entries const& entries) {
+  for (auto const& entry : entries) {
+    if (seen.insert(path_entry_key(entry)).second) {
+      if (!out.empty()) {
+        out += L';';
+      }
+      out += entry;
+    }
+  }
+}
+
+}  // namespace
+
+bool is_path_list(std::wstring_view name) {
+  for (auto list : kPathLists) {
+    if (ascii_iequals(name, list)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::wstring path_entry_key(std::wstring_view entry) {
+  if (entry.size() >= 2 && entry.front() == L'"' && entry.back() == L'"') {
+    entry = entry.substr(1, entry.size() - 2);
+  }
+  std::wstring key;
+  key.reserve(entry.size());
+  for (auto c : entry) {
+    key += c == L'/' ? L'\\' : ascii_tolower(c);
+  }
+  while (key.size() > 1 && key.back() == L'\\' &&
+         !(key.size() == 3 && key[1] == L':')) {
+    key.pop_back();
+  }
+  return key;
+}
+
+std::vector<std::wstring_view> split_path_list(std::wstring_view value) {
+  std::vector<std::wstring_view> entries;
+  for (auto entry : split_view(value, L';')) {
+    if (!entry.empty()) {
+      entries.push_back(entry);
+    }
+  }
+  return entries;
+}
+
+std::wstring dedupe_path_list(std::wstring_view value) {
+  std::wstring out;
+  out.reserve(value.size());
+  std::unordered_set<std::wstring> seen;
+  append_new(out, seen, split_path_list(value));
+  return out;
+}
+
+bool diff_path_list(std::wstring_view before, std::wstring_view after,
+                    PathListEdit& edit) {
+  std::vector<std::wstring> old_keys;
+  std::unordered_set<std::wstring> old_set;
+  for (auto entry : split_path_list(before)) {
+    auto key = path_entry_key(entry);
+    if (old_set.insert(key).second) {
+      old_keys.push_back(std::move(key));
+    }
+  }
+  std::vector<std::wstring_view> entries;
+  std::vector<std::wstring> keys;
+  std::unordered_set<std::wstring> new_set;
+  for (auto entry : split_path_list(after)) {
+    auto key = path_entry_key(entry);
+    if (new_set.insert(key).second) {
+      entries.push_back(entry);
+      keys.push_back(std::move(key));
+    }
+  }
+
+  // Try prepends of growing length: merging after[0, i) in front of the old
+  // entries must reproduce after[0, i + kept), and the rest is the append.
+  std::unordered_set<std::wstring> prepended;
+  for (size_t i = 0; i <= keys.size(); ++i) {
+    size_t pos = i;
+    bool matches = true;
+    for (auto const& key : old_keys) {
+      if (prepended.count(key) != 0) {
+        continue;
+      }
+      if (pos == keys.size() || keys[pos] != key) {
+        matches = false;
+        break;
+      }
+      ++pos;
+    }
+    if (matches) {
+      edit.prepend_.assign(entries.begin(), entries.begin() + i);
+      edit.append_.assign(entries.begin() + pos, entries.end());
+      return true;
+    }
+    if (i < keys.size()) {
+      prepended.insert(keys[i]);
+    }
+  }
+  return false;
+}
+
+std::wstring merge_path_list(std::wstring_view current,
+                             PathListEdit const& edit) {
+  std::wstring out;
+  out.reserve(current.size());
+  std::unordered_set<std::wstring> seen;
+  append_new(out, seen, edit.prepend_);
+  append_new(out, seen, split_path_list(current));
+  append_new(out, seen, edit.append_);
+  return out;
+}
@@ -0,0 +1,47 @@
+#ifndef PATH_LIST_H_
+#define PATH_LIST_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Variables that hold ';'-separated directory lists: PATH, INCLUDE, LIB,
+// LIBPATH and EXTERNAL_INCLUDE, in any case. Their values are treated as
+// ordered sets.
+bool is_path_list(std::wstring_view name);
+
+// What two entries are compared by: without surrounding quotes, with '/'
+// as '\' and no trailing separator (except after a drive, "C:\"), ASCII
+// case-folded. C:\VS\bin, "c:/vs/bin/" and C:\VS\BIN\ are the same entry.
+std::wstring path_entry_key(std::wstring_view entry);
+
+// The non-empty entries of `value`.
+std::vector<std::wstring_view> split_path_list(std::wstring_view value);
+
+// `value` with every entry after its first occurrence removed, and without
+// empty entries. The first spelling of an entry is the one kept.
+std::wstring dedupe_path_list(std::wstring_view value);
+
+// A change to a list that keeps the entries it already has: `prepend_` goes
+// in front of them and `append_` after them, duplicates dropped.
+struct PathListEdit {
+  std::vector<std::wstring> prepend_;
+  std::vector<std::wstring> append_;
+
+  bool empty() const { return prepend_.empty() && append_.empty(); }
+  bool operator==(PathListEdit const&) const = default;
+};
+
+// The edit, with the shortest prepend, that turns `before` into `after` up
+// to duplicates and spelling; e.g. "C:\VS\bin;C:\Windows" from
+// "C:\Windows" is a prepend of C:\VS\bin, and an entry moved forward is
+// prepended again. Returns false when `after` drops entries of `before`,
+// which no edit expresses.
+bool diff_path_list(std::wstring_view before, std::wstring_view after,
+                    PathListEdit& edit);
+
+// dedupe_path_list of the edit's prepend, `current` and append.
+std::wstring merge_path_list(std::wstring_view current,
+                             PathListEdit const& edit);
+
+#endif  // PATH_LIST_H_
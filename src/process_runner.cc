@@ -0,0 +1,354 @@
+#include "process_runner.h"
+
+#include <cstring>
+#include <mutex>
+
+#include "trace.h"
+#include "unicode.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+#include <memory>
+#include <thread>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+namespace {
+
+constexpr size_t kReadBufferSize = 64 * 1024;
+// How often a cancellable child checks whether it was cancelled.
+constexpr int kCancelPollMilliseconds = 20;
+
+#if defined(_WIN32)
+
+struct HandleCloser {
+  void operator()(HANDLE handle) const {
+    if (handle && handle != INVALID_HANDLE_VALUE) {
+      ::CloseHandle(handle);
+    }
+  }
+};
+using UniqueHandle = std::unique_ptr<void, HandleCloser>;
+
+#endif
+
+}  // namespace
+
+#if defined(_WIN32)
+
+std::optional<int> run_process(std::vector<std::string> const& args,
+                               std::filesystem::path const& cwd,
+                               EnvBlock const& env, OutputSink const& sink,
+                               std::atomic<bool> const* cancelled) {
+  TraceSpan span("run process");
+  SECURITY_ATTRIBUTES inheritable{sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE};
+  // Each handle is owned as soon as it exists, so that every early return
+  // closes what was opened before it.
+  auto create_pipe = [&inheritable](UniqueHandle& read, UniqueHandle& write) {
+    HANDLE read_end = nullptr;
+    HANDLE write_end = nullptr;
+    if (!::CreatePipe(&read_end, &write_end, &inheritable, 0)) {
+      return false;
+    }
+    read.reset(read_end);
+    write.reset(write_end);
+    return ::SetHandleInformation(read_end, HANDLE_FLAG_INHERIT, 0) != 0;
+  };
+  UniqueHandle out_read, out_write, err_read, err_write;
+  if (!create_pipe(out_read, out_write) || !create_pipe(err_read, err_write)) {
+    return std::nullopt;
+  }
+  UniqueHandle null_input(::CreateFileW(
+      L"NUL", GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, &inheritable,
+      OPEN_EXISTING, 0, nullptr));
+  if (null_input.get() == INVALID_HANDLE_VALUE) {
+    return std::nullopt;
+  }
+
+  // Only these handles are inherited, so that children started at the same
+  // time by other threads do not keep each other's pipes open.
+  HANDLE inherited[] = {null_input.get(), out_write.get(), err_write.get()};
+  SIZE_T attribute_size = 0;
+  ::InitializeProcThreadAttributeList(nullptr, 1, 0, &attribute_size);
+  std::vector<char> attribute_storage(attribute_size);
+  auto attributes = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(
+      attribute_storage.data());
+  if (!::InitializeProcThreadAttributeList(attributes, 1, 0,
+                                           &attribute_size)) {
+    return std::nullopt;
+  }
+  std::unique_ptr<_PROC_THREAD_ATTRIBUTE_LIST,
+                  decltype(&::DeleteProcThreadAttributeList)>
+      attributes_guard(attributes, &::DeleteProcThreadAttributeList);
+  if (!::UpdateProcThreadAttribute(attributes, 0,
+                                   PROC_THREAD_ATTRIBUTE_HANDLE_LIST,
+                                   inherited, sizeof(inherited), nullptr,
+                                   nullptr)) {
+    return std::nullopt;
+  }
+
+  STARTUPINFOEXW startup{};
+  startup.StartupInfo.cb = sizeof(startup);
+  startup.StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+  startup.StartupInfo.hStdInput = null_input.get();
+  startup.StartupInfo.hStdOutput = out_write.get();
+  startup.StartupInfo.hStdError = err_write.get();
+  startup.lpAttributeList = attributes;
+
+  std::string joined;
+  for (auto const& arg : args) {
+    if (!joined.empty()) {
+      joined += ' ';
+    }
+    joined += arg;
+  }
+  auto command_line = utf8_decode(joined);
+  PROCESS_INFORMATION process{};
+  if (!::CreateProcessW(nullptr, command_line.data(), nullptr, nullptr, TRUE,
+                        CREATE_UNICODE_ENVIRONMENT |
+                            EXTENDED_STARTUPINFO_PRESENT |
+                            (cancelled ? CREATE_SUSPENDED : 0),
+                        const_cast<wchar_t*>(env.data().data()),
+                        cwd.empty() ? nullptr : cwd.c_str(),
+                        &startup.StartupInfo, &process)) {
+    return std::nullopt;
+  }
+  UniqueHandle process_handle(process.hProcess);
+  UniqueHandle thread_handle(process.hThread);
+  // The child holds the write ends now; ours must go for reads to end.
+  out_write.reset();
+  err_write.reset();
+
+  // A cancellable child starts suspended in a job, so that cancelling kills
+  // what it starts too. Without the job only the child itself is killed.
+  UniqueHandle job;
+  std::atomic<bool> killed{false};
+  std::thread watcher;
+  if (cancelled) {
+    job.reset(::CreateJobObjectW(nullptr, nullptr));
+    if (job && !::AssignProcessToJobObject(job.get(), process_handle.get())) {
+      job.reset();
+    }
+    ::ResumeThread(thread_handle.get());
+    // Killing the child closes its pipes, which ends the reads below.
+    watcher = std::thread([&]() {
+      while (::WaitForSingleObject(process_handle.get(),
+                                   kCancelPollMilliseconds) == WAIT_TIMEOUT) {
+        if (cancelled->load()) {
+          if (job) {
+            ::TerminateJobObject(job.get(), 1);
+          } else {
+            ::TerminateProcess(process_handle.get(), 1);
+          }
+          killed = true;
+          return;
+        }
+      }
+    });
+  }
+
+  std::mutex sink_mutex;
+  auto pump = [&sink, &sink_mutex](HANDLE pipe, OutputChannel channel) {
+    std::vector<char> buffer(kReadBufferSize);
+    DWORD read = 0;
+    while (::ReadFile(pipe, buffer.data(), static_cast<DWORD>(buffer.size()),
+                      &read, nullptr) &&
+           read > 0) {
+      std::lock_guard lock(sink_mutex);
+      sink(channel, std::string_view(buffer.data(), read));
+    }
+  };
+  std::thread err_thread(pump, err_read.get(), OutputChannel::kStderr);
+  pump(out_read.get(), OutputChannel::kStdout);
+  err_thread.join();
+
+  ::WaitForSingleObject(process_handle.get(), INFINITE);
+  if (watcher.joinable()) {
+    watcher.join();
+  }
+  if (killed) {
+    return std::nullopt;
+  }
+  DWORD exit_code = 0;
+  ::GetExitCodeProcess(process_handle.get(), &exit_code);
+  return static_cast<int>(exit_code);
+}
+
+#else
+
+std::optional<int> run_process(std::vector<std::string> const& args,
+                               std::filesystem::path const& cwd,
+                               EnvBlock const& env, OutputSink const& sink,
+                               std::atomic<bool> const* cancelled) {
+  TraceSpan span("run process");
+  if (args.empty()) {
+    return std::nullopt;
+  }
+  // Everything the child needs is built before fork(), which leaves only
+  // async-signal-safe calls between fork() and exec().
+  std::vector<char*> argv;
+  for (auto const& arg : args) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+  // The block's entries are NUL-terminated already, so envp can point into
+  // one converted copy of it.
+  auto env_strings = utf8_encode(env.data());
+  std::vector<char*> envp;
+  for (size_t i = 0; env_strings[i] != '\0';
+       i += std::strlen(&env_strings[i]) + 1) {
+    envp.push_back(&env_strings[i]);
+  }
+  envp.push_back(nullptr);
+
+  int out[2], err[2], status[2];
+  if (::pipe(out) != 0) {
+    return std::nullopt;
+  }
+  if (::pipe(err) != 0) {
+    ::close(out[0]);
+    ::close(out[1]);
+    return std::nullopt;
+  }
+  if (::pipe(status) != 0) {
+    for (int fd : {out[0], out[1], err[0], err[1]}) {
+      ::close(fd);
+    }
+    return std::nullopt;
+  }
+  for (int fd : {out[0], out[1], err[0], err[1], status[0], status[1]}) {
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+
+  pid_t pid = ::fork();
+  if (pid == 0) {
+    // A group of its own, so that cancelling kills what the child starts.
+    if (cancelled) {
+      ::setpgid(0, 0);
+    }
+    int null_input = ::open("/dev/null", O_RDONLY);
+    if (null_input >= 0) {
+      ::dup2(null_input, STDIN_FILENO);
+    }
+    ::dup2(out[1], STDOUT_FILENO);
+    ::dup2(err[1], STDERR_FILENO);
+    if (!cwd.empty() && ::chdir(cwd.c_str()) != 0) {
+      int error = errno;
+      [[maybe_unused]] auto n = ::write(status[1], &error, sizeof(error));
+      ::_exit(127);
+    }
+    // execvp searches the PATH of `environ`, which is the child's.
+    environ = envp.data();
+    ::execvp(argv[0], argv.data());
+    int error = errno;
+    [[maybe_unused]] auto n = ::write(status[1], &error, sizeof(error));
+    ::_exit(127);
+  }
+  ::close(out[1]);
+  ::close(err[1]);
+  ::close(status[1]);
+  if (pid < 0) {
+    ::close(out[0]);
+    ::close(err[0]);
+    ::close(status[0]);
+    return std::nullopt;
+  }
+  // Also here, so that a kill cannot race the child's own setpgid().
+  if (cancelled) {
+    ::setpgid(pid, pid);
+  }
+  bool killed = false;
+  auto kill_if_cancelled = [&]() {
+    if (!killed && cancelled && cancelled->load()) {
+      ::kill(-pid, SIGKILL);
+      killed = true;
+    }
+    return killed;
+  };
+
+  // The status pipe closes on a successful exec and carries errno otherwise.
+  int exec_error = 0;
+  ssize_t status_read;
+  do {
+    status_read = ::read(status[0], &exec_error, sizeof(exec_error));
+  } while (status_read < 0 && errno == EINTR);
+  ::close(status[0]);
+
+  std::vector<char> buffer(kReadBufferSize);
+  pollfd fds[2] = {{out[0], POLLIN, 0}, {err[0], POLLIN, 0}};
+  int open_fds = 2;
+  while (open_fds > 0 && !kill_if_cancelled()) {
+    if (::poll(fds, 2, cancelled ? kCancelPollMilliseconds : -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    for (auto& fd : fds) {
+      if (fd.fd < 0 || fd.revents == 0) {
+        continue;
+      }
+      auto n = ::read(fd.fd, buffer.data(), buffer.size());
+      if (n > 0) {
+        sink(fd.fd == out[0] ? OutputChannel::kStdout : OutputChannel::kStderr,
+             std::string_view(buffer.data(), static_cast<size_t>(n)));
+      } else if (n == 0 || errno != EINTR) {
+        ::close(fd.fd);
+        fd.fd = -1;
+        --open_fds;
+      }
+    }
+  }
+  for (auto const& fd : fds) {
+    if (fd.fd >= 0) {
+      ::close(fd.fd);
+    }
+  }
+
+  // A child that closed its output may still run; a cancellable one is
+  // waited for without blocking.
+  int wait_status = 0;
+  while (true) {
+    auto waited =
+        ::waitpid(pid, &wait_status, cancelled && !killed ? WNOHANG : 0);
+    if (waited < 0 && errno == EINTR) {
+      continue;
+    }
+    if (waited != 0) {
+      break;
+    }
+    if (!kill_if_cancelled()) {
+      ::poll(nullptr, 0, kCancelPollMilliseconds);
+    }
+  }
+  if (killed || status_read > 0) {
+    return std::nullopt;
+  }
+  if (WIFEXITED(wait_status)) {
+    return WEXITSTATUS(wait_status);
+  }
+  // Like a shell reports a child killed by a signal.
+  return 128 + WTERMSIG(wait_status);
+}
+
+#endif
+
+std::optional<int> run_process(std::vector<std::string> const& args,
+                               std::filesystem::path const& cwd,
+                               Environment const& env,
+                               OutputSink const& sink,
+                               std::atomic<bool> const* cancelled) {
+  return run_process(args, cwd, EnvStore(env).block(), sink, cancelled);
+}
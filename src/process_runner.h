@@ -0,0 +1,45 @@
+#ifndef PROCESS_RUNNER_H_
+#define PROCESS_RUNNER_H_
+
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "env_cache.h"
+#include "env_store.h"
+
+enum class OutputChannel { kStdout, kStderr };
+
+// Receives a child's output as it is produced. Called from one thread at a
+// time, but not necessarily the thread that started the child.
+using OutputSink = std::function<void(OutputChannel, std::string_view)>;
+
+// Runs `args` with exactly `env` in `cwd` (the current directory when empty)
+// and forwards its stdout and stderr to `sink` as the child writes them.
+// Returns the exit code, or std::nullopt when the child could not be
+// started.
+//
+// Once `cancelled` is set, the child and everything it started are killed
+// and std::nullopt is returned. It is polled, so it may be set from any
+// thread.
+//
+// On Windows `args` are joined with spaces into the command line, as
+// subprocess::run does, so arguments must already be quoted for the program
+// (see quote_argument). Elsewhere they are passed to execvp as they are.
+std::optional<int> run_process(std::vector<std::string> const& args,
+                               std::filesystem::path const& cwd,
+                               EnvBlock const& env, OutputSink const& sink,
+                               std::atomic<bool> const* cancelled = nullptr);
+// Builds the block of `env` first; prefer the EnvBlock overload to start
+// many commands in the same environment.
+std::optional<int> run_process(std::vector<std::string> const& args,
+                               std::filesystem::path const& cwd,
+                               Environment const& env,
+                               OutputSink const& sink,
+                               std::atomic<bool> const* cancelled = nullptr);
+
+#endif  // PROCESS_RUNNER_H_
@@ -0,0 +1,134 @@
+#ifndef PRODUCT_H_
+#define PRODUCT_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+#include "ascii.h"
+
+// The Visual Studio products vsrun knows by name. Instances of any other
+// product are kUnknown and matched by their id string instead.
+enum class Product : uint8_t {
+  kUnknown,
+  kCommunity,
+  kProfessional,
+  kEnterprise,
+  kBuildTools,
+  kTeamExplorer,
+  kTestAgent,
+  kTestController,
+  kTestProfessional,
+};
+
+// Product ids are this prefix and the product's name, e.g.
+// Microsoft.VisualStudio.Product.BuildTools.
+constexpr std::wstring_view kProductPrefix = L"microsoft.visualstudio.product.";
+
+// Names in enum order, starting with kCommunity.
+constexpr std::wstring_view kProductNames[] = {
+    L"Community",
+    L"Professional",
+    L"Enterprise",
+    L"BuildTools",
+    L"TeamExplorer",
+    L"TestAgent",
+    L"TestController",
+    L"TestProfessional",
+};
+constexpr size_t kProductCount = std::size(kProductNames) + 1;
+
+constexpr std::wstring_view product_name(Product product) {
+  return product == Product::kUnknown
+             ? std::wstring_view{}
+             : kProductNames[static_cast<size_t>(product) - 1];
+}
+
+namespace product_detail {
+
+// Compares `a` to the ASCII `b` ignoring case, for narrow and wide `a`.
+template <typename CharT>
+constexpr bool iequals(std::basic_string_view<CharT> a, std::wstring_view b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    auto c = static_cast<std::make_unsigned_t<CharT>>(a[i]);
+    if (c >= 0x80 || ascii_tolower(static_cast<wchar_t>(c)) !=
+                         ascii_tolower(b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename CharT>
+constexpr uint32_t hash(std::basic_string_view<CharT> name, uint32_t seed) {
+  uint32_t h = 0x811c9dc5u ^ seed;
+  for (auto c : name) {
+    h ^= ascii_tolower(static_cast<uint32_t>(
+        static_cast<std::make_unsigned_t<CharT>>(c)));
+    h *= 0x01000193u;
+  }
+  return h;
+}
+
+constexpr size_t kTableSize = 16;
+static_assert(kTableSize >= kProductCount);
+
+// The first seed under which the names hash to distinct slots. Failing to
+// find one is a compile error.
+consteval uint32_t find_seed() {
+  for (uint32_t seed = 0;; ++seed) {
+    std::array<bool, kTableSize> used{};
+    bool perfect = true;
+    for (auto name : kProductNames) {
+      auto slot = hash(name, seed) % kTableSize;
+      perfect = perfect && !used[slot];
+      used[slot] = true;
+    }
+    if (perfect) {
+      return seed;
+    }
+  }
+}
+
+constexpr uint32_t kSeed = find_seed();
+
+// The Product whose name hashes to each slot, or kUnknown.
+consteval std::array<Product, kTableSize> build_table() {
+  std::array<Product, kTableSize> table{};
+  for (size_t i = 0; i < std::size(kProductNames); ++i) {
+    table[hash(kProductNames[i], kSeed) % kTableSize] =
+        static_cast<Product>(i + 1);
+  }
+  return table;
+}
+
+constexpr auto kTable = build_table();
+
+template <typename CharT>
+constexpr Product find_product(std::basic_string_view<CharT> id) {
+  if (id.size() > kProductPrefix.size() &&
+      iequals(id.substr(0, kProductPrefix.size()), kProductPrefix)) {
+    id.remove_prefix(kProductPrefix.size());
+  }
+  auto product = kTable[hash(id, kSeed) % kTableSize];
+  return iequals(id, product_name(product)) ? product : Product::kUnknown;
+}
+
+}  // namespace product_detail
+
+// The product a product id or bare name ("community", or
+// "Microsoft.VisualStudio.Product.Community") stands for, ignoring case:
+// one hash and one comparison, no allocation.
+constexpr Product find_product(std::wstring_view id) {
+  return product_detail::find_product(id);
+}
+constexpr Product find_product(std::string_view id) {
+  return product_detail::find_product(id);
+}
+
+#endif  // PRODUCT_H_
@@ -0,0 +1,192 @@
+#include "query.h"
+
+#include <algorithm>
+
+#include "split.h"
+#include "trace.h"
+#include "unicode.h"
+
+namespace {
+
+constexpr uint32_t product_bit(Product product) {
+  return uint32_t{1} << static_cast<uint32_t>(product);
+}
+static_assert(kProductCount <= 32);
+
+}  // namespace
+
+std::optional<Query> Query::compile(QuerySpec const& spec,
+                                    std::string* error) {
+  auto fail = [error](std::string_view clause, std::string const& value) {
+    if (error) {
+      *error = std::string(clause) + ": " + value;
+    }
+    return std::nullopt;
+  };
+
+  Query query;
+  query.spec_ = spec;
+  query.clauses_ = spec.include_incomplete_ ? 0u : uint32_t{kComplete};
+
+  if (spec.version_ != "*") {
+    auto range = parse_version_range(spec.version_);
+    if (!range) {
+      return fail("version", spec.version_);
+    }
+    query.version_ = *range;
+    if (range->min_ != 0 || range->max_ != UINT64_MAX) {
+      query.clauses_ |= kVersion;
+    }
+  }
+
+  for (auto product : split_view(spec.product_, ',')) {
+    if (product == "*") {
+      query.product_patterns_.clear();
+      break;
+    }
+    if (product.empty()) {
+      return fail("product", spec.product_);
+    }
+    query.product_patterns_.push_back(utf8_decode(product));
+    query.product_mask_ |= product_bit(find_product(product));
+  }
+  if (!query.product_patterns_.empty()) {
+    query.clauses_ |= kProduct;
+  }
+
+  if (spec.workload_.empty()) {
+    return fail("workload", spec.workload_);
+  }
+  query.workload_ = resolve_workload(utf8_decode(spec.workload_));
+  query.clauses_ |= kWorkload;
+
+  query.requires_ = parse_package_requirement(utf8_decode(spec.requires_all_),
+                                              utf8_decode(spec.requires_any_));
+  if (!query.requires_.empty()) {
+    query.clauses_ |= kRequires;
+  }
+
+  if (spec.prerelease_ != PrereleasePolicy::kInclude) {
+    query.prerelease_ = spec.prerelease_ == PrereleasePolicy::kOnly;
+    query.clauses_ |= kPrerelease;
+  }
+
+  std::string sort_error;
+  auto sort_plan = SortPlan::parse(spec.sort_, &sort_error);
+  if (!sort_plan) {
+    return fail("sort", sort_error);
+  }
+  query.sort_plan_ = std::move(*sort_plan);
+  return query;
+}
+
+std::optional<MatchStage> Query::rejects(VisualStudio const& vs) const {
+  if ((clauses_ & kComplete) && !vs.is_complete_) {
+    return MatchStage::kComplete;
+  }
+  if ((clauses_ & kVersion) &&
+      !vs.is_version_match(version_.min_, version_.max_)) {
+    return MatchStage::kVersion;
+  }
+  if ((clauses_ & kProduct) && !is_product_match(vs)) {
+    return MatchStage::kProduct;
+  }
+  if ((clauses_ & kWorkload) && !vs.is_workload_match(workload_)) {
+    return MatchStage::kPackages;
+  }
+  if ((clauses_ & kRequires) && !requires_.is_satisfied_by(vs.packages_)) {
+    return MatchStage::kPackages;
+  }
+  if ((clauses_ & kPrerelease) && vs.is_prerelease_ != prerelease_) {
+    return MatchStage::kDetails;
+  }
+  return std::nullopt;
+}
+
+bool Query::is_product_match(VisualStudio const& vs) const {
+  if (vs.product_ != Product::kUnknown) {
+    // Patterns outside the product table cannot name a known product.
+    return (product_mask_ & product_bit(vs.product_)) != 0;
+  }
+  return std::any_of(product_patterns_.begin(), product_patterns_.end(),
+                     [&vs](std::wstring const& pattern) {
+                       return vs.is_product_match(pattern);
+                     });
+}
+
+std::vector<VisualStudio const*> Query::select(
+    std::vector<VisualStudio> const& instances, OutputIntent intent) const {
+  std::vector<VisualStudio const*> selected;
+  {
+    TraceSpan span("filter instances");
+    if (intent == OutputIntent::kExists) {
+      auto it = std::find_if(
+          instances.begin(), instances.end(),
+          [this](VisualStudio const& vs) { return matches(vs); });
+      if (it != instances.end()) {
+        selected.push_back(&*it);
+      }
+      return selected;
+    }
+    selected.reserve(instances.size());
+    for (auto const& vs : instances) {
+      if (!rejects(vs)) {
+        selected.push_back(&vs);
+      }
+    }
+  }
+  if (intent != OutputIntent::kAll) {
+    TraceSpan span("pick instance");
+    if (auto i = sort_plan_.pick(selected, intent == OutputIntent::kLast)) {
+      return {selected[*i]};
+    }
+    return selected;
+  }
+  TraceSpan span("sort instances");
+  sort_plan_.apply(selected);
+  return selected;
+}
+
+std::vector<VisualStudio> Query::evaluate(
+    std::vector<VisualStudio> const& instances, OutputIntent intent) const {
+  std::vector<VisualStudio> matched;
+  for (auto const* vs : select(instances, intent)) {
+    matched.push_back(*vs);
+  }
+  return matched;
+}
+
+InstanceFilter Query::filter() const {
+  InstanceFilter filter{.version_min_ = version_.min_,
+                        .version_max_ = version_.max_,
+                        .workload_ = utf8_decode(spec_.workload_),
+                        .requires_ = requires_,
+                        .complete_only_ = (clauses_ & kComplete) != 0};
+  // A single product can be checked before the package list is fetched.
+  if (product_patterns_.size() == 1) {
+    filter.product_ = product_patterns_.front();
+  }
+  return filter;
+}
+
+bool Query::is_filter_exact() const {
+  return !(clauses_ & kPrerelease) && product_patterns_.size() <= 1;
+}
+
+std::vector<VisualStudio> Query::collect(InstanceSource& source,
+                                         OutputIntent intent,
+                                         MatchObserver const& observer) const {
+  auto matched = collect_matching_instances(
+      source, filter(), is_filter_exact() ? intent : OutputIntent::kAll,
+      sort_plan_, observer);
+  return evaluate(matched, intent);
+}
+
+std::vector<VisualStudio> Query::collect(InstanceSource& source,
+                                         OutputIntent intent, WorkerPool& pool,
+                                         MatchObserver const& observer) const {
+  auto matched = collect_matching_instances(
+      source, filter(), is_filter_exact() ? intent : OutputIntent::kAll,
+      sort_plan_, pool, observer);
+  return evaluate(matched, intent);
+}
@@ -0,0 +1,108 @@
+#ifndef QUERY_H_
+#define QUERY_H_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "instance.h"
+#include "instance_source.h"
+#include "package_index.h"
+#include "sort_plan.h"
+#include "version.h"
+
+enum class PrereleasePolicy { kInclude, kExclude, kOnly };
+
+// What to search for, in the form the vsrun options take it.
+struct QuerySpec {
+  // A version range, see parse_version_range(); "*" for any version.
+  std::string version_ = "*";
+  // Comma-separated product names or ids, see find_product(); "*" for any.
+  std::string product_ = "*";
+  // A workload id; "*" for any instance that has a workload.
+  std::string workload_ = "*";
+  // Comma-separated package ids, see PackageRequirement.
+  std::string requires_all_ = {};
+  std::string requires_any_ = {};
+  PrereleasePolicy prerelease_ = PrereleasePolicy::kInclude;
+  bool include_incomplete_ = false;
+  // A --sort specification, see SortPlan.
+  std::string sort_ = {};
+};
+
+// A QuerySpec parsed and validated once, then evaluated against any number
+// of instance collections. Clauses that accept every instance are dropped
+// when compiling, so a query matching everything only copies and sorts.
+class Query {
+ public:
+  // The query matching every complete instance, in enumeration order.
+  Query() = default;
+
+  // Returns std::nullopt and sets `error` to the offending clause when
+  // `spec` is malformed.
+  static std::optional<Query> compile(QuerySpec const& spec,
+                                      std::string* error = nullptr);
+
+  QuerySpec const& spec() const { return spec_; }
+  SortPlan const& sort_plan() const { return sort_plan_; }
+
+  // The first clause `vs` fails, or std::nullopt when it matches. Package
+  // clauses need the instance's workloads and package index; prerelease is
+  // reported as MatchStage::kDetails.
+  std::optional<MatchStage> rejects(VisualStudio const& vs) const;
+  bool matches(VisualStudio const& vs) const { return !rejects(vs); }
+
+  // The matching instances `intent` asks for, pointing into `instances`:
+  // all of them in sort order, or at most one. kExists stops at the first
+  // match, and kFirst and kLast pick theirs without sorting.
+  std::vector<VisualStudio const*> select(
+      std::vector<VisualStudio> const& instances,
+      OutputIntent intent = OutputIntent::kAll) const;
+  // Same as above, copied.
+  std::vector<VisualStudio> evaluate(
+      std::vector<VisualStudio> const& instances,
+      OutputIntent intent = OutputIntent::kAll) const;
+
+  // The part of the query an InstanceSource can check while enumerating.
+  // Its matches still have to go through evaluate().
+  InstanceFilter filter() const;
+  // Whether filter() is the whole query, so that a source can also apply
+  // the OutputIntent itself.
+  bool is_filter_exact() const;
+
+  // Runs the query over `source`: filter(), with `intent` when the filter is
+  // exact, while enumerating, and then evaluate() for the rest.
+  std::vector<VisualStudio> collect(
+      InstanceSource& source, OutputIntent intent = OutputIntent::kAll,
+      MatchObserver const& observer = {}) const;
+  std::vector<VisualStudio> collect(InstanceSource& source,
+                                    OutputIntent intent, WorkerPool& pool,
+                                    MatchObserver const& observer = {}) const;
+
+ private:
+  enum Clause : uint32_t {
+    kComplete = 1 << 0,
+    kVersion = 1 << 1,
+    kProduct = 1 << 2,
+    kWorkload = 1 << 3,
+    kRequires = 1 << 4,
+    kPrerelease = 1 << 5,
+  };
+
+  bool is_product_match(VisualStudio const& vs) const;
+
+  QuerySpec spec_;
+  // The clauses left after compiling away the wildcards.
+  uint32_t clauses_ = kComplete;
+  VersionRange version_ = {0, UINT64_MAX};
+  // A bit per known Product, for instances whose product_ is resolved.
+  uint32_t product_mask_ = 0;
+  std::vector<std::wstring> product_patterns_;
+  std::optional<InternedId> workload_;
+  PackageRequirement requires_;
+  bool prerelease_ = false;
+  SortPlan sort_plan_;
+};
+
+#endif  // QUERY_H_
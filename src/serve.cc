@@ -0,0 +1,244 @@
+#include "serve.h"
+
+#include <exception>
+#include <thread>
+#include <utility>
+
+#include "instance_snapshot.h"
+#include "unicode.h"
+
+namespace {
+
+std::string instance_key(RunRequest const& request) {
+  std::string key;
+  for (auto const* field :
+       {&request.version_, &request.product_, &request.workload_,
+        &request.requires_all_, &request.requires_any_, &request.sort_}) {
+    key += *field;
+    key += '\0';
+  }
+  key += request.select_last_ ? "last" : "first";
+  return key;
+}
+
+// The same identity EnvCacheKey gives an on-disk entry.
+std::string delta_key(VisualStudio const& vs, RunRequest const& request) {
+  std::string key = utf8_encode(vs.install_path_);
+  key += '\0' + utf8_encode(vs.install_version_);
+  key += '\0' + std::to_string(to_uint64(vs.install_datetime_));
+  key += '\0' + request.arch_ + '\0' + request.host_arch_;
+  for (auto const& [name, value] : select_vsdevcmd_inputs(request.env_)) {
+    key += '\0' + utf8_encode(name) + '=' + utf8_encode(value);
+  }
+  return key;
+}
+
+// Returns the value memoized under `key`, computing it outside the lock if
+// nobody has. Failures are not memoized, so the next request tries again.
+template <typename Slots, typename Compute>
+auto fill_once(std::mutex& mutex, std::condition_variable& filled,
+               Slots& slots, std::string const& key, Compute compute)
+    -> decltype(compute()) {
+  std::unique_lock lock(mutex);
+  while (true) {
+    auto [it, inserted] = slots.try_emplace(key);
+    if (inserted) {
+      break;
+    }
+    if (it->second.done_) {
+      return it->second.value_;
+    }
+    filled.wait(lock);
+  }
+  lock.unlock();
+
+  decltype(compute()) value;
+  try {
+    value = compute();
+  } catch (...) {
+    lock.lock();
+    slots.erase(key);
+    filled.notify_all();
+    throw;
+  }
+
+  lock.lock();
+  if (value) {
+    auto& slot = slots[key];
+    slot.value_ = value;
+    slot.done_ = true;
+  } else {
+    slots.erase(key);
+  }
+  filled.notify_all();
+  return value;
+}
+
+}  // namespace
+
+ResidentEnvironments::ResidentEnvironments(FindInstance find_instance,
+                                           Capture capture,
+                                           Fingerprint fingerprint)
+    : find_instance_(std::move(find_instance)),
+      capture_(std::move(capture)),
+      fingerprint_(std::move(fingerprint)) {
+  if (!fingerprint_) {
+    fingerprint_ = []() {
+      return instances_fingerprint(default_instances_dir());
+    };
+  }
+  instances_fingerprint_ = fingerprint_();
+}
+
+std::optional<Environment> ResidentEnvironments::environment(
+    RunRequest const& request, std::string& error) {
+  auto fingerprint = fingerprint_();
+  {
+    std::lock_guard lock(mutex_);
+    if (fingerprint != instances_fingerprint_) {
+      // An instance was installed, updated or removed since the lookups.
+      instances_.clear();
+      deltas_.clear();
+      instances_fingerprint_ = fingerprint;
+    }
+  }
+  auto vs = fill_once(mutex_, filled_, instances_, instance_key(request),
+                      [this, &request]() { return find_instance_(request); });
+  if (!vs) {
+    error = "no Visual Studio instance matches the request";
+    return std::nullopt;
+  }
+  auto delta = fill_once(
+      mutex_, filled_, deltas_, delta_key(*vs, request),
+      [this, &vs, &request]() { return capture_(*vs, request, request.env_); });
+  if (!delta) {
+    error = "VsDevCmd.bat failed for " + utf8_encode(vs->install_path_);
+    return std::nullopt;
+  }
+  auto env = request.env_;
+  apply_environment(env, *delta);
+  return env;
+}
+
+DevEnvServer::DevEnvServer(EnvironmentProvider& provider, CommandRunner runner)
+    : provider_(provider), runner_(std::move(runner)) {}
+
+bool DevEnvServer::serve_connection(LocalStream& stream) {
+  auto frame = stream.read_frame();
+  if (!frame) {
+    return true;
+  }
+  if (frame->type_ == FrameType::kShutdown) {
+    stream.write_frame(FrameType::kExit, encode_exit_code(0));
+    return false;
+  }
+  if (frame->type_ != FrameType::kRequest) {
+    stream.write_frame(FrameType::kError, "expected a request");
+    return true;
+  }
+  auto request = decode_run_request(frame->payload_);
+  if (!request) {
+    stream.write_frame(FrameType::kError,
+                       "malformed request or another protocol version");
+    return true;
+  }
+
+  try {
+    std::string error;
+    auto env = provider_.environment(*request, error);
+    if (!env) {
+      stream.write_frame(FrameType::kError, error);
+      return true;
+    }
+    // Once the client has gone, the command still runs to completion but
+    // its output is dropped.
+    bool connected = true;
+    auto exit_code = runner_(
+        *request, *env,
+        [&stream, &connected](OutputChannel channel, std::string_view data) {
+          if (connected) {
+            connected = stream.write_frame(channel == OutputChannel::kStdout
+                                               ? FrameType::kStdout
+                                               : FrameType::kStderr,
+                                           data);
+          }
+        });
+    if (!exit_code) {
+      stream.write_frame(FrameType::kError,
+                         "cannot start " + (request->command_.empty()
+                                                ? std::string("<empty>")
+                                                : request->command_.front()));
+      return true;
+    }
+    stream.write_frame(FrameType::kExit, encode_exit_code(*exit_code));
+  } catch (std::exception const& e) {
+    stream.write_frame(FrameType::kError, e.what());
+  }
+  return true;
+}
+
+void DevEnvServer::serve(LocalListener& listener) {
+  while (!stopping_) {
+    auto stream = listener.accept();
+    if (stopping_ || !stream.is_open()) {
+      break;
+    }
+    {
+      std::lock_guard lock(mutex_);
+      ++active_;
+    }
+    std::thread([this, &listener, stream = std::move(stream)]() mutable {
+      bool keep_serving = serve_connection(stream);
+      stream.close();
+      if (!keep_serving && !stopping_.exchange(true)) {
+        // Wakes the accept() the loop is blocked in.
+        connect_local(listener.endpoint());
+      }
+      std::lock_guard lock(mutex_);
+      --active_;
+      idle_.notify_all();
+    }).detach();
+  }
+  std::unique_lock lock(mutex_);
+  idle_.wait(lock, [this]() { return active_ == 0; });
+}
+
+std::optional<int> request_run(LocalStream& stream, RunRequest const& request,
+                               OutputSink const& sink, std::string& error) {
+  if (!stream.write_frame(FrameType::kRequest, encode_run_request(request))) {
+    error = "cannot send the request";
+    return std::nullopt;
+  }
+  while (auto frame = stream.read_frame()) {
+    switch (frame->type_) {
+      case FrameType::kStdout:
+        sink(OutputChannel::kStdout, frame->payload_);
+        break;
+      case FrameType::kStderr:
+        sink(OutputChannel::kStderr, frame->payload_);
+        break;
+      case FrameType::kExit:
+        if (auto exit_code = decode_exit_code(frame->payload_)) {
+          return exit_code;
+        }
+        error = "malformed exit code";
+        return std::nullopt;
+      case FrameType::kError:
+        error = frame->payload_;
+        return std::nullopt;
+      default:
+        error = "unexpected frame from the server";
+        return std::nullopt;
+    }
+  }
+  error = "the server closed the connection";
+  return std::nullopt;
+}
+
+bool request_shutdown(LocalStream& stream) {
+  if (!stream.write_frame(FrameType::kShutdown, {})) {
+    return false;
+  }
+  auto frame = stream.read_frame();
+  return frame && frame->type_ == FrameType::kExit;
+}
@@ -0,0 +1,108 @@
+#ifndef SERVE_H_
+#define SERVE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "env_cache.h"
+#include "instance.h"
+#include "local_socket.h"
+#include "process_runner.h"
+#include "serve_protocol.h"
+
+// Produces the environment a request's command runs in: the client's
+// environment with the selected instance's dev environment applied.
+class EnvironmentProvider {
+ public:
+  virtual ~EnvironmentProvider() = default;
+  // On failure returns std::nullopt and describes why in `error`.
+  virtual std::optional<Environment> environment(RunRequest const& request,
+                                                 std::string& error) = 0;
+};
+
+// Keeps what `vsrun --serve` has looked up in memory: the instance each
+// selector resolved to, and the VsDevCmd.bat delta for each instance, arch
+// pair and set of VsDevCmd inputs. Safe to call from several connections at
+// once; each distinct lookup runs once. Everything is forgotten when Setup's
+// instances change, so a long-running server sees installs and updates.
+class ResidentEnvironments : public EnvironmentProvider {
+ public:
+  using FindInstance =
+      std::function<std::optional<VisualStudio>(RunRequest const&)>;
+  // Captures (or loads from the on-disk cache) the delta for running
+  // VsDevCmd.bat of `vs` on top of `parent`.
+  using Capture = std::function<std::optional<EnvDelta>(
+      VisualStudio const& vs, RunRequest const& request,
+      Environment const& parent)>;
+  // Identifies the installed instances; instances_fingerprint() of
+  // default_instances_dir() when not given.
+  using Fingerprint = std::function<std::optional<uint64_t>()>;
+
+  ResidentEnvironments(FindInstance find_instance, Capture capture,
+                       Fingerprint fingerprint = {});
+
+  std::optional<Environment> environment(RunRequest const& request,
+                                         std::string& error) override;
+
+ private:
+  // The slot is filled once; later callers wait for the first one.
+  template <typename T>
+  struct Slot {
+    bool done_ = false;
+    std::optional<T> value_;
+  };
+
+  FindInstance find_instance_;
+  Capture capture_;
+  Fingerprint fingerprint_;
+  std::mutex mutex_;
+  std::condition_variable filled_;
+  // The fingerprint instances_ and deltas_ were looked up under.
+  std::optional<uint64_t> instances_fingerprint_;
+  std::map<std::string, Slot<VisualStudio>> instances_;
+  std::map<std::string, Slot<EnvDelta>> deltas_;
+};
+
+// Runs a request's command in `env`, streaming its output to `sink`.
+using CommandRunner = std::function<std::optional<int>(
+    RunRequest const& request, Environment const& env,
+    OutputSink const& sink)>;
+
+// The `vsrun --serve` loop: every connection carries one request, served on
+// its own thread while the loop accepts the next client.
+class DevEnvServer {
+ public:
+  DevEnvServer(EnvironmentProvider& provider, CommandRunner runner);
+
+  // Reads one request from `stream` and answers it. Returns false when the
+  // request asks the server to shut down.
+  bool serve_connection(LocalStream& stream);
+
+  // Accepts connections until a client sends kShutdown, then waits for the
+  // requests in flight to finish.
+  void serve(LocalListener& listener);
+
+ private:
+  EnvironmentProvider& provider_;
+  CommandRunner runner_;
+  std::atomic<bool> stopping_{false};
+  std::mutex mutex_;
+  std::condition_variable idle_;
+  int active_ = 0;
+};
+
+// Client side: sends `request` and forwards the output frames to `sink`.
+// Returns the command's exit code, or std::nullopt when the server failed,
+// with the reason in `error`.
+std::optional<int> request_run(LocalStream& stream, RunRequest const& request,
+                               OutputSink const& sink, std::string& error);
+// Asks the server on `stream` to stop accepting connections.
+bool request_shutdown(LocalStream& stream);
+
+#endif  // SERVE_H_
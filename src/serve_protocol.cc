@@ -0,0 +1,194 @@
+#include "serve_protocol.h"
+
+#include "unicode.h"
+
+namespace {
+
+enum RequestFlags : uint8_t {
+  kSelectLast = 1 << 0,
+  kUseShell = 1 << 1,
+};
+
+void put_u32(std::string& out, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+  }
+}
+
+uint32_t get_u32(std::string_view data) {
+  uint32_t value = 0;
+  for (int i = 0; i < 4; ++i) {
+    value |= uint32_t{static_cast<unsigned char>(data[i])} << (8 * i);
+  }
+  return value;
+}
+
+void put_string(std::string& out, std::string_view s) {
+  put_u32(out, static_cast<uint32_t>(s.size()));
+  out += s;
+}
+
+// Consumes the payload front to back; any read past the end fails the whole
+// decode.
+class PayloadReader {
+ public:
+  explicit PayloadReader(std::string_view data) : data_(data) {}
+
+  std::optional<uint32_t> u32() {
+    if (data_.size() < 4) {
+      return std::nullopt;
+    }
+    auto value = get_u32(data_);
+    data_.remove_prefix(4);
+    return value;
+  }
+
+  std::optional<uint8_t> u8() {
+    if (data_.empty()) {
+      return std::nullopt;
+    }
+    auto value = static_cast<uint8_t>(data_.front());
+    data_.remove_prefix(1);
+    return value;
+  }
+
+  std::optional<std::string> string() {
+    auto size = u32();
+    if (!size || data_.size() < *size) {
+      return std::nullopt;
+    }
+    std::string value(data_.substr(0, *size));
+    data_.remove_prefix(*size);
+    return value;
+  }
+
+  bool at_end() const { return data_.empty(); }
+
+ private:
+  std::string_view data_;
+};
+
+bool is_known_frame_type(uint8_t type) {
+  switch (static_cast<FrameType>(type)) {
+    case FrameType::kRequest:
+    case FrameType::kShutdown:
+    case FrameType::kStdout:
+    case FrameType::kStderr:
+    case FrameType::kExit:
+    case FrameType::kError:
+      return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+std::string encode_frame(FrameType type, std::string_view payload) {
+  std::string frame;
+  frame.reserve(kFrameHeaderSize + payload.size());
+  frame.push_back(static_cast<char>(type));
+  put_u32(frame, static_cast<uint32_t>(payload.size()));
+  frame += payload;
+  return frame;
+}
+
+std::optional<std::pair<FrameType, uint32_t>> decode_frame_header(
+    std::string_view data) {
+  if (data.size() < kFrameHeaderSize) {
+    return std::nullopt;
+  }
+  auto type = static_cast<uint8_t>(data[0]);
+  auto size = get_u32(data.substr(1));
+  if (!is_known_frame_type(type) || size > kMaxFramePayload) {
+    return std::nullopt;
+  }
+  return std::pair{static_cast<FrameType>(type), size};
+}
+
+std::string encode_run_request(RunRequest const& request) {
+  std::string out;
+  put_u32(out, kProtocolVersion);
+  for (auto const* field :
+       {&request.version_, &request.product_, &request.workload_,
+        &request.requires_all_, &request.requires_any_, &request.sort_,
+        &request.arch_, &request.host_arch_, &request.cwd_}) {
+    put_string(out, *field);
+  }
+  out.push_back(static_cast<char>((request.select_last_ ? kSelectLast : 0) |
+                                  (request.use_shell_ ? kUseShell : 0)));
+  put_u32(out, static_cast<uint32_t>(request.command_.size()));
+  for (auto const& arg : request.command_) {
+    put_string(out, arg);
+  }
+  put_u32(out, static_cast<uint32_t>(request.env_.size()));
+  for (auto const& [name, value] : request.env_) {
+    put_string(out, utf8_encode(name));
+    put_string(out, utf8_encode(value));
+  }
+  return out;
+}
+
+std::optional<RunRequest> decode_run_request(std::string_view payload) {
+  PayloadReader in(payload);
+  if (in.u32() != kProtocolVersion) {
+    return std::nullopt;
+  }
+  RunRequest request;
+  for (auto* field :
+       {&request.version_, &request.product_, &request.workload_,
+        &request.requires_all_, &request.requires_any_, &request.sort_,
+        &request.arch_, &request.host_arch_, &request.cwd_}) {
+    auto value = in.string();
+    if (!value) {
+      return std::nullopt;
+    }
+    *field = std::move(*value);
+  }
+  auto flags = in.u8();
+  if (!flags) {
+    return std::nullopt;
+  }
+  request.select_last_ = (*flags & kSelectLast) != 0;
+  request.use_shell_ = (*flags & kUseShell) != 0;
+
+  auto argc = in.u32();
+  if (!argc) {
+    return std::nullopt;
+  }
+  for (uint32_t i = 0; i < *argc; ++i) {
+    auto arg = in.string();
+    if (!arg) {
+      return std::nullopt;
+    }
+    request.command_.push_back(std::move(*arg));
+  }
+  auto envc = in.u32();
+  if (!envc) {
+    return std::nullopt;
+  }
+  for (uint32_t i = 0; i < *envc; ++i) {
+    auto name = in.string();
+    auto value = in.string();
+    if (!name || !value) {
+      return std::nullopt;
+    }
+    request.env_[utf8_decode(*name)] = utf8_decode(*value);
+  }
+  if (!in.at_end()) {
+    return std::nullopt;
+  }
+  return request;
+}
+
+std::string encode_exit_code(int exit_code) {
+  std::string out;
+  put_u32(out, static_cast<uint32_t>(exit_code));
+  return out;
+}
+
+std::optional<int> decode_exit_code(std::string_view payload) {
+  if (payload.size() != 4) {
+    return std::nullopt;
+  }
+  return static_cast<int>(get_u32(payload));
+}
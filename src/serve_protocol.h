@@ -0,0 +1,70 @@
+#ifndef SERVE_PROTOCOL_H_
+#define SERVE_PROTOCOL_H_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "env_cache.h"
+
+// The wire format between `vsrun --client` and `vsrun --serve`. Every message
+// is a frame: a type byte, a 32-bit little-endian payload length, then the
+// payload. The client sends one kRequest (or kShutdown); the server answers
+// with any number of kStdout/kStderr frames and ends with kExit or kError.
+enum class FrameType : uint8_t {
+  kRequest = 'Q',
+  kShutdown = 'S',
+  kStdout = 'O',
+  kStderr = 'E',
+  kExit = 'X',
+  kError = '!',
+};
+
+struct Frame {
+  FrameType type_;
+  std::string payload_;
+};
+
+inline constexpr uint32_t kProtocolVersion = 1;
+inline constexpr size_t kFrameHeaderSize = 5;
+// Bounds what a peer can make the other side allocate.
+inline constexpr uint32_t kMaxFramePayload = 64u << 20;
+
+// What a client asks the server to run: which instance, which dev
+// environment on top of which parent environment, and the command. The
+// instance selector fields take the same values as the vsrun options.
+struct RunRequest {
+  std::string version_;
+  std::string product_ = "*";
+  std::string workload_ = "*";
+  std::string requires_all_;
+  std::string requires_any_;
+  std::string sort_;
+  bool select_last_ = false;
+  std::string arch_;
+  std::string host_arch_;
+  bool use_shell_ = false;
+  std::string cwd_;
+  // The client's environment, after -u, -i and NAME=VALUE prefixes.
+  Environment env_;
+  std::vector<std::string> command_;
+
+  bool operator==(RunRequest const& other) const = default;
+};
+
+std::string encode_frame(FrameType type, std::string_view payload);
+// Parses the header at the start of `data`, returning the type and payload
+// length, or std::nullopt for an unknown type or an oversized payload.
+std::optional<std::pair<FrameType, uint32_t>> decode_frame_header(
+    std::string_view data);
+
+std::string encode_run_request(RunRequest const& request);
+// Returns std::nullopt for malformed payloads and other protocol versions.
+std::optional<RunRequest> decode_run_request(std::string_view payload);
+
+std::string encode_exit_code(int exit_code);
+std::optional<int> decode_exit_code(std::string_view payload);
+
+#endif  // SERVE_PROTOCOL_H_
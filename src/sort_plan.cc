@@ -0,0 +1,191 @@
+#include "sort_plan.h"
+
+#include <algorithm>
+
+#include "ascii.h"
+#include "package_index.h"
+#include "split.h"
+
+namespace {
+
+std::optional<bool> parse_direction(std::string_view direction) {
+  if (direction == "asc") {
+    return false;
+  }
+  if (direction == "desc") {
+    return true;
+  }
+  return std::nullopt;
+}
+
+template <typename T, typename Get>
+void sort_by_key(SortPlan const& plan, std::vector<T>& items, Get get) {
+  if (plan.empty() || items.size() < 2) {
+    return;
+  }
+  std::vector<std::pair<SortPlan::Key, size_t>> order;
+  order.reserve(items.size());
+  for (size_t i = 0; i < items.size(); ++i) {
+    order.emplace_back(plan.key(get(items[i])), i);
+  }
+  // The index breaks ties, which keeps the sort stable.
+  std::sort(order.begin(), order.end());
+
+  std::vector<T> sorted;
+  sorted.reserve(items.size());
+  for (auto const& [key, i] : order) {
+    sorted.push_back(std::move(items[i]));
+  }
+  items = std::move(sorted);
+}
+
+template <typename T, typename Get>
+std::optional<size_t> pick_by_key(SortPlan const& plan,
+                                  std::vector<T> const& items, bool last,
+                                  Get get) {
+  if (items.empty()) {
+    return std::nullopt;
+  }
+  if (plan.empty()) {
+    return last ? items.size() - 1 : 0;
+  }
+  size_t best = 0;
+  auto best_key = plan.key(get(items[0]));
+  for (size_t i = 1; i < items.size(); ++i) {
+    auto key = plan.key(get(items[i]));
+    // Ties go to the earlier instance first and to the later one last, as
+    // after a stable sort.
+    if (last ? !(key < best_key) : key < best_key) {
+      best = i;
+      best_key = key;
+    }
+  }
+  return best;
+}
+
+}  // namespace
+
+std::optional<SortPlan> SortPlan::parse(std::string_view spec,
+                                        std::string* error) {
+  SortPlan plan;
+  if (spec.empty()) {
+    return plan;
+  }
+  for (auto term : split_view(spec, ',')) {
+    auto fail = [error, term]() {
+      if (error) {
+        *error = std::string(term);
+      }
+      return std::nullopt;
+    };
+    auto colon = term.find(':');
+    if (colon == std::string_view::npos) {
+      return fail();
+    }
+    auto name = term.substr(0, colon);
+    auto value = term.substr(colon + 1);
+
+    Term compiled{};
+    if (name == "version" || name == "date" || name == "time") {
+      auto descending = parse_direction(value);
+      if (!descending) {
+        return fail();
+      }
+      compiled.field_ = name == "version" ? Field::kVersion : Field::kDate;
+      compiled.descending_ = *descending;
+    } else if (name == "product") {
+      compiled.field_ = Field::kProduct;
+      compiled.descending_ = false;
+      for (auto product : split_view(value, '-')) {
+        if (product.empty()) {
+          return fail();
+        }
+        std::wstring id(kProductPrefix);
+        id.append(product.begin(), product.end());
+        compiled.products_.push_back(fold_package_id(id));
+      }
+      auto count = static_cast<uint32_t>(compiled.products_.size());
+      compiled.product_ranks_.fill(count);
+      // Backwards, so that a product listed twice keeps its first rank.
+      for (auto rank = count; rank-- > 0;) {
+        auto product = find_product(compiled.products_[rank]);
+        compiled.product_ranks_[static_cast<size_t>(product)] = rank;
+      }
+    } else {
+      return fail();
+    }
+
+    // As before, a repeated field takes its last value.
+    auto same = std::find_if(plan.terms_.begin(), plan.terms_.end(),
+                             [&compiled](Term const& t) {
+                               return t.field_ == compiled.field_;
+                             });
+    if (same != plan.terms_.end()) {
+      *same = std::move(compiled);
+    } else {
+      plan.terms_.push_back(std::move(compiled));
+    }
+  }
+  return plan;
+}
+
+bool SortPlan::needs_details() const {
+  return std::any_of(terms_.begin(), terms_.end(), [](Term const& term) {
+    return term.field_ == Field::kDate;
+  });
+}
+
+SortPlan::Key SortPlan::key(VisualStudio const& vs) const {
+  Key key{};
+  for (size_t i = 0; i < terms_.size(); ++i) {
+    auto const& term = terms_[i];
+    uint64_t word = 0;
+    switch (term.field_) {
+      case Field::kVersion:
+        word = vs.version_;
+        break;
+      case Field::kDate:
+        word = to_uint64(vs.install_datetime_);
+        break;
+      case Field::kProduct: {
+        if (vs.product_ != Product::kUnknown) {
+          word = term.product_ranks_[static_cast<size_t>(vs.product_)];
+          break;
+        }
+        // Products missing from the list rank after all listed ones.
+        auto it = std::find_if(term.products_.begin(), term.products_.end(),
+                               [&vs](std::wstring const& product) {
+                                 return ascii_iequals(product, vs.product_id_);
+                               });
+        word = static_cast<uint64_t>(it - term.products_.begin());
+        break;
+      }
+    }
+    key[i] = term.descending_ ? ~word : word;
+  }
+  return key;
+}
+
+void SortPlan::apply(std::vector<VisualStudio>& instances) const {
+  sort_by_key(*this, instances, [](VisualStudio const& vs) -> auto& {
+    return vs;
+  });
+}
+
+void SortPlan::apply(std::vector<VisualStudio const*>& instances) const {
+  sort_by_key(*this, instances, [](VisualStudio const* vs) -> auto& {
+    return *vs;
+  });
+}
+
+std::optional<size_t> SortPlan::pick(
+    std::vector<VisualStudio> const& instances, bool last) const {
+  return pick_by_key(*this, instances, last,
+                     [](VisualStudio const& vs) -> auto& { return vs; });
+}
+
+std::optional<size_t> SortPlan::pick(
+    std::vector<VisualStudio const*> const& instances, bool last) const {
+  return pick_by_key(*this, instances, last,
+                     [](VisualStudio const* vs) -> auto& { return *vs; });
+}
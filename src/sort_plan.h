@@ -0,0 +1,80 @@
+#ifndef SORT_PLAN_H_
+#define SORT_PLAN_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "instance.h"
+
+// What a caller does with the sorted matches, so that whoever produces them
+// can stop once the rest cannot change the answer.
+enum class OutputIntent {
+  // Every match, in sort order.
+  kAll,
+  // Whether anything matches; any one match will do.
+  kExists,
+  // The match that sorts first, or last.
+  kFirst,
+  kLast,
+};
+
+// A compiled `--sort` specification, e.g.
+//
+//   version:asc,product:Professional-Enterprise-Community
+//
+// Terms apply in the order given. Before sorting, every instance gets one
+// packed key holding a word per term (the version, the install FILETIME or
+// the product's rank), complemented for descending terms, so the sort
+// itself only compares integers.
+class SortPlan {
+ public:
+  enum class Field { kVersion, kDate, kProduct };
+
+  struct Term {
+    Field field_;
+    bool descending_;
+    // Folded product ids in rank order, for Field::kProduct.
+    std::vector<std::wstring> products_;
+    // The rank of each known Product, products_.size() when not listed.
+    std::array<uint32_t, kProductCount> product_ranks_;
+  };
+
+  // At most one term per field; "date" and "time" are the same field.
+  static constexpr size_t kMaxTerms = 3;
+  using Key = std::array<uint64_t, kMaxTerms>;
+
+  SortPlan() = default;
+
+  // Returns std::nullopt and sets `error` to the offending term when `spec`
+  // is malformed. An empty `spec` compiles to the empty plan.
+  static std::optional<SortPlan> parse(std::string_view spec,
+                                       std::string* error = nullptr);
+
+  bool empty() const { return terms_.empty(); }
+  std::vector<Term> const& terms() const { return terms_; }
+
+  // Whether the key depends on details() rather than only on the version and
+  // product.
+  bool needs_details() const;
+
+  Key key(VisualStudio const& vs) const;
+  // Stable, so instances with equal keys keep their enumeration order.
+  void apply(std::vector<VisualStudio>& instances) const;
+  void apply(std::vector<VisualStudio const*>& instances) const;
+  // The index of the instance apply() would put first, or last with `last`,
+  // found in a single pass; std::nullopt when `instances` is empty.
+  std::optional<size_t> pick(std::vector<VisualStudio> const& instances,
+                             bool last) const;
+  std::optional<size_t> pick(
+      std::vector<VisualStudio const*> const& instances, bool last) const;
+
+ private:
+  std::vector<Term> terms_;
+};
+
+#endif  // SORT_PLAN_H_
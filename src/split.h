@@ -0,0 +1,266 @@
+#ifndef SPLIT_H_
+#define SPLIT_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template <typename T, typename = std::void_t<>>
+struct has_push_back : public std::false_type {};
+template <typename C>
+struct has_push_back<C, std::void_t<decltype(std::declval<C>().push_back(
+                            std::declval<typename C::value_type>()))>>
+    : public std::true_type {};
+template <typename T>
+constexpr bool has_push_back_v = has_push_back<T>::value;
+
+template <typename T, typename = std::void_t<>>
+struct has_emplace_back : public std::false_type {};
+template <typename C>
+struct has_emplace_back<C, std::void_t<decltype(std::declval<C>().emplace_back(
+                               std::declval<typename C::value_type>()))>>
+    : public std::true_type {};
+template <typename T>
+constexpr bool has_emplace_back_v = has_emplace_back<T>::value;
+
+template <typename T, typename = std::void_t<>>
+struct has_insert : public std::false_type {};
+template <typename C>
+struct has_insert<C, std::void_t<decltype(std::declval<C>().insert(
+                         std::declval<typename C::value_type>()))>>
+    : public std::true_type {};
+template <typename T>
+constexpr bool has_insert_v = has_insert<T>::value;
+
+template <typename T, typename = std::void_t<>>
+struct has_emplace : public std::false_type {};
+template <typename C>
+struct has_emplace<C, std::void_t<decltype(std::declval<C>().emplace(
+                          std::declval<typename C::value_type>()))>>
+    : public std::true_type {};
+template <typename T>
+constexpr bool has_emplace_v = has_emplace<T>::value;
+
+template <typename T, typename = std::void_t<>>
+struct has_push : public std::false_type {};
+template <typename C>
+struct has_push<C, std::void_t<decltype(std::declval<C>().push(
+                       std::declval<typename C::value_type>()))>>
+    : public std::true_type {};
+template <typename T>
+constexpr bool has_push_v = has_push<T>::value;
+
+template <typename T, typename = std::void_t<>>
+struct has_push_front : public std::false_type {};
+template <typename C>
+struct has_push_front<C, std::void_t<decltype(std::declval<C>().push_front(
+                             std::declval<typename C::value_type>()))>>
+    : public std::true_type {};
+template <typename T>
+constexpr bool has_push_front_v = has_push_front<T>::value;
+
+// Matches one delimiter character. SplitRange finds it with
+// char_traits::find, which is memchr/wmemchr and vectorized by the C
+// runtimes, instead of testing a character at a time.
+template <typename CharT>
+struct Delimiter {
+  CharT c_;
+
+  constexpr bool operator()(CharT c) const { return c == c_; }
+};
+
+// The tokens of a string as views into it, found one at a time as the range
+// is iterated; nothing is copied or allocated. At most `max_count`
+// delimiters split (any number when negative), so the last token holds the
+// rest of the string. With `is_compress_token` a run of delimiters counts
+// as one. There is always at least one token, if only an empty one.
+//
+// The range refers to the string, and its iterators to the range.
+template <typename CharT, typename F>
+class SplitRange {
+ public:
+  using view_type = std::basic_string_view<CharT>;
+
+  class iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = view_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = view_type const*;
+    using reference = view_type const&;
+
+    iterator() = default;
+
+    reference operator*() const { return token_; }
+    pointer operator->() const { return &token_; }
+
+    iterator& operator++() {
+      if (last_) {
+        done_ = true;
+      } else {
+        next();
+      }
+      return *this;
+    }
+    iterator operator++(int) {
+      auto old = *this;
+      ++*this;
+      return old;
+    }
+
+    bool operator==(iterator const& other) const {
+      return done_ == other.done_ &&
+             (done_ || (token_.data() == other.token_.data() &&
+                        token_.size() == other.token_.size()));
+    }
+
+   private:
+    friend class SplitRange;
+
+    explicit iterator(SplitRange const* range)
+        : range_(range),
+          rest_(range->str_),
+          splits_(range->max_count_),
+          done_(false) {
+      next();
+    }
+
+    // Takes the token at the front of rest_.
+    void next() {
+      if (splits_ != 0) {
+        auto end = range_->find(rest_);
+        if (end != view_type::npos) {
+          token_ = rest_.substr(0, end);
+          rest_.remove_prefix(end + 1);
+          if (range_->is_compress_token_) {
+            auto more = std::find_if_not(rest_.begin(), rest_.end(),
+                                         range_->is_delimiter_);
+            rest_.remove_prefix(static_cast<size_t>(more - rest_.begin()));
+          }
+          if (splits_ > 0) {
+            --splits_;
+          }
+          return;
+        }
+      }
+      token_ = rest_;
+      rest_ = {};
+      last_ = true;
+    }
+
+    SplitRange const* range_ = nullptr;
+    view_type rest_;
+    view_type token_;
+    int splits_ = 0;
+    bool last_ = false;
+    // Past the last token; the end iterator.
+    bool done_ = true;
+  };
+
+  SplitRange(view_type str, F is_delimiter, int max_count = -1,
+             bool is_compress_token = false)
+      : str_(str),
+        is_delimiter_(std::move(is_delimiter)),
+        max_count_(max_count),
+        is_compress_token_(is_compress_token) {}
+
+  iterator begin() const { return iterator(this); }
+  iterator end() const { return iterator(); }
+
+ private:
+  size_t find(view_type s) const {
+    if constexpr (std::is_same_v<F, Delimiter<CharT>>) {
+      auto const* found = std::char_traits<CharT>::find(s.data(), s.size(),
+                                                        is_delimiter_.c_);
+      return found ? static_cast<size_t>(found - s.data()) : view_type::npos;
+    } else {
+      auto found = std::find_if(s.begin(), s.end(), is_delimiter_);
+      return found == s.end() ? view_type::npos
+                              : static_cast<size_t>(found - s.begin());
+    }
+  }
+
+  view_type str_;
+  F is_delimiter_;
+  int max_count_;
+  bool is_compress_token_;
+};
+
+template <typename CharT, typename F>
+  requires std::is_same_v<bool,
+                          decltype(std::declval<F>()(std::declval<CharT>()))>
+SplitRange<CharT, F> split_view_if(std::basic_string_view<CharT> str, F f,
+                                   int max_count = -1,
+                                   bool is_compress_token = false) {
+  return {str, std::move(f), max_count, is_compress_token};
+}
+
+template <typename CharT, typename F>
+  requires std::is_same_v<bool,
+                          decltype(std::declval<F>()(std::declval<CharT>()))>
+SplitRange<CharT, F> split_view_if(std::basic_string<CharT> const& str, F f,
+                                   int max_count = -1,
+                                   bool is_compress_token = false) {
+  return {str, std::move(f), max_count, is_compress_token};
+}
+
+template <typename CharT>
+SplitRange<CharT, Delimiter<CharT>> split_view(
+    std::type_identity_t<std::basic_string_view<CharT>> str, CharT delim,
+    int max_count = -1, bool is_compress_token = false) {
+  return {str, Delimiter<CharT>{delim}, max_count, is_compress_token};
+}
+
+// Appends the tokens of split_view_if to `to`.
+template <typename CharT, typename F, typename C>
+  requires std::is_same_v<bool,
+                          decltype(std::declval<F>()(std::declval<CharT>()))>
+C& split_to_if(C& to, const std::basic_string<CharT>& str, F f,
+               int max_count = -1, bool is_compress_token = false) {
+  auto tokens = split_view_if(str, f, max_count, is_compress_token);
+  auto it = tokens.begin();
+  auto rest = *it;
+  // Spelled out: a braced pair of string_view iterators, which may be
+  // pointers, would pick the initializer_list overloads.
+  using value_type = typename C::value_type;
+  for (++it; it != tokens.end(); ++it) {
+    to.insert(to.end(), value_type(rest.begin(), rest.end()));
+    rest = *it;
+  }
+
+  if constexpr (has_emplace_back_v<C>) {
+    to.emplace_back(rest.begin(), rest.end());
+  } else if constexpr (has_emplace_v<C>) {
+    to.emplace(rest.begin(), rest.end());
+  } else if constexpr (has_push_back_v<C>) {
+    to.push_back(value_type(rest.begin(), rest.end()));
+  } else if constexpr (has_insert_v<C>) {
+    to.insert(value_type(rest.begin(), rest.end()));
+  } else if constexpr (has_push_v<C>) {
+    to.push(value_type(rest.begin(), rest.end()));
+  } else if constexpr (has_push_front_v<C>) {
+    to.push_front(value_type(rest.begin(), rest.end()));
+  } else {
+    static_assert(
+        !std::is_same_v<C, C>,
+        "The container does not support adding elements via a known method.");
+  }
+
+  return to;
+}
+
+inline std::vector<std::string> split(std::string const& s, char delim,
+                                      int max) {
+  std::vector<std::string> result;
+  for (auto token : split_view(s, delim, max)) {
+    result.emplace_back(token);
+  }
+  return result;
+}
+
+#endif  // SPLIT_H_
@@ -0,0 +1,89 @@
+#include "startup.h"
+
+#include <future>
+#include <memory>
+#include <thread>
+#include <utility>
+
+#include "trace.h"
+
+bool is_same_installation(VisualStudio const& a, VisualStudio const& b) {
+  return a.install_path_ == b.install_path_ &&
+         a.install_version_ == b.install_version_ &&
+         to_uint64(a.install_datetime_) == to_uint64(b.install_datetime_);
+}
+
+StartupResult run_startup(StartupStages const& stages) {
+  auto cancelled = std::make_shared<std::atomic<bool>>(false);
+
+  // The background stages own copies of their functions, so that an
+  // abandoned speculation does not refer to `stages`.
+  std::shared_future<Environment> parent =
+      std::async(std::launch::async, [prepare = stages.prepare_]() {
+        TraceSpan span("prepare stage");
+        return prepare ? prepare() : Environment{};
+      }).share();
+
+  std::shared_future<std::optional<VisualStudio>> guess;
+  std::future<std::optional<EnvDelta>> speculation;
+  if (stages.predict_ && stages.develop_) {
+    guess = std::async(std::launch::async, [predict = stages.predict_]() {
+              TraceSpan span("predict instance");
+              try {
+                return predict();
+              } catch (...) {
+                return std::optional<VisualStudio>();
+              }
+            }).share();
+    // Detached rather than std::async, whose future would block until a
+    // cancelled speculation has wound down.
+    std::packaged_task<std::optional<EnvDelta>()> task(
+        [develop = stages.develop_, guess, parent,
+         cancelled]() -> std::optional<EnvDelta> {
+          auto const& vs = guess.get();
+          if (!vs || cancelled->load()) {
+            return std::nullopt;
+          }
+          auto const& env = parent.get();
+          if (cancelled->load()) {
+            return std::nullopt;
+          }
+          TraceSpan span("speculative dev environment");
+          return develop(*vs, env, *cancelled);
+        });
+    speculation = task.get_future();
+    std::thread(std::move(task)).detach();
+  }
+
+  StartupResult result;
+  result.select_last_ = stages.select_last_;
+  try {
+    {
+      TraceSpan span("lookup stage");
+      result.instances_ = stages.lookup_();
+    }
+    result.parent_ = parent.get();
+  } catch (...) {
+    cancelled->store(true);
+    parent.wait();
+    throw;
+  }
+
+  auto const* selected = result.selected();
+  if (speculation.valid()) {
+    auto const& vs = guess.get();
+    if (selected && vs && is_same_installation(*vs, *selected)) {
+      result.speculation_ = Speculation::kHit;
+      result.dev_env_ = speculation.get();
+      return result;
+    }
+    cancelled->store(true);
+    result.speculation_ = vs ? Speculation::kMiss : Speculation::kNone;
+  }
+  if (selected && stages.develop_) {
+    TraceSpan span("dev environment stage");
+    std::atomic<bool> wanted{false};
+    result.dev_env_ = stages.develop_(*selected, result.parent_, wanted);
+  }
+  return result;
+}
@@ -0,0 +1,66 @@
+#ifndef STARTUP_H_
+#define STARTUP_H_
+
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include "env_cache.h"
+#include "instance.h"
+
+// The stages before vsrun can start a command. Only lookup_ runs on the
+// calling thread, which keeps the Setup COM objects on the thread that
+// created them. The others run in the background.
+struct StartupStages {
+  // The authoritative instance lookup, already filtered and sorted.
+  std::function<std::vector<VisualStudio>()> lookup_ = {};
+  // The parent environment for the command. It does not depend on the
+  // instance, so it is built while lookup_ runs.
+  std::function<Environment()> prepare_ = {};
+  // A cheap guess at the instance lookup_ will select, e.g. from the
+  // instance snapshot without checking that it is fresh, or std::nullopt.
+  // Empty, or throwing, means no guess.
+  std::function<std::optional<VisualStudio>()> predict_ = {};
+  // The dev environment of an instance on top of the parent. Empty when the
+  // command needs none. With a guess, it starts for the guessed instance
+  // before lookup_ returns. `cancelled` is set once that result is known to
+  // be unwanted.
+  std::function<std::optional<EnvDelta>(VisualStudio const& vs,
+                                         Environment const& parent,
+                                         std::atomic<bool> const& cancelled)>
+      develop_ = {};
+  bool select_last_ = false;
+};
+
+enum class Speculation { kNone, kHit, kMiss };
+
+struct StartupResult {
+  std::vector<VisualStudio> instances_;
+  bool select_last_ = false;
+  Environment parent_;
+  // develop_ for the selected instance.
+  std::optional<EnvDelta> dev_env_;
+  Speculation speculation_ = Speculation::kNone;
+
+  VisualStudio const* selected() const {
+    if (instances_.empty()) {
+      return nullptr;
+    }
+    return select_last_ ? &instances_.back() : &instances_.front();
+  }
+};
+
+// Whether `a` and `b` are the same installation, as the env cache keys it.
+bool is_same_installation(VisualStudio const& a, VisualStudio const& b);
+
+// Runs `stages`, overlapping those that do not depend on each other. A guess
+// that matches the selected instance reuses the speculative develop_; any
+// other is cancelled and develop_ runs again for the selected instance.
+// A cancelled develop_ is not waited for: it runs on a detached thread with
+// its own copy of the function, and should return soon after `cancelled` is
+// set. Exceptions from lookup_, prepare_ and develop_ propagate once
+// prepare_ has stopped.
+StartupResult run_startup(StartupStages const& stages);
+
+#endif  // STARTUP_H_
@@ -0,0 +1,338 @@
+#include "state_json.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+#include "ascii.h"
+#include "json_reader.h"
+#include "unicode.h"
+#include "version.h"
+
+namespace {
+
+std::wstring to_wide(std::string_view raw) {
+  if (raw.find('\\') == std::string_view::npos) {
+    return utf8_decode(raw);
+  }
+  return utf8_decode(json_unescape(raw));
+}
+
+bool read_digits(std::string_view& s, size_t n, int& value) {
+  if (s.size() < n) {
+    return false;
+  }
+  value = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (s[i] < '0' || s[i] > '9') {
+      return false;
+    }
+    value = value * 10 + (s[i] - '0');
+  }
+  s.remove_prefix(n);
+  return true;
+}
+
+bool skip_char(std::string_view& s, char c) {
+  if (s.empty() || s.front() != c) {
+    return false;
+  }
+  s.remove_prefix(1);
+  return true;
+}
+
+// Days since 1970-01-01 in the proleptic Gregorian calendar.
+int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  const int64_t era = (y >= 0 ? y : y - 399) / 400;
+  const unsigned yoe = static_cast<unsigned>(y - era * 400);
+  const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+bool is_true(JsonReader& reader) {
+  if (reader.peek() == JsonReader::Type::kBool) {
+    bool value = false;
+    return reader.read_bool(value) && value;
+  }
+  if (reader.peek() == JsonReader::Type::kString) {
+    std::string_view raw;
+    return reader.read_string(raw) && ascii_iequals(raw, "true");
+  }
+  reader.skip();
+  return false;
+}
+
+// Member `name` of the current object as a string, other types skipped.
+void read_string_member(JsonReader& reader, std::wstring& out) {
+  std::string_view raw;
+  if (reader.peek() == JsonReader::Type::kString) {
+    if (reader.read_string(raw)) {
+      out = to_wide(raw);
+    }
+  } else {
+    reader.skip();
+  }
+}
+
+void read_product(JsonReader& reader, VisualStudio& vs) {
+  if (reader.peek() != JsonReader::Type::kObject) {
+    reader.skip();
+    return;
+  }
+  std::string_view key;
+  reader.begin_object();
+  while (reader.next_member(key)) {
+    if (key == "id") {
+      read_string_member(reader, vs.product_id_);
+      vs.product_ = find_product(vs.product_id_);
+    } else {
+      reader.skip();
+    }
+  }
+}
+
+void read_catalog(JsonReader& reader, VisualStudio& vs) {
+  if (reader.peek() != JsonReader::Type::kObject) {
+    reader.skip();
+    return;
+  }
+  std::string_view key;
+  reader.begin_object();
+  while (reader.next_member(key)) {
+    if (key == "productMilestoneIsPreRelease") {
+      vs.is_prerelease_ = is_true(reader);
+    } else {
+      reader.skip();
+    }
+  }
+}
+
+void read_display_name(JsonReader& reader, std::string_view language,
+                       VisualStudio& vs) {
+  if (reader.peek() != JsonReader::Type::kArray) {
+    reader.skip();
+    return;
+  }
+  bool preferred = false;
+  reader.begin_array();
+  while (reader.next_element()) {
+    if (reader.peek() != JsonReader::Type::kObject) {
+      reader.skip();
+      continue;
+    }
+    std::string_view key, lang, title;
+    reader.begin_object();
+    while (reader.next_member(key)) {
+      if (key == "language" &&
+          reader.peek() == JsonReader::Type::kString) {
+        reader.read_string(lang);
+      } else if (key == "title" &&
+                 reader.peek() == JsonReader::Type::kString) {
+        reader.read_string(title);
+      } else {
+        reader.skip();
+      }
+    }
+    if (!preferred && !title.empty() &&
+        (vs.display_name_.empty() || ascii_iequals(lang, language))) {
+      vs.display_name_ = to_wide(title);
+      preferred = ascii_iequals(lang, language);
+    }
+  }
+}
+
+void read_packages(JsonReader& reader, VisualStudio& vs) {
+  if (reader.peek() != JsonReader::Type::kArray) {
+    reader.skip();
+    return;
+  }
+  std::vector<InternedId> packages;
+  reader.begin_array();
+  while (reader.next_element()) {
+    if (reader.peek() != JsonReader::Type::kObject) {
+      reader.skip();
+      continue;
+    }
+    std::string_view key, id, type;
+    reader.begin_object();
+    while (reader.next_member(key)) {
+      if (key == "id" && reader.peek() == JsonReader::Type::kString) {
+        reader.read_string(id);
+      } else if (key == "type" &&
+                 reader.peek() == JsonReader::Type::kString) {
+        reader.read_string(type);
+      } else {
+        reader.skip();
+      }
+    }
+    if (id.empty()) {
+      continue;
+    }
+    packages.push_back(Interner::global().intern(to_wide(id)));
+    if (ascii_iequals(type, "Workload")) {
+      vs.workloads_.insert(packages.back());
+    }
+  }
+  vs.packages_ = PackageIndex::from_ids(std::move(packages));
+}
+
+}  // namespace
+
+std::optional<uint64_t> parse_iso8601_filetime(std::string_view s) {
+  int year, month, day, hour, minute, second;
+  if (!read_digits(s, 4, year) || !skip_char(s, '-') ||
+      !read_digits(s, 2, month) || !skip_char(s, '-') ||
+      !read_digits(s, 2, day) || !skip_char(s, 'T') ||
+      !read_digits(s, 2, hour) || !skip_char(s, ':') ||
+      !read_digits(s, 2, minute) || !skip_char(s, ':') ||
+      !read_digits(s, 2, second)) {
+    return std::nullopt;
+  }
+  if (year < 1601 || month < 1 || month > 12 || day < 1 || day > 31 ||
+      hour > 23 || minute > 59 || second > 60) {
+    return std::nullopt;
+  }
+
+  // Fractional seconds, to 100ns resolution.
+  int64_t fraction = 0;
+  if (skip_char(s, '.')) {
+    int digits = 0;
+    while (!s.empty() && '0' <= s.front() && s.front() <= '9') {
+      if (digits++ < 7) {
+        fraction = fraction * 10 + (s.front() - '0');
+      }
+      s.remove_prefix(1);
+    }
+    for (; digits < 7; ++digits) {
+      fraction *= 10;
+    }
+  }
+
+  int64_t offset_seconds = 0;
+  if (!s.empty() && (s.front() == '+' || s.front() == '-')) {
+    int sign = s.front() == '-' ? -1 : 1;
+    s.remove_prefix(1);
+    int oh, om;
+    if (!read_digits(s, 2, oh) || !skip_char(s, ':') ||
+        !read_digits(s, 2, om)) {
+      return std::nullopt;
+    }
+    offset_seconds = sign * (oh * 3600 + om * 60);
+  } else if (!skip_char(s, 'Z') && !s.empty()) {
+    return std::nullopt;
+  }
+  if (!s.empty()) {
+    return std::nullopt;
+  }
+
+  constexpr int64_t kDaysFrom1601To1970 = 134774;
+  int64_t days = days_from_civil(year, static_cast<unsigned>(month),
+                                 static_cast<unsigned>(day)) +
+                 kDaysFrom1601To1970;
+  int64_t seconds =
+      days * 86400 + hour * 3600 + minute * 60 + second - offset_seconds;
+  if (seconds < 0) {
+    return std::nullopt;
+  }
+  return static_cast<uint64_t>(seconds * 10000000 + fraction);
+}
+
+std::optional<VisualStudio> parse_state_json(std::string_view json,
+                                             std::string_view language) {
+  VisualStudio vs{.version_ = 0,
+                  .install_datetime_ = to_filetime(0),
+                  .install_version_ = {},
+                  .install_path_ = {},
+                  .display_name_ = {},
+                  .product_id_ = {},
+                  // state.json only records completeness when it is not.
+                  .is_complete_ = true,
+                  .is_prerelease_ = false,
+                  .workloads_ = {},
+                  .packages_ = {}};
+
+  JsonReader reader(json);
+  std::string_view key;
+  if (!reader.begin_object()) {
+    return std::nullopt;
+  }
+  while (reader.next_member(key)) {
+    if (key == "installationPath") {
+      read_string_member(reader, vs.install_path_);
+    } else if (key == "installationVersion") {
+      read_string_member(reader, vs.install_version_);
+    } else if (key == "installDate") {
+      std::string_view raw;
+      if (reader.peek() == JsonReader::Type::kString &&
+          reader.read_string(raw)) {
+        if (auto ticks = parse_iso8601_filetime(raw); ticks) {
+          vs.install_datetime_ = to_filetime(*ticks);
+        }
+      } else {
+        reader.skip();
+      }
+    } else if (key == "isComplete") {
+      vs.is_complete_ = is_true(reader);
+    } else if (key == "product") {
+      read_product(reader, vs);
+    } else if (key == "catalogInfo") {
+      read_catalog(reader, vs);
+    } else if (key == "localizedResources") {
+      read_display_name(reader, language, vs);
+    } else if (key == "packages") {
+      read_packages(reader, vs);
+    } else {
+      reader.skip();
+    }
+  }
+  if (reader.failed() || vs.install_path_.empty() ||
+      vs.install_version_.empty()) {
+    return std::nullopt;
+  }
+  auto version = parse_version(vs.install_version_);
+  if (!version) {
+    return std::nullopt;
+  }
+  vs.version_ = *version;
+  return vs;
+}
+
+std::vector<VisualStudio> enumerate_state_json_instances(
+    std::filesystem::path const& instances_dir, std::string_view language) {
+  std::vector<std::filesystem::path> states;
+  std::error_code ec;
+  for (auto it = std::filesystem::directory_iterator(instances_dir, ec);
+       !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+    states.push_back(it->path() / "state.json");
+  }
+  // Same order on every run, like the COM enumeration.
+  std::sort(states.begin(), states.end());
+
+  std::vector<VisualStudio> all;
+  std::string buffer;
+  for (auto const& state : states) {
+    std::ifstream in(state, std::ios::binary);
+    if (!in) {
+      continue;
+    }
+    auto size = std::filesystem::file_size(state, ec);
+    if (ec) {
+      continue;
+    }
+    buffer.resize(static_cast<size_t>(size));
+    if (!in.read(buffer.data(), static_cast<std::streamsize>(size))) {
+      continue;
+    }
+    std::string_view json = buffer;
+    if (json.starts_with("\xEF\xBB\xBF")) {
+      json.remove_prefix(3);
+    }
+    if (auto vs = parse_state_json(json, language); vs) {
+      all.push_back(std::move(*vs));
+    }
+  }
+  return all;
+}
@@ -0,0 +1,32 @@
+#ifndef STATE_JSON_H_
+#define STATE_JSON_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "instance.h"
+
+// A COM-free instance source: Setup records every instance in
+// _Instances\<id>\state.json, which holds everything VisualStudio needs.
+// Only the required members are decoded; the rest, including the thousands
+// of package entries other than their id and type, is skipped in place.
+
+// Returns std::nullopt when `json` is malformed or lacks the installation
+// path or version. `language` picks the localized display name.
+std::optional<VisualStudio> parse_state_json(std::string_view json,
+                                             std::string_view language =
+                                                 "en-us");
+
+// Parses every `<instances_dir>/*/state.json`, skipping unreadable ones.
+std::vector<VisualStudio> enumerate_state_json_instances(
+    std::filesystem::path const& instances_dir,
+    std::string_view language = "en-us");
+
+// "2023-11-15T08:21:31Z" (optionally with fractional seconds) to FILETIME
+// ticks.
+std::optional<uint64_t> parse_iso8601_filetime(std::string_view str);
+
+#endif  // STATE_JSON_H_
@@ -0,0 +1,122 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace {
+
+std::atomic<uint64_t> next_tracer_id{1};
+
+// Trace-event timestamps are microseconds; keeps the nanoseconds as
+// decimals.
+void append_micros(std::string& out, uint64_t nanos) {
+  char text[32];
+  std::snprintf(text, sizeof(text), "%llu.%03u",
+                static_cast<unsigned long long>(nanos / 1000),
+                static_cast<unsigned>(nanos % 1000));
+  out += text;
+}
+
+void append_json_string(std::string& out, char const* str) {
+  out += '"';
+  for (; *str; ++str) {
+    auto c = static_cast<unsigned char>(*str);
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += static_cast<char>(c);
+    } else if (c < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out += escaped;
+    } else {
+      out += static_cast<char>(c);
+    }
+  }
+  out += '"';
+}
+
+}  // namespace
+
+Tracer::Tracer()
+    : epoch_(std::chrono::steady_clock::now()),
+      id_(next_tracer_id.fetch_add(1, std::memory_order_relaxed)) {}
+
+Tracer::Buffer& Tracer::buffer() {
+  thread_local uint64_t tracer_id = 0;
+  thread_local Buffer* buffer = nullptr;
+  if (tracer_id != id_) {
+    std::lock_guard lock(mutex_);
+    buffers_.push_back(std::make_unique<Buffer>());
+    buffer = buffers_.back().get();
+    buffer->thread_ = static_cast<uint32_t>(buffers_.size());
+    tracer_id = id_;
+  }
+  return *buffer;
+}
+
+void Tracer::record(char const* name, uint64_t start, uint64_t end) {
+  auto& buffer = this->buffer();
+  std::lock_guard lock(buffer.mutex_);
+  buffer.events_.push_back(
+      {name, start, end > start ? end - start : 0, buffer.thread_});
+}
+
+std::vector<TraceEvent> Tracer::events() const {
+  std::vector<TraceEvent> events;
+  {
+    std::lock_guard lock(mutex_);
+    for (auto const& buffer : buffers_) {
+      std::lock_guard buffer_lock(buffer->mutex_);
+      events.insert(events.end(), buffer->events_.begin(),
+                    buffer->events_.end());
+    }
+  }
+  // Enclosing spans first, so viewers nest spans that start together.
+  std::stable_sort(events.begin(), events.end(),
+                   [](TraceEvent const& a, TraceEvent const& b) {
+                     return a.start_ != b.start_ ? a.start_ < b.start_
+                                                 : a.duration_ > b.duration_;
+                   });
+  return events;
+}
+
+std::string Tracer::to_json() const {
+  std::string json = "{\"traceEvents\":[";
+  bool first = true;
+  for (auto const& event : events()) {
+    json += first ? "\n" : ",\n";
+    first = false;
+    json += "{\"name\":";
+    append_json_string(json, event.name_);
+    json += ",\"cat\":\"vsrun\",\"ph\":\"X\",\"ts\":";
+    append_micros(json, event.start_);
+    json += ",\"dur\":";
+    append_micros(json, event.duration_);
+    json += ",\"pid\":1,\"tid\":";
+    json += std::to_string(event.thread_);
+    json += '}';
+  }
+  json += "\n],\"displayTimeUnit\":\"ms\"}\n";
+  return json;
+}
+
+bool Tracer::write(std::filesystem::path const& path) const {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out << to_json();
+  return static_cast<bool>(out);
+}
+
+TraceSession::TraceSession(std::filesystem::path path, Tracer& tracer)
+    : path_(std::move(path)), tracer_(tracer) {
+  if (!path_.empty()) {
+    tracer_.enable();
+  }
+}
+
+TraceSession::~TraceSession() {
+  if (!path_.empty()) {
+    tracer_.disable();
+    tracer_.write(path_);
+  }
+}
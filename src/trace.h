@@ -0,0 +1,114 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One timed span, in nanoseconds since the tracer was created. `name_` must
+// outlive the tracer; spans are named with string literals.
+struct TraceEvent {
+  char const* name_;
+  uint64_t start_;
+  uint64_t duration_;
+  // Small ids in the order threads first recorded a span, 1 for the first.
+  uint32_t thread_;
+};
+
+// Collects spans in memory for `--trace`. Each thread appends to its own
+// buffer, so recording only takes that buffer's uncontended lock. Disabled,
+// a TraceSpan costs one relaxed load.
+class Tracer {
+ public:
+  // The process-wide tracer that TraceSpan records into by default.
+  static Tracer& global() {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  Tracer();
+  Tracer(Tracer const&) = delete;
+  Tracer& operator=(Tracer const&) = delete;
+
+  void enable() { enabled_.store(true, std::memory_order_relaxed); }
+  void disable() { enabled_.store(false, std::memory_order_relaxed); }
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  // Nanoseconds since the tracer was created, whether or not it is enabled,
+  // so that a span can start before tracing is turned on.
+  uint64_t now() const {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - epoch_)
+            .count());
+  }
+
+  void record(char const* name, uint64_t start, uint64_t end);
+
+  // Every span recorded so far, by start time.
+  std::vector<TraceEvent> events() const;
+  // The spans as Chrome trace-event JSON, for chrome://tracing or Perfetto.
+  std::string to_json() const;
+  bool write(std::filesystem::path const& path) const;
+
+ private:
+  struct Buffer {
+    std::mutex mutex_;
+    std::vector<TraceEvent> events_;
+    uint32_t thread_;
+  };
+
+  Buffer& buffer();
+
+  std::atomic<bool> enabled_{false};
+  std::chrono::steady_clock::time_point epoch_;
+  // Tells this tracer's thread-local buffers from those of a tracer that
+  // lived at the same address before.
+  uint64_t id_;
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Buffer>> buffers_;
+};
+
+// Records the time from construction to destruction as a span of `tracer`,
+// when it is enabled at construction.
+class TraceSpan {
+ public:
+  explicit TraceSpan(char const* name, Tracer& tracer = Tracer::global())
+      : tracer_(tracer.enabled() ? &tracer : nullptr),
+        name_(name),
+        start_(tracer_ ? tracer_->now() : 0) {}
+  ~TraceSpan() {
+    if (tracer_) {
+      tracer_->record(name_, start_, tracer_->now());
+    }
+  }
+  TraceSpan(TraceSpan const&) = delete;
+  TraceSpan& operator=(TraceSpan const&) = delete;
+
+ private:
+  Tracer* tracer_;
+  char const* name_;
+  uint64_t start_;
+};
+
+// Enables `tracer` for its lifetime and then writes it to `path`, unless
+// `path` is empty, which leaves tracing off.
+class TraceSession {
+ public:
+  explicit TraceSession(std::filesystem::path path,
+                        Tracer& tracer = Tracer::global());
+  ~TraceSession();
+  TraceSession(TraceSession const&) = delete;
+  TraceSession& operator=(TraceSession const&) = delete;
+
+ private:
+  std::filesystem::path path_;
+  Tracer& tracer_;
+};
+
+#endif  // TRACE_H_
@@ -0,0 +1,370 @@
+#include "unicode.h"
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// The ASCII fast paths below copy a vector of characters at a time and stop
+// at the first vector that holds anything else. The widest instruction set
+// the compiler targets is used; there is no runtime dispatch.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define UNICODE_ASCII_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UNICODE_ASCII_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define UNICODE_ASCII_NEON 1
+#endif
+
+namespace {
+
+constexpr char32_t kReplacement = 0xFFFD;
+
+using WideUnit = std::make_unsigned_t<wchar_t>;
+
+// Widens the leading ASCII bytes of `in` into `out` and returns how many
+// there were.
+size_t widen_ascii(char const* in, size_t size, wchar_t* out) {
+  size_t i = 0;
+#if defined(UNICODE_ASCII_AVX2)
+  for (; i + 32 <= size; i += 32) {
+    auto bytes =
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(in + i));
+    if (_mm256_movemask_epi8(bytes) != 0) {
+      break;
+    }
+    for (int half = 0; half < 2; ++half) {
+      auto part = half == 0 ? _mm256_castsi256_si128(bytes)
+                            : _mm256_extracti128_si256(bytes, 1);
+      auto* dest = reinterpret_cast<__m256i*>(out + i + half * 16);
+      if constexpr (sizeof(wchar_t) == 2) {
+        _mm256_storeu_si256(dest, _mm256_cvtepu8_epi16(part));
+      } else {
+        _mm256_storeu_si256(dest, _mm256_cvtepu8_epi32(part));
+        _mm256_storeu_si256(dest + 1,
+                            _mm256_cvtepu8_epi32(_mm_srli_si128(part, 8)));
+      }
+    }
+  }
+#elif defined(UNICODE_ASCII_SSE2)
+  auto const zero = _mm_setzero_si128();
+  for (; i + 16 <= size; i += 16) {
+    auto bytes = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i));
+    if (_mm_movemask_epi8(bytes) != 0) {
+      break;
+    }
+    auto* dest = reinterpret_cast<__m128i*>(out + i);
+    auto low = _mm_unpacklo_epi8(bytes, zero);
+    auto high = _mm_unpackhi_epi8(bytes, zero);
+    if constexpr (sizeof(wchar_t) == 2) {
+      _mm_storeu_si128(dest, low);
+      _mm_storeu_si128(dest + 1, high);
+    } else {
+      _mm_storeu_si128(dest, _mm_unpacklo_epi16(low, zero));
+      _mm_storeu_si128(dest + 1, _mm_unpackhi_epi16(low, zero));
+      _mm_storeu_si128(dest + 2, _mm_unpacklo_epi16(high, zero));
+      _mm_storeu_si128(dest + 3, _mm_unpackhi_epi16(high, zero));
+    }
+  }
+#elif defined(UNICODE_ASCII_NEON)
+  for (; i + 16 <= size; i += 16) {
+    auto bytes = vld1q_u8(reinterpret_cast<uint8_t const*>(in + i));
+    if (vmaxvq_u8(bytes) >= 0x80) {
+      break;
+    }
+    auto low = vmovl_u8(vget_low_u8(bytes));
+    auto high = vmovl_u8(vget_high_u8(bytes));
+    if constexpr (sizeof(wchar_t) == 2) {
+      auto* dest = reinterpret_cast<uint16_t*>(out + i);
+      vst1q_u16(dest, low);
+      vst1q_u16(dest + 8, high);
+    } else {
+      auto* dest = reinterpret_cast<uint32_t*>(out + i);
+      vst1q_u32(dest, vmovl_u16(vget_low_u16(low)));
+      vst1q_u32(dest + 4, vmovl_u16(vget_high_u16(low)));
+      vst1q_u32(dest + 8, vmovl_u16(vget_low_u16(high)));
+      vst1q_u32(dest + 12, vmovl_u16(vget_high_u16(high)));
+    }
+  }
+#else
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, in + i, sizeof(word));
+    if ((word & 0x8080808080808080ULL) != 0) {
+      break;
+    }
+    for (size_t n = 0; n < 8; ++n) {
+      out[i + n] = static_cast<wchar_t>(in[i + n]);
+    }
+  }
+#endif
+  for (; i < size && static_cast<uint8_t>(in[i]) < 0x80; ++i) {
+    out[i] = static_cast<wchar_t>(in[i]);
+  }
+  return i;
+}
+
+// Narrows the leading ASCII characters of `in` into `out` and returns how
+// many there were.
+size_t narrow_ascii(wchar_t const* in, size_t size, char* out) {
+  size_t i = 0;
+#if defined(UNICODE_ASCII_AVX2)
+  if constexpr (sizeof(wchar_t) == 2) {
+    auto const non_ascii = _mm256_set1_epi16(static_cast<short>(0xFF80));
+    for (; i + 32 <= size; i += 32) {
+      auto const* src = reinterpret_cast<__m256i const*>(in + i);
+      auto a = _mm256_loadu_si256(src);
+      auto b = _mm256_loadu_si256(src + 1);
+      if (!_mm256_testz_si256(_mm256_or_si256(a, b), non_ascii)) {
+        break;
+      }
+      // packus works within 128-bit lanes; the permute restores the order.
+      auto packed =
+          _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0b11011000);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+    }
+  } else {
+    auto const non_ascii = _mm256_set1_epi32(~0x7F);
+    auto const order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    for (; i + 32 <= size; i += 32) {
+      auto const* src = reinterpret_cast<__m256i const*>(in + i);
+      auto a = _mm256_loadu_si256(src);
+      auto b = _mm256_loadu_si256(src + 1);
+      auto c = _mm256_loadu_si256(src + 2);
+      auto d = _mm256_loadu_si256(src + 3);
+      auto any = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+      if (!_mm256_testz_si256(any, non_ascii)) {
+        break;
+      }
+      auto packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b),
+                                        _mm256_packs_epi32(c, d));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i),
+                          _mm256_permutevar8x32_epi32(packed, order));
+    }
+  }
+#elif defined(UNICODE_ASCII_SSE2)
+  auto const zero = _mm_setzero_si128();
+  if constexpr (sizeof(wchar_t) == 2) {
+    auto const non_ascii = _mm_set1_epi16(static_cast<short>(0xFF80));
+    for (; i + 16 <= size; i += 16) {
+      auto const* src = reinterpret_cast<__m128i const*>(in + i);
+      auto a = _mm_loadu_si128(src);
+      auto b = _mm_loadu_si128(src + 1);
+      auto high_bits = _mm_and_si128(_mm_or_si128(a, b), non_ascii);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi16(high_bits, zero)) != 0xFFFF) {
+        break;
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                       _mm_packus_epi16(a, b));
+    }
+  } else {
+    auto const non_ascii = _mm_set1_epi32(~0x7F);
+    for (; i + 16 <= size; i += 16) {
+      auto const* src = reinterpret_cast<__m128i const*>(in + i);
+      auto a = _mm_loadu_si128(src);
+      auto b = _mm_loadu_si128(src + 1);
+      auto c = _mm_loadu_si128(src + 2);
+      auto d = _mm_loadu_si128(src + 3);
+      auto any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+      auto high_bits = _mm_and_si128(any, non_ascii);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(high_bits, zero)) != 0xFFFF) {
+        break;
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                       _mm_packus_epi16(_mm_packs_epi32(a, b),
+                                        _mm_packs_epi32(c, d)));
+    }
+  }
+#elif defined(UNICODE_ASCII_NEON)
+  auto* dest = reinterpret_cast<uint8_t*>(out);
+  if constexpr (sizeof(wchar_t) == 2) {
+    for (; i + 16 <= size; i += 16) {
+      auto const* src = reinterpret_cast<uint16_t const*>(in + i);
+      auto a = vld1q_u16(src);
+      auto b = vld1q_u16(src + 8);
+      if (vmaxvq_u16(vorrq_u16(a, b)) >= 0x80) {
+        break;
+      }
+      vst1q_u8(dest + i, vcombine_u8(vmovn_u16(a), vmovn_u16(b)));
+    }
+  } else {
+    for (; i + 16 <= size; i += 16) {
+      auto const* src = reinterpret_cast<uint32_t const*>(in + i);
+      auto a = vld1q_u32(src);
+      auto b = vld1q_u32(src + 4);
+      auto c = vld1q_u32(src + 8);
+      auto d = vld1q_u32(src + 12);
+      if (vmaxvq_u32(vorrq_u32(vorrq_u32(a, b), vorrq_u32(c, d))) >= 0x80) {
+        break;
+      }
+      auto low = vcombine_u16(vmovn_u32(a), vmovn_u32(b));
+      auto high = vcombine_u16(vmovn_u32(c), vmovn_u32(d));
+      vst1q_u8(dest + i, vcombine_u8(vmovn_u16(low), vmovn_u16(high)));
+    }
+  }
+#endif
+  for (; i < size && static_cast<WideUnit>(in[i]) < 0x80; ++i) {
+    out[i] = static_cast<char>(in[i]);
+  }
+  return i;
+}
+
+char* put_utf8(char* out, char32_t cp) {
+  if (cp < 0x80) {
+    *out++ = static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    *out++ = static_cast<char>(0xC0 | (cp >> 6));
+    *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    *out++ = static_cast<char>(0xE0 | (cp >> 12));
+    *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+  } else {
+    *out++ = static_cast<char>(0xF0 | (cp >> 18));
+    *out++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+    *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+  }
+  return out;
+}
+
+wchar_t* put_wide(wchar_t* out, char32_t cp) {
+  if constexpr (sizeof(wchar_t) == 2) {
+    if (cp >= 0x10000) {
+      cp -= 0x10000;
+      *out++ = static_cast<wchar_t>(0xD800 + (cp >> 10));
+      *out++ = static_cast<wchar_t>(0xDC00 + (cp & 0x3FF));
+      return out;
+    }
+  }
+  *out++ = static_cast<wchar_t>(cp);
+  return out;
+}
+
+}  // namespace
+
+std::string utf8_encode(std::wstring_view wstr) {
+  // Sized for the worst case, written in one pass and cut to length: a
+  // UTF-16 unit takes at most 3 bytes (a surrogate pair 4 for 2 units), a
+  // UTF-32 one 4.
+  std::string out(wstr.size() * (sizeof(wchar_t) == 2 ? 3 : 4), '\0');
+  char* next = out.data();
+  size_t i = 0;
+  while (true) {
+    auto ascii = narrow_ascii(wstr.data() + i, wstr.size() - i, next);
+    i += ascii;
+    next += ascii;
+    if (i == wstr.size()) {
+      break;
+    }
+    char32_t cp = static_cast<WideUnit>(wstr[i]);
+    if constexpr (sizeof(wchar_t) == 2) {
+      if (cp >= 0xD800 && cp <= 0xDBFF && i + 1 < wstr.size() &&
+          wstr[i + 1] >= 0xDC00 && wstr[i + 1] <= 0xDFFF) {
+        cp = 0x10000 + ((cp - 0xD800) << 10) +
+             (static_cast<char32_t>(wstr[i + 1]) - 0xDC00);
+        ++i;
+      }
+    }
+    if ((cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) {
+      cp = kReplacement;
+    }
+    next = put_utf8(next, cp);
+    ++i;
+  }
+  out.resize(static_cast<size_t>(next - out.data()));
+  return out;
+}
+
+std::wstring utf8_decode(std::string_view str) {
+  // No byte yields more than one unit: a 4-byte sequence becomes at most a
+  // surrogate pair, and each invalid byte at most one U+FFFD.
+  std::wstring out(str.size(), L'\0');
+  wchar_t* next = out.data();
+  size_t i = 0;
+  while (true) {
+    auto ascii = widen_ascii(str.data() + i, str.size() - i, next);
+    i += ascii;
+    next += ascii;
+    if (i == str.size()) {
+      break;
+    }
+    auto c = static_cast<uint8_t>(str[i]);
+    size_t len = 0;
+    char32_t cp = 0;
+    char32_t min = 0;
+    if ((c & 0xE0) == 0xC0) {
+      len = 2;
+      cp = c & 0x1F;
+      min = 0x80;
+    } else if ((c & 0xF0) == 0xE0) {
+      len = 3;
+      cp = c & 0x0F;
+      min = 0x800;
+    } else if ((c & 0xF8) == 0xF0) {
+      len = 4;
+      cp = c & 0x07;
+      min = 0x10000;
+    }
+    size_t n = 1;
+    while (len != 0 && n < len && i + n < str.size() &&
+           (static_cast<uint8_t>(str[i + n]) & 0xC0) == 0x80) {
+      cp = (cp << 6) | (static_cast<uint8_t>(str[i + n]) & 0x3F);
+      ++n;
+    }
+    if (len == 0 || n != len || cp < min || cp > 0x10FFFF ||
+        (cp >= 0xD800 && cp <= 0xDFFF)) {
+      next = put_wide(next, kReplacement);
+      i += n;
+      continue;
+    }
+    next = put_wide(next, cp);
+    i += len;
+  }
+  out.resize(static_cast<size_t>(next - out.data()));
+  return out;
+}
+
+std::u16string to_utf16(std::wstring_view wstr) {
+  if constexpr (sizeof(wchar_t) == sizeof(char16_t)) {
+    return std::u16string(wstr.begin(), wstr.end());
+  } else {
+    std::u16string out;
+    out.reserve(wstr.size());
+    for (wchar_t c : wstr) {
+      auto cp = static_cast<char32_t>(c);
+      if (cp >= 0x10000 && cp <= 0x10FFFF) {
+        cp -= 0x10000;
+        out.push_back(static_cast<char16_t>(0xD800 + (cp >> 10)));
+        out.push_back(static_cast<char16_t>(0xDC00 + (cp & 0x3FF)));
+      } else {
+        out.push_back(static_cast<char16_t>(cp > 0x10FFFF ? kReplacement : cp));
+      }
+    }
+    return out;
+  }
+}
+
+std::wstring from_utf16(std::u16string_view str) {
+  if constexpr (sizeof(wchar_t) == sizeof(char16_t)) {
+    return std::wstring(str.begin(), str.end());
+  } else {
+    std::wstring out;
+    out.reserve(str.size());
+    for (size_t i = 0; i < str.size(); ++i) {
+      char32_t cp = str[i];
+      if (cp >= 0xD800 && cp <= 0xDBFF && i + 1 < str.size() &&
+          str[i + 1] >= 0xDC00 && str[i + 1] <= 0xDFFF) {
+        cp = 0x10000 + ((cp - 0xD800) << 10) + (str[i + 1] - 0xDC00);
+        ++i;
+      } else if (cp >= 0xD800 && cp <= 0xDFFF) {
+        cp = kReplacement;
+      }
+      out.push_back(static_cast<wchar_t>(cp));
+    }
+    return out;
+  }
+}
@@ -0,0 +1,17 @@
+#ifndef UNICODE_H_
+#define UNICODE_H_
+
+#include <string>
+#include <string_view>
+
+// Portable UTF-8 <-> wide string conversion. std::wstring holds UTF-16 on
+// Windows and UTF-32 elsewhere; both are handled. Invalid input is replaced
+// by U+FFFD instead of throwing.
+std::string utf8_encode(std::wstring_view wstr);
+std::wstring utf8_decode(std::string_view str);
+
+// UTF-16 <-> wide string; a plain copy where wchar_t is 16 bits.
+std::u16string to_utf16(std::wstring_view wstr);
+std::wstring from_utf16(std::u16string_view str);
+
+#endif  // UNICODE_H_
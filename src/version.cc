@@ -0,0 +1,63 @@
+#include "version.h"
+
+#include <algorithm>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+namespace {
+
+// Returns std::nullopt when `version` is not a bare version prefix.
+template <typename CharT>
+std::optional<std::basic_string<CharT>> expand_version_range(
+    std::basic_string_view<CharT> version) {
+  if (version.empty() || version.front() == CharT('[') ||
+      version.front() == CharT('(')) {
+    return std::nullopt;
+  }
+  auto is_version_char = [](CharT c) {
+    return c == CharT('.') || (CharT('0') <= c && c <= CharT('9'));
+  };
+  if (!std::all_of(version.begin(), version.end(), is_version_char)) {
+    return std::nullopt;
+  }
+
+  // Fill the missing parts of the upper bound with the largest value.
+  auto dot_count = std::count(version.begin(), version.end(), CharT('.'));
+  if (dot_count > 3) {
+    return std::nullopt;
+  }
+  std::basic_string<CharT> max_version;
+  if (dot_count == 3) {
+    max_version = version.substr(0, version.rfind(CharT('.')));
+  } else {
+    max_version = version;
+    for (auto i = dot_count; i < 2; ++i) {
+      for (auto c : std::string_view(".65535")) {
+        max_version.push_back(CharT(c));
+      }
+    }
+  }
+  for (auto c : std::string_view(".65535")) {
+    max_version.push_back(CharT(c));
+  }
+
+  std::basic_string<CharT> range;
+  range.reserve(version.size() + max_version.size() + 3);
+  range.push_back(CharT('['));
+  range += version;
+  range.push_back(CharT(','));
+  range += max_version;
+  range.push_back(CharT(')'));
+  return range;
+}
+
+}  // namespace
+
+std::wstring to_version_range(std::wstring version) {
+  return expand_version_range<wchar_t>(version).value_or(std::move(version));
+}
+
+std::string to_version_range(std::string version) {
+  return expand_version_range<char>(version).value_or(std::move(version));
+}
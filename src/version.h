@@ -0,0 +1,152 @@
+#ifndef VERSION_H_
+#define VERSION_H_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Native equivalents of ISetupHelper::ParseVersion and ParseVersionRange, so
+// that filtering does not need the Setup COM server.
+
+struct VersionRange {
+  uint64_t min_;
+  uint64_t max_;
+};
+
+// Packs "a[.b[.c[.d]]]" into 4x16 bits, a in the high word.
+template <typename CharT>
+constexpr std::optional<uint64_t> parse_version(
+    std::basic_string_view<CharT> str) {
+  while (!str.empty() && (str.front() == CharT(' ') ||
+                          str.front() == CharT('\t'))) {
+    str.remove_prefix(1);
+  }
+  while (!str.empty() && (str.back() == CharT(' ') ||
+                          str.back() == CharT('\t'))) {
+    str.remove_suffix(1);
+  }
+  if (str.empty()) {
+    return std::nullopt;
+  }
+  uint64_t version = 0;
+  int parts = 0;
+  size_t i = 0;
+  while (true) {
+    uint32_t part = 0;
+    size_t digits = 0;
+    while (i < str.size() && CharT('0') <= str[i] && str[i] <= CharT('9')) {
+      part = part * 10 + static_cast<uint32_t>(str[i] - CharT('0'));
+      if (part > 0xFFFF) {
+        return std::nullopt;
+      }
+      ++i;
+      ++digits;
+    }
+    if (digits == 0 || parts == 4) {
+      return std::nullopt;
+    }
+    version |= uint64_t{part} << (48 - 16 * parts);
+    ++parts;
+    if (i == str.size()) {
+      return version;
+    }
+    if (str[i] != CharT('.')) {
+      return std::nullopt;
+    }
+    ++i;
+  }
+}
+
+// Accepts "v" (meaning [v,)), "[v]", and "[a,b]" with either bound optional
+// and '(' / ')' marking an exclusive bound.
+template <typename CharT>
+constexpr std::optional<VersionRange> parse_version_range(
+    std::basic_string_view<CharT> str) {
+  while (!str.empty() && (str.front() == CharT(' ') ||
+                          str.front() == CharT('\t'))) {
+    str.remove_prefix(1);
+  }
+  while (!str.empty() && (str.back() == CharT(' ') ||
+                          str.back() == CharT('\t'))) {
+    str.remove_suffix(1);
+  }
+  if (str.empty()) {
+    return std::nullopt;
+  }
+  if (str.front() != CharT('[') && str.front() != CharT('(')) {
+    auto version = parse_version(str);
+    if (!version) {
+      return std::nullopt;
+    }
+    return VersionRange{*version, UINT64_MAX};
+  }
+
+  bool min_exclusive = str.front() == CharT('(');
+  bool max_exclusive = str.back() == CharT(')');
+  if (str.size() < 2 || (str.back() != CharT(']') && !max_exclusive)) {
+    return std::nullopt;
+  }
+  str = str.substr(1, str.size() - 2);
+
+  auto comma = str.find(CharT(','));
+  if (comma == str.npos) {
+    // "[v]" is exactly v.
+    auto version = parse_version(str);
+    if (!version || min_exclusive || max_exclusive) {
+      return std::nullopt;
+    }
+    return VersionRange{*version, *version};
+  }
+
+  auto is_blank = [](std::basic_string_view<CharT> s) {
+    for (auto c : s) {
+      if (c != CharT(' ') && c != CharT('\t')) {
+        return false;
+      }
+    }
+    return true;
+  };
+  VersionRange range{0, UINT64_MAX};
+  if (auto lower = str.substr(0, comma); !is_blank(lower)) {
+    auto version = parse_version(lower);
+    if (!version || (min_exclusive && *version == UINT64_MAX)) {
+      return std::nullopt;
+    }
+    range.min_ = *version + (min_exclusive ? 1 : 0);
+  }
+  if (auto upper = str.substr(comma + 1); !is_blank(upper)) {
+    auto version = parse_version(upper);
+    if (!version || (max_exclusive && *version == 0)) {
+      return std::nullopt;
+    }
+    range.max_ = *version - (max_exclusive ? 1 : 0);
+  }
+  if (range.min_ > range.max_) {
+    return std::nullopt;
+  }
+  return range;
+}
+
+constexpr std::optional<uint64_t> parse_version(std::string_view str) {
+  return parse_version<char>(str);
+}
+constexpr std::optional<uint64_t> parse_version(std::wstring_view str) {
+  return parse_version<wchar_t>(str);
+}
+constexpr std::optional<VersionRange> parse_version_range(
+    std::string_view str) {
+  return parse_version_range<char>(str);
+}
+constexpr std::optional<VersionRange> parse_version_range(
+    std::wstring_view str) {
+  return parse_version_range<wchar_t>(str);
+}
+
+// Expands a bare version prefix into the range of versions it names, e.g.
+// "17" to "[17,17.65535.65535.65535)". Anything else, ranges included, is
+// returned unchanged.
+std::wstring to_version_range(std::wstring version);
+std::string to_version_range(std::string version);
+
+#endif  // VERSION_H_
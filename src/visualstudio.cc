@@ -4,14 +4,19 @@
 #include "visualstudio.h"
 
 #include <algorithm>
-#include <functional>
 #include <iostream>
 #include <iterator>
-#include <map>
 #include <memory>
 #include <ostream>
 #include <stdexcept>
 #include <string_view>
+
+#include "instance_snapshot.h"
+#include "split.h"
+#include "state_json.h"
+#include "trace.h"
+#include "unicode.h"
+#include "version.h"
 namespace {
 
 std::wstring ToISO8601(const FILETIME* ft) {
@@ -30,12 +35,21 @@ std::wstring ToISO8601(const FILETIME* ft) {
                           st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
   return std::wstring(wz);
 }
+
+// UTF-8 is converted by utf8_decode/utf8_encode in one pass; the Win32
+// calls are left for the other codepages.
+bool is_utf8_codepage(UINT codepage) {
+  return codepage == CP_UTF8 || (codepage == CP_ACP && ::GetACP() == CP_UTF8);
+}
 }  // namespace
 
 std::wstring to_wstring(const std::string_view str, const UINT from_codepage) {
   if (str.empty()) {
     return {};
   }
+  if (is_utf8_codepage(from_codepage)) {
+    return utf8_decode(str);
+  }
   int size_needed = MultiByteToWideChar(from_codepage, 0, str.data(),
                                         (int)str.size(), NULL, 0);
   if (size_needed <= 0) {
@@ -53,6 +67,9 @@ std::string to_string(const std::wstring_view wstr, const UINT to_codepage) {
   if (wstr.empty()) {
     return {};
   }
+  if (is_utf8_codepage(to_codepage)) {
+    return utf8_encode(wstr);
+  }
   int size_needed = WideCharToMultiByte(to_codepage, 0, wstr.data(),
                                         (int)wstr.size(), NULL, 0, NULL, NULL);
   if (size_needed <= 0) {
@@ -65,50 +82,6 @@ std::string to_string(const std::wstring_view wstr, const UINT to_codepage) {
   return str;
 }
 
-bool VisualStudio::is_product_match(std::wstring const& product_pattern) const {
-  if (product_pattern == L"*") {
-    return true;
-  }
-  std::wstring ipattern;
-  std::transform(product_pattern.begin(), product_pattern.end(),
-                 std::back_inserter(ipattern), [](wchar_t c) {
-                   if ('A' <= c && c <= 'Z') {
-                     return c - 'A' + 'a';
-                   } else {
-                     return static_cast<int>(c);
-                   }
-                 });
-  std::wstring iproduct_id;
-  std::transform(product_id_.begin(), product_id_.end(),
-                 std::back_inserter(iproduct_id), [](wchar_t c) {
-                   if (L'A' <= c && c <= L'Z') {
-                     return c - L'A' + L'a';
-                   } else {
-                     return static_cast<int>(c);
-                   }
-                 });
-  if (!ipattern.starts_with(L"microsoft.visualstudio.product.")) {
-    ipattern = L"microsoft.visualstudio.product." + ipattern;
-  }
-  return ipattern == iproduct_id;
-}
-bool VisualStudio::is_workload_match(
-    std::wstring const& workload_pattern) const {
-  if (workload_pattern == L"*" && !workloads_.empty()) {
-    return true;
-  }
-
-  for (auto const& workload : workloads_) {
-    if (0 == _wcsicmp(workload_pattern.c_str(), workload.c_str())) {
-      return true;
-    }
-  }
-  return false;
-}
-bool VisualStudio::is_version_match(uint64_t min, uint64_t max) const {
-  return version_ >= min && version_ <= max;
-}
-
 std::wostream& operator<<(std::wostream& out, VisualStudio const& vs) {
   out << L"Version: " << vs.install_version_ << " (" << vs.version_ << ")"
       << L'\n';
@@ -119,136 +92,78 @@ std::wostream& operator<<(std::wostream& out, VisualStudio const& vs) {
   out << L"Complete: " << std::boolalpha << vs.is_complete_ << L'\n';
   out << L"Prerelease: " << vs.is_prerelease_ << L'\n';
   out << L"Workloads: ";
-  std::copy(vs.workloads_.begin(), vs.workloads_.end(),
+  auto workloads = vs.workloads_.names();
+  std::copy(workloads.begin(), workloads.end(),
             std::ostream_iterator<std::wstring, wchar_t>(out, L", "));
   out << L'\n';
   return out;
 }
 
-void SortVisualStudio(std::vector<VisualStudio>& all_visual_studio,
-                      std::map<std::string, std::string> sort_by) {
-  if (sort_by.empty()) {
-    return;
-  }
-  std::vector<std::function<bool(VisualStudio const& a, VisualStudio const& b)>>
-      sort_functions;
-  for (auto const& [sort_name, sort_value] : sort_by) {
-    if (sort_name == "version") {
-      if (sort_value == "asc") {
-        sort_functions.push_back(
-            [](VisualStudio const& a, VisualStudio const& b) {
-              return a.version_ < b.version_;
-            });
-      } else {
-        sort_functions.push_back(
-            [](VisualStudio const& a, VisualStudio const& b) {
-              return b.version_ < a.version_;
-            });
-      }
-    } else if (sort_name == "date" || sort_name == "time") {
-      if (sort_value == "asc") {
-        sort_functions.push_back([](VisualStudio const& a,
-                                    VisualStudio const& b) {
-          return CompareFileTime(&a.install_datetime_, &b.install_datetime_) <
-                 0;
-        });
-      } else {
-        sort_functions.push_back([](VisualStudio const& a,
-                                    VisualStudio const& b) {
-          return CompareFileTime(&a.install_datetime_, &b.install_datetime_) >
-                 0;
-        });
-      }
-    } else if (sort_name == "product") {
-      auto s = split(sort_value, '-', -1);
-      for (auto& i : s) {
-        i = "Microsoft.VisualStudio.Product." + i;
-      }
-      sort_functions.push_back(
-          [s](VisualStudio const& a, VisualStudio const& b) {
-            auto ai = std::find(s.cbegin(), s.cend(), to_string(a.product_id_));
-            auto bi = std::find(s.cbegin(), s.cend(), to_string(b.product_id_));
-            bool ret = (ai - s.begin()) < (bi - s.begin());
-            return ret;
-          });
+ISetupConfiguration2Ptr& LazySetupConfiguration::config() {
+  if (!config_) {
+    if (!com_) {
+      TraceSpan span("CoInitializeEx");
+      com_.emplace(COINIT_MULTITHREADED);
+    }
+    TraceSpan span("CreateInstance");
+    ISetupConfigurationPtr configuration;
+    if (auto hr = configuration.CreateInstance(__uuidof(SetupConfiguration));
+        FAILED(hr)) {
+      throw win32_exception(hr, "failed to create query class");
     }
+    config_ = configuration;
   }
-  std::sort(all_visual_studio.begin(), all_visual_studio.end(),
-            [&sort_functions](VisualStudio const& a, VisualStudio const& b) {
-              for (auto& less_func : sort_functions) {
-                if (less_func(a, b)) {
-                  return true;
-                }
-                if (less_func(b, a)) {
-                  return false;
-                }
-              }
-              return false;
-            });
+  return config_;
 }
 
-std::vector<VisualStudio> GetMatchedVisualStudios(
-    ISetupConfiguration2Ptr& config, std::string const& filter_version,
-    std::string const& filter_product, std::string const& filter_workload,
-    std::map<std::string, std::string> const& sort_by, int debug_level) {
-  std::vector<VisualStudio> all_visual_studio;
-  IEnumSetupInstancesPtr instances;
-  if (auto hr = config->EnumInstances(&instances); FAILED(hr)) {
-    throw win32_exception(hr, "failed to query all instances");
-  }
+namespace {
 
-  ISetupHelperPtr helper(config);
+class ComInstance : public SourceInstance {
+ public:
+  ComInstance(ISetupInstance2Ptr instance, LCID lcid)
+      : instance_(std::move(instance)), lcid_(lcid) {}
 
-  auto lcid = ::GetUserDefaultLCID();
-  ISetupInstancePtr instance;
-  while (instances->Next(1, &instance, NULL) == S_OK) {
-    ISetupInstance2Ptr instance2(instance);
-
-    bstr_t display_name;
-    if (FAILED(instance2->GetDisplayName(lcid, display_name.GetAddress()))) {
-      continue;
-    }
-    bstr_t install_path;
-    if (FAILED(instance2->GetInstallationPath(install_path.GetAddress()))) {
-      continue;
-    }
+  bool is_complete() override {
+    TraceSpan span("IsComplete");
+    VARIANT_BOOL is_complete{VARIANT_FALSE};
+    instance_->IsComplete(&is_complete);
+    return is_complete != VARIANT_FALSE;
+  }
 
+  std::optional<std::pair<std::wstring, uint64_t>> version() override {
+    TraceSpan span("GetInstallationVersion");
     bstr_t install_version;
     if (FAILED(
-            instance2->GetInstallationVersion(install_version.GetAddress()))) {
-      continue;
+            instance_->GetInstallationVersion(install_version.GetAddress()))) {
+      return std::nullopt;
     }
-
-    FILETIME install_time;
-    if (FAILED(instance2->GetInstallDate(&install_time))) {
-      continue;
+    std::wstring_view view(install_version.GetBSTR(),
+                           install_version.length());
+    auto version = parse_version(view);
+    if (!version) {
+      return std::nullopt;
     }
+    return std::pair{std::wstring(view), *version};
+  }
 
-    uint64_t version;
-    helper->ParseVersion(install_version.GetBSTR(), &version);
-
+  std::optional<std::wstring> product_id() override {
+    TraceSpan span("GetProduct");
     ISetupPackageReferencePtr package;
-    if (FAILED(instance2->GetProduct(&package)) || !package) {
-      continue;
+    if (FAILED(instance_->GetProduct(&package)) || !package) {
+      return std::nullopt;
     }
     bstr_t product_id;
     if (FAILED(package->GetId(product_id.GetAddress()))) {
-      continue;
-    }
-
-    VARIANT_BOOL is_complete{VARIANT_FALSE};
-    instance2->IsComplete(&is_complete);
-
-    VARIANT_BOOL is_prerelease{VARIANT_FALSE};
-    ISetupInstanceCatalogPtr catalog;
-    if (SUCCEEDED(instance2->QueryInterface(&catalog)) && !!catalog) {
-      if (SUCCEEDED(catalog->IsPrerelease(&is_prerelease))) {
-      }
+      return std::nullopt;
     }
+    return product_id.GetBSTR();
+  }
 
+  std::optional<InstancePackages> packages(bool index_all) override {
+    TraceSpan span("GetPackages");
     LPSAFEARRAY psa = nullptr;
-    if (FAILED(instance2->GetPackages(&psa))) {
-      continue;
+    if (FAILED(instance_->GetPackages(&psa))) {
+      return std::nullopt;
     }
     std::unique_ptr<LPSAFEARRAY, decltype([](LPSAFEARRAY* ppsa) {
                       if (ppsa && *ppsa) {
@@ -260,190 +175,269 @@ std::vector<VisualStudio> GetMatchedVisualStudios(
                     })>
         psa_guard(&psa);
 
-    std::vector<std::wstring> workloads;
+    InstancePackages packages;
+    std::vector<InternedId> all_ids;
 
     ::SafeArrayLock(psa);
 
     auto begin = reinterpret_cast<ISetupPackageReferencePtr*>(psa->pvData);
     auto end = begin + psa->rgsabound[0].cElements;
     std::vector<ISetupPackageReferencePtr> all_packages(begin, end);
+    if (index_all) {
+      all_ids.reserve(all_packages.size());
+    }
     for (auto package_ptr : all_packages) {
       bstr_t type;
       if (FAILED(package_ptr->GetType(type.GetAddress()))) {
         continue;
       }
-      if (0 != _wcsicmp(L"Workload", type.GetBSTR())) {
+      bool is_workload = 0 == _wcsicmp(L"Workload", type.GetBSTR());
+      if (!is_workload && !index_all) {
         continue;
       }
       bstr_t id;
       if (FAILED(package_ptr->GetId(id.GetAddress()))) {
         continue;
       }
-      workloads.push_back(id.GetBSTR());
+      auto interned = Interner::global().intern(
+          std::wstring_view(id.GetBSTR(), id.length()));
+      if (is_workload) {
+        packages.workloads_.insert(interned);
+      }
+      if (index_all) {
+        all_ids.push_back(interned);
+      }
     }
+    packages.index_ = PackageIndex::from_ids(std::move(all_ids));
+    return packages;
+  }
 
-    all_visual_studio.push_back(
-        {.version_ = version,
-         .install_datetime_ = install_time,
-         .install_version_ = install_version.GetBSTR(),
-         .install_path_ = install_path.GetBSTR(),
-         .display_name_ = display_name.GetBSTR(),
-         .product_id_ = product_id.GetBSTR(),
-         .is_complete_ = (is_complete != VARIANT_FALSE),
-         .is_prerelease_ = (is_prerelease != VARIANT_FALSE),
-         .workloads_ = workloads});
-    if (debug_level > 0) {
-      std::wcerr << L"Found VisualStudio: No." << all_visual_studio.size()
-                 << L'\n';
-      std::wcerr << all_visual_studio.back() << '\n';
+  bool details(VisualStudio& vs) override {
+    TraceSpan span("instance details");
+    bstr_t display_name;
+    if (FAILED(instance_->GetDisplayName(lcid_, display_name.GetAddress()))) {
+      return false;
     }
-  }
+    bstr_t install_path;
+    if (FAILED(instance_->GetInstallationPath(install_path.GetAddress()))) {
+      return false;
+    }
+    if (FAILED(instance_->GetInstallDate(&vs.install_datetime_))) {
+      return false;
+    }
+    vs.display_name_ = display_name.GetBSTR();
+    vs.install_path_ = install_path.GetBSTR();
 
-  uint64_t version_min, version_max;
-  auto wversion = to_wstring(filter_version);
-  if (S_OK !=
-      helper->ParseVersionRange(wversion.c_str(), &version_min, &version_max)) {
-    return {};
+    VARIANT_BOOL is_prerelease{VARIANT_FALSE};
+    ISetupInstanceCatalogPtr catalog;
+    if (SUCCEEDED(instance_->QueryInterface(&catalog)) && !!catalog) {
+      catalog->IsPrerelease(&is_prerelease);
+    }
+    vs.is_prerelease_ = (is_prerelease != VARIANT_FALSE);
+    return true;
   }
 
-  std::vector<VisualStudio> all_match_visualstudios;
-  for (auto vs : all_visual_studio) {
-    if (vs.is_complete_ && vs.is_version_match(version_min, version_max) &&
-        vs.is_product_match(to_wstring(filter_product)) &&
-        vs.is_workload_match(to_wstring(filter_workload))) {
-      if (debug_level > 0) {
-        std::cerr << "Match: version(" << filter_version << "), product("
-                  << filter_product << "), filter_workload(" << filter_workload
-                  << ")" << to_string(vs.display_name_) << '\n';
-      }
-      all_match_visualstudios.push_back(vs);
-    } else {
-      if (debug_level > 0) {
-        std::cerr << "Not Match: version(" << filter_version << "), product("
-                  << filter_product << "), filter_workload(" << filter_workload
-                  << ")" << to_string(vs.display_name_) << '\n';
-      }
-    }
+ private:
+  ISetupInstance2Ptr instance_;
+  LCID lcid_;
+};
+
+void PrintFound(std::vector<VisualStudio> const& all_visual_studio) {
+  for (size_t i = 0; i < all_visual_studio.size(); ++i) {
+    std::wcerr << L"Found VisualStudio: No." << i + 1 << L'\n';
+    std::wcerr << all_visual_studio[i] << '\n';
   }
+}
+
+}  // namespace
 
-  if (!sort_by.empty()) {
-    SortVisualStudio(all_match_visualstudios, sort_by);
+ComInstanceSource::ComInstanceSource(ISetupConfiguration2Ptr& config)
+    : lcid_(::GetUserDefaultLCID()) {
+  TraceSpan span("EnumInstances");
+  if (auto hr = config->EnumInstances(&instances_); FAILED(hr)) {
+    throw win32_exception(hr, "failed to query all instances");
   }
+}
 
-  return all_match_visualstudios;
+std::unique_ptr<SourceInstance> ComInstanceSource::next() {
+  TraceSpan span("IEnumSetupInstances::Next");
+  ISetupInstancePtr instance;
+  if (instances_->Next(1, &instance, NULL) != S_OK) {
+    return nullptr;
+  }
+  return std::make_unique<ComInstance>(ISetupInstance2Ptr(instance), lcid_);
 }
 
-std::pair<bool, std::string> check_product_id(const std::string& val) {
-  auto product_id = val;
-  std::transform(product_id.begin(), product_id.end(), product_id.begin(),
-                 [](unsigned char c) {
-                   if ('A' <= c && c <= 'Z') {
-                     return c - 'A' + 'a';
-                   } else {
-                     return static_cast<int>(c);
-                   }
-                 });
-  if (product_id == "professional") {
-    return {true, ""};
+std::vector<std::unique_ptr<SourceInstance>> ComInstanceSource::next_batch(
+    size_t max) {
+  std::vector<ISetupInstance*> fetched(max, nullptr);
+  ULONG count = 0;
+  {
+    TraceSpan span("IEnumSetupInstances::Next");
+    if (FAILED(instances_->Next(static_cast<ULONG>(max), fetched.data(),
+                                &count))) {
+      count = 0;
+    }
   }
-  if (product_id == "enterprise") {
-    return {true, ""};
+  std::vector<std::unique_ptr<SourceInstance>> batch;
+  batch.reserve(count);
+  for (ULONG i = 0; i < count; ++i) {
+    // Take over the reference Next() returned.
+    ISetupInstancePtr instance(fetched[i], false);
+    batch.push_back(
+        std::make_unique<ComInstance>(ISetupInstance2Ptr(instance), lcid_));
   }
-  if (product_id == "community") {
-    return {true, ""};
+  return batch;
+}
+
+namespace {
+
+// The user's locale, e.g. "en-US", which is the language of the LCID that
+// ComInstanceSource passes to GetDisplayName.
+std::string user_locale_name() {
+  wchar_t name[LOCALE_NAME_MAX_LENGTH];
+  if (::GetUserDefaultLocaleName(name, LOCALE_NAME_MAX_LENGTH) == 0) {
+    return "en-us";
   }
-  return {false, "not one of Professional,Enterprise,Community"};
+  return to_string(name);
 }
 
-std::pair<bool, std::string> check_sort_by(const std::string& val) {
-  auto sort1 = split(val, ',', -1);
-  auto sort_by_asc_desc = [](std::string const& val) {
-    if (val == "asc" || val == "desc") {
-      return std::pair<bool, std::string>{true, ""};
-    } else {
-      return std::pair<bool, std::string>{false, "asc/desc"};
-    }
-  };
-  auto sort_by_product_checker = [](std::string const& val) {
-    std::pair<bool, std::string> err_return = {
-        false, "Professional,Enterprise,Community"};
-    std::string product_ids = val;
-    std::transform(product_ids.begin(), product_ids.end(), product_ids.begin(),
-                   [](unsigned char c) {
-                     if ('A' <= c && c <= 'Z') {
-                       return c - 'A' + 'a';
-                     } else {
-                       return static_cast<int>(c);
-                     }
-                   });
-    auto s = split(product_ids, '-', -1);
-    if (s.size() != 3) {
-      return err_return;
-    }
-    if (std::find(s.begin(), s.end(), "Professional") == s.end()) {
-      return err_return;
-    }
-    if (std::find(s.begin(), s.end(), "Enterprise") == s.end()) {
-      return err_return;
+// Enough to overlap the property calls of a typical build agent's handful of
+// instances without spawning a thread per instance.
+constexpr size_t kComWorkers = 4;
+
+// Workers join the multithreaded apartment that LazySetupConfiguration
+// created the Setup configuration in.
+WorkerPool MakeComWorkerPool() {
+  static thread_local HRESULT hr = E_FAIL;
+  return WorkerPool(
+      kComWorkers,
+      []() {
+        TraceSpan span("CoInitializeEx");
+        hr = ::CoInitializeEx(NULL, COINIT_MULTITHREADED);
+      },
+      []() {
+        if (SUCCEEDED(hr)) {
+          ::CoUninitialize();
+        }
+      });
+}
+
+}  // namespace
+
+std::unique_ptr<InstanceSource> OpenInstanceSource(
+    LazySetupConfiguration& setup, InstanceBackend backend, int debug_level,
+    InstanceBackend* opened) {
+  if (backend == InstanceBackend::kCom) {
+    try {
+      auto source = std::make_unique<ComInstanceSource>(setup.config());
+      if (opened) {
+        *opened = InstanceBackend::kCom;
+      }
+      return source;
+    } catch (win32_exception const& e) {
+      if (e.code() != static_cast<DWORD>(REGDB_E_CLASSNOTREG)) {
+        throw;
+      }
+      if (debug_level > 0) {
+        std::cerr << "Setup configuration is not registered, reading "
+                     "state.json instead\n";
+      }
     }
-    if (std::find(s.begin(), s.end(), "Community") == s.end()) {
-      return err_return;
+  }
+  if (opened) {
+    *opened = InstanceBackend::kStateJson;
+  }
+  // In the language ComInstance asks Setup for.
+  return std::make_unique<VectorInstanceSource>(enumerate_state_json_instances(
+      default_instances_dir(), user_locale_name()));
+}
+
+std::vector<VisualStudio> GetMatchedVisualStudios(
+    LazySetupConfiguration& setup, Query const& query, OutputIntent intent,
+    int debug_level, bool use_snapshot, InstanceBackend backend) {
+  auto observer = [&query, debug_level](VisualStudio const& vs,
+                                        std::optional<MatchStage> rejected) {
+    if (debug_level > 0) {
+      auto const& spec = query.spec();
+      std::cerr << (!rejected                            ? "Match: "
+                    : rejected == MatchStage::kOutranked ? "Outranked: "
+                                                         : "Not Match: ")
+                << "version("
+                << spec.version_ << "), product(" << spec.product_
+                << "), filter_workload(" << spec.workload_ << ")"
+                << to_string(vs.display_name_.empty() ? vs.install_version_
+                                                      : vs.display_name_)
+                << '\n';
     }
-    return std::pair<bool, std::string>{true, ""};
   };
 
-  for (auto const& s1 : sort1) {
-    auto sort2 = split(s1, ':', -1);
-    if (sort2.size() != 2) {
-      return std::pair<bool, std::string>{false, s1};
-    }
-    if (sort2[0] == "version" || sort2[0] == "date" || sort2[0] == "time") {
-      if (auto [ret, msg] = sort_by_asc_desc(sort2[1]); ret) {
-        continue;
-      }
-    } else if (sort2[0] == "product") {
-      if (auto [ret, msg] = sort_by_product_checker(sort2[1]); ret) {
-        continue;
-      }
+  if (use_snapshot) {
+    InstanceLookup lookup{
+        .match_ =
+            [&query, intent, &observer](InstanceSource& source) {
+              return query.collect(source, intent, observer);
+            },
+        .enumerate_ =
+            [&setup, debug_level, backend](InstanceBackend& produced) {
+              TraceSpan span("enumerate instances");
+              auto source =
+                  OpenInstanceSource(setup, backend, debug_level, &produced);
+              auto pool = MakeComWorkerPool();
+              auto all = collect_all_instances(*source, pool);
+              if (debug_level > 0) {
+                PrintFound(all);
+              }
+              return all;
+            }};
+    // Refreshing the snapshot fetches every property of every instance, so
+    // a lookup that needs less searches the backend and refreshes after
+    // answering, on a thread that creates its own Setup configuration.
+    if (intent != OutputIntent::kAll) {
+      lookup.search_ = [&]() {
+        auto source = OpenInstanceSource(setup, backend, debug_level);
+        auto pool = MakeComWorkerPool();
+        return query.collect(*source, intent, pool, observer);
+      };
+      lookup.enumerate_ = [backend](InstanceBackend& produced) {
+        LazySetupConfiguration own_setup;
+        auto source = OpenInstanceSource(own_setup, backend, 0, &produced);
+        auto pool = MakeComWorkerPool();
+        return collect_all_instances(*source, pool);
+      };
     }
-    return std::pair<bool, std::string>{false, s1};
+    return load_or_enumerate_instances(
+        default_snapshot_path(), default_instances_dir(), backend, lookup);
   }
-  return std::pair<bool, std::string>{true, ""};
+
+  // The source rejects what it can before fetching every property; the
+  // query then applies the rest and sorts.
+  TraceSpan span("enumerate instances");
+  auto source = OpenInstanceSource(setup, backend, debug_level);
+  auto pool = MakeComWorkerPool();
+  return query.collect(*source, intent, pool, observer);
 }
 
-std::wstring to_version_range(std::wstring wversion) {
-  if (wversion.front() != L'[' && wversion.front() != L'(') {
-    auto it = std::find_if(wversion.begin(), wversion.end(), [](wchar_t c) {
-      return (c != L'.' && !(L'0' <= c && L'9' >= c));
-    });
-    if (it != wversion.end()) {
-      return wversion;
-    } else {
-      auto dot_count = std::count(wversion.begin(), wversion.end(), L'.');
-      if (dot_count > 3) {
-        return wversion;
-      }
-      if (dot_count == 3) {
-        if (auto last_dot = wversion.find_last_of(L'.');
-            last_dot != std::string::npos) {
-          auto max_version = wversion.substr(0, last_dot - 0) + +L".65535";
-          wversion = L"[" + wversion + L"," + max_version + L")";
-        }
-      } else if (dot_count == 2) {
-        wversion = L"[" + wversion + L"," + wversion + L".65535)";
-      } else if (dot_count == 1) {
-        wversion = L"[" + wversion + L"," + wversion + L".65535.65535)";
-      } else if (dot_count == 0) {
-        wversion = L"[" + wversion + L"," + wversion + L".65535.65535.65535)";
-      }
+std::pair<bool, std::string> check_product_id(const std::string& val) {
+  // The list syntax QuerySpec::product_ takes.
+  for (auto product : split_view(val, ',')) {
+    if (product == "*" || find_product(product) != Product::kUnknown) {
+      continue;
     }
+    std::string known;
+    for (auto name : kProductNames) {
+      known += (known.empty() ? "" : ",") + to_string(name);
+    }
+    return {false, "'" + std::string(product) + "' is not * or one of " +
+                       known};
   }
-  return wversion;
+  return {true, ""};
 }
 
-std::string to_version_range(std::string version) {
-  if (version.empty()) {
-    return {};
+std::pair<bool, std::string> check_sort_by(const std::string& val) {
+  std::string error;
+  if (!SortPlan::parse(val, &error)) {
+    return {false, error};
   }
-  return to_string(to_version_range(to_wstring(version)));
+  return {true, ""};
 }
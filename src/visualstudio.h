@@ -9,6 +9,12 @@
 #include <winerror.h>
 
 #include "Setup.Configuration.h"
+#include "instance.h"
+#include "instance_source.h"
+#include "query.h"
+#include "sort_plan.h"
+#include "split.h"
+#include "version.h"
 
 #if defined(__MINGW32__) || defined(__MINGW64__)
 __CRT_UUID_DECL(ISetupConfiguration, 0x42843719, 0xDB4C, 0x46C2, 0x8E, 0x7C,
@@ -43,127 +49,12 @@ _COM_SMARTPTR_TYPEDEF(ISetupInstanceCatalog, __uuidof(ISetupInstanceCatalog));
 #include <algorithm>
 #include <cstdint>  // uint64_t
 #include <map>
+#include <memory>
+#include <optional>
 #include <stdexcept>  // std::runtime_error
 #include <string>
 #include <vector>
 
-template <typename T, typename = std::void_t<>>
-struct has_push_back : public std::false_type {};
-template <typename C>
-struct has_push_back<C, std::void_t<decltype(std::declval<C>().push_back(
-                            std::declval<typename C::value_type>()))>>
-    : public std::true_type {};
-template <typename T>
-constexpr bool has_push_back_v = has_push_back<T>::value;
-
-template <typename T, typename = std::void_t<>>
-struct has_emplace_back : public std::false_type {};
-template <typename C>
-struct has_emplace_back<C, std::void_t<decltype(std::declval<C>().emplace_back(
-                               std::declval<typename C::value_type>()))>>
-    : public std::true_type {};
-template <typename T>
-constexpr bool has_emplace_back_v = has_emplace_back<T>::value;
-
-template <typename T, typename = std::void_t<>>
-struct has_insert : public std::false_type {};
-template <typename C>
-struct has_insert<C, std::void_t<decltype(std::declval<C>().insert(
-                         std::declval<typename C::value_type>()))>>
-    : public std::true_type {};
-template <typename T>
-constexpr bool has_insert_v = has_insert<T>::value;
-
-template <typename T, typename = std::void_t<>>
-struct has_emplace : public std::false_type {};
-template <typename C>
-struct has_emplace<C, std::void_t<decltype(std::declval<C>().emplace(
-                          std::declval<typename C::value_type>()))>>
-    : public std::true_type {};
-template <typename T>
-constexpr bool has_emplace_v = has_emplace<T>::value;
-
-template <typename T, typename = std::void_t<>>
-struct has_push : public std::false_type {};
-template <typename C>
-struct has_push<C, std::void_t<decltype(std::declval<C>().push(
-                       std::declval<typename C::value_type>()))>>
-    : public std::true_type {};
-template <typename T>
-constexpr bool has_push_v = has_push<T>::value;
-
-template <typename T, typename = std::void_t<>>
-struct has_push_front : public std::false_type {};
-template <typename C>
-struct has_push_front<C, std::void_t<decltype(std::declval<C>().push_front(
-                             std::declval<typename C::value_type>()))>>
-    : public std::true_type {};
-template <typename T>
-constexpr bool has_push_front_v = has_push_front<T>::value;
-template <typename CharT, typename F, typename C>
-  requires std::is_same_v<bool,
-                          decltype(std::declval<F>()(std::declval<CharT>()))>
-C& split_to_if(C& to, const std::basic_string<CharT>& str, F f,
-               int max_count = -1, bool is_compress_token = false) {
-  auto begin = str.begin();
-  auto delimiter = begin;
-  int count = 0;
-
-  while ((max_count < 0 || count++ < max_count) &&
-         (delimiter = std::find_if(begin, str.end(), f)) != str.end()) {
-    to.insert(to.end(), {begin, delimiter});
-    if (is_compress_token) {
-      begin = std::find_if_not(delimiter, str.end(), f);
-    } else {
-      begin = std::next(delimiter);
-    }
-  }
-
-  if constexpr (has_emplace_back_v<C>) {
-    to.emplace_back(begin, str.end());
-  } else if constexpr (has_emplace_v<C>) {
-    to.emplace(begin, str.end());
-  } else if constexpr (has_push_back_v<C>) {
-    to.push_back({begin, str.end()});
-  } else if constexpr (has_insert_v<C>) {
-    to.insert({begin, str.end()});
-  } else if constexpr (has_push_v<C>) {
-    to.push({begin, str.end()});
-  } else if constexpr (has_push_front_v<C>) {
-    to.push_front({begin, str.end()});
-  } else {
-    static_assert(
-        !std::is_same_v<C, C>,
-        "The container does not support adding elements via a known method.");
-  }
-
-  return to;
-}
-
-inline std::vector<std::string> split(std::string const& s, char delim,
-                                      int max) {
-  std::vector<std::string> result;
-  split_to_if(result, s, [delim](char c) { return c == delim; }, max, false);
-  return result;
-}
-
-struct VisualStudio {
-  uint64_t version_;
-  FILETIME install_datetime_;
-  std::wstring install_version_;
-  std::wstring install_path_;
-  std::wstring display_name_;
-  std::wstring product_id_;
-  bool is_complete_;
-  bool is_prerelease_;
-  std::vector<std::wstring> workloads_;
-  bool is_complete() const { return is_complete_; }
-  bool is_prerelease() const { return is_prerelease_; }
-  bool is_product_match(std::wstring const& product_pattern) const;
-  bool is_workload_match(std::wstring const& workload_pattern) const;
-  bool is_version_match(uint64_t min, uint64_t max) const;
-};
-
 class win32_exception : public std::runtime_error {
  public:
   win32_exception(_In_ DWORD code, _In_z_ const char* what) noexcept
@@ -182,8 +73,8 @@ class win32_exception : public std::runtime_error {
 
 class CoInitializer {
  public:
-  CoInitializer() {
-    hr = ::CoInitialize(NULL);
+  explicit CoInitializer(DWORD co_init = COINIT_APARTMENTTHREADED) {
+    hr = ::CoInitializeEx(NULL, co_init);
     if (FAILED(hr)) {
       throw win32_exception(hr, "failed to initialize COM");
     }
@@ -199,13 +90,54 @@ class CoInitializer {
   HRESULT hr;
 };
 
+// Initializes COM and creates the Setup configuration server on first use,
+// so that queries answered from the instance snapshot never pay for either.
+// The thread joins the multithreaded apartment, so that instances it
+// enumerates can be read directly from the MTA worker pool.
+class LazySetupConfiguration {
+ public:
+  ISetupConfiguration2Ptr& config();
+  // Versions are parsed natively (version.h); this is only for callers
+  // that need anything else from ISetupHelper.
+  ISetupHelperPtr helper() { return ISetupHelperPtr(config()); }
+
+ private:
+  std::optional<CoInitializer> com_;
+  ISetupConfiguration2Ptr config_;
+};
+
 std::wostream& operator<<(std::wostream& out, VisualStudio const& vs);
 
+// Walks the instances through the Setup COM API, one property call at a time.
+class ComInstanceSource : public InstanceSource {
+ public:
+  explicit ComInstanceSource(ISetupConfiguration2Ptr& config);
+  std::unique_ptr<SourceInstance> next() override;
+  // One IEnumSetupInstances::Next call for the whole batch.
+  std::vector<std::unique_ptr<SourceInstance>> next_batch(size_t max) override;
+
+ private:
+  IEnumSetupInstancesPtr instances_;
+  LCID lcid_;
+};
+
+// The instances of `backend`. kCom falls back to state.json when the Setup
+// COM server is not registered; `opened`, if given, is set to the backend
+// actually used.
+std::unique_ptr<InstanceSource> OpenInstanceSource(
+    LazySetupConfiguration& setup, InstanceBackend backend,
+    int debug_level = 0, InstanceBackend* opened = nullptr);
+
+// With `use_snapshot`, instances come from the per-user snapshot while it is
+// fresh, and the backend is only asked to refresh it. Otherwise the query's
+// filter is pushed down to the backend so that rejected instances are never
+// fully fetched, and so is `intent` when the filter is the whole query.
+// Returns the instances `intent` asks for, see Query::select().
 std::vector<VisualStudio> GetMatchedVisualStudios(
-    ISetupConfiguration2Ptr& config, std::string const& version,
-    std::string const& product = "*", std::string const& workload = "*",
-    std::map<std::string, std::string> const& sort_by = {},
-    int debug_level = 0);
+    LazySetupConfiguration& setup, Query const& query,
+    OutputIntent intent = OutputIntent::kAll, int debug_level = 0,
+    bool use_snapshot = true,
+    InstanceBackend backend = InstanceBackend::kCom);
 
 std::wstring to_wstring(const std::string_view str,
                         const UINT from_codepage = CP_UTF8);
@@ -214,7 +146,4 @@ std::string to_string(const std::wstring_view wstr,
 
 std::pair<bool, std::string> check_product_id(const std::string& val);
 std::pair<bool, std::string> check_sort_by(std::string const& sort_by);
-
-std::wstring to_version_range(std::wstring version);
-std::string to_version_range(std::string version);
 #endif  // VISUAL_STUDIO_H_
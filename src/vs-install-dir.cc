@@ -17,23 +17,18 @@
 #include "visualstudio.h"
 
 int wmain(int argc, wchar_t* argv[]) {
-  CoInitializer comInitializer;
-  ISetupConfiguration2Ptr vs_setup_config([]() {
-    ISetupConfigurationPtr configuration;
-    if (auto hr = configuration.CreateInstance(__uuidof(SetupConfiguration));
-        FAILED(hr)) {
-      throw win32_exception(hr, "failed to create query class");
-    }
-    return configuration;
-  }());
-  ISetupHelperPtr helper(vs_setup_config);
+  LazySetupConfiguration setup;
 
   int debug_level = 0;
   std::string version_range = "[16.0,)";
   std::string product_id = "*";  // Microsoft.VisualStudio.Product.*
   std::string sort_by = "";
   std::string select_workload = "*";
+  std::string requires_all;
+  std::string requires_any;
   std::optional<bool> select_one = std::nullopt;
+  bool no_snapshot = false;
+  bool use_state_json = false;
 
   argparse::ArgParser parser{
       "vs-install-dir",
@@ -43,16 +38,12 @@ int wmain(int argc, wchar_t* argv[]) {
                   "A version range for instances to find. Example: "
                   "[17.0,18.0) will find versions 17.*.",
                   version_range)
-      .checker(
-          [&helper](std::string const& val) -> std::pair<bool, std::string> {
-            auto wversion = to_version_range(to_wstring(val));
-            uint64_t version_min, version_max;
-            if (FAILED(helper->ParseVersionRange(wversion.c_str(), &version_min,
-                                                 &version_max))) {
-              return {false, "not a valid version range: " + val};
-            }
-            return {true, ""};
-          });
+      .checker([](std::string const& val) -> std::pair<bool, std::string> {
+        if (!parse_version_range(to_version_range(val))) {
+          return {false, "not a valid version range: " + val};
+        }
+        return {true, ""};
+      });
   parser
       .add_option("product",
                   "One or more product IDs to find. Defaults to Community, "
@@ -65,6 +56,13 @@ int wmain(int argc, wchar_t* argv[]) {
       "workload",
       "require workload, Microsoft.VisualStudio.Workload.NativeDesktop",
       select_workload);
+  parser.add_option("requires",
+                    "require all of these comma-separated package IDs, of any "
+                    "type, e.g. Microsoft.VisualStudio.Component.VC.ATL",
+                    requires_all);
+  parser.add_option("requires-any",
+                    "require at least one of these comma-separated package IDs",
+                    requires_any);
 
   parser
       .add_option(
@@ -81,6 +79,13 @@ int wmain(int argc, wchar_t* argv[]) {
   parser.add_alias("p,professional", "product", "Professional");
   parser.add_alias("e,enterprise", "product", "Enterprise");
   parser.add_flag("verbose", "show verbose messages", debug_level);
+  parser.add_flag("no-snapshot",
+                  "enumerate instances instead of reading the cached snapshot",
+                  no_snapshot);
+  parser.add_flag("state-json",
+                  "read Setup's state.json files instead of querying the COM "
+                  "Setup API",
+                  use_state_json);
 
   try {
     parser.parse(argc, argv);
@@ -89,31 +94,30 @@ int wmain(int argc, wchar_t* argv[]) {
     return EXIT_FAILURE;
   }
 
-  std::map<std::string, std::string> sort_by_map;
-  if (!sort_by.empty()) {
-    auto s1 = split(sort_by, ',', -1);
-    for (auto const& s : s1) {
-      auto s2 = split(s, ':', 1);
-      sort_by_map[s2[0]] = s2[1];
-    }
+  // Every clause was validated by its option's checker.
+  auto query = Query::compile({.version_ = to_version_range(version_range),
+                               .product_ = product_id,
+                               .workload_ = select_workload,
+                               .requires_all_ = requires_all,
+                               .requires_any_ = requires_any,
+                               .sort_ = sort_by});
+  if (!query) {
+    return EXIT_FAILURE;
   }
+  // With a selection, only the selected instance is looked up.
+  auto intent = !select_one.has_value() ? OutputIntent::kAll
+                : select_one.value()    ? OutputIntent::kFirst
+                                        : OutputIntent::kLast;
   auto all_match_visualstudios = GetMatchedVisualStudios(
-      vs_setup_config, to_version_range(version_range), product_id,
-      select_workload, sort_by_map, debug_level);
+      setup, *query, intent, debug_level, !no_snapshot,
+      use_state_json ? InstanceBackend::kStateJson : InstanceBackend::kCom);
 
   if (all_match_visualstudios.empty()) {
     return EXIT_FAILURE;
   }
 
-  if (select_one.has_value()) {
-    std::wcout << (select_one.value()
-                       ? all_match_visualstudios.front().install_path_
-                       : all_match_visualstudios.back().install_path_)
-               << L'\n';
-  } else {
-    for (auto const& vs : all_match_visualstudios) {
-      std::wcout << vs.install_path_ << L'\n';
-    }
+  for (auto const& vs : all_match_visualstudios) {
+    std::wcout << vs.install_path_ << L'\n';
   }
 
   return EXIT_SUCCESS;
@@ -7,35 +7,499 @@
 #include <windows.h>
 #include <winerror.h>
 
+#include <fcntl.h>
+#include <io.h>
+
 #include <algorithm>
 #include <argparse/argparse.hpp>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
 #include <environment/environment.hpp>
 #include <exception>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <stdexcept>
 #include <subprocess/subprocess.hpp>
-
+#include <system_error>
+
+#include "batch.h"
+#include "command_graph.h"
+#include "command_line.h"
+#include "env_cache.h"
+#include "env_export.h"
+#include "env_store.h"
+#include "instance_snapshot.h"
+#include "local_socket.h"
+#include "multi_arch.h"
+#include "process_runner.h"
+#include "serve.h"
+#include "startup.h"
+#include "trace.h"
+#include "unicode.h"
 #include "visualstudio.h"
 
-std::string quote_path_if_needed(std::string&& p) {
-  if (std::find(p.begin(), p.end(), ' ') != p.end()) {
-    p.insert(p.begin(), '"');
-    p.push_back('"');
+// Passes a child's bytes through unchanged.
+void write_output(OutputChannel channel, std::string_view data) {
+  auto* out = channel == OutputChannel::kStdout ? stdout : stderr;
+  std::fwrite(data.data(), 1, data.size(), out);
+  std::fflush(out);
+}
+
+// Runs VsDevCmd.bat on top of `parent` and returns the resulting environment,
+// as printed by `set` into `capture_file`. Setting `cancelled` kills the run.
+std::optional<Environment> capture_vsdevcmd_environment(
+    std::filesystem::path const& vsdevcmd, std::string const& host_arch,
+    std::string const& arch, Environment const& parent,
+    std::filesystem::path const& capture_file, int debug_level,
+    std::atomic<bool> const* cancelled = nullptr) {
+  TraceSpan span("VsDevCmd.bat");
+  std::error_code ec;
+  std::filesystem::create_directories(capture_file.parent_path(), ec);
+  // `/u` makes cmd write the output of `set` as UTF-16LE.
+  std::vector<std::string> args{"cmd.exe",
+                                "/u",
+                                "/d",
+                                "/c",
+                                "call",
+                                quote_argument(vsdevcmd.string()),
+                                "-no_logo",
+                                "-host_arch=" + host_arch,
+                                "-arch=" + arch,
+                                ">nul&&",
+                                "set",
+                                ">",
+                                quote_argument(capture_file.string())};
+  if (debug_level >= 1) {
+    std::copy(begin(args), end(args),
+              std::ostream_iterator<std::string>(std::cerr, " "));
+    std::cerr << '\n';
   }
-  return p;
+
+  if (run_process(args, {}, parent, write_output, cancelled) != 0) {
+    std::filesystem::remove(capture_file, ec);
+    return std::nullopt;
+  }
+
+  std::ifstream in(capture_file, std::ios::binary);
+  std::string bytes(std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>{});
+  in.close();
+  std::filesystem::remove(capture_file, ec);
+  if (bytes.empty()) {
+    return std::nullopt;
+  }
+  std::wstring output(bytes.size() / sizeof(wchar_t), L'\0');
+  std::memcpy(output.data(), bytes.data(), output.size() * sizeof(wchar_t));
+  return parse_set_output(output);
 }
 
-int wmain(int argc, wchar_t* argv[]) {
-  CoInitializer comInitializer;
-  ISetupConfiguration2Ptr vs_setup_config([]() {
-    ISetupConfigurationPtr configuration;
-    if (auto hr = configuration.CreateInstance(__uuidof(SetupConfiguration));
-        FAILED(hr)) {
-      throw win32_exception(hr, "failed to create query class");
+std::filesystem::path vsdevcmd_path(VisualStudio const& vs) {
+  return std::filesystem::path(vs.install_path_) / "Common7" / "Tools" /
+         "VsDevCmd.bat";
+}
+
+// Removes the -u variables from this process's environment.
+void unset_environment(std::vector<std::string> const& names) {
+  for (auto const& name : names) {
+    env::unset(name);
+  }
+}
+
+// The environment the command starts from: the current one (empty with -i)
+// after unset_environment(), plus the NAME=VALUE words leading `user_cmds`,
+// which are taken off it.
+Environment prepare_environment(std::vector<std::string>& user_cmds,
+                                bool ignore_environment) {
+  TraceSpan span("prepare environment");
+  // Windows variable names ignore case; a std::map alone would let an
+  // override of PATH sit next to the inherited Path.
+  EnvStore envs;
+  if (!ignore_environment) {
+    envs = EnvStore(env::allutf16());
+  }
+  auto MSYSTEM = env::get("MSYSTEM");
+  auto ORIGINAL_PATH = env::get("ORIGINAL_PATH");
+  auto ORIGINAL_TEMP = env::get("ORIGINAL_TEMP");
+  auto ORIGINAL_TMP = env::get("ORIGINAL_TMP");
+  if (MSYSTEM && ORIGINAL_PATH && ORIGINAL_TEMP && ORIGINAL_TMP) {
+    auto ORIGINAL_TEMP_DIR = std::filesystem::path(ORIGINAL_TEMP.value());
+    auto ORIGINAL_TMP_DIR = std::filesystem::path(ORIGINAL_TMP.value());
+    if (is_directory(ORIGINAL_TEMP_DIR) && is_directory(ORIGINAL_TMP_DIR)) {
+      envs.set(L"PATH", to_wstring(ORIGINAL_PATH.value()));
+      envs.set(L"TEMP", ORIGINAL_TEMP_DIR.make_preferred().native());
+      envs.set(L"TMP", ORIGINAL_TMP_DIR.make_preferred().native());
+    }
+  }
+  while (!user_cmds.empty() &&
+         user_cmds.begin()->find('=') != std::string::npos) {
+    auto assignment = split_view(user_cmds.front(), '=', 1);
+    auto part = assignment.begin();
+    auto name = *part++;
+    envs.set(to_wstring(name), to_wstring(*part));
+    user_cmds.erase(user_cmds.begin());
+  }
+  auto result = envs.to_environment();
+  // A nested vsrun, or one started from a dev prompt, would otherwise grow
+  // PATH and INCLUDE with every VsDevCmd.bat run.
+  dedupe_path_lists(result);
+  return result;
+}
+
+// What VsDevCmd.bat of `vs` changes on top of `parent`, from the on-disk
+// cache unless `no_env_cache`. A capture is killed once `cancelled` is set.
+std::optional<EnvDelta> dev_environment(
+    VisualStudio const& vs, std::string const& arch,
+    std::string const& host_arch, Environment const& parent, bool no_env_cache,
+    int debug_level, std::atomic<bool> const* cancelled = nullptr) {
+  TraceSpan span("dev environment");
+  auto vsdevcmd = vsdevcmd_path(vs);
+  if (no_env_cache) {
+    static std::atomic<int> captures{0};
+    auto capture_file =
+        std::filesystem::temp_directory_path() /
+        ("vsrun-" + std::to_string(::GetCurrentProcessId()) + "-" +
+         std::to_string(captures++) + ".capture");
+    auto after = capture_vsdevcmd_environment(vsdevcmd, host_arch, arch,
+                                              parent, capture_file,
+                                              debug_level, cancelled);
+    if (!after) {
+      return std::nullopt;
+    }
+    return diff_environment(parent, *after);
+  }
+  EnvCacheKey key{.install_path_ = vs.install_path_,
+                  .install_version_ = vs.install_version_,
+                  .install_datetime_ = to_uint64(vs.install_datetime_),
+                  .arch_ = arch,
+                  .host_arch_ = host_arch,
+                  .inputs_ = select_vsdevcmd_inputs(parent)};
+  EnvCache cache(default_cache_dir());
+  return cache.get_or_capture(key, parent, [&]() {
+    auto capture_file = cache.entry_path(key);
+    capture_file += ".capture";
+    return capture_vsdevcmd_environment(vsdevcmd, host_arch, arch, parent,
+                                        capture_file, debug_level, cancelled);
+  });
+}
+
+// With the environment known up front, programs can be started without a
+// cmd.exe in between, unless the command needs cmd's parsing.
+std::vector<std::string> dev_command(std::vector<std::string> user_cmds,
+                                     Environment const& envs,
+                                     std::filesystem::path const& cwd,
+                                     bool use_shell) {
+  std::vector<std::string> args;
+  std::optional<std::filesystem::path> program;
+  if (!use_shell && !needs_shell(user_cmds)) {
+    program = find_executable(user_cmds.front(), envs, cwd);
+  }
+  if (program && is_native_executable(*program)) {
+    user_cmds.front() = to_string(program->native());
+    std::transform(user_cmds.begin(), user_cmds.end(), user_cmds.begin(),
+                   [](std::string const& arg) { return quote_argument(arg); });
+  } else {
+    args = {"cmd.exe", "/d", "/c"};
+  }
+  args.insert(args.end(), user_cmds.begin(), user_cmds.end());
+  return args;
+}
+
+// `vsrun --serve`: keeps the instances and dev environments it looked up in
+// memory and runs commands for `vsrun --client` until `vsrun --stop-server`.
+int run_server(LazySetupConfiguration& setup, std::string const& endpoint,
+               InstanceBackend backend, bool no_snapshot, bool no_env_cache,
+               int debug_level) {
+  // Joins the MTA on this thread for the server's lifetime, so that the
+  // connection threads reach the Setup API through the implicit MTA.
+  try {
+    setup.config();
+  } catch (win32_exception const&) {
+    // Not registered; GetMatchedVisualStudios reads state.json instead.
+  }
+  std::mutex setup_mutex;
+  ResidentEnvironments provider(
+      [&](RunRequest const& request) -> std::optional<VisualStudio> {
+        // LazySetupConfiguration is not thread-safe.
+        std::lock_guard lock(setup_mutex);
+        auto query = Query::compile({.version_ = request.version_,
+                                     .product_ = request.product_,
+                                     .workload_ = request.workload_,
+                                     .requires_all_ = request.requires_all_,
+                                     .requires_any_ = request.requires_any_,
+                                     .sort_ = request.sort_});
+        if (!query) {
+          return std::nullopt;
+        }
+        auto selected = GetMatchedVisualStudios(
+            setup, *query,
+            request.select_last_ ? OutputIntent::kLast : OutputIntent::kFirst,
+            debug_level, !no_snapshot, backend);
+        if (selected.empty()) {
+          return std::nullopt;
+        }
+        return selected.front();
+      },
+      [no_env_cache, debug_level](VisualStudio const& vs,
+                                  RunRequest const& request,
+                                  Environment const& parent) {
+        return dev_environment(vs, request.arch_, request.host_arch_, parent,
+                               no_env_cache, debug_level);
+      });
+  DevEnvServer server(
+      provider,
+      [](RunRequest const& request, Environment const& envs,
+         OutputSink const& sink) -> std::optional<int> {
+        if (request.command_.empty()) {
+          return std::nullopt;
+        }
+        std::filesystem::path cwd =
+            request.cwd_.empty() ? std::filesystem::current_path()
+                                 : std::filesystem::path(
+                                       utf8_decode(request.cwd_));
+        return run_process(
+            dev_command(request.command_, envs, cwd, request.use_shell_), cwd,
+            envs, sink);
+      });
+  try {
+    LocalListener listener(endpoint);
+    if (debug_level > 0) {
+      std::cerr << "serving on " << endpoint << '\n';
+    }
+    server.serve(listener);
+  } catch (std::system_error const& e) {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+// The whole of `file`, or of stdin for "-".
+std::optional<std::string> read_input(std::string const& file) {
+  if (file == "-") {
+    _setmode(_fileno(stdin), _O_BINARY);
+    return std::string(std::istreambuf_iterator<char>(std::cin), {});
+  }
+  std::ifstream in(std::filesystem::path(to_wstring(file)), std::ios::binary);
+  if (!in) {
+    return std::nullopt;
+  }
+  return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+// `vsrun --batch`: sets up the dev environment of `vs` once and runs every
+// command of `batch_file` (stdin for "-") in it through cmd.exe, `jobs` at a
+// time. Each command's output is written as one group, in file order.
+int run_batch_file(VisualStudio const& vs, std::string const& batch_file,
+                   size_t jobs, std::string const& arch,
+                   std::string const& host_arch, Environment const& envs,
+                   std::filesystem::path const& cwd, bool no_env_cache,
+                   int debug_level) {
+  auto text = read_input(batch_file);
+  if (!text) {
+    std::cerr << "cannot read " << batch_file << '\n';
+    return EXIT_FAILURE;
+  }
+  auto commands = parse_batch(*text);
+
+  auto dev_env =
+      dev_environment(vs, arch, host_arch, envs, no_env_cache, debug_level);
+  if (!dev_env) {
+    std::cerr << "VsDevCmd.bat failed for " << to_string(vs.install_path_)
+              << '\n';
+    return EXIT_FAILURE;
+  }
+  // Every command starts from the same block.
+  EnvStore store(envs);
+  store.apply(*dev_env);
+  auto block = store.block();
+
+  _setmode(_fileno(stdout), _O_BINARY);
+  _setmode(_fileno(stderr), _O_BINARY);
+  auto results = run_batch(
+      commands, jobs,
+      [&](std::string const& command, OutputSink const& sink) {
+        return run_process({"cmd.exe", "/d", "/c", command}, cwd, block, sink);
+      },
+      [&](size_t index, BatchResult const& result) {
+        for (auto const& chunk : result.output_) {
+          write_output(chunk.channel_, chunk.data_);
+        }
+        if (!result.succeeded() || debug_level > 0) {
+          std::cerr << "vsrun: [" << index + 1 << '/' << commands.size()
+                    << "] "
+                    << (result.exit_code_
+                            ? "exit " + std::to_string(*result.exit_code_)
+                            : std::string("cannot start"))
+                    << ": " << result.command_ << std::endl;
+        }
+      });
+  auto failed = std::count_if(
+      results.begin(), results.end(),
+      [](BatchResult const& result) { return !result.succeeded(); });
+  if (failed > 0) {
+    std::cerr << "vsrun: " << failed << " of " << results.size()
+              << " commands failed" << std::endl;
+  }
+  return batch_exit_code(results);
+}
+
+// `vsrun --graph`: runs the nodes of `graph_file` through cmd.exe once their
+// dependencies have succeeded, each in the dev environment of `vs` for its
+// arch. Every (instance, arch) pair runs VsDevCmd.bat at most once.
+int run_graph_file(VisualStudio const& vs, std::string const& graph_file,
+                   size_t jobs, FailurePolicy policy, std::string const& arch,
+                   std::string const& host_arch, Environment const& envs,
+                   std::filesystem::path const& cwd, bool no_env_cache,
+                   int debug_level) {
+  auto text = read_input(graph_file);
+  if (!text) {
+    std::cerr << "cannot read " << graph_file << '\n';
+    return EXIT_FAILURE;
+  }
+  std::string error;
+  auto graph = CommandGraph::parse(*text, &error);
+  if (!graph) {
+    std::cerr << graph_file << ": " << error << '\n';
+    return EXIT_FAILURE;
+  }
+  for (auto const& node : graph->nodes()) {
+    if (!node.arch_.empty() && node.arch_ != "x86" && node.arch_ != "x64" &&
+        node.arch_ != "arm64") {
+      std::cerr << graph_file << ": unknown arch " << node.arch_ << " of "
+                << node.name_ << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+
+  ResidentEnvironments environments(
+      [&vs](RunRequest const&) { return std::optional<VisualStudio>(vs); },
+      [no_env_cache, debug_level](VisualStudio const& vs,
+                                  RunRequest const& request,
+                                  Environment const& parent) {
+        return dev_environment(vs, request.arch_, request.host_arch_, parent,
+                               no_env_cache, debug_level);
+      });
+  // The block of each arch, built once and shared by its nodes.
+  std::mutex blocks_mutex;
+  std::map<std::string, EnvBlock> blocks;
+  _setmode(_fileno(stdout), _O_BINARY);
+  _setmode(_fileno(stderr), _O_BINARY);
+  auto results = run_graph(
+      *graph, jobs, policy,
+      [&](GraphNode const& node, OutputSink const& sink) {
+        RunRequest request;
+        request.arch_ = node.arch_.empty() ? arch : node.arch_;
+        request.host_arch_ = host_arch;
+        std::optional<EnvBlock> block;
+        {
+          std::lock_guard lock(blocks_mutex);
+          if (auto it = blocks.find(request.arch_); it != blocks.end()) {
+            block = it->second;
+          }
+        }
+        if (!block) {
+          request.env_ = envs;
+          std::string error;
+          auto dev_envs = environments.environment(request, error);
+          if (!dev_envs) {
+            throw std::runtime_error(error);
+          }
+          block = EnvStore(*dev_envs).block();
+          std::lock_guard lock(blocks_mutex);
+          blocks.emplace(request.arch_, *block);
+        }
+        return run_process({"cmd.exe", "/d", "/c", node.command_}, cwd,
+                           *block, sink);
+      },
+      [&](size_t, GraphNode const& node, NodeResult const& result) {
+        for (auto const& chunk : result.output_) {
+          write_output(chunk.channel_, chunk.data_);
+        }
+        if (result.status_ != NodeStatus::kSucceeded || debug_level > 0) {
+          std::cerr << "vsrun: " << node.name_ << ": "
+                    << (result.status_ == NodeStatus::kSkipped ? "skipped"
+                        : result.exit_code_
+                            ? "exit " + std::to_string(*result.exit_code_)
+                            : std::string("cannot start"))
+                    << std::endl;
+        }
+      });
+  return graph_exit_code(results);
+}
+
+// `vsrun --arch a,b,...`: captures the dev environment of `vs` for every
+// arch at once and runs `user_cmds` in each, with %VSRUN_ARCH% telling the
+// runs apart. Each arch's output is written as one group.
+int run_for_archs(VisualStudio const& vs,
+                  std::vector<std::string> const& archs,
+                  std::string const& host_arch,
+                  std::vector<std::string> const& user_cmds,
+                  Environment const& envs, std::filesystem::path const& cwd,
+                  bool use_shell, bool no_env_cache, int debug_level) {
+  _setmode(_fileno(stdout), _O_BINARY);
+  _setmode(_fileno(stderr), _O_BINARY);
+  auto results = run_per_arch(
+      archs,
+      [&](std::string const& arch) -> std::optional<Environment> {
+        auto dev_env = dev_environment(vs, arch, host_arch, envs,
+                                       no_env_cache, debug_level);
+        if (!dev_env) {
+          return std::nullopt;
+        }
+        auto arch_envs = envs;
+        apply_environment(arch_envs, *dev_env);
+        return arch_envs;
+      },
+      [&](std::string const&, Environment const& arch_envs,
+          OutputSink const& sink) {
+        return run_process(dev_command(user_cmds, arch_envs, cwd, use_shell),
+                           cwd, arch_envs, sink);
+      },
+      [&](size_t, BatchResult const& result) {
+        for (auto const& chunk : result.output_) {
+          write_output(chunk.channel_, chunk.data_);
+        }
+        if (!result.succeeded() || debug_level > 0) {
+          std::cerr << "vsrun: " << result.command_ << ": "
+                    << (result.exit_code_
+                            ? "exit " + std::to_string(*result.exit_code_)
+                            : std::string("cannot start"))
+                    << std::endl;
+        }
+      });
+  return batch_exit_code(results);
+}
+
+// `vsrun --client`: has the server run the command. Returns std::nullopt
+// when no server answers, so that the caller runs the command itself.
+std::optional<int> run_on_server(std::string const& endpoint,
+                                 RunRequest const& request, int debug_level) {
+  auto stream = connect_local(endpoint);
+  if (!stream.is_open()) {
+    if (debug_level > 0) {
+      std::cerr << "no server on " << endpoint << ", running locally\n";
     }
-    return configuration;
-  }());
-  ISetupHelperPtr helper(vs_setup_config);
+    return std::nullopt;
+  }
+  // The child's bytes go out unchanged.
+  _setmode(_fileno(stdout), _O_BINARY);
+  _setmode(_fileno(stderr), _O_BINARY);
+  std::string error;
+  auto exit_code = request_run(stream, request, write_output, error);
+  if (!exit_code) {
+    std::cerr << "vsrun server: " << error << '\n';
+    return EXIT_FAILURE;
+  }
+  return exit_code;
+}
+
+int wmain(int argc, wchar_t* argv[]) {
+  LazySetupConfiguration setup;
 
 #if defined(__aarch64__) || defined(_M_ARM64)
   std::string arch = "arm64";
@@ -54,8 +518,24 @@ int wmain(int argc, wchar_t* argv[]) {
   std::string sort_by = "";
   bool select_the_first_one{true};
   std::string select_workload = "*";
+  std::string requires_all;
+  std::string requires_any;
 
   bool ignore_environment = false;
+  bool no_env_cache = false;
+  bool no_snapshot = false;
+  bool use_state_json = false;
+  bool use_shell = false;
+  bool serve_mode = false;
+  bool client_mode = false;
+  bool stop_server = false;
+  std::string endpoint = default_serve_endpoint();
+  std::string trace_file;
+  std::string print_env;
+  std::string batch_file;
+  std::string graph_file;
+  bool keep_going = false;
+  int jobs = 0;
 
   std::string workdir;
   std::vector<std::string> uset_env_names;
@@ -63,8 +543,17 @@ int wmain(int argc, wchar_t* argv[]) {
   argparse::ArgParser parser{
       "vsrun",
       R"(call C:\*\Microsoft Visual Studio\*\Common7\Tools\VsDevCmd.bat && %*)"};
-  parser.add_option("arch", "target cpu arch", arch)
-      .choices({"x86", "x64", "arm64"});
+  parser
+      .add_option("arch",
+                  "target cpu arch, or a comma-separated list such as "
+                  "x64,arm64 to run the command once per arch in parallel, "
+                  "with %VSRUN_ARCH% set to the arch",
+                  arch)
+      .checker([](std::string const& val) {
+        std::string error;
+        bool ok = parse_arch_list(val, &error).has_value();
+        return std::pair<bool, std::string>{ok, error};
+      });
   parser.add_option("host-arch", "host cpu arch", host_arch)
       .choices({"x86", "x64", "arm64"});
   parser
@@ -72,19 +561,15 @@ int wmain(int argc, wchar_t* argv[]) {
                   "A version range for instances to find. Example: "
                   "[17.0,18.0) will find versions 17.*.",
                   version_range)
-      .checker(
-          [&helper](std::string const& val) -> std::pair<bool, std::string> {
-            if (val.empty()) {
-              return {false, "version range is empty."};
-            }
-            auto wversion = to_version_range(to_wstring(val));
-            uint64_t version_min, version_max;
-            if (FAILED(helper->ParseVersionRange(wversion.c_str(), &version_min,
-                                                 &version_max))) {
-              return {false, "not a valid version range: " + val};
-            }
-            return {true, ""};
-          });
+      .checker([](std::string const& val) -> std::pair<bool, std::string> {
+        if (val.empty()) {
+          return {false, "version range is empty."};
+        }
+        if (!parse_version_range(to_version_range(val))) {
+          return {false, "not a valid version range: " + val};
+        }
+        return {true, ""};
+      });
   parser
       .add_option("product",
                   "One or more product IDs to find. Defaults to Community, "
@@ -97,6 +582,13 @@ int wmain(int argc, wchar_t* argv[]) {
       "workload",
       "require workload, Microsoft.VisualStudio.Workload.NativeDesktop",
       select_workload);
+  parser.add_option("requires",
+                    "require all of these comma-separated package IDs, of any "
+                    "type, e.g. Microsoft.VisualStudio.Component.VC.ATL",
+                    requires_all);
+  parser.add_option("requires-any",
+                    "require at least one of these comma-separated package IDs",
+                    requires_any);
 
   parser
       .add_option(
@@ -143,6 +635,76 @@ int wmain(int argc, wchar_t* argv[]) {
   parser.add_flag("i,ignore-environment", "start with an empty environment",
                   ignore_environment);
 
+  parser.add_flag("no-env-cache",
+                  "run VsDevCmd.bat again instead of reusing its cached "
+                  "environment",
+                  no_env_cache);
+  parser.add_flag("no-snapshot",
+                  "enumerate instances instead of reading the cached snapshot",
+                  no_snapshot);
+  parser.add_flag("state-json",
+                  "read Setup's state.json files instead of querying the COM "
+                  "Setup API",
+                  use_state_json);
+  parser.add_flag("shell",
+                  "always run the command through cmd.exe, even when it could "
+                  "be started directly",
+                  use_shell);
+  parser.add_flag("serve",
+                  "keep instances and dev environments in memory and run "
+                  "commands for `vsrun --client` until `vsrun --stop-server`",
+                  serve_mode);
+  parser.add_flag("client",
+                  "run the command through a `vsrun --serve` server, or "
+                  "directly when none is running",
+                  client_mode);
+  parser.add_flag("stop-server", "stop the `vsrun --serve` server",
+                  stop_server);
+  parser
+      .add_option("print-env",
+                  "print what VsDevCmd.bat sets instead of running a command, "
+                  "as cmd, powershell, sh, json, cmake, cmake-preset or ninja "
+                  "(an environment block for `ninja -t msvc -e`)",
+                  print_env)
+      .value_help("format")
+      .checker([](std::string const& val) {
+        return std::pair<bool, std::string>{
+            parse_env_format(val).has_value(), "unknown format: " + val};
+      });
+  parser
+      .add_option("batch",
+                  "run each line of <file> (or NUL-separated entry; - reads "
+                  "stdin) as a command in one dev environment",
+                  batch_file)
+      .value_help("file");
+  parser
+      .add_option("graph",
+                  "run the commands of a JSON node list in dependency order, "
+                  "e.g. [{\"name\":\"b\",\"command\":\"cmake --build b\","
+                  "\"arch\":\"arm64\",\"deps\":[\"a\"]}]",
+                  graph_file)
+      .value_help("file");
+  parser.add_flag("k,keep-going",
+                  "with --graph, keep running what does not depend on a "
+                  "failed command instead of stopping at the first failure",
+                  keep_going);
+  parser
+      .add_option("j,jobs",
+                  "run up to N --batch or --graph commands at once, default "
+                  "the number of cores",
+                  jobs)
+      .value_help("N");
+  parser
+      .add_option("trace",
+                  "write how long each phase took to <file>, as Chrome "
+                  "trace-event JSON for chrome://tracing or Perfetto",
+                  trace_file)
+      .value_help("file");
+  parser.add_option("endpoint",
+                    "named pipe of the server, default "
+                    "\\\\.\\pipe\\vsrun-%USERNAME% or %VSRUN_ENDPOINT%",
+                    endpoint);
+
   parser.add_positional("CMDSTR", "run command in vs dev environment",
                         user_cmds);
 
@@ -154,24 +716,149 @@ int wmain(int argc, wchar_t* argv[]) {
  vsrun "cmake -B build -S . -D CMAKE_BUILD_TYPE=Release && cmake --build build --config Release"
   )==");
 
+  // Tracing starts once --trace is parsed, so the parse is timed here.
+  auto parse_start = Tracer::global().now();
   try {
     parser.parse(argc, argv);
   } catch (std::exception const& e) {
     std::cerr << e.what() << std::endl;
     return EXIT_FAILURE;
   }
+  TraceSession trace_session(trace_file);
+  if (Tracer::global().enabled()) {
+    Tracer::global().record("parse arguments", parse_start,
+                            Tracer::global().now());
+  }
 
-  std::map<std::string, std::string> sort_by_map;
-  if (!sort_by.empty()) {
-    auto s1 = split(sort_by, ',', -1);
-    for (auto const& s : s1) {
-      auto s2 = split(s, ':', 1);
-      sort_by_map[s2[0]] = s2[1];
+  // Already validated by the --arch checker.
+  auto archs = parse_arch_list(arch).value();
+  arch = archs.front();
+  if (archs.size() > 1 &&
+      (serve_mode || !batch_file.empty() || !graph_file.empty() ||
+       !print_env.empty())) {
+    std::cerr << "--arch takes a single arch with --serve, --batch, --graph "
+                 "and --print-env\n";
+    return EXIT_FAILURE;
+  }
+
+  auto backend =
+      use_state_json ? InstanceBackend::kStateJson : InstanceBackend::kCom;
+  if (stop_server) {
+    auto stream = connect_local(endpoint);
+    return request_shutdown(stream) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if (serve_mode) {
+    return run_server(setup, endpoint, backend, no_snapshot, no_env_cache,
+                      debug_level);
+  }
+  if (client_mode && archs.size() == 1 && !user_cmds.empty() &&
+      !list_visual_studio &&
+      !check_installed_or_not) {
+    auto cmds = user_cmds;
+    RunRequest request{
+        .version_ = to_version_range(version_range),
+        .product_ = product_id,
+        .workload_ = select_workload,
+        .requires_all_ = requires_all,
+        .requires_any_ = requires_any,
+        .sort_ = sort_by,
+        .select_last_ = !select_the_first_one,
+        .arch_ = arch,
+        .host_arch_ = host_arch,
+        .use_shell_ = use_shell,
+        .cwd_ = workdir.empty()
+                    ? utf8_encode(std::filesystem::current_path().native())
+                    : workdir,
+        .env_ = {},
+        .command_ = {}};
+    unset_environment(uset_env_names);
+    request.env_ = prepare_environment(cmds, ignore_environment);
+    request.command_ = std::move(cmds);
+    if (auto exit_code = run_on_server(endpoint, request, debug_level)) {
+      return *exit_code;
     }
   }
-  auto all_match_visualstudios = GetMatchedVisualStudios(
-      vs_setup_config, to_version_range(version_range), product_id,
-      select_workload, sort_by_map, debug_level);
+
+  // Every clause was validated by its option's checker.
+  auto query = Query::compile({.version_ = to_version_range(version_range),
+                               .product_ = product_id,
+                               .workload_ = select_workload,
+                               .requires_all_ = requires_all,
+                               .requires_any_ = requires_any,
+                               .sort_ = sort_by});
+  if (!query) {
+    return EXIT_FAILURE;
+  }
+  // Only the stages that will be used are given to run_startup. The dev
+  // environment is looked up up front for --print-env and for a single-arch
+  // command; --no-env-cache commands run VsDevCmd.bat in the same cmd.exe.
+  bool has_command = !user_cmds.empty();
+  bool needs_env = !check_installed_or_not &&
+                   (has_command || !print_env.empty() || !graph_file.empty() ||
+                    !batch_file.empty());
+  bool needs_dev_env =
+      needs_env && (!print_env.empty() ||
+                    (graph_file.empty() && batch_file.empty() &&
+                     archs.size() == 1 && !no_env_cache));
+  // --check only asks whether anything matches, and only --list uses more
+  // than the selected instance.
+  auto intent = check_installed_or_not ? OutputIntent::kExists
+                : list_visual_studio   ? OutputIntent::kAll
+                : select_the_first_one ? OutputIntent::kFirst
+                                       : OutputIntent::kLast;
+  StartupStages stages{
+      .lookup_ =
+          [&]() {
+            return GetMatchedVisualStudios(setup, *query, intent, debug_level,
+                                           !no_snapshot, backend);
+          },
+      .select_last_ = !select_the_first_one};
+  if (needs_env) {
+    // Before any stage starts, so that none sees the variables go.
+    unset_environment(uset_env_names);
+    stages.prepare_ = [&user_cmds, ignore_environment]() {
+      return prepare_environment(user_cmds, ignore_environment);
+    };
+  }
+  if (needs_dev_env) {
+    stages.develop_ = [arch, host_arch, no_env_cache, debug_level](
+                          VisualStudio const& vs, Environment const& parent,
+                          std::atomic<bool> const& cancelled)
+        -> std::optional<EnvDelta> {
+      // A missing VsDevCmd.bat is reported once the instance is final.
+      if (cancelled || !is_regular_file(vsdevcmd_path(vs))) {
+        return std::nullopt;
+      }
+      return dev_environment(vs, arch, host_arch, parent, no_env_cache,
+                             debug_level, &cancelled);
+    };
+  }
+  if (needs_dev_env && !no_snapshot) {
+    // The snapshot as it is, fresh or not: lookup_ has the final say, and
+    // VsDevCmd.bat starts for the guess while it decides.
+    stages.predict_ = [&query, backend, select_last = !select_the_first_one]()
+        -> std::optional<VisualStudio> {
+      auto snap = InstanceSnapshot::open(default_snapshot_path());
+      if (!snap || snap->backend() != backend) {
+        return std::nullopt;
+      }
+      SnapshotInstanceSource source(std::move(*snap));
+      auto selected = query->collect(
+          source, select_last ? OutputIntent::kLast : OutputIntent::kFirst);
+      if (selected.empty()) {
+        return std::nullopt;
+      }
+      return selected.front();
+    };
+  }
+  auto startup = run_startup(stages);
+  auto const& all_match_visualstudios = startup.instances_;
+  if (debug_level > 0 && startup.speculation_ != Speculation::kNone) {
+    std::cerr << "Speculative VsDevCmd.bat: "
+              << (startup.speculation_ == Speculation::kHit ? "used"
+                                                            : "discarded")
+              << '\n';
+  }
 
   if (check_installed_or_not) {
     if (all_match_visualstudios.empty()) {
@@ -196,62 +883,94 @@ int wmain(int argc, wchar_t* argv[]) {
     }
     return EXIT_FAILURE;
   }
+  auto const& vs = *startup.selected();
 
-  if (!user_cmds.empty()) {
-    std::filesystem::path installationPath =
-        select_the_first_one ? all_match_visualstudios.front().install_path_
-                             : all_match_visualstudios.back().install_path_;
+  if (!print_env.empty()) {
+    if (!user_cmds.empty()) {
+      std::cerr << "--print-env does not run a command\n";
+      return EXIT_FAILURE;
+    }
+    if (!startup.dev_env_) {
+      std::cerr << "VsDevCmd.bat failed for " << to_string(vs.install_path_)
+                << '\n';
+      return EXIT_FAILURE;
+    }
+    // In an MSYS shell, sh output puts the new PATH entries in MSYS form.
+    _setmode(_fileno(stdout), _O_BINARY);
+    write_output(OutputChannel::kStdout,
+                 format_environment(*parse_env_format(print_env),
+                                    *startup.dev_env_, startup.parent_,
+                                    env::get("MSYSTEM").has_value()));
+    return EXIT_SUCCESS;
+  }
+  if (!graph_file.empty()) {
+    if (!user_cmds.empty()) {
+      std::cerr << "--graph takes its commands from " << graph_file << '\n';
+      return EXIT_FAILURE;
+    }
+    return run_graph_file(
+        vs, graph_file, static_cast<size_t>(std::max(jobs, 0)),
+        keep_going ? FailurePolicy::kKeepGoing : FailurePolicy::kFailFast,
+        arch, host_arch, startup.parent_,
+        workdir.empty() ? std::filesystem::current_path()
+                        : std::filesystem::path(workdir),
+        no_env_cache, debug_level);
+  }
+  if (!batch_file.empty()) {
+    if (!user_cmds.empty()) {
+      std::cerr << "--batch takes its commands from " << batch_file << '\n';
+      return EXIT_FAILURE;
+    }
+    return run_batch_file(
+        vs, batch_file, static_cast<size_t>(std::max(jobs, 0)), arch,
+        host_arch, std::move(startup.parent_),
+        workdir.empty() ? std::filesystem::current_path()
+                        : std::filesystem::path(workdir),
+        no_env_cache, debug_level);
+  }
+
+  if (has_command) {
+    std::filesystem::path installationPath = vs.install_path_;
     if (!is_directory(installationPath)) {
       std::cerr << "installation not a directory: " << installationPath << '\n';
       return EXIT_FAILURE;
     }
-    std::filesystem::path VcDevCmdPath =
-        installationPath / "Common7" / "Tools" / "VsDevCmd.bat";
+    std::filesystem::path VcDevCmdPath = vsdevcmd_path(vs);
     if (!is_regular_file(VcDevCmdPath)) {
       std::cerr << VcDevCmdPath.string()
                 << " not exists or not a bat file: " << VcDevCmdPath << '\n';
       return EXIT_FAILURE;
     }
 
-    std::vector<std::string> args{"cmd.exe",
-                                  "/d",
-                                  "/c",
-                                  "call",
-                                  quote_path_if_needed(VcDevCmdPath.string()),
-                                  "-no_logo",
-                                  "-host_arch=" + host_arch,
-                                  "-arch=" + arch,
-                                  ">nul&&"};
-
-    std::map<std::wstring, std::wstring> envs;
-    for (auto name : uset_env_names) {
-      env::unset(name);
-    }
-    if (!ignore_environment) {
-      envs = env::allutf16();
-    }
-    auto MSYSTEM = env::get("MSYSTEM");
-    auto ORIGINAL_PATH = env::get("ORIGINAL_PATH");
-    auto ORIGINAL_TEMP = env::get("ORIGINAL_TEMP");
-    auto ORIGINAL_TMP = env::get("ORIGINAL_TMP");
-    if (MSYSTEM && ORIGINAL_PATH && ORIGINAL_TEMP && ORIGINAL_TMP) {
-      auto ORIGINAL_TEMP_DIR = std::filesystem::path(ORIGINAL_TEMP.value());
-      auto ORIGINAL_TMP_DIR = std::filesystem::path(ORIGINAL_TMP.value());
-      if (is_directory(ORIGINAL_TEMP_DIR) && is_directory(ORIGINAL_TMP_DIR)) {
-        envs[L"PATH"] = to_wstring(ORIGINAL_PATH.value());
-        envs[L"TEMP"] = ORIGINAL_TEMP_DIR.make_preferred().native();
-        envs[L"TMP"] = ORIGINAL_TMP_DIR.make_preferred().native();
-      }
-    }
-    while (!user_cmds.empty() &&
-           user_cmds.begin()->find('=') != std::string::npos) {
-      auto tmp = split(*user_cmds.begin(), '=', 1);
-      envs.insert(
-          {to_wstring(tmp[0]), to_wstring(tmp.size() > 1 ? tmp[1] : "")});
-      user_cmds.erase(user_cmds.begin());
+    auto envs = std::move(startup.parent_);
+
+    if (archs.size() > 1) {
+      return run_for_archs(vs, archs, host_arch, user_cmds, envs,
+                           workdir.empty() ? std::filesystem::current_path()
+                                           : std::filesystem::path(workdir),
+                           use_shell, no_env_cache, debug_level);
     }
 
-    args.insert(args.end(), user_cmds.begin(), user_cmds.end());
+    auto const& dev_env = startup.dev_env_;
+    std::vector<std::string> args;
+    if (dev_env) {
+      apply_environment(envs, *dev_env);
+      args = dev_command(user_cmds, envs,
+                         workdir.empty() ? std::filesystem::current_path()
+                                         : std::filesystem::path(workdir),
+                         use_shell);
+    } else {
+      args = {"cmd.exe",
+              "/d",
+              "/c",
+              "call",
+              quote_argument(VcDevCmdPath.string()),
+              "-no_logo",
+              "-host_arch=" + host_arch,
+              "-arch=" + arch,
+              ">nul&&"};
+      args.insert(args.end(), user_cmds.begin(), user_cmds.end());
+    }
     if (debug_level >= 1) {
       std::copy(begin(args), end(args),
                 std::ostream_iterator<std::string>(std::cerr, " "));
@@ -261,6 +980,7 @@ int wmain(int argc, wchar_t* argv[]) {
     using subprocess::named_arguments::cwd;
     using subprocess::named_arguments::env;
 
+    TraceSpan span("run command");
     return subprocess::run(args, cwd = workdir, env = envs);
   } else {
     std::cerr << parser.usage() << '\n';
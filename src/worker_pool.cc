@@ -0,0 +1,55 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(size_t threads, std::function<void()> thread_init,
+                       std::function<void()> thread_exit)
+    : thread_init_(std::move(thread_init)),
+      thread_exit_(std::move(thread_exit)) {
+  threads = std::max<size_t>(threads, 1);
+  threads_.reserve(threads);
+  for (size_t i = 0; i < threads; ++i) {
+    threads_.emplace_back([this]() { run(); });
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+  }
+  ready_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void WorkerPool::post(std::function<void()> task) {
+  {
+    std::lock_guard lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  ready_.notify_one();
+}
+
+void WorkerPool::run() {
+  if (thread_init_) {
+    thread_init_();
+  }
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock lock(mutex_);
+      ready_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        break;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+  if (thread_exit_) {
+    thread_exit_();
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// A fixed set of threads running posted tasks in FIFO order. `thread_init`
+// and `thread_exit` run on every worker around its task loop, e.g. to enter
+// and leave the COM multithreaded apartment.
+class WorkerPool {
+ public:
+  explicit WorkerPool(size_t threads, std::function<void()> thread_init = {},
+                      std::function<void()> thread_exit = {});
+  // Runs the tasks already posted, then joins the workers.
+  ~WorkerPool();
+
+  WorkerPool(WorkerPool const&) = delete;
+  WorkerPool& operator=(WorkerPool const&) = delete;
+
+  void post(std::function<void()> task);
+
+  // Futures complete in any order; callers that need the input order keep
+  // the futures in that order and wait on them one by one.
+  template <typename F>
+  std::future<std::invoke_result_t<F>> submit(F&& f) {
+    using R = std::invoke_result_t<F>;
+    auto task =
+        std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    auto future = task->get_future();
+    post([task]() { (*task)(); });
+    return future;
+  }
+
+  size_t size() const { return threads_.size(); }
+
+ private:
+  void run();
+
+  std::function<void()> thread_init_;
+  std::function<void()> thread_exit_;
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<std::function<void()>> tasks_;
+  bool stopping_ = false;
+  std::vector<std::thread> threads_;
+};
+
+#endif  // WORKER_POOL_H_
@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/batch.h"
+
+namespace {
+
+#if defined(_WIN32)
+std::optional<int> RunInShell(std::string const& command,
+                              OutputSink const& sink) {
+  Environment env;
+  if (auto const* root = _wgetenv(L"SystemRoot")) {
+    env[L"SystemRoot"] = root;
+    env[L"PATH"] = std::wstring(root) + L"\\System32";
+  }
+  return run_process({"cmd.exe", "/d", "/c", command}, {}, env, sink);
+}
+#else
+std::optional<int> RunInShell(std::string const& command,
+                              OutputSink const& sink) {
+  return run_process({"sh", "-c", command}, {}, {{L"PATH", L"/usr/bin:/bin"}},
+                     sink);
+}
+#endif
+
+struct Reported {
+  std::vector<size_t> order_;
+  std::string text_;
+
+  BatchReporter reporter() {
+    return [this](size_t index, BatchResult const& result) {
+      order_.push_back(index);
+      for (auto const& chunk : result.output_) {
+        text_ += chunk.channel_ == OutputChannel::kStdout ? "O:" : "E:";
+        text_ += chunk.data_;
+      }
+    };
+  }
+};
+
+}  // namespace
+
+TEST(Batch, ParsesLines) {
+  EXPECT_EQ(parse_batch("cmake --build a\r\n\n  # comment\n\t\nctest\n"),
+            (std::vector<std::string>{"cmake --build a", "ctest"}));
+  EXPECT_EQ(parse_batch("last line without newline"),
+            (std::vector<std::string>{"last line without newline"}));
+  EXPECT_TRUE(parse_batch("").empty());
+}
+
+TEST(Batch, ParsesNulSeparatedCommands) {
+  using namespace std::string_literals;
+  EXPECT_EQ(parse_batch("echo a\nb\0#kept\0\0ctest\0"s),
+            (std::vector<std::string>{"echo a\nb", "#kept", "ctest"}));
+}
+
+TEST(Batch, ReportsGroupsInInputOrder) {
+  // The first command finishes last; its output still comes first.
+  std::vector<std::string> commands = {"sleep 0.3; echo first; echo e >&2",
+                                       "echo second", "echo third; exit 4"};
+#if defined(_WIN32)
+  commands[0] = "ping -n 2 127.0.0.1 >nul & echo first& echo e 1>&2";
+  commands[2] = "echo third& exit 4";
+#endif
+  Reported reported;
+  auto results = run_batch(commands, 3, RunInShell, reported.reporter());
+  ASSERT_EQ(results.size(), 3u);
+  EXPECT_EQ(reported.order_, (std::vector<size_t>{0, 1, 2}));
+#if !defined(_WIN32)
+  EXPECT_EQ(reported.text_, "O:first\nE:e\nO:second\nO:third\n");
+#endif
+  EXPECT_EQ(results[0].exit_code_, 0);
+  EXPECT_EQ(results[2].exit_code_, 4);
+  EXPECT_EQ(results[1].command_, commands[1]);
+  EXPECT_TRUE(results[0].output_.empty());
+  EXPECT_EQ(batch_exit_code(results), 4);
+}
+
+TEST(Batch, RunsAtMostJobsCommandsAtOnce) {
+  std::atomic<int> running{0};
+  std::atomic<int> peak{0};
+  std::vector<std::string> commands(12, "x");
+  auto results = run_batch(
+      commands, 3,
+      [&](std::string const&, OutputSink const&) -> std::optional<int> {
+        int now = ++running;
+        int seen = peak;
+        while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        --running;
+        return 0;
+      },
+      [](size_t, BatchResult const&) {});
+  EXPECT_EQ(results.size(), 12u);
+  EXPECT_LE(peak, 3);
+  EXPECT_GE(peak, 2);
+  EXPECT_EQ(batch_exit_code(results), 0);
+}
+
+TEST(Batch, OutputOfConcurrentCommandsDoesNotInterleave) {
+  std::vector<std::string> commands;
+  for (int i = 0; i < 8; ++i) {
+    commands.push_back(std::to_string(i));
+  }
+  Reported reported;
+  run_batch(
+      commands, 4,
+      [](std::string const& command, OutputSink const& sink) {
+        for (int line = 0; line < 50; ++line) {
+          sink(OutputChannel::kStdout, command + "\n");
+          std::this_thread::yield();
+        }
+        return std::optional<int>(0);
+      },
+      reported.reporter());
+  std::string expected;
+  for (auto const& command : commands) {
+    expected += "O:";
+    for (int line = 0; line < 50; ++line) {
+      expected += command + "\n";
+    }
+  }
+  EXPECT_EQ(reported.text_, expected);
+}
+
+TEST(Batch, CommandsThatCannotStartFailTheBatch) {
+  Reported reported;
+  auto results = run_batch(
+      {"ok", "missing", "throws"}, 2,
+      [](std::string const& command,
+         OutputSink const&) -> std::optional<int> {
+        if (command == "missing") {
+          return std::nullopt;
+        }
+        if (command == "throws") {
+          throw std::runtime_error("boom");
+        }
+        return 0;
+      },
+      reported.reporter());
+  EXPECT_FALSE(results[1].exit_code_);
+  EXPECT_FALSE(results[2].exit_code_);
+  EXPECT_EQ(reported.text_, "E:boom");
+  EXPECT_EQ(batch_exit_code(results), 1);
+  EXPECT_EQ(batch_exit_code({}), 0);
+}
@@ -0,0 +1,242 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/command_graph.h"
+
+namespace {
+
+constexpr char kRelease[] = R"([
+  {"name": "configure-x64", "arch": "x64", "command": "configure x64"},
+  {"name": "configure-arm64", "arch": "arm64", "command": "configure arm64"},
+  {"name": "build-x64", "arch": "x64", "deps": ["configure-x64"],
+   "command": "build x64"},
+  {"name": "build-arm64", "arch": "arm64", "deps": ["configure-arm64"],
+   "command": "build arm64"},
+  {"name": "package", "deps": ["build-x64", "build-arm64"],
+   "command": "package", "comment": "ignored"}
+])";
+
+CommandGraph Parse(std::string_view json) {
+  std::string error;
+  auto graph = CommandGraph::parse(json, &error);
+  EXPECT_TRUE(graph) << error;
+  return graph.value_or(CommandGraph{});
+}
+
+std::string ParseError(std::string_view json) {
+  std::string error;
+  EXPECT_FALSE(CommandGraph::parse(json, &error));
+  return error;
+}
+
+// Records when every node started and finished, on one shared clock.
+struct Timeline {
+  std::mutex mutex_;
+  int clock_ = 0;
+  std::map<std::string, std::pair<int, int>> spans_;
+  std::atomic<int> running_{0};
+  std::atomic<int> peak_{0};
+
+  NodeRunner runner(std::string const& failing = {}) {
+    return [this, failing](GraphNode const& node, OutputSink const& sink)
+               -> std::optional<int> {
+      int start;
+      {
+        std::lock_guard lock(mutex_);
+        start = clock_++;
+      }
+      int now = ++running_;
+      int seen = peak_;
+      while (now > seen && !peak_.compare_exchange_weak(seen, now)) {
+      }
+      sink(OutputChannel::kStdout, node.command_);
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      --running_;
+      std::lock_guard lock(mutex_);
+      spans_[node.name_] = {start, clock_++};
+      return node.name_ == failing ? 2 : 0;
+    };
+  }
+
+  bool ran(std::string const& name) {
+    std::lock_guard lock(mutex_);
+    return spans_.count(name) != 0;
+  }
+
+  bool before(std::string const& first, std::string const& second) {
+    std::lock_guard lock(mutex_);
+    return spans_.at(first).second < spans_.at(second).first;
+  }
+};
+
+std::vector<NodeStatus> Statuses(std::vector<NodeResult> const& results) {
+  std::vector<NodeStatus> statuses;
+  for (auto const& result : results) {
+    statuses.push_back(result.status_);
+  }
+  return statuses;
+}
+
+void Ignore(size_t, GraphNode const&, NodeResult const&) {}
+
+}  // namespace
+
+TEST(CommandGraph, ParsesNodes) {
+  auto graph = Parse(kRelease);
+  ASSERT_EQ(graph.size(), 5u);
+  auto const& package = graph.nodes()[4];
+  EXPECT_EQ(package.name_, "package");
+  EXPECT_EQ(package.command_, "package");
+  EXPECT_EQ(package.arch_, "");
+  EXPECT_EQ(package.deps_,
+            (std::vector<std::string>{"build-x64", "build-arm64"}));
+  EXPECT_EQ(graph.dependency_count(4), 2u);
+  EXPECT_EQ(graph.dependents(0), (std::vector<size_t>{2}));
+  EXPECT_EQ(Parse("[]").size(), 0u);
+}
+
+TEST(CommandGraph, RejectsInvalidGraphs) {
+  EXPECT_NE(ParseError(R"([{"name": "a", "command": "x", "deps": ["b"]}])")
+                .find("unknown node b"),
+            std::string::npos);
+  EXPECT_NE(ParseError(R"([{"name": "a", "command": "x"},
+                           {"name": "a", "command": "y"}])")
+                .find("duplicate"),
+            std::string::npos);
+  EXPECT_NE(ParseError(R"([{"name": "a", "command": "x", "deps": ["c"]},
+                           {"name": "b", "command": "y", "deps": ["a"]},
+                           {"name": "c", "command": "z", "deps": ["b"]},
+                           {"name": "d", "command": "w"}])")
+                .find("cycle"),
+            std::string::npos);
+  EXPECT_NE(ParseError(R"([{"name": "a", "command": "x", "deps": ["a"]}])")
+                .find("cycle"),
+            std::string::npos);
+  EXPECT_NE(ParseError(R"([{"name": "a"}])").find("command"),
+            std::string::npos);
+  EXPECT_NE(ParseError(R"([{"name": 1, "command": "x"}])").find("name"),
+            std::string::npos);
+  EXPECT_NE(ParseError(R"({"name": "a"})").find("array"), std::string::npos);
+  EXPECT_FALSE(ParseError(R"([{"name": "a", "command": "x"})").empty());
+  EXPECT_FALSE(ParseError(R"([] [])").empty());
+}
+
+TEST(CommandGraph, RunsEveryNodeAfterItsDependencies) {
+  auto graph = Parse(kRelease);
+  Timeline timeline;
+  std::vector<std::string> reported;
+  auto results = run_graph(
+      graph, 4, FailurePolicy::kFailFast, timeline.runner(),
+      [&reported](size_t, GraphNode const& node, NodeResult const& result) {
+        ASSERT_EQ(result.output_.size(), 1u);
+        reported.push_back(result.output_[0].data_);
+        EXPECT_EQ(result.output_[0].data_, node.command_);
+      });
+  EXPECT_EQ(Statuses(results),
+            std::vector<NodeStatus>(5, NodeStatus::kSucceeded));
+  EXPECT_EQ(reported.size(), 5u);
+  EXPECT_TRUE(timeline.before("configure-x64", "build-x64"));
+  EXPECT_TRUE(timeline.before("configure-arm64", "build-arm64"));
+  EXPECT_TRUE(timeline.before("build-x64", "package"));
+  EXPECT_TRUE(timeline.before("build-arm64", "package"));
+  EXPECT_GE(timeline.peak_, 2);
+  EXPECT_EQ(graph_exit_code(results), 0);
+}
+
+TEST(CommandGraph, IdleThreadsStealReleasedNodes) {
+  // Finishing "root" releases every leaf onto the deque of the one thread
+  // that ran it; the others only get to run them by stealing.
+  std::vector<GraphNode> nodes = {{"root", "root", "", {}}};
+  for (int i = 0; i < 12; ++i) {
+    auto name = "leaf" + std::to_string(i);
+    nodes.push_back({name, name, "", {"root"}});
+  }
+  auto graph = CommandGraph::build(nodes);
+  ASSERT_TRUE(graph);
+  Timeline timeline;
+  auto results =
+      run_graph(*graph, 4, FailurePolicy::kFailFast, timeline.runner(), Ignore);
+  EXPECT_EQ(graph_exit_code(results), 0);
+  EXPECT_GE(timeline.peak_, 2);
+  EXPECT_LE(timeline.peak_, 4);
+}
+
+TEST(CommandGraph, KeepGoingSkipsOnlyWhatDependsOnAFailure) {
+  auto graph = Parse(kRelease);
+  Timeline timeline;
+  std::map<std::string, NodeStatus> reported;
+  auto results = run_graph(
+      graph, 2, FailurePolicy::kKeepGoing, timeline.runner("build-arm64"),
+      [&reported](size_t, GraphNode const& node, NodeResult const& result) {
+        reported[node.name_] = result.status_;
+      });
+  EXPECT_EQ(Statuses(results),
+            (std::vector<NodeStatus>{
+                NodeStatus::kSucceeded, NodeStatus::kSucceeded,
+                NodeStatus::kSucceeded, NodeStatus::kFailed,
+                NodeStatus::kSkipped}));
+  EXPECT_EQ(results[3].exit_code_, 2);
+  EXPECT_FALSE(timeline.ran("package"));
+  EXPECT_EQ(reported.size(), 5u);
+  EXPECT_EQ(reported["package"], NodeStatus::kSkipped);
+  EXPECT_EQ(graph_exit_code(results), 2);
+}
+
+TEST(CommandGraph, FailFastStartsNothingAfterAFailure) {
+  std::vector<GraphNode> nodes;
+  for (int i = 0; i < 6; ++i) {
+    auto name = "n" + std::to_string(i);
+    nodes.push_back({name, name, "", {}});
+  }
+  auto graph = CommandGraph::build(nodes);
+  ASSERT_TRUE(graph);
+  std::atomic<int> started{0};
+  auto fail_all = [&started](GraphNode const&, OutputSink const&) {
+    ++started;
+    return std::optional<int>(1);
+  };
+
+  auto results =
+      run_graph(*graph, 1, FailurePolicy::kFailFast, fail_all, Ignore);
+  auto statuses = Statuses(results);
+  EXPECT_EQ(started, 1);
+  EXPECT_EQ(std::count(statuses.begin(), statuses.end(), NodeStatus::kSkipped),
+            5);
+  EXPECT_EQ(graph_exit_code(results), 1);
+
+  started = 0;
+  run_graph(*graph, 1, FailurePolicy::kKeepGoing, fail_all, Ignore);
+  EXPECT_EQ(started, 6);
+}
+
+TEST(CommandGraph, RunsShellCommands) {
+#if !defined(_WIN32)
+  auto graph = Parse(R"([
+    {"name": "a", "command": "echo a"},
+    {"name": "b", "command": "echo b >&2; exit 3", "deps": ["a"]}
+  ])");
+  std::string text;
+  auto results = run_graph(
+      graph, 2, FailurePolicy::kKeepGoing,
+      [](GraphNode const& node, OutputSink const& sink) {
+        return run_process({"sh", "-c", node.command_}, {},
+                           {{L"PATH", L"/usr/bin:/bin"}}, sink);
+      },
+      [&text](size_t, GraphNode const& node, NodeResult const& result) {
+        text += node.name_ + ":";
+        for (auto const& chunk : result.output_) {
+          text += chunk.data_;
+        }
+      });
+  EXPECT_EQ(text, "a:a\nb:b\n");
+  EXPECT_EQ(graph_exit_code(results), 3);
+#endif
+}
@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+#include "../src/command_line.h"
+
+namespace {
+
+class FindExecutableTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    root_ = std::filesystem::temp_directory_path() /
+            ("vsrun-command-line-test-" +
+             std::to_string(
+                 std::chrono::steady_clock::now().time_since_epoch().count()));
+    std::filesystem::create_directories(root_ / "cwd");
+    std::filesystem::create_directories(root_ / "bin1");
+    std::filesystem::create_directories(root_ / "bin 2");
+  }
+  void TearDown() override { std::filesystem::remove_all(root_); }
+
+  std::filesystem::path Touch(std::filesystem::path const& p) {
+    std::ofstream(root_ / p).put('\0');
+    return root_ / p;
+  }
+
+  Environment Env() const {
+    return {{L"Path", (root_ / "bin1").wstring() + L";\"" +
+                          (root_ / "bin 2").wstring() + L"\";"},
+            {L"PATHEXT", L".COM;.EXE;.BAT;.CMD"}};
+  }
+
+  std::filesystem::path root_;
+};
+
+}  // namespace
+
+TEST(CommandLine, quote_argument) {
+  ASSERT_EQ(quote_argument("cl.exe"), "cl.exe");
+  ASSERT_EQ(quote_argument(""), "\"\"");
+  ASSERT_EQ(quote_argument("a b"), "\"a b\"");
+  ASSERT_EQ(quote_argument("C:\\Program Files\\"), "\"C:\\Program Files\\\\\"");
+  ASSERT_EQ(quote_argument("say \"hi\""), "\"say \\\"hi\\\"\"");
+  ASSERT_EQ(quote_argument("a\\\\\"b"), "\"a\\\\\\\\\\\"b\"");
+  ASSERT_EQ(quote_argument("C:\\no\\spaces\\"), "C:\\no\\spaces\\");
+  ASSERT_EQ(join_command_line({"cl", "/Fo", "out dir\\"}),
+            "cl /Fo \"out dir\\\\\"");
+}
+
+TEST(CommandLine, needs_shell) {
+  ASSERT_FALSE(needs_shell({"cl", "/nologo", "/c", "a.c"}));
+  ASSERT_FALSE(needs_shell({"cmake", "-S", "a b", "-B", "build"}));
+  ASSERT_TRUE(needs_shell({}));
+  ASSERT_TRUE(needs_shell({"cmake -B build"}));
+  ASSERT_TRUE(needs_shell({"where", "cl", "&&", "where", "link"}));
+  ASSERT_TRUE(needs_shell({"cl", "/c", "a.c", ">log.txt"}));
+  ASSERT_TRUE(needs_shell({"echo", "%PATH%"}));
+  ASSERT_TRUE(needs_shell({"SET"}));
+  ASSERT_TRUE(needs_shell({"echo."}));
+  ASSERT_TRUE(needs_shell({"cd.."}));
+  ASSERT_FALSE(needs_shell({"setx", "A", "1"}));
+  ASSERT_FALSE(needs_shell({".\\dir"}));
+}
+
+TEST_F(FindExecutableTest, searches_cwd_then_path) {
+  auto cl = Touch("bin1/cl.exe");
+  auto link = Touch("bin 2/link.exe");
+  ASSERT_EQ(find_executable("cl", Env(), root_ / "cwd"), cl);
+  ASSERT_EQ(find_executable("link", Env(), root_ / "cwd"), link);
+  ASSERT_EQ(find_executable("cl.exe", Env(), root_ / "cwd"), cl);
+  ASSERT_FALSE(find_executable("missing", Env(), root_ / "cwd"));
+
+  auto local = Touch("cwd/cl.exe");
+  ASSERT_EQ(find_executable("cl", Env(), root_ / "cwd"), local);
+}
+
+TEST_F(FindExecutableTest, pathext_order_and_paths) {
+  auto bat = Touch("bin1/tool.bat");
+  ASSERT_EQ(find_executable("tool", Env(), root_ / "cwd"), bat);
+  ASSERT_FALSE(is_native_executable(bat));
+  auto com = Touch("bin1/tool.com");
+  ASSERT_EQ(find_executable("tool", Env(), root_ / "cwd"), com);
+  ASSERT_TRUE(is_native_executable(com));
+
+  auto dotted = Touch("bin1/python3.11.exe");
+  ASSERT_EQ(find_executable("python3.11", Env(), root_ / "cwd"), dotted);
+
+  auto relative = Touch("cwd/build.exe");
+  ASSERT_EQ(find_executable("./build", Env(), root_ / "cwd"), relative);
+  ASSERT_EQ(find_executable((root_ / "bin1" / "cl").string(), Env(), "/"),
+            std::nullopt);
+  auto cl = Touch("bin1/cl.exe");
+  ASSERT_EQ(find_executable((root_ / "bin1" / "cl").string(), Env(), "/"), cl);
+}
@@ -0,0 +1,212 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+#include "../src/env_cache.h"
+
+namespace {
+
+class EnvCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = std::filesystem::temp_directory_path() /
+           ("vsrun-env-cache-test-" +
+            std::to_string(
+                std::chrono::steady_clock::now().time_since_epoch().count()));
+  }
+  void TearDown() override { std::filesystem::remove_all(dir_); }
+
+  static EnvCacheKey MakeKey() {
+    return {.install_path_ = L"C:\\VS\\2022\\Community",
+            .install_version_ = L"17.8.34330.188",
+            .install_datetime_ = 133000000000000000ULL,
+            .arch_ = "x64",
+            .host_arch_ = "x64",
+            .inputs_ = {{L"PATH", L"C:\\Windows"}}};
+  }
+
+  // Stands in for `cmd /c call VsDevCmd.bat >nul && set`.
+  std::optional<Environment> FakeCapture(Environment parent) {
+    ++captures_;
+    parent[L"PATH"] = L"C:\\VS\\bin;" + parent[L"PATH"];
+    parent[L"VSCMD_VER"] = L"17.8.0";
+    parent.erase(L"REMOVED");
+    return parent;
+  }
+
+  std::filesystem::path dir_;
+  int captures_ = 0;
+};
+
+}  // namespace
+
+TEST(EnvCache, parse_set_output) {
+  auto env = parse_set_output(
+      L"ALLUSERSPROFILE=C:\\ProgramData\r\n"
+      L"=C:=C:\\work\r\n"
+      L"noise\r\n"
+      L"EMPTY=\r\n"
+      L"X=a=b\n");
+  ASSERT_EQ(env.size(), 3);
+  ASSERT_EQ(env[L"ALLUSERSPROFILE"], L"C:\\ProgramData");
+  ASSERT_EQ(env[L"EMPTY"], L"");
+  ASSERT_EQ(env[L"X"], L"a=b");
+}
+
+TEST(EnvCache, diff_and_apply) {
+  Environment before{{L"A", L"1"}, {L"B", L"2"}, {L"C", L"3"}};
+  Environment after{{L"A", L"1"}, {L"B", L"20"}, {L"D", L"4"}};
+  auto delta = diff_environment(before, after);
+  ASSERT_EQ(delta.set_, (Environment{{L"B", L"20"}, {L"D", L"4"}}));
+  ASSERT_EQ(delta.unset_, std::vector<std::wstring>{L"C"});
+  apply_environment(before, delta);
+  ASSERT_EQ(before, after);
+}
+
+TEST(EnvCache, diff_keeps_list_variables_as_edits) {
+  Environment before{{L"PATH", L"C:\\Windows;C:\\Tools"},
+                     {L"INCLUDE", L"C:\\old"},
+                     {L"LIB", L"C:\\Lib"}};
+  Environment after{
+      {L"PATH", L"C:\\VS\\bin;c:/windows/;C:\\VS\\bin;C:\\Tools;D:\\x"},
+      {L"INCLUDE", L"C:\\VS\\include;C:\\VS\\include"},
+      {L"LIB", L"c:\\lib\\"},
+      {L"LIBPATH", L"C:\\VS\\ref;C:\\VS\\ref"}};
+  auto delta = diff_environment(before, after);
+  // INCLUDE lost its old entry, so it is set as a whole, without the
+  // duplicate; LIB only changed its spelling.
+  ASSERT_EQ(delta.set_, (Environment{{L"INCLUDE", L"C:\\VS\\include"},
+                                     {L"LIBPATH", L"C:\\VS\\ref"}}));
+  ASSERT_EQ(delta.lists_.size(), 1u);
+  ASSERT_EQ(delta.lists_.at(L"PATH"),
+            (PathListEdit{.prepend_ = {L"C:\\VS\\bin"},
+                          .append_ = {L"D:\\x"}}));
+
+  apply_environment(before, delta);
+  ASSERT_EQ(before.at(L"PATH"), L"C:\\VS\\bin;C:\\Windows;C:\\Tools;D:\\x");
+  ASSERT_EQ(before.at(L"LIB"), L"C:\\Lib");
+
+  // Applied again, as a nested vsrun would, nothing grows.
+  apply_environment(before, delta);
+  ASSERT_EQ(before.at(L"PATH"), L"C:\\VS\\bin;C:\\Windows;C:\\Tools;D:\\x");
+}
+
+TEST(EnvCache, resolve_and_dedupe_path_lists) {
+  EnvDelta delta;
+  delta.lists_[L"PATH"] = {.prepend_ = {L"C:\\VS\\bin"}, .append_ = {}};
+  delta.lists_[L"LIB"] = {.prepend_ = {L"C:\\VS\\lib"}, .append_ = {}};
+  auto resolved = resolve_path_lists(delta, {{L"PATH", L"C:\\Windows"}});
+  ASSERT_TRUE(resolved.lists_.empty());
+  ASSERT_EQ(resolved.set_,
+            (Environment{{L"LIB", L"C:\\VS\\lib"},
+                         {L"PATH", L"C:\\VS\\bin;C:\\Windows"}}));
+
+  Environment env{{L"Path", L"C:\\a;;C:\\A\\;C:\\b"}, {L"OTHER", L"x;x"}};
+  dedupe_path_lists(env);
+  ASSERT_EQ(env, (Environment{{L"OTHER", L"x;x"}, {L"Path", L"C:\\a;C:\\b"}}));
+}
+
+TEST(EnvCache, select_vsdevcmd_inputs) {
+  auto inputs = select_vsdevcmd_inputs(
+      {{L"PATH", L"p"}, {L"INCLUDE", L"i"}, {L"USERNAME", L"me"}});
+  ASSERT_EQ(inputs, (Environment{{L"INCLUDE", L"i"}, {L"PATH", L"p"}}));
+
+  // Windows passes PATH as "Path"; it is an input all the same.
+  inputs = select_vsdevcmd_inputs(
+      {{L"Path", L"p"}, {L"include", L"i"}, {L"UserName", L"me"}});
+  ASSERT_EQ(inputs, (Environment{{L"INCLUDE", L"i"}, {L"PATH", L"p"}}));
+}
+
+TEST_F(EnvCacheTest, serialize_round_trip) {
+  auto key = MakeKey();
+  EnvDelta delta{.set_ = {{L"PATH", L"C:\\VS\\bin;C:\\Windows"},
+                          {L"UNICODE", L"\u00e9\u4e2d\U0001F600"}},
+                 .unset_ = {L"OLD"},
+                 .lists_ = {{L"INCLUDE",
+                             {.prepend_ = {L"C:\\VS\\include",
+                                           L"C:\\Kits\\ucrt"},
+                              .append_ = {}}},
+                            {L"LIB",
+                             {.prepend_ = {}, .append_ = {L"D:\\lib"}}}}};
+  auto data = serialize_env_cache_entry(key, delta);
+  auto parsed = parse_env_cache_entry(data, key);
+  ASSERT_TRUE(parsed);
+  ASSERT_EQ(parsed->set_, delta.set_);
+  ASSERT_EQ(parsed->unset_, delta.unset_);
+  ASSERT_EQ(parsed->lists_, delta.lists_);
+
+  ASSERT_FALSE(parse_env_cache_entry(data.substr(0, data.size() - 1), key));
+}
+
+TEST_F(EnvCacheTest, capture_once_then_reuse) {
+  EnvCache cache(dir_);
+  auto key = MakeKey();
+  Environment parent{{L"PATH", L"C:\\Windows"}, {L"REMOVED", L"x"}};
+  auto capture = [&]() { return FakeCapture(parent); };
+
+  auto first = cache.get_or_capture(key, parent, capture);
+  auto second = cache.get_or_capture(key, parent, capture);
+  ASSERT_EQ(captures_, 1);
+  ASSERT_TRUE(first && second);
+  ASSERT_EQ(first->set_, second->set_);
+  ASSERT_EQ(second->unset_, std::vector<std::wstring>{L"REMOVED"});
+
+  auto env = parent;
+  apply_environment(env, *second);
+  ASSERT_EQ(env, *FakeCapture(parent));
+}
+
+TEST_F(EnvCacheTest, updated_instance_invalidates_entry) {
+  EnvCache cache(dir_);
+  auto key = MakeKey();
+  Environment parent{{L"PATH", L"C:\\Windows"}};
+  auto capture = [&]() { return FakeCapture(parent); };
+  cache.get_or_capture(key, parent, capture);
+
+  auto updated = key;
+  updated.install_version_ = L"17.9.34607.119";
+  ASSERT_EQ(cache.entry_path(key), cache.entry_path(updated));
+  ASSERT_FALSE(cache.load(updated));
+
+  auto reinstalled = key;
+  reinstalled.install_datetime_ += 1;
+  ASSERT_FALSE(cache.load(reinstalled));
+
+  cache.get_or_capture(updated, parent, capture);
+  ASSERT_EQ(captures_, 2);
+  ASSERT_TRUE(cache.load(updated));
+  ASSERT_FALSE(cache.load(key));
+}
+
+TEST_F(EnvCacheTest, key_identity_selects_entry) {
+  EnvCache cache(dir_);
+  auto key = MakeKey();
+  auto arm64 = key;
+  arm64.arch_ = "arm64";
+  auto other_parent = key;
+  other_parent.inputs_[L"INCLUDE"] = L"C:\\include";
+  ASSERT_NE(cache.entry_path(key), cache.entry_path(arm64));
+  ASSERT_NE(cache.entry_path(key), cache.entry_path(other_parent));
+
+  // A parent spelled the Windows way still keys on its PATH.
+  auto old_path = key;
+  old_path.inputs_ = select_vsdevcmd_inputs({{L"Path", L"C:\\Windows"}});
+  auto new_path = key;
+  new_path.inputs_ =
+      select_vsdevcmd_inputs({{L"Path", L"C:\\Tools;C:\\Windows"}});
+  ASSERT_EQ(cache.entry_path(old_path), cache.entry_path(key));
+  ASSERT_NE(cache.entry_path(old_path), cache.entry_path(new_path));
+}
+
+TEST_F(EnvCacheTest, failed_capture_is_not_cached) {
+  EnvCache cache(dir_);
+  auto key = MakeKey();
+  auto delta = cache.get_or_capture(key, {}, [&]() {
+    ++captures_;
+    return std::optional<Environment>{};
+  });
+  ASSERT_FALSE(delta);
+  ASSERT_FALSE(std::filesystem::exists(cache.entry_path(key)));
+}
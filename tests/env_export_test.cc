@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "../src/env_export.h"
+#include "../src/json_reader.h"
+
+namespace {
+
+EnvDelta MakeDelta() {
+  EnvDelta delta;
+  delta.set_[L"INCLUDE"] = L"C:\\VS\\include;C:\\Kits\\include";
+  delta.set_[L"PATH"] = L"C:\\VS\\bin;C:\\Windows;C:\\Windows\\System32";
+  delta.set_[L"VSCMD_TITLE"] = L"it's 100% \"dev\" $HOME";
+  delta.unset_.push_back(L"OLD");
+  return delta;
+}
+
+Environment MakeParent() {
+  return {{L"PATH", L"C:\\Windows;C:\\Windows\\System32"}, {L"OLD", L"1"}};
+}
+
+std::string Format(EnvFormat format, bool msys_paths = false) {
+  return format_environment(format, MakeDelta(), MakeParent(), msys_paths);
+}
+
+}  // namespace
+
+TEST(EnvExport, ParsesFormatNames) {
+  EXPECT_EQ(parse_env_format("cmd"), EnvFormat::kCmd);
+  EXPECT_EQ(parse_env_format("PowerShell"), EnvFormat::kPowerShell);
+  EXPECT_EQ(parse_env_format("ps1"), EnvFormat::kPowerShell);
+  EXPECT_EQ(parse_env_format("sh"), EnvFormat::kSh);
+  EXPECT_EQ(parse_env_format("json"), EnvFormat::kJson);
+  EXPECT_EQ(parse_env_format("cmake"), EnvFormat::kCMake);
+  EXPECT_EQ(parse_env_format("cmake-preset"), EnvFormat::kCMakePreset);
+  EXPECT_EQ(parse_env_format("ninja"), EnvFormat::kNinja);
+  EXPECT_FALSE(parse_env_format("bash"));
+  EXPECT_FALSE(parse_env_format(""));
+}
+
+TEST(EnvExport, Cmd) {
+  EXPECT_EQ(Format(EnvFormat::kCmd),
+            "@echo off\r\n"
+            "set \"OLD=\"\r\n"
+            "set \"INCLUDE=C:\\VS\\include;C:\\Kits\\include\"\r\n"
+            "set \"PATH=C:\\VS\\bin;C:\\Windows;C:\\Windows\\System32\"\r\n"
+            "set \"VSCMD_TITLE=it's 100%% \"dev\" $HOME\"\r\n");
+}
+
+TEST(EnvExport, PowerShell) {
+  EXPECT_EQ(
+      Format(EnvFormat::kPowerShell),
+      "Remove-Item -LiteralPath 'Env:OLD' -ErrorAction SilentlyContinue\n"
+      "Set-Item -LiteralPath 'Env:INCLUDE' -Value "
+      "'C:\\VS\\include;C:\\Kits\\include'\n"
+      "Set-Item -LiteralPath 'Env:PATH' -Value "
+      "'C:\\VS\\bin;C:\\Windows;C:\\Windows\\System32'\n"
+      "Set-Item -LiteralPath 'Env:VSCMD_TITLE' -Value "
+      "'it''s 100% \"dev\" $HOME'\n");
+}
+
+TEST(EnvExport, Sh) {
+  EXPECT_EQ(Format(EnvFormat::kSh),
+            "unset OLD\n"
+            "export INCLUDE='C:\\VS\\include;C:\\Kits\\include'\n"
+            "export PATH='C:\\VS\\bin;C:\\Windows;C:\\Windows\\System32'\n"
+            "export VSCMD_TITLE='it'\\''s 100% \"dev\" $HOME'\n");
+
+  EnvDelta delta;
+  delta.set_[L"ProgramFiles(x86)"] = L"C:\\Program Files (x86)";
+  EXPECT_EQ(format_environment(EnvFormat::kSh, delta, {}),
+            "# ProgramFiles(x86) is not a valid sh variable name\n");
+}
+
+TEST(EnvExport, ShWithMsysPaths) {
+  // Only the entries VsDevCmd.bat added go in front of the shell's PATH;
+  // INCLUDE stays in the Windows form cl.exe reads.
+  EXPECT_EQ(Format(EnvFormat::kSh, true),
+            "unset OLD\n"
+            "export INCLUDE='C:\\VS\\include;C:\\Kits\\include'\n"
+            "export PATH=\"/c/VS/bin:$PATH\"\n"
+            "export VSCMD_TITLE='it'\\''s 100% \"dev\" $HOME'\n");
+
+  EnvDelta delta;
+  delta.set_[L"Path"] = L"D:\\Program Files\\$x;C:\\Windows";
+  EXPECT_EQ(format_environment(EnvFormat::kSh, delta, MakeParent(), true),
+            "export Path=\"/d/Program Files/\\$x:$PATH\"\n");
+}
+
+TEST(EnvExport, MsysPaths) {
+  EXPECT_EQ(to_msys_path(L"C:\\Program Files\\VS\\"), L"/c/Program Files/VS");
+  EXPECT_EQ(to_msys_path(L"d:\\"), L"/d");
+  EXPECT_EQ(to_msys_path(L"\\\\server\\share\\bin"), L"//server/share/bin");
+  EXPECT_EQ(to_msys_path(L"relative\\dir"), L"relative/dir");
+}
+
+TEST(EnvExport, Json) {
+  auto json = Format(EnvFormat::kJson);
+  EXPECT_EQ(json,
+            "{\n"
+            "  \"set\": {\n"
+            "    \"INCLUDE\": \"C:\\\\VS\\\\include;C:\\\\Kits\\\\include\",\n"
+            "    \"PATH\": \"C:\\\\VS\\\\bin;C:\\\\Windows;"
+            "C:\\\\Windows\\\\System32\",\n"
+            "    \"VSCMD_TITLE\": \"it's 100% \\\"dev\\\" $HOME\"\n"
+            "  },\n"
+            "  \"unset\": [\"OLD\"]\n"
+            "}\n");
+  JsonReader reader(json);
+  EXPECT_TRUE(reader.skip());
+  EXPECT_FALSE(reader.failed());
+
+  EXPECT_EQ(format_environment(EnvFormat::kJson, {}, {}),
+            "{\n  \"set\": {},\n  \"unset\": []\n}\n");
+}
+
+TEST(EnvExport, CMake) {
+  EXPECT_EQ(Format(EnvFormat::kCMake),
+            "unset(ENV{OLD})\n"
+            "set(ENV{INCLUDE} \"C:\\\\VS\\\\include;C:\\\\Kits\\\\include\")\n"
+            "set(ENV{PATH} "
+            "\"C:\\\\VS\\\\bin;C:\\\\Windows;C:\\\\Windows\\\\System32\")\n"
+            "set(ENV{VSCMD_TITLE} \"it's 100% \\\"dev\\\" \\$HOME\")\n");
+}
+
+TEST(EnvExport, CMakePreset) {
+  EnvDelta delta;
+  delta.set_[L"INCLUDE"] = L"C:\\VS\\include";
+  delta.unset_.push_back(L"OLD");
+  EXPECT_EQ(format_environment(EnvFormat::kCMakePreset, delta, {}),
+            "\"environment\": {\n"
+            "  \"OLD\": null,\n"
+            "  \"INCLUDE\": \"C:\\\\VS\\\\include\"\n"
+            "}\n");
+
+  auto preset = Format(EnvFormat::kCMakePreset);
+  auto object = preset.substr(preset.find('{'));
+  JsonReader reader(object);
+  EXPECT_TRUE(reader.skip());
+  EXPECT_FALSE(reader.failed());
+}
+
+TEST(EnvExport, Ninja) {
+  using namespace std::string_literals;
+  EnvDelta delta;
+  delta.set_[L"INCLUDE"] = L"C:\\VS\\include";
+  delta.unset_.push_back(L"OLD");
+  EXPECT_EQ(format_environment(EnvFormat::kNinja, delta, MakeParent()),
+            "INCLUDE=C:\\VS\\include\0"
+            "PATH=C:\\Windows;C:\\Windows\\System32\0\0"s);
+}
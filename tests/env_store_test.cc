@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "../src/ascii.h"
+#include "../src/env_store.h"
+
+namespace {
+
+using namespace std::string_literals;
+
+std::wstring Fold(std::wstring name) {
+  for (auto& c : name) {
+    c = ascii_tolower(c);
+  }
+  return name;
+}
+
+// SplitMix64, so every run sees the same inputs.
+class Random {
+ public:
+  explicit Random(uint64_t seed) : state_(seed) {}
+
+  uint64_t next() {
+    uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+  size_t below(size_t n) { return static_cast<size_t>(next() % n); }
+
+ private:
+  uint64_t state_;
+};
+
+}  // namespace
+
+TEST(EnvStore, NamesIgnoreCaseAndKeepTheFirstSpelling) {
+  EnvStore store;
+  store.set(L"Path", L"C:\\Windows");
+  store.set(L"PATH", L"C:\\VS;C:\\Windows");
+  EXPECT_EQ(store.size(), 1u);
+  EXPECT_EQ(store.get(L"path"), L"C:\\VS;C:\\Windows");
+  EXPECT_EQ(store.to_environment(),
+            (Environment{{L"Path", L"C:\\VS;C:\\Windows"}}));
+
+  EXPECT_TRUE(store.erase(L"pAtH"));
+  EXPECT_FALSE(store.erase(L"PATH"));
+  EXPECT_EQ(store.get(L"Path"), std::nullopt);
+  EXPECT_TRUE(store.empty());
+
+  // "PATH" sorts before "Path" in the map, so its spelling wins.
+  EnvStore from_map(Environment{{L"Path", L"b"}, {L"PATH", L"a"}});
+  EXPECT_EQ(from_map.to_environment(), (Environment{{L"PATH", L"b"}}));
+}
+
+TEST(EnvStore, SetAcceptsItsOwnValues) {
+  EnvStore store;
+  store.set(L"A", L"0123456789");
+  store.set(L"B", *store.get(L"A"));
+  store.set(L"A", store.get(L"A")->substr(3));
+  store.set(L"B", std::wstring(*store.get(L"B")).append(*store.get(L"A")));
+  EXPECT_EQ(store.get(L"A"), L"3456789");
+  EXPECT_EQ(store.get(L"B"), L"01234567893456789");
+}
+
+TEST(EnvStore, MatchesAMapUnderRandomEdits) {
+  Random random(0x5eed);
+  EnvStore store;
+  // Folded name to spelling and value.
+  std::map<std::wstring, std::pair<std::wstring, std::wstring>> expected;
+  for (int i = 0; i < 20000; ++i) {
+    auto name = L"Var"s + std::to_wstring(random.below(300));
+    if (random.below(2)) {
+      name = Fold(name);
+    }
+    if (random.below(3) == 0) {
+      EXPECT_EQ(store.erase(name), expected.erase(Fold(name)) == 1);
+    } else {
+      auto value = std::wstring(random.below(40), L'a' + random.below(26));
+      store.set(name, value);
+      auto [it, inserted] = expected.try_emplace(Fold(name), name, value);
+      it->second.second = value;
+    }
+    ASSERT_EQ(store.size(), expected.size());
+  }
+  Environment env;
+  for (auto const& [key, entry] : expected) {
+    EXPECT_EQ(store.get(key), entry.second) << key;
+    env.emplace(entry.first, entry.second);
+  }
+  EXPECT_EQ(store.to_environment(), env);
+}
+
+TEST(EnvStore, BlockIsSortedAsWindowsSortsIt) {
+  EnvStore store;
+  for (auto const* name : {L"b", L"_X", L"Path", L"a1", L"A", L"=C:"}) {
+    store.set(name, name);
+  }
+  auto block = store.block();
+  EXPECT_EQ(block.size(), 6u);
+  // Upper-cased, '_' comes after the letters.
+  EXPECT_EQ(block.data(),
+            L"=C:==C:\0A=A\0a1=a1\0b=b\0Path=Path\0_X=_X\0\0"s);
+
+  EXPECT_EQ(EnvBlock().data(), L"\0\0"s);
+  EXPECT_EQ(EnvStore().block().data(), L"\0\0"s);
+  EXPECT_TRUE(EnvStore().block().empty());
+}
+
+TEST(EnvStore, BlocksOutliveLaterChanges) {
+  EnvStore store(Environment{{L"A", L"1"}});
+  auto block = store.block();
+  auto copy = block;
+  EXPECT_EQ(copy.data().data(), block.data().data());
+  store.set(L"A", L"2");
+  store.set(L"B", L"3");
+  EXPECT_EQ(block.data(), L"A=1\0\0"s);
+  EXPECT_EQ(store.block().data(), L"A=2\0B=3\0\0"s);
+}
+
+TEST(EnvStore, AppliesDeltasIgnoringCase) {
+  EnvStore store(Environment{
+      {L"Path", L"C:\\Windows"}, {L"Foo", L"1"}, {L"Keep", L"k"}});
+  EnvDelta delta;
+  delta.unset_ = {L"FOO"};
+  delta.set_ = {{L"KEEP", L"kept"}, {L"VSCMD_VER", L"17.8.0"}};
+  delta.lists_[L"PATH"] = PathListEdit{{L"C:\\VS"}, {}};
+  store.apply(delta);
+  EXPECT_EQ(store.to_environment(),
+            (Environment{{L"Keep", L"kept"},
+                         {L"Path", L"C:\\VS;C:\\Windows"},
+                         {L"VSCMD_VER", L"17.8.0"}}));
+}
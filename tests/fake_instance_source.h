@@ -0,0 +1,121 @@
+#ifndef TESTS_FAKE_INSTANCE_SOURCE_H_
+#define TESTS_FAKE_INSTANCE_SOURCE_H_
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../src/instance_source.h"
+
+struct CallCounts {
+  int is_complete = 0;
+  int version = 0;
+  int product_id = 0;
+  int packages = 0;
+  int package_indexes = 0;
+  int details = 0;
+};
+
+// Shared by the instances of one source to observe overlapping calls.
+struct Latency {
+  std::chrono::milliseconds per_call{0};
+  std::atomic<int> in_flight{0};
+  std::atomic<int> max_in_flight{0};
+
+  void call() {
+    if (per_call.count() == 0) {
+      return;
+    }
+    int now = ++in_flight;
+    int max = max_in_flight;
+    while (now > max && !max_in_flight.compare_exchange_weak(max, now)) {
+    }
+    std::this_thread::sleep_for(per_call);
+    --in_flight;
+  }
+};
+
+// Counts the property fetches a SourceInstance sees, standing in for the
+// per-property COM round trips.
+class FakeInstance : public SourceInstance {
+ public:
+  FakeInstance(VisualStudio const& vs, CallCounts& counts, Latency& latency)
+      : vs_(vs), counts_(counts), latency_(latency) {}
+
+  bool is_complete() override {
+    latency_.call();
+    ++counts_.is_complete;
+    return vs_.is_complete_;
+  }
+  std::optional<std::pair<std::wstring, uint64_t>> version() override {
+    latency_.call();
+    ++counts_.version;
+    return std::pair{vs_.install_version_, vs_.version_};
+  }
+  std::optional<std::wstring> product_id() override {
+    latency_.call();
+    ++counts_.product_id;
+    return vs_.product_id_;
+  }
+  std::optional<InstancePackages> packages(bool index_all) override {
+    latency_.call();
+    ++counts_.packages;
+    if (index_all) {
+      ++counts_.package_indexes;
+    }
+    return InstancePackages{.workloads_ = vs_.workloads_,
+                            .index_ = vs_.packages_};
+  }
+  bool details(VisualStudio& vs) override {
+    latency_.call();
+    ++counts_.details;
+    vs.install_path_ = vs_.install_path_;
+    vs.display_name_ = vs_.display_name_;
+    vs.install_datetime_ = vs_.install_datetime_;
+    vs.is_prerelease_ = vs_.is_prerelease_;
+    return true;
+  }
+
+ private:
+  VisualStudio vs_;
+  CallCounts& counts_;
+  Latency& latency_;
+};
+
+class FakeInstanceSource : public InstanceSource {
+ public:
+  explicit FakeInstanceSource(std::vector<VisualStudio> instances,
+                              std::chrono::milliseconds latency = {})
+      : instances_(std::move(instances)), counts_(instances_.size()) {
+    latency_.per_call = latency;
+  }
+
+  std::unique_ptr<SourceInstance> next() override {
+    if (next_ >= instances_.size()) {
+      return nullptr;
+    }
+    auto i = next_++;
+    return std::make_unique<FakeInstance>(instances_[i], counts_[i],
+                                          latency_);
+  }
+  std::vector<std::unique_ptr<SourceInstance>> next_batch(
+      size_t max) override {
+    batch_sizes_.push_back(max);
+    return InstanceSource::next_batch(max);
+  }
+
+  CallCounts const& counts(size_t i) const { return counts_[i]; }
+  int max_in_flight() const { return latency_.max_in_flight; }
+  std::vector<size_t> const& batch_sizes() const { return batch_sizes_; }
+
+ private:
+  std::vector<VisualStudio> instances_;
+  std::vector<CallCounts> counts_;
+  Latency latency_;
+  std::vector<size_t> batch_sizes_;
+  size_t next_ = 0;
+};
+
+#endif  // TESTS_FAKE_INSTANCE_SOURCE_H_
@@ -0,0 +1,349 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "../src/instance_snapshot.h"
+#include "fake_instance_source.h"
+
+namespace {
+
+class InstanceSnapshotTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    root_ = std::filesystem::temp_directory_path() /
+            ("vsrun-snapshot-test-" +
+             std::to_string(
+                 std::chrono::steady_clock::now().time_since_epoch().count()));
+    std::filesystem::create_directories(instances_dir());
+  }
+  void TearDown() override { std::filesystem::remove_all(root_); }
+
+  std::filesystem::path instances_dir() const { return root_ / "_Instances"; }
+  std::filesystem::path snapshot_path() const {
+    return root_ / "cache" / "instances.snapshot";
+  }
+
+  void WriteState(std::string const& id, std::string const& content) {
+    std::filesystem::create_directories(instances_dir() / id);
+    std::ofstream(instances_dir() / id / "state.json") << content;
+  }
+
+  static std::vector<VisualStudio> Instances() {
+    return {
+        {.version_ = 0x0011000884B200BCULL,
+         .install_datetime_ = to_filetime(133400000000000000ULL),
+         .install_version_ = L"17.8.33970.188",
+         .install_path_ = L"C:\\Program Files\\Microsoft Visual "
+                          L"Studio\\2022\\Community",
+         .display_name_ = L"Visual Studio Community 2022",
+         .product_id_ = L"Microsoft.VisualStudio.Product.Community",
+         .is_complete_ = true,
+         .is_prerelease_ = false,
+         .workloads_ = {L"Microsoft.VisualStudio.Workload.NativeDesktop",
+                        L"Microsoft.VisualStudio.Workload.ManagedDesktop"},
+         .packages_ = PackageIndex(
+             {L"Microsoft.VisualStudio.Workload.NativeDesktop",
+              L"Microsoft.VisualStudio.Workload.ManagedDesktop",
+              L"Microsoft.VisualStudio.Component.VC.ATL"})},
+        {.version_ = 0x001000000000FFFFULL,
+         .install_datetime_ = to_filetime(132000000000000000ULL),
+         .install_version_ = L"16.0.0.65535",
+         .install_path_ = L"D:\\\u5de5\u5177\\BuildTools",
+         .display_name_ = L"",
+         .product_id_ = L"Microsoft.VisualStudio.Product.BuildTools",
+         .is_complete_ = false,
+         .is_prerelease_ = true,
+         .workloads_ = {L"Microsoft.VisualStudio.Workload.NativeDesktop"},
+         .packages_ = {}},
+    };
+  }
+
+  std::filesystem::path root_;
+};
+
+void ExpectSame(VisualStudio const& a, VisualStudio const& b) {
+  EXPECT_EQ(a.version_, b.version_);
+  EXPECT_EQ(to_uint64(a.install_datetime_), to_uint64(b.install_datetime_));
+  EXPECT_EQ(a.install_version_, b.install_version_);
+  EXPECT_EQ(a.install_path_, b.install_path_);
+  EXPECT_EQ(a.display_name_, b.display_name_);
+  EXPECT_EQ(a.product_id_, b.product_id_);
+  EXPECT_EQ(a.is_complete_, b.is_complete_);
+  EXPECT_EQ(a.is_prerelease_, b.is_prerelease_);
+  EXPECT_EQ(a.workloads_, b.workloads_);
+  EXPECT_EQ(a.packages_, b.packages_);
+}
+
+std::vector<VisualStudio> MatchAll(InstanceSource& source) {
+  return collect_all_instances(source);
+}
+
+}  // namespace
+
+TEST_F(InstanceSnapshotTest, round_trip) {
+  auto instances = Instances();
+  ASSERT_TRUE(write_instance_snapshot(snapshot_path(), instances, 42,
+                                      InstanceBackend::kCom));
+  auto snap = InstanceSnapshot::open(snapshot_path());
+  ASSERT_TRUE(snap);
+  ASSERT_EQ(snap->fingerprint(), 42);
+  ASSERT_EQ(snap->backend(), InstanceBackend::kCom);
+  ASSERT_EQ(snap->size(), instances.size());
+
+  // Zero-copy accessors see the records in place.
+  ASSERT_EQ(snap->record(1).flags, snapshot::kPrerelease);
+  ASSERT_EQ(snap->string(snap->record(0).product_id),
+            u"Microsoft.VisualStudio.Product.Community");
+  ASSERT_EQ(snap->workload(snap->record(1), 0),
+            u"Microsoft.VisualStudio.Workload.NativeDesktop");
+  ASSERT_EQ(snap->record(0).packages_count, 3u);
+  ASSERT_EQ(snap->package(snap->record(0), 0),
+            u"microsoft.visualstudio.component.vc.atl");
+
+  auto loaded = snap->load();
+  ASSERT_EQ(loaded.size(), instances.size());
+  for (size_t i = 0; i < loaded.size(); ++i) {
+    ExpectSame(loaded[i], instances[i]);
+  }
+}
+
+TEST_F(InstanceSnapshotTest, strings_are_pooled) {
+  auto instances = Instances();
+  instances.push_back(instances.front());
+  auto one = serialize_instance_snapshot({instances.front()}, 0,
+                                         InstanceBackend::kCom);
+  auto two = serialize_instance_snapshot({instances.front(), instances.back()},
+                                         0, InstanceBackend::kCom);
+  // A duplicate instance only costs its record and id references.
+  ASSERT_EQ(two.size() - one.size(),
+            sizeof(snapshot::Record) + (2 + 3) * sizeof(snapshot::String));
+}
+
+TEST_F(InstanceSnapshotTest, rejects_damaged_files) {
+  ASSERT_FALSE(InstanceSnapshot::open(snapshot_path()));
+
+  auto data = serialize_instance_snapshot(Instances(), 0,
+                                          InstanceBackend::kCom);
+  std::filesystem::create_directories(snapshot_path().parent_path());
+  std::ofstream(snapshot_path(), std::ios::binary)
+      << data.substr(0, data.size() - 2);
+  ASSERT_FALSE(InstanceSnapshot::open(snapshot_path()));
+
+  auto bad_offset = data;
+  snapshot::Record record;
+  std::memcpy(&record, bad_offset.data() + sizeof(snapshot::Header),
+              sizeof(record));
+  record.install_path.offset = 0xFFFFFFF0;
+  std::memcpy(bad_offset.data() + sizeof(snapshot::Header), &record,
+              sizeof(record));
+  std::ofstream(snapshot_path(), std::ios::binary | std::ios::trunc)
+      << bad_offset;
+  ASSERT_FALSE(InstanceSnapshot::open(snapshot_path()));
+
+  auto bad_version = data;
+  bad_version[8] = 99;
+  std::ofstream(snapshot_path(), std::ios::binary | std::ios::trunc)
+      << bad_version;
+  ASSERT_FALSE(InstanceSnapshot::open(snapshot_path()));
+}
+
+TEST_F(InstanceSnapshotTest, fingerprint_tracks_state_files) {
+  WriteState("1a2b3c4d", "{}");
+  auto first = instances_fingerprint(instances_dir());
+  ASSERT_TRUE(first);
+  ASSERT_EQ(first, instances_fingerprint(instances_dir()));
+
+  WriteState("1a2b3c4d", "{\"installationVersion\": \"17.9\"}");
+  auto modified = instances_fingerprint(instances_dir());
+  ASSERT_NE(first, modified);
+
+  WriteState("5e6f7a8b", "{}");
+  ASSERT_NE(modified, instances_fingerprint(instances_dir()));
+
+  ASSERT_FALSE(instances_fingerprint(root_ / "missing"));
+}
+
+TEST_F(InstanceSnapshotTest, enumerates_only_when_stale) {
+  WriteState("1a2b3c4d", "{}");
+  int enumerations = 0;
+  InstanceLookup enumerate{.match_ = MatchAll,
+                           .enumerate_ = [&](InstanceBackend&) {
+                             ++enumerations;
+                             return Instances();
+                           }};
+
+  auto first = load_or_enumerate_instances(
+      snapshot_path(), instances_dir(), InstanceBackend::kCom, enumerate);
+  auto second = load_or_enumerate_instances(
+      snapshot_path(), instances_dir(), InstanceBackend::kCom, enumerate);
+  ASSERT_EQ(enumerations, 1);
+  ASSERT_EQ(second.size(), first.size());
+  ExpectSame(second[0], first[0]);
+
+  WriteState("5e6f7a8b", "{}");
+  load_or_enumerate_instances(snapshot_path(), instances_dir(),
+                              InstanceBackend::kCom, enumerate);
+  ASSERT_EQ(enumerations, 2);
+
+  // Without a readable _Instances directory nothing is cached.
+  load_or_enumerate_instances(snapshot_path(), root_ / "missing",
+                              InstanceBackend::kCom, enumerate);
+  load_or_enumerate_instances(snapshot_path(), root_ / "missing",
+                              InstanceBackend::kCom, enumerate);
+  ASSERT_EQ(enumerations, 4);
+}
+
+TEST_F(InstanceSnapshotTest, serves_only_the_backend_that_wrote_it) {
+  WriteState("1a2b3c4d", "{}");
+  int enumerations = 0;
+  InstanceLookup enumerate{.match_ = MatchAll,
+                           .enumerate_ = [&](InstanceBackend&) {
+                             ++enumerations;
+                             return Instances();
+                           }};
+  load_or_enumerate_instances(snapshot_path(), instances_dir(),
+                              InstanceBackend::kStateJson, enumerate);
+  ASSERT_EQ(InstanceSnapshot::open(snapshot_path())->backend(),
+            InstanceBackend::kStateJson);
+  load_or_enumerate_instances(snapshot_path(), instances_dir(),
+                              InstanceBackend::kCom, enumerate);
+  ASSERT_EQ(enumerations, 2);
+  ASSERT_EQ(InstanceSnapshot::open(snapshot_path())->backend(),
+            InstanceBackend::kCom);
+  load_or_enumerate_instances(snapshot_path(), instances_dir(),
+                              InstanceBackend::kCom, enumerate);
+  ASSERT_EQ(enumerations, 2);
+}
+
+TEST_F(InstanceSnapshotTest, is_tagged_with_the_backend_that_stood_in) {
+  WriteState("1a2b3c4d", "{}");
+  int enumerations = 0;
+  // As when COM is not registered and state.json is read instead.
+  InstanceLookup fallback{.match_ = MatchAll,
+                          .enumerate_ = [&](InstanceBackend& backend) {
+                            ++enumerations;
+                            backend = InstanceBackend::kStateJson;
+                            return Instances();
+                          }};
+  load_or_enumerate_instances(snapshot_path(), instances_dir(),
+                              InstanceBackend::kCom, fallback);
+  ASSERT_EQ(InstanceSnapshot::open(snapshot_path())->backend(),
+            InstanceBackend::kStateJson);
+  // So a COM lookup does not take it for COM data.
+  load_or_enumerate_instances(snapshot_path(), instances_dir(),
+                              InstanceBackend::kCom, fallback);
+  ASSERT_EQ(enumerations, 2);
+}
+
+TEST_F(InstanceSnapshotTest, source_reads_records_in_place) {
+  auto instances = Instances();
+  ASSERT_TRUE(write_instance_snapshot(snapshot_path(), instances, 0,
+                                      InstanceBackend::kCom));
+  SnapshotInstanceSource all(*InstanceSnapshot::open(snapshot_path()));
+  auto loaded = collect_all_instances(all);
+  ASSERT_EQ(loaded.size(), instances.size());
+  for (size_t i = 0; i < loaded.size(); ++i) {
+    ExpectSame(loaded[i], instances[i]);
+  }
+
+  // Without requirements, package ids are never decoded.
+  SnapshotInstanceSource matching(*InstanceSnapshot::open(snapshot_path()));
+  auto matched = collect_matching_instances(matching, {});
+  ASSERT_EQ(matched.size(), 1u);
+  EXPECT_EQ(matched[0].install_path_, instances[0].install_path_);
+  EXPECT_EQ(matched[0].workloads_, instances[0].workloads_);
+  EXPECT_EQ(matched[0].packages_.size(), 0u);
+
+  SnapshotInstanceSource requiring(*InstanceSnapshot::open(snapshot_path()));
+  matched = collect_matching_instances(
+      requiring, {.requires_ = parse_package_requirement(
+                      L"Microsoft.VisualStudio.Component.VC.ATL")});
+  ASSERT_EQ(matched.size(), 1u);
+  EXPECT_EQ(matched[0].packages_, instances[0].packages_);
+}
+
+TEST_F(InstanceSnapshotTest, stale_snapshot_is_searched_then_refreshed) {
+  WriteState("1a2b3c4d", "{}");
+  auto stale = *instances_fingerprint(instances_dir());
+  ASSERT_TRUE(write_instance_snapshot(snapshot_path(), Instances(), stale,
+                                      InstanceBackend::kCom));
+  WriteState("5e6f7a8b", "{}");
+
+  auto instances = Instances();
+  instances[1].is_complete_ = true;
+  instances.push_back(instances[0]);
+  FakeInstanceSource backend(instances);
+  FakeInstanceSource refresh(instances);
+  int enumerations = 0;
+  InstanceLookup lookup{
+      .match_ = MatchAll,
+      .enumerate_ =
+          [&](InstanceBackend&) {
+            ++enumerations;
+            return collect_all_instances(refresh);
+          },
+      .search_ =
+          [&]() {
+            return collect_matching_instances(backend, {},
+                                              OutputIntent::kExists,
+                                              SortPlan());
+          }};
+  auto found = load_or_enumerate_instances(snapshot_path(), instances_dir(),
+                                           InstanceBackend::kCom, lookup);
+  ASSERT_EQ(found.size(), 1u);
+  // Only the first instance is fetched, and only as far as matching needs.
+  EXPECT_EQ(backend.counts(0).packages, 1);
+  EXPECT_EQ(backend.counts(0).package_indexes, 0);
+  EXPECT_EQ(backend.counts(1).is_complete, 0);
+  EXPECT_EQ(backend.counts(2).is_complete, 0);
+
+  // The refresh fetches everything, after the answer.
+  wait_for_snapshot_refresh();
+  EXPECT_EQ(enumerations, 1);
+  auto refreshed = InstanceSnapshot::open(snapshot_path());
+  ASSERT_TRUE(refreshed);
+  EXPECT_EQ(refreshed->fingerprint(), instances_fingerprint(instances_dir()));
+  EXPECT_EQ(refreshed->load().size(), 3u);
+}
+
+TEST_F(InstanceSnapshotTest, first_lookup_leaves_a_fresh_snapshot) {
+  WriteState("1a2b3c4d", "{}");
+  FakeInstanceSource backend(Instances());
+  int searches = 0;
+  int enumerations = 0;
+  InstanceLookup lookup{
+      .match_ =
+          [](InstanceSource& source) {
+            return collect_matching_instances(source, {}, OutputIntent::kFirst,
+                                              SortPlan());
+          },
+      .enumerate_ =
+          [&](InstanceBackend&) {
+            ++enumerations;
+            return Instances();
+          },
+      .search_ =
+          [&]() {
+            ++searches;
+            return collect_matching_instances(backend, {},
+                                              OutputIntent::kFirst,
+                                              SortPlan());
+          }};
+  auto first = load_or_enumerate_instances(snapshot_path(), instances_dir(),
+                                           InstanceBackend::kCom, lookup);
+  ASSERT_EQ(first.size(), 1u);
+  EXPECT_EQ(searches, 1);
+  wait_for_snapshot_refresh();
+  EXPECT_EQ(enumerations, 1);
+
+  // The next call is answered from the snapshot the first one left.
+  auto second = load_or_enumerate_instances(snapshot_path(), instances_dir(),
+                                            InstanceBackend::kCom, lookup);
+  ASSERT_EQ(second.size(), 1u);
+  EXPECT_EQ(second[0].install_path_, first[0].install_path_);
+  EXPECT_EQ(searches, 1);
+  EXPECT_EQ(enumerations, 1);
+}
@@ -0,0 +1,398 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "../src/instance_source.h"
+#include "fake_instance_source.h"
+
+namespace {
+
+VisualStudio Instance(uint64_t version, std::wstring product,
+                      bool is_complete = true,
+                      IdSet workloads = {
+                          L"Microsoft.VisualStudio.Workload.NativeDesktop"}) {
+  return {.version_ = version,
+          .install_datetime_ = to_filetime(version),
+          .install_version_ = std::to_wstring(version >> 48) + L".0",
+          .install_path_ = L"C:\\VS\\" + product,
+          .display_name_ = L"Visual Studio " + product,
+          .product_id_ = L"Microsoft.VisualStudio.Product." + product,
+          .is_complete_ = is_complete,
+          .is_prerelease_ = false,
+          .workloads_ = workloads,
+          .packages_ = PackageIndex(workloads.names())};
+}
+
+constexpr uint64_t k16 = 16ULL << 48;
+constexpr uint64_t k17 = 17ULL << 48;
+
+// SplitMix64, so every run sees the same inputs.
+class Random {
+ public:
+  explicit Random(uint64_t seed) : state_(seed) {}
+
+  uint64_t next() {
+    uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+  size_t below(size_t n) { return static_cast<size_t>(next() % n); }
+
+ private:
+  uint64_t state_;
+};
+
+int TotalPackageFetches(FakeInstanceSource const& source, size_t size) {
+  int total = 0;
+  for (size_t i = 0; i < size; ++i) {
+    total += source.counts(i).packages;
+  }
+  return total;
+}
+
+}  // namespace
+
+TEST(InstanceSource, RejectedInstancesNeverFetchPackages) {
+  FakeInstanceSource source({
+      Instance(k17, L"Community", /*is_complete=*/false),
+      Instance(k16, L"Community"),
+      Instance(k17, L"BuildTools"),
+      Instance(k17, L"Community", true, {}),
+      Instance(k17, L"Community"),
+  });
+  InstanceFilter filter{.version_min_ = k17,
+                        .version_max_ = (18ULL << 48) - 1,
+                        .product_ = L"Community",
+                        .workload_ = L"*"};
+  auto matched = collect_matching_instances(source, filter);
+  ASSERT_EQ(matched.size(), 1u);
+  EXPECT_EQ(matched[0].install_path_, L"C:\\VS\\Community");
+  EXPECT_EQ(matched[0].display_name_, L"Visual Studio Community");
+  EXPECT_EQ(matched[0].workloads_.size(), 1u);
+
+  // Incomplete: nothing but the completeness flag.
+  EXPECT_EQ(source.counts(0).is_complete, 1);
+  EXPECT_EQ(source.counts(0).version, 0);
+  EXPECT_EQ(source.counts(0).product_id, 0);
+  EXPECT_EQ(source.counts(0).packages, 0);
+  EXPECT_EQ(source.counts(0).details, 0);
+  // Version out of range: no product, no packages.
+  EXPECT_EQ(source.counts(1).version, 1);
+  EXPECT_EQ(source.counts(1).product_id, 0);
+  EXPECT_EQ(source.counts(1).packages, 0);
+  EXPECT_EQ(source.counts(1).details, 0);
+  // Wrong product: no packages.
+  EXPECT_EQ(source.counts(2).product_id, 1);
+  EXPECT_EQ(source.counts(2).packages, 0);
+  EXPECT_EQ(source.counts(2).details, 0);
+  // No workloads: packages fetched once, details skipped.
+  EXPECT_EQ(source.counts(3).packages, 1);
+  EXPECT_EQ(source.counts(3).details, 0);
+  // Match: every stage exactly once.
+  EXPECT_EQ(source.counts(4).is_complete, 1);
+  EXPECT_EQ(source.counts(4).version, 1);
+  EXPECT_EQ(source.counts(4).product_id, 1);
+  EXPECT_EQ(source.counts(4).packages, 1);
+  EXPECT_EQ(source.counts(4).details, 1);
+}
+
+TEST(InstanceSource, ObserverSeesRejectingStage) {
+  FakeInstanceSource source({
+      Instance(k17, L"Community", false),
+      Instance(k16, L"Community"),
+      Instance(k17, L"Professional"),
+      Instance(k17, L"Community"),
+  });
+  std::vector<std::optional<MatchStage>> stages;
+  InstanceFilter filter{.version_min_ = k17,
+                        .version_max_ = UINT64_MAX,
+                        .product_ = L"community",
+                        .workload_ =
+                            L"microsoft.visualstudio.workload.nativedesktop"};
+  collect_matching_instances(
+      source, filter,
+      [&stages](VisualStudio const&, std::optional<MatchStage> stage) {
+        stages.push_back(stage);
+      });
+  EXPECT_EQ(stages, (std::vector<std::optional<MatchStage>>{
+                        MatchStage::kComplete, MatchStage::kVersion,
+                        MatchStage::kProduct, std::nullopt}));
+}
+
+TEST(InstanceSource, CollectAllKeepsIncompleteInstances) {
+  FakeInstanceSource source({Instance(k17, L"Community", false),
+                             Instance(k16, L"Professional")});
+  auto all = collect_all_instances(source);
+  ASSERT_EQ(all.size(), 2u);
+  EXPECT_FALSE(all[0].is_complete_);
+  EXPECT_EQ(all[1].product_id_, L"Microsoft.VisualStudio.Product.Professional");
+  EXPECT_EQ(to_uint64(all[1].install_datetime_), k16);
+}
+
+TEST(InstanceSource, VectorSourceMatchesInMemory) {
+  VectorInstanceSource source(
+      {Instance(k16, L"Enterprise"), Instance(k17, L"Enterprise")});
+  auto matched = collect_matching_instances(
+      source, {.version_min_ = k16, .version_max_ = k16 + 1});
+  ASSERT_EQ(matched.size(), 1u);
+  EXPECT_EQ(matched[0].version_, k16);
+  EXPECT_EQ(matched[0].install_path_, L"C:\\VS\\Enterprise");
+}
+
+TEST(InstanceSource, PooledMatchingKeepsEnumerationOrder) {
+  std::vector<VisualStudio> instances;
+  for (int i = 0; i < 20; ++i) {
+    instances.push_back(
+        Instance(k17 + static_cast<uint64_t>(i),
+                 i % 3 == 0 ? L"BuildTools" : L"Community", i % 5 != 4));
+  }
+  FakeInstanceSource source(instances, std::chrono::milliseconds(2));
+  WorkerPool pool(4);
+  std::vector<uint64_t> observed;
+  auto matched = collect_matching_instances(
+      source, {.product_ = L"Community"}, pool,
+      [&observed](VisualStudio const& vs, std::optional<MatchStage> stage) {
+        if (stage != MatchStage::kComplete) {
+          observed.push_back(vs.version_);
+        }
+      });
+
+  std::vector<uint64_t> expected_matched, expected_observed;
+  for (int i = 0; i < 20; ++i) {
+    if (i % 5 != 4) {
+      expected_observed.push_back(k17 + static_cast<uint64_t>(i));
+      if (i % 3 != 0) {
+        expected_matched.push_back(k17 + static_cast<uint64_t>(i));
+      }
+    }
+  }
+  std::vector<uint64_t> matched_versions;
+  for (auto const& vs : matched) {
+    matched_versions.push_back(vs.version_);
+  }
+  EXPECT_EQ(matched_versions, expected_matched);
+  EXPECT_EQ(observed, expected_observed);
+  EXPECT_GT(source.max_in_flight(), 1);
+  EXPECT_LE(source.max_in_flight(), 4);
+  // 20 instances in batches of 8, then an empty batch.
+  EXPECT_EQ(source.batch_sizes().size(), 4u);
+  // The staging still applies per instance.
+  EXPECT_EQ(source.counts(0).packages, 0);
+  EXPECT_EQ(source.counts(1).packages, 1);
+}
+
+TEST(InstanceSource, PooledCollectAllOverlapsLatency) {
+  std::vector<VisualStudio> instances;
+  for (int i = 0; i < 6; ++i) {
+    instances.push_back(Instance(k16 + static_cast<uint64_t>(i), L"Community"));
+  }
+  constexpr auto kLatency = std::chrono::milliseconds(10);
+  FakeInstanceSource source(instances, kLatency);
+  WorkerPool pool(6);
+
+  auto start = std::chrono::steady_clock::now();
+  auto all = collect_all_instances(source, pool);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  ASSERT_EQ(all.size(), 6u);
+  for (size_t i = 0; i < all.size(); ++i) {
+    EXPECT_EQ(all[i].version_, k16 + i);
+  }
+  // Five calls per instance; serially that would be 6 * 5 * kLatency.
+  EXPECT_LT(elapsed, 6 * 5 * kLatency);
+  EXPECT_GT(source.max_in_flight(), 1);
+}
+
+TEST(InstanceSource, PackageRequirementsUseTheIndex) {
+  auto with_atl = Instance(k17, L"Community");
+  with_atl.packages_ = PackageIndex({L"Microsoft.VisualStudio.Component.VC.ATL",
+                                     L"Microsoft.VisualStudio.Component.VC."
+                                     L"Tools.x86.x64"});
+  FakeInstanceSource source({Instance(k16, L"Community"), with_atl,
+                             Instance(k17, L"Community")});
+  InstanceFilter filter{
+      .requires_ = parse_package_requirement(
+          L"microsoft.visualstudio.component.vc.atl, "
+          L"MICROSOFT.VISUALSTUDIO.COMPONENT.VC.TOOLS.X86.X64")};
+  auto matched = collect_matching_instances(source, filter);
+  ASSERT_EQ(matched.size(), 1u);
+  EXPECT_EQ(matched[0].packages_.size(), 2u);
+  EXPECT_EQ(source.counts(1).package_indexes, 1);
+  EXPECT_EQ(source.counts(2).package_indexes, 1);
+
+  // Without requirements the full package list is never asked for.
+  FakeInstanceSource plain({with_atl});
+  ASSERT_EQ(collect_matching_instances(plain, {}).size(), 1u);
+  EXPECT_EQ(plain.counts(0).packages, 1);
+  EXPECT_EQ(plain.counts(0).package_indexes, 0);
+}
+
+TEST(InstanceSource, ExistsStopsAtTheFirstMatch) {
+  FakeInstanceSource source({
+      Instance(k17, L"Community", false),
+      Instance(k16, L"Community"),
+      Instance(k17, L"Community"),
+      Instance(k17, L"Enterprise"),
+      Instance(k17, L"Professional"),
+  });
+  auto matched = collect_matching_instances(
+      source, {.version_min_ = k17}, OutputIntent::kExists, SortPlan());
+  ASSERT_EQ(matched.size(), 1u);
+  EXPECT_EQ(matched[0].product_id_,
+            L"Microsoft.VisualStudio.Product.Community");
+  EXPECT_EQ(source.counts(2).details, 1);
+  // The instances after the match are never enumerated.
+  EXPECT_EQ(source.counts(3).is_complete, 0);
+  EXPECT_EQ(source.counts(4).is_complete, 0);
+
+  FakeInstanceSource empty({Instance(k16, L"Community")});
+  EXPECT_TRUE(collect_matching_instances(empty, {.version_min_ = k17},
+                                         OutputIntent::kExists, SortPlan())
+                  .empty());
+}
+
+TEST(InstanceSource, FirstWithoutSortStopsAtTheFirstMatch) {
+  FakeInstanceSource source({Instance(k16, L"Community"),
+                             Instance(k17, L"Community"),
+                             Instance(k17, L"Enterprise")});
+  auto matched = collect_matching_instances(
+      source, {.version_min_ = k17}, OutputIntent::kFirst, SortPlan());
+  ASSERT_EQ(matched.size(), 1u);
+  EXPECT_EQ(matched[0].version_, k17);
+  EXPECT_EQ(source.counts(2).is_complete, 0);
+
+  // The last one needs them all, but nothing is skipped or refetched.
+  FakeInstanceSource last({Instance(k17, L"Community"),
+                           Instance(k17, L"Enterprise"),
+                           Instance(k16, L"Professional")});
+  matched = collect_matching_instances(last, {.version_min_ = k17},
+                                       OutputIntent::kLast, SortPlan());
+  ASSERT_EQ(matched.size(), 1u);
+  EXPECT_EQ(matched[0].product_id_,
+            L"Microsoft.VisualStudio.Product.Enterprise");
+  EXPECT_EQ(last.counts(0).packages, 1);
+  EXPECT_EQ(last.counts(1).packages, 1);
+  EXPECT_EQ(last.counts(2).packages, 0);
+}
+
+TEST(InstanceSource, TopOneFetchesPackagesOnlyForContenders) {
+  FakeInstanceSource source({
+      Instance(k16, L"Community"),
+      Instance(k17, L"Community"),
+      Instance(k16 + 1, L"Enterprise"),
+      Instance(k17, L"Professional"),
+      Instance(k17 + 1, L"Community", true, {}),
+      Instance(k16, L"BuildTools"),
+  });
+  auto plan = SortPlan::parse("version:desc");
+  ASSERT_TRUE(plan.has_value());
+  std::vector<std::optional<MatchStage>> stages;
+  auto matched = collect_matching_instances(
+      source, {}, OutputIntent::kFirst, *plan,
+      [&stages](VisualStudio const&, std::optional<MatchStage> stage) {
+        stages.push_back(stage);
+      });
+  ASSERT_EQ(matched.size(), 1u);
+  EXPECT_EQ(matched[0].product_id_,
+            L"Microsoft.VisualStudio.Product.Community");
+  EXPECT_EQ(matched[0].version_, k17);
+  EXPECT_EQ(stages, (std::vector<std::optional<MatchStage>>{
+                        std::nullopt, std::nullopt, MatchStage::kOutranked,
+                        MatchStage::kOutranked, MatchStage::kPackages,
+                        MatchStage::kOutranked}));
+  // Outranked by version: the product is known, the packages never fetched.
+  EXPECT_EQ(source.counts(2).product_id, 1);
+  EXPECT_EQ(source.counts(2).packages, 0);
+  EXPECT_EQ(source.counts(2).details, 0);
+  // A tie keeps the earlier instance first.
+  EXPECT_EQ(source.counts(3).packages, 0);
+  // Could have won, so its packages were read.
+  EXPECT_EQ(source.counts(4).packages, 1);
+  EXPECT_EQ(source.counts(5).packages, 0);
+  EXPECT_EQ(TotalPackageFetches(source, 6), 3);
+}
+
+TEST(InstanceSource, DateSortFetchesDetailsBeforePackages) {
+  // Instance() installs each instance on the date of its version.
+  FakeInstanceSource source({Instance(k17, L"Community"),
+                             Instance(k16, L"Enterprise"),
+                             Instance(k17 + 1, L"Professional")});
+  auto plan = SortPlan::parse("date:asc");
+  auto matched = collect_matching_instances(source, {}, OutputIntent::kLast,
+                                            *plan);
+  ASSERT_EQ(matched.size(), 1u);
+  EXPECT_EQ(matched[0].product_id_,
+            L"Microsoft.VisualStudio.Product.Professional");
+  EXPECT_EQ(matched[0].display_name_, L"Visual Studio Professional");
+  EXPECT_EQ(source.counts(1).details, 1);
+  EXPECT_EQ(source.counts(1).packages, 0);
+  EXPECT_EQ(source.counts(2).details, 1);
+  EXPECT_EQ(source.counts(2).packages, 1);
+}
+
+TEST(InstanceSource, IntentsAgreeWithSortingEveryMatch) {
+  Random random(25);
+  std::wstring const products[] = {L"Community", L"Enterprise",
+                                   L"Professional", L"BuildTools"};
+  for (int round = 0; round < 50; ++round) {
+    std::vector<VisualStudio> instances;
+    auto size = random.below(12);
+    for (size_t i = 0; i < size; ++i) {
+      auto vs = Instance(k16 + (random.below(3) << 48) + random.below(3),
+                         products[random.below(4)], random.below(5) != 0);
+      vs.install_datetime_ = to_filetime(random.below(4));
+      instances.push_back(vs);
+    }
+    for (auto spec : {"", "version:asc", "date:desc,version:asc",
+                      "product:Enterprise-Community,version:desc"}) {
+      auto plan = *SortPlan::parse(spec);
+      InstanceFilter filter{.version_min_ = k16 + (1ULL << 48)};
+      FakeInstanceSource all_source(instances);
+      auto all = collect_matching_instances(all_source, filter);
+      plan.apply(all);
+      for (auto intent : {OutputIntent::kExists, OutputIntent::kFirst,
+                          OutputIntent::kLast}) {
+        for (bool pooled : {false, true}) {
+          FakeInstanceSource source(instances);
+          WorkerPool pool(3);
+          auto picked =
+              pooled ? collect_matching_instances(source, filter, intent,
+                                                  plan, pool)
+                     : collect_matching_instances(source, filter, intent,
+                                                  plan);
+          ASSERT_EQ(picked.size(), all.empty() ? 0u : 1u) << spec;
+          if (all.empty() || intent == OutputIntent::kExists) {
+            continue;
+          }
+          auto const& expected =
+              intent == OutputIntent::kFirst ? all.front() : all.back();
+          EXPECT_EQ(picked[0].version_, expected.version_) << spec;
+          EXPECT_EQ(picked[0].product_id_, expected.product_id_) << spec;
+          EXPECT_EQ(to_uint64(picked[0].install_datetime_),
+                    to_uint64(expected.install_datetime_))
+              << spec;
+          EXPECT_LE(TotalPackageFetches(source, instances.size()),
+                    TotalPackageFetches(all_source, instances.size()));
+        }
+      }
+    }
+  }
+}
+
+TEST(InstanceSource, PooledExistsStopsFetchingOnceFound) {
+  std::vector<VisualStudio> instances;
+  for (int i = 0; i < 32; ++i) {
+    instances.push_back(Instance(k17 + static_cast<uint64_t>(i), L"Community"));
+  }
+  FakeInstanceSource source(instances, std::chrono::milliseconds(2));
+  WorkerPool pool(2);
+  auto matched = collect_matching_instances(source, {}, OutputIntent::kExists,
+                                            SortPlan(), pool);
+  ASSERT_EQ(matched.size(), 1u);
+  EXPECT_EQ(matched[0].version_, k17);
+  // The tasks queued behind the first match skip their fetches.
+  EXPECT_LT(TotalPackageFetches(source, instances.size()), 8);
+}
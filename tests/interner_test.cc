@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/instance.h"
+#include "../src/interner.h"
+
+TEST(Interner, DenseCaseInsensitiveIds) {
+  Interner interner;
+  auto a = interner.intern(L"Microsoft.VisualStudio.Workload.NativeDesktop");
+  auto b = interner.intern(L"Microsoft.VisualStudio.Component.VC.ATL");
+  EXPECT_EQ(a, 0u);
+  EXPECT_EQ(b, 1u);
+  EXPECT_EQ(interner.intern(L"microsoft.visualstudio.workload.NATIVEDESKTOP"),
+            a);
+  EXPECT_EQ(interner.size(), 2u);
+  EXPECT_EQ(interner.find(L"MICROSOFT.VISUALSTUDIO.COMPONENT.VC.ATL"), b);
+  EXPECT_FALSE(interner.find(L"Microsoft.VisualStudio.Component.VC.MFC"));
+  // The first spelling is kept.
+  EXPECT_EQ(interner.name(a), L"Microsoft.VisualStudio.Workload.NativeDesktop");
+}
+
+TEST(Interner, NamesSurviveGrowth) {
+  Interner interner;
+  auto first = interner.name(interner.intern(L"first"));
+  for (int i = 0; i < 10000; ++i) {
+    interner.intern(L"component." + std::to_wstring(i));
+  }
+  EXPECT_EQ(first, L"first");
+  EXPECT_EQ(interner.find(L"COMPONENT.9999"), 10000u);
+}
+
+TEST(Interner, ConcurrentInterningAgrees) {
+  Interner interner;
+  std::vector<std::vector<InternedId>> ids(4);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < ids.size(); ++t) {
+    threads.emplace_back([&interner, &ids, t]() {
+      for (int i = 0; i < 2000; ++i) {
+        ids[t].push_back(interner.intern(L"id." + std::to_wstring(i)));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(interner.size(), 2000u);
+  for (size_t t = 1; t < ids.size(); ++t) {
+    EXPECT_EQ(ids[t], ids[0]);
+  }
+}
+
+TEST(IdSet, BitOperations) {
+  IdSet set;
+  EXPECT_TRUE(set.empty());
+  set.insert(3);
+  set.insert(64);
+  set.insert(200);
+  EXPECT_FALSE(set.empty());
+  EXPECT_EQ(set.size(), 3u);
+  EXPECT_TRUE(set.contains(64));
+  EXPECT_FALSE(set.contains(65));
+  EXPECT_FALSE(set.contains(100000));
+  EXPECT_EQ(set.ids(), (std::vector<InternedId>{3, 64, 200}));
+
+  IdSet subset;
+  subset.insert(3);
+  subset.insert(200);
+  EXPECT_TRUE(set.contains_all(subset));
+  EXPECT_FALSE(subset.contains_all(set));
+  EXPECT_TRUE(set.contains_all(IdSet()));
+
+  IdSet other;
+  other.insert(4);
+  EXPECT_FALSE(set.intersects(other));
+  other.insert(200);
+  EXPECT_TRUE(set.intersects(other));
+  EXPECT_FALSE(set.intersects(IdSet()));
+}
+
+TEST(IdSet, EqualityIgnoresCapacity) {
+  IdSet a, b;
+  a.insert(1);
+  b.insert(1);
+  EXPECT_EQ(a, b);
+  b.insert(500);
+  EXPECT_NE(a, b);
+  EXPECT_EQ(IdSet(), IdSet{});
+}
+
+TEST(IdSet, NamesResolveThroughTheGlobalInterner) {
+  IdSet set{L"Test.Interner.Workload.B", L"Test.Interner.Workload.A",
+            L"test.interner.workload.b"};
+  EXPECT_EQ(set.size(), 2u);
+  auto names = set.names();
+  std::sort(names.begin(), names.end());
+  EXPECT_EQ(names, (std::vector<std::wstring>{L"Test.Interner.Workload.A",
+                                              L"Test.Interner.Workload.B"}));
+  std::vector<std::wstring> upper{L"TEST.INTERNER.WORKLOAD.A",
+                                  L"TEST.INTERNER.WORKLOAD.B"};
+  EXPECT_EQ(set, IdSet(upper));
+}
+
+TEST(IdSet, WorkloadMatching) {
+  VisualStudio vs{.version_ = 0,
+                  .install_datetime_ = to_filetime(0),
+                  .install_version_ = {},
+                  .install_path_ = {},
+                  .display_name_ = {},
+                  .product_id_ = {},
+                  .is_complete_ = true,
+                  .is_prerelease_ = false,
+                  .workloads_ = {L"Microsoft.VisualStudio.Workload.VCTools"},
+                  .packages_ = {}};
+  EXPECT_TRUE(vs.is_workload_match(L"*"));
+  EXPECT_TRUE(vs.is_workload_match(L"microsoft.visualstudio.workload.vctools"));
+  EXPECT_FALSE(vs.is_workload_match(L"Microsoft.VisualStudio.Workload.Azure"));
+  EXPECT_FALSE(resolve_workload(L"*"));
+
+  vs.workloads_ = {};
+  EXPECT_FALSE(vs.is_workload_match(L"*"));
+}
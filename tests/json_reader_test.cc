@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "../src/json_reader.h"
+
+TEST(JsonReaderTest, ReadsMembersAndSkipsTheRest) {
+  JsonReader reader(
+      R"({"skip": {"a": [1, {"b": null}], "c": "}"}, "id": "x", "n": -1.5e3,)"
+      R"( "ok": true})");
+  std::string_view key, id;
+  bool ok = false;
+  ASSERT_TRUE(reader.begin_object());
+  std::vector<std::string> keys;
+  while (reader.next_member(key)) {
+    keys.emplace_back(key);
+    if (key == "id") {
+      ASSERT_TRUE(reader.read_string(id));
+    } else if (key == "ok") {
+      ASSERT_TRUE(reader.read_bool(ok));
+    } else {
+      ASSERT_TRUE(reader.skip());
+    }
+  }
+  EXPECT_FALSE(reader.failed());
+  EXPECT_EQ(keys, (std::vector<std::string>{"skip", "id", "n", "ok"}));
+  EXPECT_EQ(id, "x");
+  EXPECT_TRUE(ok);
+}
+
+TEST(JsonReaderTest, IteratesArrays) {
+  JsonReader reader(R"([ "a" , "b\"c", "d" ])");
+  std::vector<std::string_view> items;
+  ASSERT_TRUE(reader.begin_array());
+  while (reader.next_element()) {
+    std::string_view item;
+    ASSERT_TRUE(reader.read_string(item));
+    items.push_back(item);
+  }
+  EXPECT_FALSE(reader.failed());
+  EXPECT_EQ(items,
+            (std::vector<std::string_view>{"a", R"(b\"c)", "d"}));
+}
+
+TEST(JsonReaderTest, EmptyContainers) {
+  JsonReader reader(R"({"a": {}, "b": []})");
+  std::string_view key;
+  ASSERT_TRUE(reader.begin_object());
+  while (reader.next_member(key)) {
+    ASSERT_TRUE(reader.skip());
+  }
+  EXPECT_FALSE(reader.failed());
+}
+
+TEST(JsonReaderTest, RejectsMalformedInput) {
+  for (std::string_view text :
+       {R"({"a": [1, 2})", R"({"a" 1})", R"({"a": "unterminated})",
+        R"({"a": 1 "b": 2})", R"({"a": [1,)", R"({"a": })", "{"}) {
+    JsonReader reader(text);
+    std::string_view key;
+    if (reader.begin_object()) {
+      while (reader.next_member(key)) {
+        if (!reader.skip()) {
+          break;
+        }
+      }
+    }
+    EXPECT_TRUE(reader.failed()) << text;
+  }
+}
+
+TEST(JsonReaderTest, DeepNestingFailsInsteadOfRecursing) {
+  std::string text = "{\"a\": " + std::string(100000, '[') + "}";
+  JsonReader reader(text);
+  std::string_view key;
+  ASSERT_TRUE(reader.begin_object());
+  ASSERT_TRUE(reader.next_member(key));
+  EXPECT_FALSE(reader.skip());
+  EXPECT_TRUE(reader.failed());
+}
+
+TEST(JsonReaderTest, Unescape) {
+  EXPECT_EQ(json_unescape(R"(C:\\Program Files\\x)"), "C:\\Program Files\\x");
+  EXPECT_EQ(json_unescape(R"(\"\/\b\f\n\r\t)"), "\"/\b\f\n\r\t");
+  EXPECT_EQ(json_unescape(R"(\u793e\u533a)"), "\xE7\xA4\xBE\xE5\x8C\xBA");
+  EXPECT_EQ(json_unescape(R"(\ud83d\ude00)"), "\xF0\x9F\x98\x80");
+  // Unpaired surrogates become U+FFFD.
+  EXPECT_EQ(json_unescape(R"(\ud83dx)"), "\xEF\xBF\xBDx");
+}
+
+TEST(JsonReaderTest, QuoteRoundTrips) {
+  std::string value = "a\"b\\c\nd\x01";
+  auto quoted = json_quote(value);
+  EXPECT_EQ(quoted, R"("a\"b\\c\nd\u0001")");
+  JsonReader reader(quoted);
+  std::string_view raw;
+  ASSERT_TRUE(reader.read_string(raw));
+  EXPECT_EQ(json_unescape(raw), value);
+}
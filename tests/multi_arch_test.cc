@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../src/multi_arch.h"
+#include "../src/unicode.h"
+
+namespace {
+
+using Archs = std::vector<std::string>;
+
+#if !defined(_WIN32)
+// Stands in for `VsDevCmd.bat -arch=<arch> && set`.
+std::optional<Environment> CaptureWithScript(std::string const& arch) {
+  std::string out;
+  auto exit_code = run_process(
+      {"sh", "-c",
+       "echo INCLUDE=/vs/include/$1; echo LIB=/vs/lib/$1; echo PATH=$PATH",
+       "vsdevcmd", arch},
+      {}, {{L"PATH", L"/usr/bin:/bin"}},
+      [&out](OutputChannel channel, std::string_view data) {
+        if (channel == OutputChannel::kStdout) {
+          out += data;
+        }
+      });
+  if (exit_code != 0) {
+    return std::nullopt;
+  }
+  return parse_set_output(utf8_decode(out));
+}
+#endif
+
+}  // namespace
+
+TEST(MultiArch, ParsesArchLists) {
+  EXPECT_EQ(parse_arch_list("x64"), (Archs{"x64"}));
+  EXPECT_EQ(parse_arch_list("x64,arm64,x86,x64"),
+            (Archs{"x64", "arm64", "x86"}));
+  std::string error;
+  EXPECT_FALSE(parse_arch_list("x64,amd64", &error));
+  EXPECT_NE(error.find("amd64"), std::string::npos);
+  EXPECT_FALSE(parse_arch_list("x64,", &error));
+  EXPECT_FALSE(parse_arch_list("", &error));
+}
+
+TEST(MultiArch, CapturesEveryArchAtOnce) {
+  // Each capture waits for the others to start; run one after another they
+  // would all time out.
+  std::mutex mutex;
+  std::condition_variable started;
+  int captures = 0;
+  Archs archs = {"x64", "arm64", "x86"};
+  auto results = run_per_arch(
+      archs,
+      [&](std::string const& arch) -> std::optional<Environment> {
+        std::unique_lock lock(mutex);
+        ++captures;
+        started.notify_all();
+        if (!started.wait_for(lock, std::chrono::seconds(10), [&]() {
+              return captures == 3;
+            })) {
+          return std::nullopt;
+        }
+        return Environment{{L"TARGET", utf8_decode(arch)}};
+      },
+      [](std::string const& arch, Environment const& env,
+         OutputSink const& sink) -> std::optional<int> {
+        sink(OutputChannel::kStdout, utf8_encode(env.at(L"TARGET")) + "/" +
+                                         utf8_encode(env.at(kArchVariable)));
+        return arch == "x86" ? 1 : 0;
+      },
+      [](size_t, BatchResult const&) {});
+  ASSERT_EQ(results.size(), 3u);
+  for (size_t i = 0; i < archs.size(); ++i) {
+    EXPECT_EQ(results[i].command_, archs[i]);
+  }
+  EXPECT_EQ(results[0].exit_code_, 0);
+  EXPECT_EQ(results[2].exit_code_, 1);
+  EXPECT_EQ(batch_exit_code(results), 1);
+}
+
+#if !defined(_WIN32)
+TEST(MultiArch, RunsTheCommandInEachArchsEnvironment) {
+  std::string text;
+  auto results = run_per_arch(
+      {"arm64", "x64"}, CaptureWithScript,
+      [](std::string const&, Environment const& env, OutputSink const& sink) {
+        return run_process({"sh", "-c", "echo $VSRUN_ARCH $INCLUDE $LIB"}, {},
+                           env, sink);
+      },
+      [&text](size_t, BatchResult const& result) {
+        for (auto const& chunk : result.output_) {
+          text += chunk.data_;
+        }
+      });
+  EXPECT_EQ(batch_exit_code(results), 0);
+  EXPECT_EQ(text,
+            "arm64 /vs/include/arm64 /vs/lib/arm64\n"
+            "x64 /vs/include/x64 /vs/lib/x64\n");
+}
+#endif
+
+TEST(MultiArch, FailedCapturesDoNotRunTheCommand) {
+  int runs = 0;
+  std::string err;
+  auto results = run_per_arch(
+      {"x64", "arm64"},
+      [](std::string const& arch) -> std::optional<Environment> {
+        if (arch == "arm64") {
+          return std::nullopt;
+        }
+        return Environment{};
+      },
+      [&runs](std::string const&, Environment const&, OutputSink const&) {
+        ++runs;
+        return std::optional<int>(0);
+      },
+      [&err](size_t, BatchResult const& result) {
+        for (auto const& chunk : result.output_) {
+          err += chunk.data_;
+        }
+      });
+  EXPECT_EQ(runs, 1);
+  EXPECT_FALSE(results[1].exit_code_);
+  EXPECT_NE(err.find("arm64"), std::string::npos);
+  EXPECT_EQ(batch_exit_code(results), 1);
+}
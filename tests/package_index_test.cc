@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../src/package_index.h"
+
+TEST(PackageIndex, InternsSortsAndDeduplicates) {
+  PackageIndex index({L"Microsoft.VisualStudio.Component.VC.ATL",
+                      L"Microsoft.VisualStudio.Component.Git",
+                      L"microsoft.visualstudio.component.vc.atl"});
+  EXPECT_EQ(index.size(), 2u);
+  EXPECT_TRUE(std::is_sorted(index.ids().begin(), index.ids().end()));
+  EXPECT_EQ(index.names(), (std::vector<std::wstring>{
+                               L"microsoft.visualstudio.component.git",
+                               L"microsoft.visualstudio.component.vc.atl"}));
+  EXPECT_TRUE(index.contains(L"microsoft.visualstudio.component.git"));
+  EXPECT_TRUE(index.contains(L"MICROSOFT.VISUALSTUDIO.COMPONENT.VC.ATL"));
+  EXPECT_FALSE(index.contains(L"microsoft.visualstudio.component.vc.mfc"));
+  EXPECT_FALSE(index.contains(L"PackageIndexTest.NeverInterned"));
+  EXPECT_TRUE(PackageIndex().empty());
+}
+
+TEST(PackageIndex, SharesIdsWithTheInterner) {
+  auto atl =
+      Interner::global().intern(L"Microsoft.VisualStudio.Component.VC.ATL");
+  PackageIndex index({L"microsoft.visualstudio.component.vc.atl"});
+  EXPECT_EQ(index.ids(), std::vector<InternedId>{atl});
+  EXPECT_TRUE(index.contains(atl));
+  EXPECT_EQ(PackageIndex::from_ids({atl, atl}), index);
+}
+
+TEST(PackageIndex, FoldOnlyTouchesAscii) {
+  EXPECT_EQ(fold_package_id(L"Component.Ä.X"), L"component.Ä.x");
+}
+
+TEST(PackageRequirement, Parse) {
+  auto requirement = parse_package_requirement(
+      L" Microsoft.VisualStudio.Component.VC.ATL ,,"
+      L"Microsoft.VisualStudio.Component.VC.Llvm.Clang,"
+      L"microsoft.visualstudio.component.vc.atl",
+      L"A,\tB ");
+  auto& interner = Interner::global();
+  std::vector<InternedId> all{
+      interner.intern(L"microsoft.visualstudio.component.vc.atl"),
+      interner.intern(L"microsoft.visualstudio.component.vc.llvm.clang")};
+  std::sort(all.begin(), all.end());
+  EXPECT_EQ(requirement.all_, all);
+  std::vector<InternedId> any{interner.intern(L"a"), interner.intern(L"b")};
+  std::sort(any.begin(), any.end());
+  EXPECT_EQ(requirement.any_, any);
+  EXPECT_TRUE(parse_package_requirement(L"", L" , ").empty());
+}
+
+TEST(PackageRequirement, AllOfAndAnyOf) {
+  PackageIndex index({L"A", L"B", L"C", L"E"});
+  auto ok = [&index](std::wstring_view all, std::wstring_view any) {
+    return parse_package_requirement(all, any).is_satisfied_by(index);
+  };
+  EXPECT_TRUE(ok(L"", L""));
+  EXPECT_TRUE(ok(L"a,c,e", L""));
+  EXPECT_TRUE(ok(L"E,A", L""));
+  EXPECT_FALSE(ok(L"a,d", L""));
+  EXPECT_FALSE(ok(L"f", L""));
+  EXPECT_TRUE(ok(L"", L"d,e"));
+  EXPECT_FALSE(ok(L"", L"d,f"));
+  EXPECT_TRUE(ok(L"a,b", L"x,c"));
+  EXPECT_FALSE(ok(L"a,x", L"c"));
+  PackageRequirement requirement{.all_ = {Interner::global().intern(L"a")},
+                                 .any_ = {}};
+  EXPECT_FALSE(requirement.is_satisfied_by(PackageIndex()));
+}
+
+TEST(PackageRequirement, ManyPackages) {
+  std::vector<std::wstring> ids;
+  for (int i = 0; i < 5000; ++i) {
+    ids.push_back(L"Microsoft.VisualStudio.Component.Package" +
+                  std::to_wstring(i));
+  }
+  PackageIndex index(ids);
+  EXPECT_TRUE(parse_package_requirement(
+                  L"microsoft.visualstudio.component.package0,"
+                  L"microsoft.visualstudio.component.package4999,"
+                  L"microsoft.visualstudio.component.package2500")
+                  .is_satisfied_by(index));
+  EXPECT_FALSE(parse_package_requirement(
+                   L"microsoft.visualstudio.component.package0,"
+                   L"microsoft.visualstudio.component.package5000")
+                   .is_satisfied_by(index));
+}
@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../src/env_cache.h"
+#include "../src/path_list.h"
+
+namespace {
+
+using Edit = PathListEdit;
+
+std::vector<std::wstring> Keys(std::wstring_view list) {
+  std::vector<std::wstring> keys;
+  for (auto entry : split_path_list(list)) {
+    keys.push_back(path_entry_key(entry));
+  }
+  return keys;
+}
+
+// `list` as an ordered set.
+std::vector<std::wstring> Set(std::wstring_view list) {
+  return Keys(dedupe_path_list(list));
+}
+
+// SplitMix64, so every run sees the same inputs.
+class Random {
+ public:
+  explicit Random(uint64_t seed) : state_(seed) {}
+
+  uint64_t next() {
+    uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+  size_t below(size_t n) { return static_cast<size_t>(next() % n); }
+
+ private:
+  uint64_t state_;
+};
+
+// A list drawn from a few directories, each spelled in one of the ways that
+// name the same entry, with the odd empty entry.
+std::wstring RandomList(Random& random) {
+  static const wchar_t* const kDirs[] = {
+      L"C:\\Windows", L"C:\\VS\\bin", L"C:\\Kits\\bin", L"D:\\tools",
+      L"C:\\Program Files\\Git\\cmd", L"C:\\", L"relative"};
+  std::wstring list;
+  size_t entries = random.below(9);
+  for (size_t i = 0; i < entries; ++i) {
+    std::wstring dir = kDirs[random.below(std::size(kDirs))];
+    switch (random.below(5)) {
+      case 0:
+        for (auto& c : dir) {
+          c = c == L'\\' ? L'/' : c;
+        }
+        break;
+      case 1:
+        for (auto& c : dir) {
+          c = (c >= L'a' && c <= L'z') ? c - L'a' + L'A' : c;
+        }
+        break;
+      case 2:
+        dir = L"\"" + dir + L"\"";
+        break;
+      case 3:
+        dir += dir.back() == L'\\' ? L"" : L"\\";
+        break;
+      default:
+        break;
+    }
+    list += dir + (random.below(6) == 0 ? L";;" : L";");
+  }
+  return list;
+}
+
+}  // namespace
+
+TEST(PathList, NamesListVariables) {
+  EXPECT_TRUE(is_path_list(L"PATH"));
+  EXPECT_TRUE(is_path_list(L"Path"));
+  EXPECT_TRUE(is_path_list(L"include"));
+  EXPECT_TRUE(is_path_list(L"LIBPATH"));
+  EXPECT_TRUE(is_path_list(L"EXTERNAL_INCLUDE"));
+  EXPECT_FALSE(is_path_list(L"PATHEXT"));
+  EXPECT_FALSE(is_path_list(L"VSINSTALLDIR"));
+}
+
+TEST(PathList, EntryKeys) {
+  EXPECT_EQ(path_entry_key(L"C:\\VS\\bin"), L"c:\\vs\\bin");
+  EXPECT_EQ(path_entry_key(L"\"c:/vs/BIN/\""), L"c:\\vs\\bin");
+  EXPECT_EQ(path_entry_key(L"C:\\VS\\bin\\\\"), L"c:\\vs\\bin");
+  EXPECT_EQ(path_entry_key(L"C:\\"), L"c:\\");
+  EXPECT_EQ(path_entry_key(L"C:/"), L"c:\\");
+  EXPECT_EQ(path_entry_key(L"\\"), L"\\");
+  EXPECT_EQ(path_entry_key(L"\""), L"\"");
+}
+
+TEST(PathList, Dedupe) {
+  EXPECT_EQ(dedupe_path_list(L"C:\\a;c:/A/;;C:\\b;C:\\A;C:\\b\\"),
+            L"C:\\a;C:\\b");
+  EXPECT_EQ(dedupe_path_list(L";;"), L"");
+  EXPECT_EQ(dedupe_path_list(L""), L"");
+}
+
+TEST(PathList, Diff) {
+  Edit edit;
+  ASSERT_TRUE(
+      diff_path_list(L"C:\\Windows", L"C:\\VS;C:\\Windows;D:\\x", edit));
+  EXPECT_EQ(edit, (Edit{.prepend_ = {L"C:\\VS"}, .append_ = {L"D:\\x"}}));
+
+  // Already on the list (from a dev prompt): the prepend moves it up.
+  edit = {};
+  ASSERT_TRUE(diff_path_list(L"C:\\VS;C:\\Windows",
+                             L"C:\\VS;C:\\Kits;C:\\VS;C:\\Windows", edit));
+  EXPECT_EQ(edit, (Edit{.prepend_ = {L"C:\\VS", L"C:\\Kits"}, .append_ = {}}));
+
+  edit = {};
+  ASSERT_TRUE(diff_path_list(L"C:\\a;C:\\b", L"c:/a/;C:\\B", edit));
+  EXPECT_TRUE(edit.empty());
+
+  // Reordering is prepending the entries that moved.
+  edit = {};
+  ASSERT_TRUE(
+      diff_path_list(L"C:\\a;C:\\b;C:\\c", L"C:\\a;C:\\c;C:\\b", edit));
+  EXPECT_EQ(edit, (Edit{.prepend_ = {L"C:\\a", L"C:\\c"}, .append_ = {}}));
+
+  EXPECT_FALSE(diff_path_list(L"C:\\a;C:\\b", L"C:\\VS;C:\\a", edit));
+  EXPECT_FALSE(diff_path_list(L"C:\\a", L"", edit));
+}
+
+TEST(PathList, Merge) {
+  Edit edit{.prepend_ = {L"C:\\VS", L"C:\\Kits"}, .append_ = {L"D:\\x"}};
+  EXPECT_EQ(merge_path_list(L"C:\\Windows", edit),
+            L"C:\\VS;C:\\Kits;C:\\Windows;D:\\x");
+  EXPECT_EQ(merge_path_list(L"C:\\kits;C:\\Windows;C:\\Windows", edit),
+            L"C:\\VS;C:\\Kits;C:\\Windows;D:\\x");
+  EXPECT_EQ(merge_path_list(L"", edit), L"C:\\VS;C:\\Kits;D:\\x");
+}
+
+// Properties that must hold for any pair of lists.
+TEST(PathList, Fuzz) {
+  Random random(0x5eed);
+  int edits = 0;
+  for (int i = 0; i < 5000; ++i) {
+    auto before = RandomList(random);
+    auto after = RandomList(random);
+    auto deduped = dedupe_path_list(after);
+    ASSERT_EQ(dedupe_path_list(deduped), deduped);
+    auto keys = Keys(deduped);
+    ASSERT_EQ(std::set<std::wstring>(keys.begin(), keys.end()).size(),
+              keys.size());
+
+    Edit edit;
+    if (diff_path_list(before, after, edit)) {
+      ++edits;
+      ASSERT_EQ(Keys(merge_path_list(before, edit)), keys)
+          << "before: " << testing::PrintToString(before)
+          << " after: " << testing::PrintToString(after);
+    }
+    // Merging an edit twice is merging it once.
+    auto once = merge_path_list(before, edit);
+    ASSERT_EQ(merge_path_list(once, edit), once);
+
+    // Whatever the delta holds, applying it gives `after` as an ordered
+    // set.
+    Environment from{{L"PATH", before}, {L"INCLUDE", after}};
+    Environment to{{L"PATH", after}, {L"LIB", before}};
+    auto env = from;
+    apply_environment(env, diff_environment(from, to));
+    ASSERT_EQ(env.size(), to.size());
+    for (auto const& [name, value] : to) {
+      ASSERT_EQ(Set(env.at(name)), Set(value));
+    }
+  }
+  // The generator produces both shapes.
+  EXPECT_GT(edits, 250);
+  EXPECT_LT(edits, 5000);
+}
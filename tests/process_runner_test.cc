@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/process_runner.h"
+
+namespace {
+
+struct Output {
+  std::string out_;
+  std::string err_;
+
+  OutputSink sink() {
+    return [this](OutputChannel channel, std::string_view data) {
+      (channel == OutputChannel::kStdout ? out_ : err_) += data;
+    };
+  }
+};
+
+#if defined(_WIN32)
+Environment BaseEnvironment() {
+  Environment env;
+  if (auto const* root = _wgetenv(L"SystemRoot")) {
+    env[L"SystemRoot"] = root;
+    env[L"PATH"] = std::wstring(root) + L"\\System32";
+  }
+  return env;
+}
+
+std::vector<std::string> Shell(std::string const& script) {
+  return {"cmd.exe", "/d", "/c", script};
+}
+#else
+Environment BaseEnvironment() { return {{L"PATH", L"/usr/bin:/bin"}}; }
+
+std::vector<std::string> Shell(std::string const& script) {
+  return {"sh", "-c", script};
+}
+#endif
+
+}  // namespace
+
+TEST(ProcessRunner, StreamsBothChannelsAndReturnsTheExitCode) {
+  Output output;
+  auto exit_code = run_process(Shell("echo out&& echo err 1>&2&& exit 7"), {},
+                               BaseEnvironment(), output.sink());
+  EXPECT_EQ(exit_code, 7);
+  EXPECT_EQ(output.out_.substr(0, 3), "out");
+  EXPECT_EQ(output.err_.substr(0, 3), "err");
+}
+
+TEST(ProcessRunner, UsesExactlyTheGivenEnvironment) {
+  auto env = BaseEnvironment();
+  env[L"VSRUN_TEST_VALUE"] = L"resident";
+  Output output;
+#if defined(_WIN32)
+  auto script = "echo %VSRUN_TEST_VALUE%";
+#else
+  auto script = "echo $VSRUN_TEST_VALUE; echo ${HOME:-unset}";
+#endif
+  EXPECT_EQ(run_process(Shell(script), {}, env, output.sink()), 0);
+  EXPECT_EQ(output.out_.substr(0, 8), "resident");
+#if !defined(_WIN32)
+  EXPECT_EQ(output.out_, "resident\nunset\n");
+#endif
+}
+
+TEST(ProcessRunner, StartsManyCommandsFromOneBlock) {
+  EnvStore store(BaseEnvironment());
+  store.set(L"VSRUN_TEST_VALUE", L"shared");
+  auto block = store.block();
+#if defined(_WIN32)
+  auto script = "echo %VSRUN_TEST_VALUE%";
+#else
+  auto script = "echo $VSRUN_TEST_VALUE";
+#endif
+  for (int i = 0; i < 3; ++i) {
+    Output output;
+    EXPECT_EQ(run_process(Shell(script), {}, block, output.sink()), 0);
+    EXPECT_EQ(output.out_.substr(0, 6), "shared");
+  }
+}
+
+TEST(ProcessRunner, RunsInTheGivenDirectory) {
+  auto dir = std::filesystem::canonical(std::filesystem::temp_directory_path());
+  Output output;
+#if defined(_WIN32)
+  auto script = "cd";
+#else
+  auto script = "pwd";
+#endif
+  EXPECT_EQ(run_process(Shell(script), dir, BaseEnvironment(), output.sink()),
+            0);
+  EXPECT_EQ(std::filesystem::path(output.out_.substr(
+                0, output.out_.find_last_not_of("\r\n") + 1)),
+            dir);
+}
+
+TEST(ProcessRunner, LargeOutputIsNotTruncated) {
+  Output output;
+#if defined(_WIN32)
+  auto script = "for /l %i in (1,1,20000) do @echo line %i";
+#else
+  auto script = "i=0; while [ $i -lt 20000 ]; do echo line $i; i=$((i+1)); "
+                "done";
+#endif
+  EXPECT_EQ(run_process(Shell(script), {}, BaseEnvironment(), output.sink()),
+            0);
+  EXPECT_NE(output.out_.find("line 19999"), std::string::npos);
+}
+
+TEST(ProcessRunner, ReportsProgramsThatCannotStart) {
+  Output output;
+  EXPECT_FALSE(run_process({"vsrun-no-such-program"}, {}, BaseEnvironment(),
+                           output.sink()));
+}
+
+TEST(ProcessRunner, CancellingKillsTheChildAndWhatItStarted) {
+  using namespace std::chrono_literals;
+  Output output;
+#if defined(_WIN32)
+  auto script = "ping -n 30 127.0.0.1 >nul";
+#else
+  auto script = "sleep 30; echo unreachable";
+#endif
+  std::atomic<bool> cancelled{false};
+  std::thread canceller([&]() {
+    std::this_thread::sleep_for(100ms);
+    cancelled = true;
+  });
+  auto start = std::chrono::steady_clock::now();
+  auto exit_code = run_process(Shell(script), {}, BaseEnvironment(),
+                               output.sink(), &cancelled);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  canceller.join();
+  EXPECT_FALSE(exit_code);
+  // `sleep` holds the pipes too, so this returns early only if it was
+  // killed along with the shell.
+  EXPECT_LT(elapsed, 10s);
+  EXPECT_EQ(output.out_, "");
+}
+
+TEST(ProcessRunner, UncancelledChildrenRunToCompletion) {
+  Output output;
+  std::atomic<bool> cancelled{false};
+  EXPECT_EQ(run_process(Shell("echo done"), {}, BaseEnvironment(),
+                        output.sink(), &cancelled),
+            0);
+  EXPECT_EQ(output.out_.substr(0, 4), "done");
+}
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "../src/instance.h"
+#include "../src/sort_plan.h"
+
+// find_product is constexpr, so the table is checked as the test compiles.
+static_assert(find_product(L"Microsoft.VisualStudio.Product.Community") ==
+              Product::kCommunity);
+static_assert(find_product("microsoft.visualstudio.product.buildtools") ==
+              Product::kBuildTools);
+static_assert(find_product("ENTERPRISE") == Product::kEnterprise);
+static_assert(find_product(L"TestProfessional") == Product::kTestProfessional);
+static_assert(find_product("Microsoft.VisualStudio.Product.") ==
+              Product::kUnknown);
+static_assert(find_product("Community2") == Product::kUnknown);
+static_assert(find_product("") == Product::kUnknown);
+static_assert(find_product("Microsoft.VisualStudio.Product.Microsoft."
+                           "VisualStudio.Product.Community") ==
+              Product::kUnknown);
+
+namespace {
+
+VisualStudio Instance(std::wstring product_id) {
+  VisualStudio vs{};
+  vs.display_name_ = product_id;
+  vs.product_id_ = std::move(product_id);
+  vs.product_ = find_product(vs.product_id_);
+  return vs;
+}
+
+}  // namespace
+
+TEST(Product, NamesRoundTrip) {
+  EXPECT_EQ(product_name(Product::kUnknown), L"");
+  for (auto name : kProductNames) {
+    EXPECT_EQ(product_name(find_product(name)), name);
+    EXPECT_EQ(find_product(std::wstring(kProductPrefix).append(name)),
+              find_product(name));
+  }
+}
+
+TEST(Product, MatchesKnownAndUnknownProducts) {
+  auto community = Instance(L"Microsoft.VisualStudio.Product.Community");
+  EXPECT_EQ(community.product_, Product::kCommunity);
+  EXPECT_TRUE(community.is_product_match(L"*"));
+  EXPECT_TRUE(community.is_product_match(L"community"));
+  EXPECT_TRUE(
+      community.is_product_match(L"MICROSOFT.VISUALSTUDIO.PRODUCT.COMMUNITY"));
+  EXPECT_FALSE(community.is_product_match(L"Professional"));
+  EXPECT_FALSE(community.is_product_match(L"Commun"));
+
+  // Products outside the table still match by their id.
+  auto preview = Instance(L"Microsoft.VisualStudio.Product.Preview");
+  EXPECT_EQ(preview.product_, Product::kUnknown);
+  EXPECT_TRUE(preview.is_product_match(L"preview"));
+  EXPECT_TRUE(
+      preview.is_product_match(L"Microsoft.VisualStudio.Product.Preview"));
+  EXPECT_FALSE(preview.is_product_match(L"Community"));
+
+  // So do instances whose product_ was never resolved.
+  VisualStudio unresolved{};
+  unresolved.product_id_ = L"Microsoft.VisualStudio.Product.Enterprise";
+  EXPECT_TRUE(unresolved.is_product_match(L"Enterprise"));
+  EXPECT_FALSE(unresolved.is_product_match(L"Community"));
+  VisualStudio other{};
+  other.product_id_ = L"Contoso.Enterprise";
+  EXPECT_FALSE(other.is_product_match(L"Enterprise"));
+}
+
+TEST(Product, SortRanksResolvedAndUnresolvedAlike) {
+  auto plan =
+      SortPlan::parse("product:Enterprise-Preview-Community-Enterprise");
+  ASSERT_TRUE(plan.has_value());
+  std::vector<VisualStudio> all{
+      Instance(L"Microsoft.VisualStudio.Product.Community"),
+      Instance(L"Microsoft.VisualStudio.Product.BuildTools"),
+      Instance(L"Microsoft.VisualStudio.Product.Preview"),
+      Instance(L"Microsoft.VisualStudio.Product.Enterprise"),
+  };
+  for (auto const& vs : all) {
+    auto unresolved = vs;
+    unresolved.product_ = Product::kUnknown;
+    EXPECT_EQ(plan->key(vs), plan->key(unresolved)) << vs.product_id_;
+  }
+  plan->apply(all);
+  std::vector<std::wstring> ids;
+  for (auto const& vs : all) {
+    ids.push_back(vs.product_id_.substr(kProductPrefix.size()));
+  }
+  EXPECT_EQ(ids, (std::vector<std::wstring>{L"Enterprise", L"Preview",
+                                            L"Community", L"BuildTools"}));
+}
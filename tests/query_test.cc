@@ -0,0 +1,198 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "../src/query.h"
+
+namespace {
+
+constexpr uint64_t k16 = 16ULL << 48;
+constexpr uint64_t k17 = 17ULL << 48;
+
+VisualStudio Instance(std::wstring name, uint64_t version,
+                      std::wstring product, IdSet workloads = {
+                          L"Microsoft.VisualStudio.Workload.NativeDesktop"}) {
+  VisualStudio vs{.version_ = version,
+                  .install_datetime_ = to_filetime(version),
+                  .install_version_ = std::to_wstring(version >> 48) + L".0",
+                  .install_path_ = L"C:\\VS\\" + name,
+                  .display_name_ = name,
+                  .product_id_ = L"Microsoft.VisualStudio.Product." + product,
+                  .is_complete_ = true,
+                  .is_prerelease_ = false,
+                  .workloads_ = workloads,
+                  .packages_ = PackageIndex(workloads.names())};
+  vs.product_ = find_product(vs.product_id_);
+  return vs;
+}
+
+std::vector<VisualStudio> Instances() {
+  std::vector<VisualStudio> all{
+      Instance(L"a", k16, L"Community"),
+      Instance(L"b", k17, L"Enterprise"),
+      Instance(L"c", k17, L"Professional"),
+      Instance(L"d", k17 + 1, L"BuildTools",
+               {L"Microsoft.VisualStudio.Workload.VCTools"}),
+      Instance(L"e", k17, L"Community", {}),
+      Instance(L"f", k17, L"Preview"),
+      Instance(L"g", k17, L"Community"),
+      Instance(L"h", k16, L"Enterprise"),
+  };
+  all[6].is_prerelease_ = true;
+  all[7].is_complete_ = false;
+  // Unresolved, as from a source that never set product_.
+  all[2].product_ = Product::kUnknown;
+  return all;
+}
+
+std::vector<std::wstring> Names(std::vector<VisualStudio> const& all) {
+  std::vector<std::wstring> names;
+  for (auto const& vs : all) {
+    names.push_back(vs.display_name_);
+  }
+  return names;
+}
+
+std::vector<std::wstring> Evaluate(QuerySpec const& spec) {
+  auto query = Query::compile(spec);
+  EXPECT_TRUE(query.has_value());
+  return Names(query.value_or(Query{}).evaluate(Instances()));
+}
+
+using Strings = std::vector<std::wstring>;
+
+}  // namespace
+
+TEST(Query, ReportsTheMalformedClause) {
+  std::string error;
+  EXPECT_FALSE(Query::compile({.version_ = "[17"}, &error));
+  EXPECT_EQ(error, "version: [17");
+  EXPECT_FALSE(Query::compile({.product_ = "Community,"}, &error));
+  EXPECT_EQ(error, "product: Community,");
+  EXPECT_FALSE(Query::compile({.workload_ = ""}, &error));
+  EXPECT_EQ(error, "workload: ");
+  EXPECT_FALSE(Query::compile({.sort_ = "version:up"}, &error));
+  EXPECT_EQ(error, "sort: version:up");
+  EXPECT_TRUE(Query::compile({}));
+}
+
+TEST(Query, MatchesWhatTheSourceFilterMatches) {
+  std::vector<QuerySpec> specs{
+      {},
+      {.version_ = "[17,18)"},
+      {.version_ = "[16,17)", .product_ = "Enterprise"},
+      {.product_ = "professional"},
+      {.product_ = "Microsoft.VisualStudio.Product.Preview"},
+      {.workload_ = "Microsoft.VisualStudio.Workload.VCTools"},
+      {.requires_any_ = "Microsoft.VisualStudio.Workload.NativeDesktop"},
+      {.requires_all_ = "Microsoft.VisualStudio.Workload.Missing"},
+  };
+  for (auto const& spec : specs) {
+    auto query = Query::compile(spec);
+    ASSERT_TRUE(query.has_value()) << spec.version_ << spec.product_;
+    VectorInstanceSource source(Instances());
+    EXPECT_EQ(Names(query->evaluate(Instances())),
+              Names(collect_matching_instances(source, query->filter())))
+        << spec.version_ << ' ' << spec.product_ << ' ' << spec.workload_;
+  }
+}
+
+TEST(Query, WildcardsMatchEveryCompleteInstance) {
+  auto all = Instances();
+  Query match_all;
+  for (auto const& vs : all) {
+    EXPECT_EQ(match_all.matches(vs), vs.is_complete_) << vs.display_name_;
+  }
+  EXPECT_EQ(Evaluate({.version_ = "[0,)", .include_incomplete_ = true}),
+            (Strings{L"a", L"b", L"c", L"d", L"f", L"g", L"h"}));
+}
+
+TEST(Query, ProductSetsAndPolicies) {
+  EXPECT_EQ(Evaluate({.product_ = "Professional,Preview,community"}),
+            (Strings{L"a", L"c", L"f", L"g"}));
+  EXPECT_EQ(Evaluate({.product_ = "Enterprise,*"}),
+            (Strings{L"a", L"b", L"c", L"d", L"f", L"g"}));
+  EXPECT_EQ(Evaluate({.product_ = "Community",
+                      .prerelease_ = PrereleasePolicy::kExclude}),
+            Strings{L"a"});
+  EXPECT_EQ(Evaluate({.prerelease_ = PrereleasePolicy::kOnly}),
+            Strings{L"g"});
+  EXPECT_EQ(Evaluate({.product_ = "Enterprise", .include_incomplete_ = true}),
+            (Strings{L"b", L"h"}));
+
+  auto query = Query::compile({.version_ = "[17,)", .product_ = "Community"});
+  auto all = Instances();
+  EXPECT_EQ(query->rejects(all[0]), MatchStage::kVersion);
+  EXPECT_EQ(query->rejects(all[1]), MatchStage::kProduct);
+  EXPECT_EQ(query->rejects(all[4]), MatchStage::kPackages);
+  EXPECT_EQ(query->rejects(all[6]), std::nullopt);
+}
+
+TEST(Query, SelectsInSortOrderWithoutCopying) {
+  auto all = Instances();
+  auto query = Query::compile(
+      {.version_ = "[17,)",
+       .product_ = "Community,Enterprise,Professional,BuildTools",
+       .workload_ = "*",
+       .sort_ = "version:desc,product:Enterprise-Community"});
+  ASSERT_TRUE(query.has_value());
+  auto selected = query->select(all);
+  ASSERT_EQ(selected.size(), 4u);
+  EXPECT_EQ(selected[0], &all[3]);
+  EXPECT_EQ(selected[1], &all[1]);
+  EXPECT_EQ(selected[2], &all[6]);
+  EXPECT_EQ(selected[3], &all[2]);
+  // The same query over another collection.
+  all.erase(all.begin() + 1);
+  EXPECT_EQ(Names(query->evaluate(all)), (Strings{L"d", L"g", L"c"}));
+}
+
+TEST(Query, FilterOnlyPushesDownWhatSourcesCheck) {
+  auto single = Query::compile({.product_ = "Community",
+                                .include_incomplete_ = true});
+  EXPECT_EQ(single->filter().product_, L"Community");
+  EXPECT_FALSE(single->filter().complete_only_);
+  auto set = Query::compile({.product_ = "Community,Preview"});
+  EXPECT_EQ(set->filter().product_, L"*");
+  EXPECT_TRUE(set->filter().complete_only_);
+
+  VectorInstanceSource source(Instances());
+  EXPECT_EQ(Names(set->evaluate(collect_matching_instances(
+                source, set->filter()))),
+            Names(set->evaluate(Instances())));
+}
+
+TEST(Query, IntentsPickWhatSortingWould) {
+  auto all = Instances();
+  for (auto sort :
+       {"", "version:asc", "version:desc,product:Enterprise-Community",
+        "date:desc", "product:Community-Enterprise,version:asc"}) {
+    auto query = Query::compile({.workload_ = "*", .sort_ = sort});
+    ASSERT_TRUE(query.has_value()) << sort;
+    auto sorted = query->select(all);
+    ASSERT_FALSE(sorted.empty());
+    EXPECT_EQ(query->select(all, OutputIntent::kFirst),
+              (std::vector{sorted.front()}))
+        << sort;
+    EXPECT_EQ(query->select(all, OutputIntent::kLast),
+              (std::vector{sorted.back()}))
+        << sort;
+    // Any match will do; it is the first one enumerated.
+    EXPECT_EQ(query->select(all, OutputIntent::kExists),
+              (std::vector<VisualStudio const*>{&all[0]}))
+        << sort;
+  }
+  auto none = Query::compile({.version_ = "[18,)", .product_ = "Enterprise"});
+  EXPECT_TRUE(none->select(all, OutputIntent::kExists).empty());
+  EXPECT_TRUE(none->evaluate(all, OutputIntent::kLast).empty());
+}
+
+TEST(Query, OnlyAnExactFilterTakesTheIntent) {
+  EXPECT_TRUE(Query::compile({.product_ = "Community"})->is_filter_exact());
+  EXPECT_TRUE(Query{}.is_filter_exact());
+  EXPECT_FALSE(
+      Query::compile({.product_ = "Community,Preview"})->is_filter_exact());
+  EXPECT_FALSE(Query::compile({.prerelease_ = PrereleasePolicy::kExclude})
+                   ->is_filter_exact());
+}
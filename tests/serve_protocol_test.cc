@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "../src/serve_protocol.h"
+
+namespace {
+
+RunRequest MakeRequest() {
+  RunRequest request;
+  request.version_ = "[17,17.65535.65535.65535)";
+  request.product_ = "Community";
+  request.workload_ = "Microsoft.VisualStudio.Workload.NativeDesktop";
+  request.requires_all_ = "Microsoft.VisualStudio.Component.VC.ATL";
+  request.sort_ = "version:desc";
+  request.select_last_ = true;
+  request.arch_ = "arm64";
+  request.host_arch_ = "x64";
+  request.use_shell_ = true;
+  request.cwd_ = "C:\\src\\project";
+  request.env_ = {{L"PATH", L"C:\\Windows"}, {L"TITLE", L"\u793e\u533a"}};
+  request.command_ = {"cmake", "--build", "build", ""};
+  return request;
+}
+
+}  // namespace
+
+TEST(ServeProtocol, RequestRoundTrip) {
+  auto request = MakeRequest();
+  EXPECT_EQ(decode_run_request(encode_run_request(request)), request);
+  EXPECT_EQ(decode_run_request(encode_run_request(RunRequest{})),
+            RunRequest{});
+}
+
+TEST(ServeProtocol, RejectsTruncatedAndTrailingData) {
+  auto payload = encode_run_request(MakeRequest());
+  for (size_t size = 0; size < payload.size(); ++size) {
+    EXPECT_FALSE(decode_run_request(payload.substr(0, size))) << size;
+  }
+  EXPECT_FALSE(decode_run_request(payload + '\0'));
+}
+
+TEST(ServeProtocol, RejectsOtherProtocolVersions) {
+  auto payload = encode_run_request(MakeRequest());
+  payload[0] = static_cast<char>(kProtocolVersion + 1);
+  EXPECT_FALSE(decode_run_request(payload));
+}
+
+TEST(ServeProtocol, FrameHeader) {
+  auto frame = encode_frame(FrameType::kStdout, "hello");
+  ASSERT_EQ(frame.size(), kFrameHeaderSize + 5);
+  auto header = decode_frame_header(frame);
+  ASSERT_TRUE(header);
+  EXPECT_EQ(header->first, FrameType::kStdout);
+  EXPECT_EQ(header->second, 5u);
+  EXPECT_EQ(frame.substr(kFrameHeaderSize), "hello");
+
+  EXPECT_FALSE(decode_frame_header(frame.substr(0, 4)));
+  EXPECT_FALSE(decode_frame_header(std::string("Z\0\0\0\0", 5)));
+  // Larger than kMaxFramePayload.
+  EXPECT_FALSE(decode_frame_header(std::string("O\0\0\0\x10", 5)));
+}
+
+TEST(ServeProtocol, ExitCode) {
+  for (int code : {0, 1, 3, 255, -1, -1073741515}) {
+    EXPECT_EQ(decode_exit_code(encode_exit_code(code)), code);
+  }
+  EXPECT_FALSE(decode_exit_code("abc"));
+}
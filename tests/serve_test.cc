@@ -0,0 +1,268 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/serve.h"
+#include "../src/unicode.h"
+
+namespace {
+
+std::string TestEndpoint() {
+  auto stamp = std::to_string(
+      std::chrono::steady_clock::now().time_since_epoch().count());
+#if defined(_WIN32)
+  return "\\\\.\\pipe\\vsrun-serve-test-" + stamp;
+#else
+  return (std::filesystem::temp_directory_path() /
+          ("vsrun-serve-" + stamp + ".sock"))
+      .string();
+#endif
+}
+
+std::wstring Widen(std::string const& s) { return utf8_decode(s); }
+
+VisualStudio MakeInstance(std::wstring path) {
+  VisualStudio vs{};
+  vs.install_path_ = std::move(path);
+  vs.install_version_ = L"17.8.34330.188";
+  return vs;
+}
+
+// Stands in for instance enumeration and VsDevCmd.bat, counting the calls
+// that would start the Setup COM server or cmd.exe.
+class ServeTest : public ::testing::Test {
+ protected:
+  ResidentEnvironments MakeProvider() {
+    return ResidentEnvironments(
+        [this](RunRequest const& request) -> std::optional<VisualStudio> {
+          ++finds_;
+          if (request.product_ == "Missing") {
+            return std::nullopt;
+          }
+          return MakeInstance(L"C:\\VS\\" + Widen(request.product_));
+        },
+        [this](VisualStudio const& vs, RunRequest const& request,
+               Environment const&) -> std::optional<EnvDelta> {
+          ++captures_;
+          std::this_thread::sleep_for(std::chrono::milliseconds(20));
+          EnvDelta delta;
+          delta.set_[L"VSINSTALLDIR"] = vs.install_path_;
+          delta.set_[L"VSCMD_ARG_TGT_ARCH"] = Widen(request.arch_);
+          delta.unset_.push_back(L"REMOVED");
+          return delta;
+        },
+        [this]() { return std::optional<uint64_t>(instances_.load()); });
+  }
+
+  static RunRequest MakeRequest(std::vector<std::string> command) {
+    RunRequest request;
+    request.version_ = "[17.0,)";
+    request.product_ = "Community";
+    request.arch_ = "x64";
+    request.host_arch_ = "x64";
+    request.env_ = {{L"PATH", L"C:\\Windows"}, {L"REMOVED", L"1"}};
+    request.command_ = std::move(command);
+    return request;
+  }
+
+  // "echo <text>" writes to stdout, "warn <text>" to stderr, "exit <n>"
+  // returns n; "env <name>" prints a variable.
+  static std::optional<int> FakeRunner(RunRequest const& request,
+                                       Environment const& env,
+                                       OutputSink const& sink) {
+    int exit_code = 0;
+    auto const& cmd = request.command_;
+    for (size_t i = 0; i + 1 < cmd.size(); i += 2) {
+      if (cmd[i] == "echo") {
+        sink(OutputChannel::kStdout, cmd[i + 1] + "\n");
+      } else if (cmd[i] == "warn") {
+        sink(OutputChannel::kStderr, cmd[i + 1] + "\n");
+      } else if (cmd[i] == "exit") {
+        exit_code = std::stoi(cmd[i + 1]);
+      } else if (cmd[i] == "env") {
+        auto it = env.find(Widen(cmd[i + 1]));
+        sink(OutputChannel::kStdout,
+             (it == env.end() ? "<unset>" : utf8_encode(it->second)) + "\n");
+      } else {
+        return std::nullopt;
+      }
+    }
+    return exit_code;
+  }
+
+  struct Reply {
+    std::optional<int> exit_code_;
+    std::string out_;
+    std::string err_;
+    std::string error_;
+  };
+
+  static Reply Run(std::string const& endpoint, RunRequest const& request) {
+    Reply reply;
+    auto stream = connect_local(endpoint);
+    EXPECT_TRUE(stream.is_open());
+    reply.exit_code_ = request_run(
+        stream, request,
+        [&reply](OutputChannel channel, std::string_view data) {
+          (channel == OutputChannel::kStdout ? reply.out_ : reply.err_) +=
+              data;
+        },
+        reply.error_);
+    return reply;
+  }
+
+  std::atomic<int> finds_{0};
+  std::atomic<int> captures_{0};
+  // Stands in for the fingerprint of Setup's _Instances directory.
+  std::atomic<uint64_t> instances_{1};
+};
+
+}  // namespace
+
+TEST_F(ServeTest, ProviderResolvesEachLookupOnce) {
+  auto provider = MakeProvider();
+  std::string error;
+  auto env = provider.environment(MakeRequest({}), error);
+  ASSERT_TRUE(env);
+  EXPECT_EQ(env->at(L"VSINSTALLDIR"), L"C:\\VS\\Community");
+  EXPECT_EQ(env->at(L"PATH"), L"C:\\Windows");
+  EXPECT_EQ(env->count(L"REMOVED"), 0u);
+
+  ASSERT_TRUE(provider.environment(MakeRequest({}), error));
+  EXPECT_EQ(finds_, 1);
+  EXPECT_EQ(captures_, 1);
+
+  // Another arch is another VsDevCmd.bat run; another VsDevCmd input too.
+  auto arm64 = MakeRequest({});
+  arm64.arch_ = "arm64";
+  ASSERT_TRUE(provider.environment(arm64, error));
+  auto include = MakeRequest({});
+  include.env_[L"INCLUDE"] = L"C:\\include";
+  ASSERT_TRUE(provider.environment(include, error));
+  EXPECT_EQ(finds_, 1);
+  EXPECT_EQ(captures_, 3);
+}
+
+TEST_F(ServeTest, ConcurrentRequestsShareOneCapture) {
+  auto provider = MakeProvider();
+  std::vector<std::thread> threads;
+  std::atomic<int> succeeded{0};
+  for (int i = 0; i < 8; ++i) {
+    threads.emplace_back([&provider, &succeeded]() {
+      std::string error;
+      if (provider.environment(MakeRequest({}), error)) {
+        ++succeeded;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(succeeded, 8);
+  EXPECT_EQ(finds_, 1);
+  EXPECT_EQ(captures_, 1);
+}
+
+TEST_F(ServeTest, FailedLookupsAreRetried) {
+  auto provider = MakeProvider();
+  auto request = MakeRequest({});
+  request.product_ = "Missing";
+  std::string error;
+  EXPECT_FALSE(provider.environment(request, error));
+  EXPECT_FALSE(error.empty());
+  EXPECT_FALSE(provider.environment(request, error));
+  EXPECT_EQ(finds_, 2);
+  EXPECT_EQ(captures_, 0);
+}
+
+TEST_F(ServeTest, InstanceChangesForgetEveryLookup) {
+  auto provider = MakeProvider();
+  std::string error;
+  ASSERT_TRUE(provider.environment(MakeRequest({}), error));
+  ASSERT_TRUE(provider.environment(MakeRequest({}), error));
+  EXPECT_EQ(finds_, 1);
+  EXPECT_EQ(captures_, 1);
+
+  // E.g. Visual Studio Installer updated an instance.
+  instances_ = 2;
+  ASSERT_TRUE(provider.environment(MakeRequest({}), error));
+  ASSERT_TRUE(provider.environment(MakeRequest({}), error));
+  EXPECT_EQ(finds_, 2);
+  EXPECT_EQ(captures_, 2);
+}
+
+TEST_F(ServeTest, ServesClientsUntilShutdown) {
+  auto provider = MakeProvider();
+  DevEnvServer server(provider, FakeRunner);
+  auto endpoint = TestEndpoint();
+  LocalListener listener(endpoint);
+  std::thread loop([&server, &listener]() { server.serve(listener); });
+
+  auto reply = Run(endpoint, MakeRequest({"echo", "hello", "warn", "careful",
+                                          "env", "VSINSTALLDIR", "exit", "3"}));
+  EXPECT_EQ(reply.exit_code_, 3);
+  EXPECT_EQ(reply.out_, "hello\nC:\\VS\\Community\n");
+  EXPECT_EQ(reply.err_, "careful\n");
+
+  // Clients in parallel, all answered from the one resident environment.
+  std::vector<std::thread> clients;
+  std::atomic<int> ok{0};
+  for (int i = 0; i < 6; ++i) {
+    clients.emplace_back([&endpoint, &ok, i]() {
+      auto reply =
+          Run(endpoint, MakeRequest({"echo", std::to_string(i), "exit", "0"}));
+      if (reply.exit_code_ == 0 && reply.out_ == std::to_string(i) + "\n") {
+        ++ok;
+      }
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  EXPECT_EQ(ok, 6);
+  EXPECT_EQ(captures_, 1);
+
+  auto failed = Run(endpoint, MakeRequest({"no-such-command", "x"}));
+  EXPECT_FALSE(failed.exit_code_);
+  EXPECT_NE(failed.error_.find("no-such-command"), std::string::npos);
+
+  auto missing = MakeRequest({"echo", "x"});
+  missing.product_ = "Missing";
+  EXPECT_FALSE(Run(endpoint, missing).exit_code_);
+
+  auto stream = connect_local(endpoint);
+  EXPECT_TRUE(request_shutdown(stream));
+  loop.join();
+}
+
+TEST_F(ServeTest, RejectsMalformedRequests) {
+  auto provider = MakeProvider();
+  DevEnvServer server(provider, FakeRunner);
+  auto endpoint = TestEndpoint();
+  LocalListener listener(endpoint);
+  std::thread loop([&server, &listener]() { server.serve(listener); });
+
+  auto stream = connect_local(endpoint);
+  ASSERT_TRUE(stream.write_frame(FrameType::kRequest, "garbage"));
+  auto frame = stream.read_frame();
+  ASSERT_TRUE(frame);
+  EXPECT_EQ(frame->type_, FrameType::kError);
+  stream.close();
+
+  auto shutdown = connect_local(endpoint);
+  EXPECT_TRUE(request_shutdown(shutdown));
+  loop.join();
+  EXPECT_EQ(finds_, 0);
+}
+
+TEST_F(ServeTest, SecondServerOnTheSameEndpointFails) {
+  auto endpoint = TestEndpoint();
+  LocalListener listener(endpoint);
+  EXPECT_THROW(LocalListener second(endpoint), std::system_error);
+}
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "../src/sort_plan.h"
+
+namespace {
+
+VisualStudio Instance(std::wstring name, uint64_t version, uint64_t installed,
+                      std::wstring product) {
+  VisualStudio vs{};
+  vs.display_name_ = std::move(name);
+  vs.version_ = version;
+  vs.install_datetime_ = to_filetime(installed);
+  vs.product_id_ = L"Microsoft.VisualStudio.Product." + product;
+  return vs;
+}
+
+std::vector<std::wstring> Sorted(std::string_view spec) {
+  std::vector<VisualStudio> all{
+      Instance(L"a", 16, 300, L"Community"),
+      Instance(L"b", 17, 100, L"Enterprise"),
+      Instance(L"c", 17, 200, L"Professional"),
+      Instance(L"d", 15, 400, L"BuildTools"),
+  };
+  auto plan = SortPlan::parse(spec);
+  EXPECT_TRUE(plan.has_value()) << spec;
+  plan.value_or(SortPlan{}).apply(all);
+  std::vector<std::wstring> names;
+  for (auto const& vs : all) {
+    names.push_back(vs.display_name_);
+  }
+  return names;
+}
+
+using Names = std::vector<std::wstring>;
+
+}  // namespace
+
+TEST(SortPlan, Parse) {
+  auto plan = SortPlan::parse("product:enterprise-Community,time:desc");
+  ASSERT_TRUE(plan.has_value());
+  ASSERT_EQ(plan->terms().size(), 2u);
+  EXPECT_EQ(plan->terms()[0].field_, SortPlan::Field::kProduct);
+  EXPECT_EQ(plan->terms()[0].products_,
+            (std::vector<std::wstring>{
+                L"microsoft.visualstudio.product.enterprise",
+                L"microsoft.visualstudio.product.community"}));
+  EXPECT_EQ(plan->terms()[1].field_, SortPlan::Field::kDate);
+  EXPECT_TRUE(plan->terms()[1].descending_);
+  EXPECT_TRUE(SortPlan::parse("")->empty());
+}
+
+TEST(SortPlan, RejectsMalformedTerms) {
+  for (auto spec : {"version", "version:up", "size:asc", "product:",
+                    "product:Community--Enterprise", "version:asc,"}) {
+    EXPECT_FALSE(SortPlan::parse(spec).has_value()) << spec;
+  }
+  std::string error;
+  SortPlan::parse("version:asc,date:sideways", &error);
+  EXPECT_EQ(error, "date:sideways");
+}
+
+TEST(SortPlan, RepeatedFieldTakesLastValue) {
+  auto plan = SortPlan::parse("version:asc,date:asc,time:desc,version:desc");
+  ASSERT_TRUE(plan.has_value());
+  ASSERT_EQ(plan->terms().size(), 2u);
+  EXPECT_EQ(plan->terms()[0].field_, SortPlan::Field::kVersion);
+  EXPECT_TRUE(plan->terms()[0].descending_);
+  EXPECT_TRUE(plan->terms()[1].descending_);
+}
+
+TEST(SortPlan, SingleTerms) {
+  EXPECT_EQ(Sorted("version:asc"), (Names{L"d", L"a", L"b", L"c"}));
+  EXPECT_EQ(Sorted("version:desc"), (Names{L"b", L"c", L"a", L"d"}));
+  EXPECT_EQ(Sorted("date:asc"), (Names{L"b", L"c", L"a", L"d"}));
+  EXPECT_EQ(Sorted("time:desc"), (Names{L"d", L"a", L"c", L"b"}));
+  // Unlisted products go last, in their original order.
+  EXPECT_EQ(Sorted("product:professional-Community"),
+            (Names{L"c", L"a", L"b", L"d"}));
+}
+
+TEST(SortPlan, TermsApplyInTheGivenOrder) {
+  EXPECT_EQ(Sorted("version:desc,date:desc"),
+            (Names{L"c", L"b", L"a", L"d"}));
+  EXPECT_EQ(Sorted("version:desc,product:Enterprise-Professional"),
+            (Names{L"b", L"c", L"a", L"d"}));
+  EXPECT_EQ(Sorted("product:Professional-Enterprise,version:desc"),
+            (Names{L"c", L"b", L"a", L"d"}));
+  EXPECT_EQ(Sorted(""), (Names{L"a", L"b", L"c", L"d"}));
+}
+
+TEST(SortPlan, KeysCompareLikeTheTerms) {
+  auto plan = SortPlan::parse("date:desc,version:asc");
+  ASSERT_TRUE(plan.has_value());
+  auto older = Instance(L"x", 17, 100, L"Community");
+  auto newer = Instance(L"y", 16, 200, L"Community");
+  EXPECT_LT(plan->key(newer), plan->key(older));
+  newer.install_datetime_ = older.install_datetime_;
+  EXPECT_LT(plan->key(newer), plan->key(older));
+}
@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <list>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../src/split.h"
+
+namespace {
+
+// split_to_if as it was before SplitRange, which copied every token: the
+// behavior the range has to keep.
+std::vector<std::string> LegacySplit(std::string const& str, char delim,
+                                     int max_count, bool is_compress_token) {
+  auto f = [delim](char c) { return c == delim; };
+  std::vector<std::string> to;
+  auto begin = str.begin();
+  auto delimiter = begin;
+  int count = 0;
+  while ((max_count < 0 || count++ < max_count) &&
+         (delimiter = std::find_if(begin, str.end(), f)) != str.end()) {
+    to.insert(to.end(), {begin, delimiter});
+    if (is_compress_token) {
+      begin = std::find_if_not(delimiter, str.end(), f);
+    } else {
+      begin = std::next(delimiter);
+    }
+  }
+  to.emplace_back(begin, str.end());
+  return to;
+}
+
+template <typename Range>
+std::vector<std::string> Tokens(Range const& range) {
+  std::vector<std::string> tokens;
+  for (auto token : range) {
+    tokens.emplace_back(token);
+  }
+  return tokens;
+}
+
+using Strings = std::vector<std::string>;
+
+}  // namespace
+
+TEST(Split, KeepsEmptyTokens) {
+  EXPECT_EQ(Tokens(split_view(std::string_view(""), ';')), Strings{""});
+  EXPECT_EQ(Tokens(split_view(std::string_view(";a;;b;"), ';')),
+            (Strings{"", "a", "", "b", ""}));
+  EXPECT_EQ(split("INCLUDE=C:\\a=b", '=', -1),
+            (Strings{"INCLUDE", "C:\\a", "b"}));
+}
+
+TEST(Split, StopsAfterMaxCount) {
+  EXPECT_EQ(split("INCLUDE=C:\\a=b", '=', 1), (Strings{"INCLUDE", "C:\\a=b"}));
+  EXPECT_EQ(split("a,b", ',', 0), Strings{"a,b"});
+  EXPECT_EQ(Tokens(split_view(std::string_view("a,b,c,d"), ',', 2)),
+            (Strings{"a", "b", "c,d"}));
+}
+
+TEST(Split, CompressesRunsOfDelimiters) {
+  auto is_space = [](char c) { return c == ' ' || c == '\t'; };
+  EXPECT_EQ(Tokens(split_view_if(std::string(" a \t b  "), is_space, -1,
+                                 true)),
+            (Strings{"", "a", "b", ""}));
+  EXPECT_EQ(Tokens(split_view(std::string_view("a;;;b;;c"), ';', 1, true)),
+            (Strings{"a", "b;;c"}));
+}
+
+TEST(Split, IsAForwardRangeOfViews) {
+  std::wstring path = L"C:\\VS\\bin;C:\\Windows";
+  auto entries = split_view(path, L';');
+  auto it = entries.begin();
+  EXPECT_EQ(*it, L"C:\\VS\\bin");
+  EXPECT_EQ(it->data(), path.data());
+  auto copy = it++;
+  EXPECT_EQ(*copy, L"C:\\VS\\bin");
+  EXPECT_EQ(*it, L"C:\\Windows");
+  EXPECT_NE(copy, it);
+  EXPECT_EQ(++it, entries.end());
+  EXPECT_EQ(std::distance(entries.begin(), entries.end()), 2);
+  EXPECT_EQ(std::vector<std::wstring_view>(entries.begin(), entries.end()),
+            (std::vector<std::wstring_view>{L"C:\\VS\\bin", L"C:\\Windows"}));
+}
+
+TEST(Split, SplitToIfFillsAnyContainer) {
+  std::set<std::string> set;
+  split_to_if(set, std::string("b,a,b"), [](char c) { return c == ','; });
+  EXPECT_EQ(set, (std::set<std::string>{"a", "b"}));
+
+  std::list<std::wstring> list;
+  split_to_if(list, std::wstring(L"x y"), [](wchar_t c) { return c == L' '; });
+  EXPECT_EQ(list, (std::list<std::wstring>{L"x", L"y"}));
+}
+
+TEST(Split, MatchesTheCopyingSplit) {
+  // SplitMix64, so every run sees the same inputs.
+  uint64_t state = 0x5eed;
+  auto next = [&state]() {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  };
+  for (int i = 0; i < 20000; ++i) {
+    std::string text(next() % 40, ' ');
+    for (auto& c : text) {
+      c = "ab;;"[next() % 4];
+    }
+    int max_count = static_cast<int>(next() % 6) - 1;
+    bool compress = next() % 2;
+    auto expected = LegacySplit(text, ';', max_count, compress);
+    ASSERT_EQ(Tokens(split_view(std::string_view(text), ';', max_count,
+                                compress)),
+              expected)
+        << text << ' ' << max_count << ' ' << compress;
+    ASSERT_EQ(Tokens(split_view_if(
+                  text, [](char c) { return c == ';'; }, max_count, compress)),
+              expected);
+    std::vector<std::string> adapted;
+    split_to_if(
+        adapted, text, [](char c) { return c == ';'; }, max_count, compress);
+    ASSERT_EQ(adapted, expected);
+  }
+}
@@ -0,0 +1,238 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/startup.h"
+
+namespace {
+
+using namespace std::chrono_literals;
+
+VisualStudio Instance(std::wstring name) {
+  VisualStudio vs{};
+  vs.install_path_ = L"C:\\VS\\" + name;
+  vs.install_version_ = L"17.8.0";
+  vs.display_name_ = std::move(name);
+  return vs;
+}
+
+EnvDelta DevEnv(VisualStudio const& vs) {
+  EnvDelta delta;
+  delta.set_[L"VSINSTALLDIR"] = vs.install_path_;
+  return delta;
+}
+
+// A stage that takes `latency`, standing in for COM enumeration or a
+// VsDevCmd.bat run.
+void Work(std::chrono::milliseconds latency) {
+  std::this_thread::sleep_for(latency);
+}
+
+}  // namespace
+
+TEST(Startup, PreparesWhileTheLookupRuns) {
+  std::promise<void> prepared;
+  auto prepared_future = prepared.get_future();
+  StartupStages stages{
+      .lookup_ =
+          [&]() {
+            // Would time out if prepare_ waited for the lookup.
+            EXPECT_EQ(prepared_future.wait_for(10s),
+                      std::future_status::ready);
+            return std::vector<VisualStudio>{Instance(L"a"), Instance(L"b")};
+          },
+      .prepare_ =
+          [&]() {
+            prepared.set_value();
+            return Environment{{L"Path", L"C:\\Windows"}};
+          },
+      .select_last_ = true};
+  auto result = run_startup(stages);
+  ASSERT_NE(result.selected(), nullptr);
+  EXPECT_EQ(result.selected()->display_name_, L"b");
+  EXPECT_EQ(result.parent_, (Environment{{L"Path", L"C:\\Windows"}}));
+  EXPECT_FALSE(result.dev_env_);
+  EXPECT_EQ(result.speculation_, Speculation::kNone);
+}
+
+TEST(Startup, StartsTheGuessedDevEnvironmentBeforeTheLookupEnds) {
+  std::promise<void> speculating;
+  auto speculating_future = speculating.get_future();
+  std::atomic<int> develops{0};
+  StartupStages stages{
+      .lookup_ =
+          [&]() {
+            EXPECT_EQ(speculating_future.wait_for(10s),
+                      std::future_status::ready);
+            return std::vector<VisualStudio>{Instance(L"a"), Instance(L"b")};
+          },
+      .prepare_ = []() { return Environment{{L"A", L"1"}}; },
+      .predict_ = []() { return std::optional(Instance(L"a")); },
+      .develop_ =
+          [&](VisualStudio const& vs, Environment const& parent,
+              std::atomic<bool> const&) -> std::optional<EnvDelta> {
+            EXPECT_EQ(parent, (Environment{{L"A", L"1"}}));
+            ++develops;
+            speculating.set_value();
+            return DevEnv(vs);
+          }};
+  auto result = run_startup(stages);
+  EXPECT_EQ(result.speculation_, Speculation::kHit);
+  EXPECT_EQ(develops, 1);
+  ASSERT_TRUE(result.dev_env_);
+  EXPECT_EQ(result.dev_env_->set_.at(L"VSINSTALLDIR"), L"C:\\VS\\a");
+}
+
+TEST(Startup, CancelsAMispredictionAndDevelopsTheSelection) {
+  std::vector<std::wstring> developed;
+  std::mutex mutex;
+  std::promise<void> abandoned;
+  StartupStages stages{
+      .lookup_ =
+          []() {
+            Work(20ms);
+            return std::vector<VisualStudio>{Instance(L"b")};
+          },
+      .predict_ = []() { return std::optional(Instance(L"a")); },
+      .develop_ =
+          [&](VisualStudio const& vs, Environment const&,
+              std::atomic<bool> const& cancelled) -> std::optional<EnvDelta> {
+            {
+              std::lock_guard lock(mutex);
+              developed.push_back(vs.display_name_);
+            }
+            if (vs.display_name_ == L"a") {
+              // The misprediction keeps running until told otherwise.
+              auto deadline = std::chrono::steady_clock::now() + 10s;
+              while (!cancelled &&
+                     std::chrono::steady_clock::now() < deadline) {
+                Work(1ms);
+              }
+              EXPECT_TRUE(cancelled);
+              abandoned.set_value();
+            }
+            return DevEnv(vs);
+          }};
+  auto result = run_startup(stages);
+  EXPECT_EQ(result.speculation_, Speculation::kMiss);
+  ASSERT_TRUE(result.dev_env_);
+  EXPECT_EQ(result.dev_env_->set_.at(L"VSINSTALLDIR"), L"C:\\VS\\b");
+  // The abandoned stage uses this test's locals.
+  abandoned.get_future().wait();
+  std::lock_guard lock(mutex);
+  EXPECT_EQ(developed, (std::vector<std::wstring>{L"a", L"b"}));
+}
+
+TEST(Startup, AMissDoesNotWaitForTheAbandonedStage) {
+  // Stands in for a VsDevCmd.bat run that ignores cancellation.
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  std::promise<void> finished;
+  StartupStages stages{
+      .lookup_ =
+          []() {
+            Work(20ms);
+            return std::vector<VisualStudio>{Instance(L"b")};
+          },
+      .predict_ = []() { return std::optional(Instance(L"a")); },
+      .develop_ =
+          [&, released](VisualStudio const& vs, Environment const&,
+                        std::atomic<bool> const&) -> std::optional<EnvDelta> {
+            if (vs.display_name_ == L"a") {
+              released.wait_for(10s);
+              finished.set_value();
+            }
+            return DevEnv(vs);
+          }};
+  auto start = std::chrono::steady_clock::now();
+  {
+    auto result = run_startup(stages);
+    EXPECT_EQ(result.speculation_, Speculation::kMiss);
+    // No ASSERT: the abandoned stage must be released before returning.
+    EXPECT_TRUE(result.dev_env_);
+  }
+  EXPECT_LT(std::chrono::steady_clock::now() - start, 5s);
+  release.set_value();
+  finished.get_future().wait();
+}
+
+TEST(Startup, NoGuessOrNoMatchDevelopsOnlyTheSelection) {
+  int develops = 0;
+  auto develop = [&](VisualStudio const& vs, Environment const&,
+                     std::atomic<bool> const&) -> std::optional<EnvDelta> {
+    ++develops;
+    return DevEnv(vs);
+  };
+  auto result = run_startup(
+      {.lookup_ = []() { return std::vector<VisualStudio>{Instance(L"a")}; },
+       .predict_ = []() -> std::optional<VisualStudio> {
+         throw std::runtime_error("corrupt snapshot");
+       },
+       .develop_ = develop});
+  EXPECT_EQ(result.speculation_, Speculation::kNone);
+  EXPECT_TRUE(result.dev_env_);
+  EXPECT_EQ(develops, 1);
+
+  // Nothing matched: no dev environment, and the guess is dropped.
+  result = run_startup(
+      {.lookup_ = []() { return std::vector<VisualStudio>{}; },
+       .predict_ = []() { return std::optional(Instance(L"a")); },
+       .develop_ = [](VisualStudio const&, Environment const&,
+                      std::atomic<bool> const& cancelled)
+           -> std::optional<EnvDelta> {
+         return cancelled ? std::nullopt : std::optional(EnvDelta{});
+       }});
+  EXPECT_EQ(result.selected(), nullptr);
+  EXPECT_EQ(result.speculation_, Speculation::kMiss);
+  EXPECT_FALSE(result.dev_env_);
+}
+
+TEST(Startup, LookupErrorsWaitForTheBackgroundStages) {
+  std::atomic<bool> prepare_done{false};
+  StartupStages stages{
+      .lookup_ = []() -> std::vector<VisualStudio> {
+        throw std::runtime_error("failed to create query class");
+      },
+      .prepare_ =
+          [&]() {
+            Work(20ms);
+            prepare_done = true;
+            return Environment{};
+          }};
+  EXPECT_THROW(run_startup(stages), std::runtime_error);
+  EXPECT_TRUE(prepare_done);
+}
+
+TEST(Startup, OverlapsInjectedLatencies) {
+  constexpr auto kLatency = 100ms;
+  StartupStages stages{
+      .lookup_ =
+          [&]() {
+            Work(kLatency);
+            return std::vector<VisualStudio>{Instance(L"a")};
+          },
+      .prepare_ =
+          [&]() {
+            Work(kLatency);
+            return Environment{};
+          },
+      .predict_ = []() { return std::optional(Instance(L"a")); },
+      .develop_ = [&](VisualStudio const& vs, Environment const&,
+                      std::atomic<bool> const&) -> std::optional<EnvDelta> {
+        Work(kLatency);
+        return DevEnv(vs);
+      }};
+  auto start = std::chrono::steady_clock::now();
+  auto result = run_startup(stages);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_EQ(result.speculation_, Speculation::kHit);
+  // Run one after another, the three stages take 3 * kLatency. Pipelined,
+  // the dev environment only waits for the parent environment.
+  EXPECT_LT(elapsed, 3 * kLatency - kLatency / 2);
+}
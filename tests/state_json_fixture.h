@@ -0,0 +1,85 @@
+#ifndef TESTS_STATE_JSON_FIXTURE_H_
+#define TESTS_STATE_JSON_FIXTURE_H_
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+// Writes state.json documents shaped like the ones Setup records, including
+// the long tail of package entries, so that parsing and benchmarks see
+// real-sized input without a Visual Studio installation.
+struct StateJsonFixture {
+  std::string install_path = "C:\\\\Program Files\\\\Microsoft Visual "
+                             "Studio\\\\2022\\\\Community";
+  std::string install_version = "17.8.34330.188";
+  std::string install_date = "2023-11-15T08:21:31Z";
+  std::string product_id = "Microsoft.VisualStudio.Product.Community";
+  std::string title = "Visual Studio Community 2022";
+  std::string prerelease = "\"False\"";
+  int packages = 3000;
+  int workloads = 4;
+
+  std::string render() const {
+    std::string out;
+    out.reserve(static_cast<size_t>(packages) * 260 + 4096);
+    out += "{\n  \"installationName\": \"VisualStudio/17.8.0+34330.188\",\n";
+    out += "  \"installationPath\": \"" + install_path + "\",\n";
+    out += "  \"launchParams\": {\n    \"fileName\": \"Common7\\\\IDE\\\\"
+           "devenv.exe\",\n    \"arguments\": \"\"\n  },\n";
+    out += "  \"installationVersion\": \"" + install_version + "\",\n";
+    out += "  \"installDate\": \"" + install_date + "\",\n";
+    out += "  \"updateDate\": \"2023-12-01T10:00:00.1234567Z\",\n";
+    out += "  \"layoutPath\": null,\n  \"channelId\": \"VisualStudio.17."
+           "Release\",\n  \"installedChannelUri\": \"https://aka.ms/vs/17/"
+           "release/channel\",\n";
+    out += "  \"catalogInfo\": {\n    \"id\": \"VisualStudio/17.8.0+34330.188"
+           "\",\n    \"buildBranch\": \"d17.8\",\n    \"productMilestone"
+           "IsPreRelease\": " +
+           prerelease + ",\n    \"productLineVersion\": \"2022\"\n  },\n";
+    out += "  \"localizedResources\": [\n"
+           "    {\"language\": \"zh-cn\", \"title\": \"Visual Studio "
+           "\\u793e\\u533a\\u7248 2022\", \"description\": \"\"},\n"
+           "    {\"language\": \"en-us\", \"title\": \"" +
+           title +
+           "\", \"description\": \"Powerful IDE, free for students, "
+           "open-source contributors, and individuals\"}\n  ],\n";
+    out += "  \"product\": {\n    \"id\": \"" + product_id +
+           "\",\n    \"version\": \"" + install_version +
+           "\",\n    \"type\": \"Product\",\n    \"extensionDir\": "
+           "\"Common7\\\\IDE\\\\Extensions\"\n  },\n";
+    out += "  \"selectedPackages\": [{\"id\": \"" + product_id +
+           "\", \"selectedState\": \"IndividuallySelected\"}],\n";
+    out += "  \"packages\": [\n";
+    for (int i = 0; i < packages; ++i) {
+      bool workload = i < workloads;
+      std::string id = workload
+                           ? "Microsoft.VisualStudio.Workload.W" +
+                                 std::to_string(i)
+                           : "Microsoft.VisualStudio.Component.Package" +
+                                 std::to_string(i);
+      out += "    {\n      \"id\": \"" + id + "\",\n";
+      out += "      \"version\": \"17.8.34330.188\",\n";
+      out += i % 3 == 0 ? "      \"chip\": \"x64\",\n" : "";
+      out += i % 5 == 0 ? "      \"language\": \"en-US\",\n" : "";
+      out += "      \"type\": \"";
+      out += workload ? "Workload" : (i % 2 ? "Vsix" : "Component");
+      out += "\",\n      \"installed\": true,\n      \"dependencies\": [1, "
+             "2.5e3, -4, false, {\"id\": \"dep\", \"optional\": [null]}]\n";
+      out += i + 1 < packages ? "    },\n" : "    }\n";
+    }
+    out += "  ],\n  \"properties\": {\"campaignId\": \"\", "
+           "\"setupEngineFilePath\": \"C:\\\\Program Files (x86)\\\\"
+           "Microsoft Visual Studio\\\\Installer\\\\setup.exe\"}\n}\n";
+    return out;
+  }
+
+  void write(std::filesystem::path const& instances_dir,
+             std::string const& instance_id) const {
+    std::filesystem::create_directories(instances_dir / instance_id);
+    std::ofstream(instances_dir / instance_id / "state.json",
+                  std::ios::binary)
+        << render();
+  }
+};
+
+#endif  // TESTS_STATE_JSON_FIXTURE_H_
@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+#include "../src/state_json.h"
+#include "state_json_fixture.h"
+
+namespace {
+
+class StateJsonTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    root_ = std::filesystem::temp_directory_path() /
+            ("vsrun-state-json-test-" +
+             std::to_string(
+                 std::chrono::steady_clock::now().time_since_epoch().count()));
+    std::filesystem::create_directories(root_);
+  }
+  void TearDown() override { std::filesystem::remove_all(root_); }
+
+  std::filesystem::path root_;
+};
+
+}  // namespace
+
+TEST(StateJson, Iso8601) {
+  EXPECT_EQ(parse_iso8601_filetime("1601-01-01T00:00:00Z"), 0u);
+  EXPECT_EQ(parse_iso8601_filetime("1970-01-01T00:00:00Z"),
+            116444736000000000ULL);
+  EXPECT_EQ(parse_iso8601_filetime("2023-11-15T08:21:31Z"),
+            133445100910000000ULL);
+  EXPECT_EQ(parse_iso8601_filetime("2023-11-15T08:21:31.25Z"),
+            133445100912500000ULL);
+  EXPECT_EQ(parse_iso8601_filetime("2023-11-15T16:21:31+08:00"),
+            133445100910000000ULL);
+  EXPECT_EQ(parse_iso8601_filetime("2023-11-15T08:21:31"),
+            133445100910000000ULL);
+  EXPECT_FALSE(parse_iso8601_filetime(""));
+  EXPECT_FALSE(parse_iso8601_filetime("2023-13-15T08:21:31Z"));
+  EXPECT_FALSE(parse_iso8601_filetime("2023-11-15 08:21:31Z"));
+  EXPECT_FALSE(parse_iso8601_filetime("2023-11-15T08:21:31Zjunk"));
+}
+
+TEST(StateJson, ParsesRealSizedDocument) {
+  StateJsonFixture fixture;
+  auto vs = parse_state_json(fixture.render());
+  ASSERT_TRUE(vs);
+  EXPECT_EQ(vs->install_path_,
+            L"C:\\Program Files\\Microsoft Visual Studio\\2022\\Community");
+  EXPECT_EQ(vs->install_version_, L"17.8.34330.188");
+  EXPECT_EQ(vs->version_, 0x00110008861A00BCULL);
+  EXPECT_EQ(to_uint64(vs->install_datetime_), 133445100910000000ULL);
+  EXPECT_EQ(vs->display_name_, L"Visual Studio Community 2022");
+  EXPECT_EQ(vs->product_id_, L"Microsoft.VisualStudio.Product.Community");
+  EXPECT_TRUE(vs->is_complete_);
+  EXPECT_FALSE(vs->is_prerelease_);
+  EXPECT_EQ(vs->workloads_, (IdSet{L"Microsoft.VisualStudio.Workload.W0",
+                                   L"Microsoft.VisualStudio.Workload.W1",
+                                   L"Microsoft.VisualStudio.Workload.W2",
+                                   L"Microsoft.VisualStudio.Workload.W3"}));
+  EXPECT_EQ(vs->packages_.size(), 3000u);
+  EXPECT_TRUE(vs->packages_.contains(
+      L"microsoft.visualstudio.component.package2999"));
+  EXPECT_TRUE(vs->packages_.contains(L"microsoft.visualstudio.workload.w0"));
+}
+
+TEST(StateJson, DisplayNameLanguage) {
+  StateJsonFixture fixture;
+  fixture.packages = 0;
+  auto vs = parse_state_json(fixture.render(), "zh-CN");
+  ASSERT_TRUE(vs);
+  EXPECT_EQ(vs->display_name_, L"Visual Studio \u793e\u533a\u7248 2022");
+
+  // Without a match the first title is used.
+  vs = parse_state_json(fixture.render(), "de-de");
+  ASSERT_TRUE(vs);
+  EXPECT_EQ(vs->display_name_, L"Visual Studio \u793e\u533a\u7248 2022");
+}
+
+TEST(StateJson, PrereleaseAndCompleteFlags) {
+  StateJsonFixture fixture;
+  fixture.packages = 1;
+  fixture.prerelease = "true";
+  auto vs = parse_state_json(fixture.render());
+  ASSERT_TRUE(vs);
+  EXPECT_TRUE(vs->is_prerelease_);
+
+  fixture.prerelease = "\"True\"";
+  auto text = fixture.render();
+  text.insert(1, "\"isComplete\": false, ");
+  vs = parse_state_json(text);
+  ASSERT_TRUE(vs);
+  EXPECT_TRUE(vs->is_prerelease_);
+  EXPECT_FALSE(vs->is_complete_);
+}
+
+TEST(StateJson, RejectsIncompleteOrMalformedDocuments) {
+  EXPECT_FALSE(parse_state_json(""));
+  EXPECT_FALSE(parse_state_json("[]"));
+  EXPECT_FALSE(parse_state_json(R"({"installationPath": "C:\\vs"})"));
+  EXPECT_FALSE(parse_state_json(
+      R"({"installationPath": "C:\\vs", "installationVersion": "x.y"})"));
+
+  StateJsonFixture fixture;
+  fixture.packages = 10;
+  auto text = fixture.render();
+  text.resize(text.size() / 2);
+  EXPECT_FALSE(parse_state_json(text));
+}
+
+TEST_F(StateJsonTest, EnumeratesInstanceDirectories) {
+  StateJsonFixture community;
+  community.write(root_, "b2c3d4e5");
+
+  StateJsonFixture build_tools;
+  build_tools.install_path = "D:\\\\BuildTools";
+  build_tools.install_version = "16.11.34301.259";
+  build_tools.product_id = "Microsoft.VisualStudio.Product.BuildTools";
+  build_tools.packages = 500;
+  build_tools.write(root_, "a1b2c3d4");
+
+  // Broken and missing state files are skipped.
+  std::filesystem::create_directories(root_ / "c0ffee00");
+  std::filesystem::create_directories(root_ / "c0ffee01");
+  std::ofstream(root_ / "c0ffee01" / "state.json") << "{";
+
+  auto all = enumerate_state_json_instances(root_);
+  ASSERT_EQ(all.size(), 2u);
+  EXPECT_EQ(all[0].install_path_, L"D:\\BuildTools");
+  EXPECT_EQ(all[0].product_id_, L"Microsoft.VisualStudio.Product.BuildTools");
+  EXPECT_EQ(all[1].install_version_, L"17.8.34330.188");
+  EXPECT_EQ(all[1].workloads_.size(), 4u);
+}
+
+TEST_F(StateJsonTest, SkipsByteOrderMark) {
+  StateJsonFixture fixture;
+  fixture.packages = 2;
+  std::filesystem::create_directories(root_ / "id");
+  std::ofstream(root_ / "id" / "state.json", std::ios::binary)
+      << "\xEF\xBB\xBF" << fixture.render();
+  auto all = enumerate_state_json_instances(root_);
+  ASSERT_EQ(all.size(), 1u);
+  EXPECT_EQ(all[0].display_name_, L"Visual Studio Community 2022");
+}
+
+TEST_F(StateJsonTest, EnumeratesInTheGivenLanguage) {
+  StateJsonFixture fixture;
+  fixture.packages = 0;
+  fixture.write(root_, "id");
+  auto all = enumerate_state_json_instances(root_, "zh-CN");
+  ASSERT_EQ(all.size(), 1u);
+  EXPECT_EQ(all[0].display_name_, L"Visual Studio \u793e\u533a\u7248 2022");
+}
+
+TEST_F(StateJsonTest, MissingDirectoryIsEmpty) {
+  EXPECT_TRUE(enumerate_state_json_instances(root_ / "missing").empty());
+}
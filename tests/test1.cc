@@ -1,6 +1,6 @@
 #include <gtest/gtest.h>
 
-#include "../src/visualstudio.h"
+#include "../src/version.h"
 
 TEST(Test1, to_version_range) {
   ASSERT_EQ((to_version_range("17")), "[17,17.65535.65535.65535)");
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/json_reader.h"
+#include "../src/trace.h"
+
+namespace {
+
+std::string ReadFile(std::filesystem::path const& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>{});
+}
+
+}  // namespace
+
+TEST(Trace, DisabledTracerRecordsNothing) {
+  Tracer tracer;
+  { TraceSpan span("ignored", tracer); }
+  EXPECT_TRUE(tracer.events().empty());
+
+  // A span started while disabled stays unrecorded.
+  TraceSpan* early = new TraceSpan("early", tracer);
+  tracer.enable();
+  delete early;
+  EXPECT_TRUE(tracer.events().empty());
+}
+
+TEST(Trace, NestedSpansEnclosedByTheirParents) {
+  Tracer tracer;
+  tracer.enable();
+  {
+    TraceSpan outer("outer", tracer);
+    { TraceSpan inner("inner", tracer); }
+    { TraceSpan second("second", tracer); }
+  }
+  tracer.disable();
+  { TraceSpan after("after", tracer); }
+
+  auto events = tracer.events();
+  ASSERT_EQ(events.size(), 3u);
+  EXPECT_STREQ(events[0].name_, "outer");
+  EXPECT_STREQ(events[1].name_, "inner");
+  EXPECT_STREQ(events[2].name_, "second");
+  for (auto const& event : events) {
+    EXPECT_EQ(event.thread_, 1u);
+    EXPECT_GE(event.start_, events[0].start_);
+    EXPECT_LE(event.start_ + event.duration_,
+              events[0].start_ + events[0].duration_);
+  }
+  EXPECT_LE(events[1].start_ + events[1].duration_, events[2].start_);
+}
+
+TEST(Trace, EachThreadGetsItsOwnId) {
+  Tracer tracer;
+  tracer.enable();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&tracer]() {
+      for (int j = 0; j < 100; ++j) {
+        TraceSpan span("work", tracer);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto events = tracer.events();
+  EXPECT_EQ(events.size(), 400u);
+  std::set<uint32_t> ids;
+  for (auto const& event : events) {
+    ids.insert(event.thread_);
+  }
+  EXPECT_EQ(ids, (std::set<uint32_t>{1, 2, 3, 4}));
+}
+
+TEST(Trace, WritesChromeTraceEvents) {
+  Tracer tracer;
+  tracer.record("a \"quoted\" span", 1500, 4250);
+  tracer.record("b", 2000, 2000);
+
+  auto json = tracer.to_json();
+  EXPECT_EQ(json,
+            "{\"traceEvents\":[\n"
+            "{\"name\":\"a \\\"quoted\\\" span\",\"cat\":\"vsrun\","
+            "\"ph\":\"X\",\"ts\":1.500,\"dur\":2.750,\"pid\":1,\"tid\":1},\n"
+            "{\"name\":\"b\",\"cat\":\"vsrun\",\"ph\":\"X\",\"ts\":2.000,"
+            "\"dur\":0.000,\"pid\":1,\"tid\":1}\n"
+            "],\"displayTimeUnit\":\"ms\"}\n");
+
+  // Readable by a JSON parser, names unescaped.
+  JsonReader reader(json);
+  std::vector<std::string> names;
+  std::string_view key;
+  ASSERT_TRUE(reader.begin_object());
+  while (reader.next_member(key)) {
+    if (key != "traceEvents") {
+      ASSERT_TRUE(reader.skip());
+      continue;
+    }
+    ASSERT_TRUE(reader.begin_array());
+    while (reader.next_element()) {
+      ASSERT_TRUE(reader.begin_object());
+      while (reader.next_member(key)) {
+        std::string_view raw;
+        if (key == "name") {
+          ASSERT_TRUE(reader.read_string(raw));
+          names.push_back(json_unescape(raw));
+        } else {
+          ASSERT_TRUE(reader.skip());
+        }
+      }
+    }
+  }
+  EXPECT_FALSE(reader.failed());
+  EXPECT_EQ(names, (std::vector<std::string>{"a \"quoted\" span", "b"}));
+}
+
+TEST(Trace, SessionWritesTheTraceOnExit) {
+  auto path = std::filesystem::temp_directory_path() / "vsrun-trace-test.json";
+  Tracer tracer;
+  {
+    TraceSession session(path, tracer);
+    EXPECT_TRUE(tracer.enabled());
+    TraceSpan span("phase", tracer);
+  }
+  EXPECT_FALSE(tracer.enabled());
+  auto json = ReadFile(path);
+  EXPECT_NE(json.find("\"name\":\"phase\""), std::string::npos) << json;
+  std::filesystem::remove(path);
+
+  Tracer off;
+  {
+    TraceSession session("", off);
+    EXPECT_FALSE(off.enabled());
+  }
+}
@@ -0,0 +1,221 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+
+#include "../src/unicode.h"
+
+namespace {
+
+using namespace std::string_literals;
+
+constexpr char32_t kReplacement = 0xFFFD;
+
+// One code point at a time, with no fast paths: what utf8_encode and
+// utf8_decode must match byte for byte.
+void ReferenceAppendUtf8(std::string& out, char32_t cp) {
+  if (cp < 0x80) {
+    out += static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    out += static_cast<char>(0xC0 | (cp >> 6));
+    out += static_cast<char>(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    out += static_cast<char>(0xE0 | (cp >> 12));
+    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (cp & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (cp >> 18));
+    out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (cp & 0x3F));
+  }
+}
+
+void ReferenceAppendWide(std::wstring& out, char32_t cp) {
+  if (sizeof(wchar_t) == 2 && cp >= 0x10000) {
+    out += static_cast<wchar_t>(0xD800 + ((cp - 0x10000) >> 10));
+    out += static_cast<wchar_t>(0xDC00 + ((cp - 0x10000) & 0x3FF));
+  } else {
+    out += static_cast<wchar_t>(cp);
+  }
+}
+
+std::string ReferenceEncode(std::wstring_view wstr) {
+  std::string out;
+  for (size_t i = 0; i < wstr.size(); ++i) {
+    auto cp = static_cast<char32_t>(wstr[i]);
+    if (sizeof(wchar_t) == 2 && cp >= 0xD800 && cp <= 0xDBFF &&
+        i + 1 < wstr.size() && wstr[i + 1] >= 0xDC00 &&
+        wstr[i + 1] <= 0xDFFF) {
+      cp = 0x10000 + ((cp - 0xD800) << 10) +
+           (static_cast<char32_t>(wstr[++i]) - 0xDC00);
+    }
+    if ((cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) {
+      cp = kReplacement;
+    }
+    ReferenceAppendUtf8(out, cp);
+  }
+  return out;
+}
+
+// A malformed sequence becomes one U+FFFD covering its lead byte and the
+// continuation bytes that were read before it went wrong.
+std::wstring ReferenceDecode(std::string_view str) {
+  std::wstring out;
+  size_t i = 0;
+  while (i < str.size()) {
+    auto c = static_cast<uint8_t>(str[i]);
+    size_t len = c < 0x80             ? 1
+                 : (c & 0xE0) == 0xC0 ? 2
+                 : (c & 0xF0) == 0xE0 ? 3
+                 : (c & 0xF8) == 0xF0 ? 4
+                                      : 0;
+    if (len == 1) {
+      out += static_cast<wchar_t>(c);
+      ++i;
+      continue;
+    }
+    char32_t cp = len == 2 ? c & 0x1F : len == 3 ? c & 0x0F : c & 0x07;
+    size_t n = 1;
+    for (; len != 0 && n < len && i + n < str.size() &&
+           (static_cast<uint8_t>(str[i + n]) & 0xC0) == 0x80;
+         ++n) {
+      cp = (cp << 6) | (static_cast<uint8_t>(str[i + n]) & 0x3F);
+    }
+    char32_t min = len == 2 ? 0x80 : len == 3 ? 0x800 : 0x10000;
+    if (len == 0 || n != len || cp < min || cp > 0x10FFFF ||
+        (cp >= 0xD800 && cp <= 0xDFFF)) {
+      ReferenceAppendWide(out, kReplacement);
+    } else {
+      ReferenceAppendWide(out, cp);
+    }
+    i += n;
+  }
+  return out;
+}
+
+// SplitMix64, so every run sees the same inputs.
+class Random {
+ public:
+  explicit Random(uint64_t seed) : state_(seed) {}
+
+  uint64_t next() {
+    uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+  size_t below(size_t n) { return static_cast<size_t>(next() % n); }
+
+ private:
+  uint64_t state_;
+};
+
+// Long ASCII runs broken by the occasional other character, so that both
+// the vector loops and their exits are exercised at every alignment.
+std::wstring RandomWide(Random& random) {
+  std::wstring text;
+  auto size = random.below(200);
+  for (size_t i = 0; i < size; ++i) {
+    switch (random.below(40)) {
+      case 0:
+        text += static_cast<wchar_t>(0x80 + random.below(0x780));
+        break;
+      case 1:
+        text += static_cast<wchar_t>(0x800 + random.below(0xF800));
+        break;
+      case 2:
+        // Lone or paired surrogates, or an astral character.
+        text += static_cast<wchar_t>(0xD800 + random.below(0x800));
+        break;
+      case 3:
+        if constexpr (sizeof(wchar_t) == 2) {
+          text += L"\U0001F600";
+        } else {
+          text += static_cast<wchar_t>(0x10000 + random.below(0x100000));
+        }
+        break;
+      case 4:
+        // Just past ASCII, and past Unicode where wchar_t allows it.
+        text += static_cast<wchar_t>(sizeof(wchar_t) == 2 ? 0xFFFF : 0x110000);
+        break;
+      default:
+        text += static_cast<wchar_t>(random.below(0x80));
+    }
+  }
+  return text;
+}
+
+std::string RandomBytes(Random& random) {
+  std::string bytes;
+  auto size = random.below(200);
+  for (size_t i = 0; i < size; ++i) {
+    auto pick = random.below(30);
+    if (pick == 0) {
+      bytes += static_cast<char>(0x80 + random.below(0x80));
+    } else if (pick == 1) {
+      bytes += ReferenceEncode(std::wstring(
+          1, static_cast<wchar_t>(0xA0 + random.below(0xD000))));
+    } else {
+      bytes += static_cast<char>(random.below(0x80));
+    }
+  }
+  return bytes;
+}
+
+}  // namespace
+
+TEST(Unicode, KnownConversions) {
+  EXPECT_EQ(utf8_encode(L""), "");
+  EXPECT_EQ(utf8_decode(""), L"");
+  EXPECT_EQ(utf8_encode(L"Visual Studio \u793e\u533a\u7248 2022"),
+            "Visual Studio \xe7\xa4\xbe\xe5\x8c\xba\xe7\x89\x88 2022");
+  EXPECT_EQ(utf8_decode("C:\\\xc3\xa9t\xc3\xa9\\\xf0\x9f\x98\x80"),
+            L"C:\\\u00e9t\u00e9\\\U0001F600");
+  // A NUL is a character like any other.
+  EXPECT_EQ(utf8_encode(L"A=1\0B=2\0\0"s), "A=1\0B=2\0\0"s);
+  EXPECT_EQ(utf8_decode("A=1\0B=2\0\0"s), L"A=1\0B=2\0\0"s);
+}
+
+TEST(Unicode, ReplacesMalformedInput) {
+  EXPECT_EQ(utf8_decode("a\xff" "b"), L"a\uFFFDb");
+  // Truncated, overlong, and an encoded surrogate.
+  EXPECT_EQ(utf8_decode("\xe7\xa4"), L"\uFFFD");
+  EXPECT_EQ(utf8_decode("\xc0\xaf"), L"\uFFFD");
+  EXPECT_EQ(utf8_decode("\xed\xa0\x80"), L"\uFFFD");
+  EXPECT_EQ(utf8_encode(std::wstring(1, static_cast<wchar_t>(0xD800))),
+            "\xef\xbf\xbd");
+}
+
+TEST(Unicode, MatchesTheReferenceAtEveryAlignment) {
+  std::wstring wide = L"C:\\Program Files\\Microsoft Visual Studio\\2022\\";
+  while (wide.size() < 150) {
+    wide += wide;
+  }
+  auto bytes = utf8_encode(wide);
+  // A non-ASCII character at each position, where the vector loops have
+  // to stop and resume.
+  for (size_t at = 0; at < 100; ++at) {
+    auto text = wide;
+    text[at] = L'\u00e9';
+    ASSERT_EQ(utf8_encode(text), ReferenceEncode(text)) << at;
+    auto encoded = bytes;
+    encoded[at] = '\xff';
+    ASSERT_EQ(utf8_decode(encoded), ReferenceDecode(encoded)) << at;
+    ASSERT_EQ(utf8_decode(std::string_view(bytes).substr(at)),
+              ReferenceDecode(std::string_view(bytes).substr(at)));
+  }
+}
+
+TEST(Unicode, MatchesTheReferenceOnRandomInput) {
+  Random random(0x5eed);
+  for (int i = 0; i < 20000; ++i) {
+    auto wide = RandomWide(random);
+    auto encoded = utf8_encode(wide);
+    ASSERT_EQ(encoded, ReferenceEncode(wide));
+    ASSERT_EQ(utf8_decode(encoded), ReferenceDecode(encoded));
+
+    auto bytes = RandomBytes(random);
+    ASSERT_EQ(utf8_decode(bytes), ReferenceDecode(bytes));
+  }
+}
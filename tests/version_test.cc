@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+
+#include "../src/version.h"
+
+// The packing is 4x16 bits with the major version in the high word, the
+// same as ISetupHelper::ParseVersion.
+static_assert(parse_version("17") == 0x0011000000000000ULL);
+static_assert(parse_version("17.8.34330.188") == 0x00110008861A00BCULL);
+static_assert(parse_version(L"0.0.0.1") == 1);
+static_assert(parse_version("1.2") < parse_version("1.2.0.1"));
+static_assert(!parse_version("65536").has_value());
+static_assert(parse_version_range("[16.0,17.0)")->max_ ==
+              0x0010FFFFFFFFFFFFULL);
+static_assert(parse_version_range("(16.0,]")->min_ == 0x0010000000000001ULL);
+static_assert(!parse_version_range("(17.0,17.0)").has_value());
+
+TEST(Version, parse_version) {
+  ASSERT_EQ(parse_version("17"), 0x0011000000000000ULL);
+  ASSERT_EQ(parse_version("17.8"), 0x0011000800000000ULL);
+  ASSERT_EQ(parse_version(L"17.8.34330.188"), 0x00110008861A00BCULL);
+  ASSERT_EQ(parse_version(" 1.2.3.4 "), 0x0001000200030004ULL);
+  ASSERT_EQ(parse_version("65535.65535.65535.65535"), UINT64_MAX);
+
+  ASSERT_FALSE(parse_version(""));
+  ASSERT_FALSE(parse_version("17."));
+  ASSERT_FALSE(parse_version(".17"));
+  ASSERT_FALSE(parse_version("1.2.3.4.5"));
+  ASSERT_FALSE(parse_version("65536"));
+  ASSERT_FALSE(parse_version("17.x"));
+}
+
+TEST(Version, parse_version_range) {
+  auto range = [](std::string_view s) {
+    auto r = parse_version_range(s);
+    return r ? std::pair{r->min_, r->max_}
+             : std::pair<uint64_t, uint64_t>{UINT64_MAX, 0};
+  };
+  constexpr uint64_t v16 = 0x0010000000000000ULL;
+  constexpr uint64_t v17 = 0x0011000000000000ULL;
+
+  ASSERT_EQ(range("16.0"), std::pair(v16, UINT64_MAX));
+  ASSERT_EQ(range("[16.0,)"), std::pair(v16, UINT64_MAX));
+  ASSERT_EQ(range("[16.0,17.0)"), std::pair(v16, v17 - 1));
+  ASSERT_EQ(range("(16.0,17.0]"), std::pair(v16 + 1, v17));
+  ASSERT_EQ(range("[,17.0]"), std::pair(uint64_t{0}, v17));
+  ASSERT_EQ(range(" [ 16.0 , 17.0 ] "), std::pair(v16, v17));
+  ASSERT_EQ(range("[17.0]"), std::pair(v17, v17));
+  ASSERT_EQ(range("[17,17.65535.65535.65535)"),
+            std::pair(v17, uint64_t{0x0011FFFFFFFFFFFE}));
+
+  ASSERT_FALSE(parse_version_range(""));
+  ASSERT_FALSE(parse_version_range("[17.0"));
+  ASSERT_FALSE(parse_version_range("{17.0}"));
+  ASSERT_FALSE(parse_version_range("[17.0,16.0]"));
+  ASSERT_FALSE(parse_version_range("(17.0)"));
+  ASSERT_FALSE(parse_version_range("[x,17.0]"));
+}
+
+TEST(Version, to_version_range_is_parseable) {
+  auto range = [](std::string_view s) {
+    auto r = parse_version_range(to_version_range(std::string(s)));
+    return r ? std::pair{r->min_, r->max_}
+             : std::pair<uint64_t, uint64_t>{UINT64_MAX, 0};
+  };
+  using Range = std::pair<uint64_t, uint64_t>;
+  ASSERT_EQ(range("17"),
+            (Range{0x0011000000000000, 0x0011FFFFFFFFFFFE}));
+  ASSERT_EQ(range("17.8"),
+            (Range{0x0011000800000000, 0x00110008FFFFFFFE}));
+  ASSERT_EQ(range("17.8.34330"),
+            (Range{0x00110008861A0000, 0x00110008861AFFFE}));
+  ASSERT_EQ(range("17.8.34330.188"),
+            (Range{0x00110008861A00BC, 0x00110008861AFFFE}));
+  ASSERT_EQ(range("[16.0,17.0)"),
+            (Range{0x0010000000000000, 0x0010FFFFFFFFFFFF}));
+  ASSERT_EQ(to_version_range(std::wstring(L"16.11")),
+            L"[16.11,16.11.65535.65535)");
+  ASSERT_EQ(range("17.x"), range("1.2.3.4.5"));
+  ASSERT_EQ(range("17.x"), (Range{UINT64_MAX, 0}));
+}
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "../src/worker_pool.h"
+
+TEST(WorkerPool, RunsSubmittedTasks) {
+  WorkerPool pool(3);
+  EXPECT_EQ(pool.size(), 3u);
+  std::vector<std::future<int>> futures;
+  for (int i = 0; i < 100; ++i) {
+    futures.push_back(pool.submit([i]() { return i * i; }));
+  }
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(futures[i].get(), i * i);
+  }
+}
+
+TEST(WorkerPool, PropagatesExceptions) {
+  WorkerPool pool(1);
+  auto future = pool.submit([]() -> int { throw std::runtime_error("boom"); });
+  EXPECT_THROW(future.get(), std::runtime_error);
+  // The worker survives the throwing task.
+  EXPECT_EQ(pool.submit([]() { return 7; }).get(), 7);
+}
+
+TEST(WorkerPool, InitAndExitRunOnEveryWorker) {
+  std::atomic<int> inits{0}, exits{0};
+  thread_local bool initialized = false;
+  std::atomic<bool> all_initialized{true};
+  {
+    WorkerPool pool(
+        4,
+        [&inits]() {
+          initialized = true;
+          ++inits;
+        },
+        [&exits]() { ++exits; });
+    std::vector<std::future<void>> futures;
+    for (int i = 0; i < 32; ++i) {
+      futures.push_back(pool.submit([&all_initialized]() {
+        if (!initialized) {
+          all_initialized = false;
+        }
+      }));
+    }
+    for (auto& future : futures) {
+      future.get();
+    }
+  }
+  EXPECT_EQ(inits, 4);
+  EXPECT_EQ(exits, 4);
+  EXPECT_TRUE(all_initialized);
+}
+
+TEST(WorkerPool, DestructorDrainsPostedTasks) {
+  std::atomic<int> done{0};
+  {
+    WorkerPool pool(2);
+    for (int i = 0; i < 50; ++i) {
+      pool.post([&done]() { ++done; });
+    }
+  }
+  EXPECT_EQ(done, 50);
+}